@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_ARENA_H
+#define INC_FUDGE_ARENA_H
+
+#include "fudge/platform.h"
+#include "fudge/status.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/* A FudgeArena provides scoped storage for messages, strings and envelopes
+   that are built (or decoded), used and then discarded together, such as
+   those handled by a single request. Objects are created in an arena with
+   the "InArena" functions: FudgeMsg_createInArena, the
+   FudgeString_create*InArena functions and FudgeCodec_decodeMsgInArena.
+
+   Objects in an arena are carved out of large blocks of memory and are not
+   reference counted: retaining or releasing them does nothing. Instead they
+   are all destroyed together when the arena is reset or released. Resetting
+   an arena keeps its blocks for reuse, so an arena that is reset after each
+   request stops allocating once it has grown to fit the largest request.
+
+   The only per-object work done on reset is for references held by arena
+   messages to objects outside the arena: strings and messages that are not
+   themselves in an arena (or otherwise immortal) are released. Byte array
+   data added to an arena message is always copied in to the arena.
+
+   Objects from an arena can be added to messages outside it, but must not
+   be used after the arena is reset or released; neither can be detected.
+
+   Thread safety:
+
+   Each arena instance, along with the objects in it, must only be used by a
+   single thread at any given time. */
+#ifdef _FUDGEARENAIMPL_DEFINED
+typedef struct FudgeArenaImpl * FudgeArena;
+#else /* ifdef _FUDGEARENAIMPL_DEFINED */
+typedef struct { void * reserved; } * FudgeArena;
+#endif /* ifdef _FUDGEARENAIMPL_DEFINED */
+
+/* Creates an arena that allocates memory in blocks of at least blocksize
+   bytes (objects that will not fit get a block to themselves). A blocksize
+   of zero uses the default of 16KB. */
+FUDGEAPI FudgeStatus FudgeArena_create ( FudgeArena * arena, size_t blocksize );
+FUDGEAPI FudgeStatus FudgeArena_retain ( FudgeArena arena );
+FUDGEAPI FudgeStatus FudgeArena_release ( FudgeArena arena );
+
+/* Destroys every object in the arena. The arena's memory is kept for the
+   objects created after the reset. */
+FUDGEAPI FudgeStatus FudgeArena_reset ( FudgeArena arena );
+
+/* Returns the number of bytes used by the objects currently in the arena,
+   and the total size of the blocks it holds. */
+FUDGEAPI size_t FudgeArena_getNumBytes ( FudgeArena arena );
+FUDGEAPI size_t FudgeArena_getCapacity ( FudgeArena arena );
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif
@@ -36,12 +36,127 @@
    is decoded upfront, so any errors will be detected immediately. */
 FUDGEAPI FudgeStatus FudgeCodec_decodeMsg ( FudgeMsgEnvelope * envelope, const fudge_byte * bytes, fudge_i32 numbytes );
 
+/* As FudgeCodec_decodeMsg, but the envelope, its message and everything the
+   message contains are allocated from the arena provided (see
+   fudge/arena.h). The decoded envelope remains valid until the arena is
+   reset or destroyed; releasing it does nothing. Passing a NULL arena is the
+   same as calling FudgeCodec_decodeMsg. */
+FUDGEAPI FudgeStatus FudgeCodec_decodeMsgInArena ( FudgeMsgEnvelope * envelope,
+                                                   const fudge_byte * bytes,
+                                                   fudge_i32 numbytes,
+                                                   FudgeArena arena );
+
+/* If enabled, FudgeCodec_decodeMsg interns the names of the fields it
+   decodes (see FudgeString_intern), so messages decoded from the same schema
+   share a single instance of each name. Disabled by default. As with the
+   compression threshold, this is a global setting and should be made before
+   any decoding threads are started. */
+FUDGEAPI void FudgeCodec_setInternFieldNames ( fudge_bool intern );
+FUDGEAPI fudge_bool FudgeCodec_getInternFieldNames ( );
+
 /* Encodes the envelope provided (which must contain a valid FudgeMsg
    instance) in to a newly allocated block of memory. The bytes pointer is set
    to this new block and numbytes is set to its size. It is the responsibilty
    of the calling code to free the block when no longer needed. */
 FUDGEAPI FudgeStatus FudgeCodec_encodeMsg ( FudgeMsgEnvelope envelope, fudge_byte * * bytes, fudge_i32 * numbytes );
 
+/* Sets the payload size (in bytes, excluding the envelope header) at or
+   above which FudgeCodec_encodeMsg and FudgeCodec_encodeMsgParallel compress
+   the message fields, signalling this with FUDGE_DIRECTIVE_COMPRESSED in the
+   envelope header (see fudge/header.h). A message is only sent compressed if
+   that makes it smaller, and is sent uncompressed if there is not enough
+   memory to compress it. A negative threshold, the default, disables
+   compression. FudgeCodec_decodeMsg always accepts compressed messages.
+   FudgeCodec_encodeBatch, FudgeCodec_encodeBatchToBuffer and
+   FudgeCodec_encodeMsgVector never compress.
+
+   The threshold is global and should be set before any encoding threads are
+   started. */
+FUDGEAPI void FudgeCodec_setCompressionThreshold ( fudge_i32 threshold );
+FUDGEAPI fudge_i32 FudgeCodec_getCompressionThreshold ( );
+
+/* As FudgeCodec_encodeMsg, but the message is split in to regions that are
+   encoded by up to numthreads threads (including the calling thread). Every
+   width is calculated first, so each region's position in the output is
+   known before any bytes are written. The output is identical to that of
+   FudgeCodec_encodeMsg.
+
+   No more than 64 threads are used, nor more than there are regions to
+   encode. The serial encoder is used if numthreads is less than two, the
+   message is too small to be worth splitting, or the library was built
+   without pthreads and atomic operations. */
+FUDGEAPI FudgeStatus FudgeCodec_encodeMsgParallel ( FudgeMsgEnvelope envelope,
+                                                    unsigned int numthreads,
+                                                    fudge_byte * * bytes,
+                                                    fudge_i32 * numbytes );
+
+/* Encodes a batch of envelopes, one after the other, in to a single newly
+   allocated block of memory. All of the envelopes are sized before any are
+   written, so only one allocation is made. The bytes pointer is set to the
+   block (or NULL if the batch is empty) and numbytes to its size. If offsets
+   is not NULL it must have room for numenvelopes entries, and is filled with
+   the offset of each envelope within the block. The calling code must free
+   the block when no longer needed.
+
+   The envelopes are always written uncompressed, whatever the compression
+   threshold, so an envelope's bytes only match those of FudgeCodec_encodeMsg
+   if compression is disabled or the envelope is below the threshold. */
+FUDGEAPI FudgeStatus FudgeCodec_encodeBatch ( const FudgeMsgEnvelope * envelopes,
+                                              size_t numenvelopes,
+                                              fudge_byte * * bytes,
+                                              size_t * numbytes,
+                                              size_t * offsets );
+
+/* As above, but writes the batch in to the buffer provided. If the buffer is
+   too small nothing is written and FUDGE_OUT_OF_BYTES is returned; numbytes
+   is always set to the size required. */
+FUDGEAPI FudgeStatus FudgeCodec_encodeBatchToBuffer ( const FudgeMsgEnvelope * envelopes,
+                                                      size_t numenvelopes,
+                                                      fudge_byte * buffer,
+                                                      size_t buffersize,
+                                                      size_t * numbytes,
+                                                      size_t * offsets );
+
+/* Scatter-gather buffer descriptor. Where sys/uio.h is available this is the
+   system's struct iovec, so the output of FudgeCodec_encodeMsgVector can be
+   passed straight to writev/sendmsg. Elsewhere it is a structure with the
+   same members. */
+#ifdef FUDGE_HAVE_SYS_UIO_H
+typedef struct iovec FudgeIOVec;
+#else /* ifdef FUDGE_HAVE_SYS_UIO_H */
+typedef struct
+{
+    void * iov_base;
+    size_t iov_len;
+} FudgeIOVec;
+#endif /* ifdef FUDGE_HAVE_SYS_UIO_H */
+
+/* Encodes the envelope provided as a list of buffer descriptors rather than
+   a single contiguous block. Headers and small values are packed in to a
+   scratch buffer, while byte array and string payloads of at least
+   "threshold" bytes are referenced in place from the fields that hold them.
+   Concatenating the buffers gives the uncompressed encoding of the envelope,
+   which is the same as the output of FudgeCodec_encodeMsg unless that would
+   have been compressed (see FudgeCodec_setCompressionThreshold: as payloads
+   are referenced in place, the envelope is never compressed here); numbytes
+   is set to this total length.
+
+   The descriptor array and the scratch buffer are held in a single newly
+   allocated block, which is returned via the vectors pointer: the calling
+   code must release it with FudgeCodec_freeVector (not free or
+   FudgeMemory_free) when no longer needed. As payloads are not copied, the
+   message must not be modified or released until the buffers have been
+   consumed. */
+FUDGEAPI FudgeStatus FudgeCodec_encodeMsgVector ( FudgeMsgEnvelope envelope,
+                                                  fudge_i32 threshold,
+                                                  FudgeIOVec * * vectors,
+                                                  size_t * numvectors,
+                                                  fudge_i32 * numbytes );
+
+/* Releases a block returned by FudgeCodec_encodeMsgVector, passing its size
+   on to the memory manager. Does nothing if vectors is NULL. */
+FUDGEAPI void FudgeCodec_freeVector ( FudgeIOVec * vectors );
+
 #ifdef __cplusplus
     }
 #endif
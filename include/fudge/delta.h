@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_DELTA_H
+#define INC_FUDGE_DELTA_H
+
+#include "fudge/message.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/* Delta encoding produces a patch message holding the differences between a
+   baseline message and a target. Applying the patch to the baseline
+   reconstructs the target. The patch is an ordinary FudgeMsg, so it can be
+   encoded and decoded with the rest of the codec.
+
+   Top level fields are matched by their key: the combination of name and
+   ordinal. The patch contains up to three submessage fields, identified by
+   the ordinals below:
+
+     FUDGEDELTA_SET_ORDINAL      Copies of the target fields that are new or
+                                 whose value (or type) differs from the
+                                 baseline.
+     FUDGEDELTA_REMOVE_ORDINAL   An indicator field carrying the key of each
+                                 baseline field missing from the target.
+     FUDGEDELTA_REPLACE_ORDINAL  The complete target message. Only used when
+                                 the target can't be expressed as changes to
+                                 the baseline: a field in either message
+                                 without a key, keys that are not unique, or
+                                 a target whose field order differs from that
+                                 produced by applying the changes.
+
+   When applied, changed fields keep their position in the baseline and new
+   fields are appended in the order they appear in the patch. Submessage
+   fields are compared in full and sent in full if any part differs. A patch
+   for identical messages is empty. */
+#define FUDGEDELTA_SET_ORDINAL      1
+#define FUDGEDELTA_REMOVE_ORDINAL   2
+#define FUDGEDELTA_REPLACE_ORDINAL  3
+
+/* Creates a new patch message holding the differences between the baseline
+   and target. The patch may share field contents (strings and submessages)
+   with the target. */
+FUDGEAPI FudgeStatus FudgeDelta_create ( FudgeMsg * patch, const FudgeMsg baseline, const FudgeMsg target );
+
+/* Creates a new message by applying the patch to the baseline. The result
+   may share field contents with the baseline and patch. Returns
+   FUDGE_INVALID_TYPE_ACCESSOR if the patch is not correctly formed. */
+FUDGEAPI FudgeStatus FudgeDelta_apply ( FudgeMsg * result, const FudgeMsg baseline, const FudgeMsg patch );
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif
@@ -16,6 +16,7 @@
 #ifndef INC_FUDGE_MSG_ENVELOPE_H
 #define INC_FUDGE_MSG_ENVELOPE_H
 
+#include "fudge/arena.h"
 #include "fudge/status.h"
 #include "fudge/types.h"
 
@@ -75,9 +76,24 @@ FUDGEAPI FudgeStatus FudgeMsgEnvelope_create ( FudgeMsgEnvelope * envelopeptr,
                                             fudge_byte schemaversion,
                                             fudge_i16 taxonomy,
                                             FudgeMsg message );
+
+/* As FudgeMsgEnvelope_create, but the envelope is created in the arena
+   provided (see fudge/arena.h). It is not reference counted and is
+   destroyed when the arena is reset or released. Passing a NULL arena
+   creates an ordinary envelope. */
+FUDGEAPI FudgeStatus FudgeMsgEnvelope_createInArena ( FudgeMsgEnvelope * envelopeptr,
+                                                   fudge_byte directives,
+                                                   fudge_byte schemaversion,
+                                                   fudge_i16 taxonomy,
+                                                   FudgeMsg message,
+                                                   FudgeArena arena );
+
 FUDGEAPI FudgeStatus FudgeMsgEnvelope_retain ( FudgeMsgEnvelope envelope );
 FUDGEAPI FudgeStatus FudgeMsgEnvelope_release ( FudgeMsgEnvelope envelope );
 
+/* Shares the envelope and its message (see FudgeMsg_share) */
+FUDGEAPI FudgeStatus FudgeMsgEnvelope_share ( FudgeMsgEnvelope envelope );
+
 /* Processing directives, for future use */
 FUDGEAPI fudge_byte FudgeMsgEnvelope_getDirectives ( const FudgeMsgEnvelope envelope );
 
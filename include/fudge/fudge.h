@@ -18,6 +18,7 @@
 
 #include "fudge/status.h"
 #include "fudge/memory.h"
+#include "fudge/types.h"
 
 #ifdef __cplusplus
     extern "C" {
@@ -34,6 +35,52 @@ FUDGEAPI FudgeStatus Fudge_init ( );
    requirements of a user implementation. */
 FUDGEAPI FudgeStatus Fudge_initEx ( FudgeMemoryManager * mm );
 
+/* As Fudge_initEx, but uses an extended memory manager. The manager (and
+   its context) must remain valid for the lifetime of the process. */
+FUDGEAPI FudgeStatus Fudge_initManagerEx ( FudgeMemoryManagerEx * mm );
+
+/* Enables (or disables) the collection of memory statistics. Disabled by
+   default. Statistics are only collected for objects created while enabled,
+   so this should be called straight after Fudge_init: freeing an object
+   created before collection was enabled reduces the current byte count
+   without having added to it (counts that would go below zero are reported
+   as zero).
+
+   Each thread keeps its own counters, so collection only adds a few
+   non-atomic updates to each allocation and free. The counters are summed
+   when read. The peak byte counts are sampled whenever a thread's usage
+   moves by more than 16KB, and on every call to Fudge_getMemoryStats, so
+   short lived peaks smaller than this may be missed.
+
+   In threaded builds on platforms without thread local storage or atomic
+   operations, statistics are not available and remain at zero. */
+FUDGEAPI void Fudge_setMemoryStatsEnabled ( fudge_bool enabled );
+FUDGEAPI fudge_bool Fudge_getMemoryStatsEnabled ( );
+
+/* Enables (or disables) thread confinement of new objects. Disabled by
+   default. When enabled, the reference counts of messages, envelopes and
+   strings are confined to the thread that created them and are updated
+   without atomic operations (or locking) until the object is explicitly
+   shared, using FudgeMsg_share, FudgeMsgEnvelope_share or
+   FudgeString_share. This removes the cost of thread safe reference
+   counting from code that builds, decodes and releases objects on a single
+   thread.
+
+   A confined object must be shared by its creating thread before any other
+   thread can retain or release it (directly, or by releasing a message
+   that holds it); failing to do so corrupts its reference count. Sharing a
+   message shares its fields' names, strings and submessages too, and
+   anything later added to a shared message is shared as it is added.
+
+   This is a global setting and should be made before any threads that use
+   the library are started. It has no effect in single threaded builds. */
+FUDGEAPI void Fudge_setThreadConfinement ( fudge_bool enabled );
+FUDGEAPI fudge_bool Fudge_getThreadConfinement ( );
+
+/* Fills the structure provided with the current memory statistics (see
+   FudgeMemoryCategory in fudge/memory.h for the categories). */
+FUDGEAPI FudgeStatus Fudge_getMemoryStats ( FudgeMemoryStats * stats );
+
 #ifdef __cplusplus
     }
 #endif
@@ -23,9 +23,16 @@
 extern "C" {
 #endif /* ifdef __cplusplus */
 
+/* Bits of the message header's processing directives. If the compressed bit
+   is set, the header is followed by the uncompressed size of the payload (as
+   a 32 bit integer) and then by the payload (the message fields) compressed
+   as a single LZ4 format block. The header's numbytes is the size of the
+   compressed message. */
+#define FUDGE_DIRECTIVE_COMPRESSED 0x80
+
 typedef struct
 {
-    fudge_byte directives;      /* Processing directives, reserved for future use */
+    fudge_byte directives;      /* Processing directives, see FUDGE_DIRECTIVE_* */
     fudge_byte schemaversion;   /* Messaging schema version, application specific */
     fudge_i16 taxonomy;         /* Message taxonomy, application specific */
     fudge_i32 numbytes;         /* Message size in bytes */
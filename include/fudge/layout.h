@@ -0,0 +1,134 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_LAYOUT_H
+#define INC_FUDGE_LAYOUT_H
+
+#include "fudge/datetime.h"
+#include "fudge/envelope.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/* A FudgeLayout is a pre-encoded message with a fixed shape: the names,
+   ordinals and types of its fields never change, only their values. It is
+   compiled once, either from a prototype message or from a list of field
+   descriptors, and the resulting bytes are then updated in place by storing
+   new values in to the layout's slots.
+
+   Every field other than a submessage is a slot. Slots are numbered in the
+   order the fields are encoded: depth first, with the fields of a
+   submessage numbered before those following it in the parent.
+
+   Storing a fixed width value writes only the value bytes. Storing a
+   variable width value (string, byte array, etc) of the same length as the
+   previous one is also a simple copy. If the length differs, the bytes
+   following the slot are moved and the widths of the field, any enclosing
+   submessages and the envelope are rewritten.
+
+   The encoded form is always available through FudgeLayout_getBytes and is
+   identical to that produced by FudgeCodec_encodeMsg for a message with the
+   same fields and values. Layouts are never compressed, whatever the
+   compression threshold (see FudgeCodec_setCompressionThreshold).
+
+   Thread safety:
+
+   Each layout instance must only be used by a single thread at any given
+   time. */
+#ifdef _FUDGELAYOUTIMPL_DEFINED
+typedef struct FudgeLayoutImpl * FudgeLayout;
+#else /* ifdef _FUDGELAYOUTIMPL_DEFINED */
+typedef struct { void * reserved; } * FudgeLayout;
+#endif /* ifdef _FUDGELAYOUTIMPL_DEFINED */
+
+/* Describes a single field when compiling a layout from a list. The name and
+   ordinal are optional (as with the FudgeMsg_addField functions). The depth
+   is the level of submessage nesting: top level fields have a depth of zero.
+   A FUDGE_TYPE_FUDGE_MSG field opens a submessage that holds the fields
+   immediately following it with a depth one greater than its own. */
+typedef struct
+{
+    fudge_type_id type;
+    FudgeString name;
+    const fudge_i16 * ordinal;
+    fudge_i32 depth;
+} FudgeLayoutField;
+
+/* Compiles a layout from the prototype envelope. The prototype's field
+   values become the initial values of the layout's slots. Note that the
+   slot types are taken from the prototype as is: integer fields added with
+   the FudgeMsg_addField functions will have been reduced to the smallest type
+   able to hold their value, so use FudgeMsg_addFieldData to fix the type of
+   an integer slot. */
+FUDGEAPI FudgeStatus FudgeLayout_create ( FudgeLayout * layout, FudgeMsgEnvelope prototype );
+
+/* Compiles a layout from the list of field descriptors provided. Every slot
+   is initialised to zero (or empty, for variable width types). Returns
+   FUDGE_INVALID_INDEX if a field's depth is not consistent with those
+   preceding it. */
+FUDGEAPI FudgeStatus FudgeLayout_createFromFields ( FudgeLayout * layout,
+                                                    fudge_byte directives,
+                                                    fudge_byte schemaversion,
+                                                    fudge_i16 taxonomy,
+                                                    const FudgeLayoutField * fields,
+                                                    size_t numfields );
+
+FUDGEAPI FudgeStatus FudgeLayout_retain ( FudgeLayout layout );
+FUDGEAPI FudgeStatus FudgeLayout_release ( FudgeLayout layout );
+
+/* Sets bytes/numbytes to the current encoded form of the layout. The bytes
+   remain owned by the layout and are only valid until the next value is
+   stored or the layout is destroyed. */
+FUDGEAPI FudgeStatus FudgeLayout_getBytes ( FudgeLayout layout, const fudge_byte * * bytes, fudge_i32 * numbytes );
+
+/* Slot queries. The find functions set slot to the first slot with the name
+   or ordinal provided, returning FUDGE_INVALID_NAME or FUDGE_INVALID_ORDINAL
+   if there is none. */
+FUDGEAPI size_t FudgeLayout_numSlots ( FudgeLayout layout );
+FUDGEAPI FudgeStatus FudgeLayout_getSlotType ( fudge_type_id * type, FudgeLayout layout, size_t slot );
+FUDGEAPI FudgeStatus FudgeLayout_findSlotByName ( size_t * slot, FudgeLayout layout, const FudgeString name );
+FUDGEAPI FudgeStatus FudgeLayout_findSlotByOrdinal ( size_t * slot, FudgeLayout layout, fudge_i16 ordinal );
+
+/* Value storage functions. All return FUDGE_INVALID_INDEX if the slot is out
+   of range and FUDGE_INVALID_TYPE_ACCESSOR if the slot has a different type.
+   The integer functions can be used with any integer slot, but return
+   FUDGE_INVALID_TYPE_COERCION if the value will not fit in the slot's type. */
+FUDGEAPI FudgeStatus FudgeLayout_setBool ( FudgeLayout layout, size_t slot, fudge_bool value );
+FUDGEAPI FudgeStatus FudgeLayout_setByte ( FudgeLayout layout, size_t slot, fudge_byte value );
+FUDGEAPI FudgeStatus FudgeLayout_setI16  ( FudgeLayout layout, size_t slot, fudge_i16 value );
+FUDGEAPI FudgeStatus FudgeLayout_setI32  ( FudgeLayout layout, size_t slot, fudge_i32 value );
+FUDGEAPI FudgeStatus FudgeLayout_setI64  ( FudgeLayout layout, size_t slot, fudge_i64 value );
+FUDGEAPI FudgeStatus FudgeLayout_setF32  ( FudgeLayout layout, size_t slot, fudge_f32 value );
+FUDGEAPI FudgeStatus FudgeLayout_setF64  ( FudgeLayout layout, size_t slot, fudge_f64 value );
+
+FUDGEAPI FudgeStatus FudgeLayout_setString ( FudgeLayout layout, size_t slot, const FudgeString value );
+
+/* Stores the bytes in any slot whose type is held as an array of bytes: byte
+   arrays, the typed arrays and user types. Typed array contents are in host
+   byte order, as for the FudgeMsg_addField*Array functions. Returns
+   FUDGE_INVALID_TYPE_ACCESSOR if the slot has a fixed width that does not
+   match numbytes. */
+FUDGEAPI FudgeStatus FudgeLayout_setBytes ( FudgeLayout layout, size_t slot, const fudge_byte * bytes, fudge_i32 numbytes );
+
+FUDGEAPI FudgeStatus FudgeLayout_setDate     ( FudgeLayout layout, size_t slot, const FudgeDate * value );
+FUDGEAPI FudgeStatus FudgeLayout_setTime     ( FudgeLayout layout, size_t slot, const FudgeTime * value );
+FUDGEAPI FudgeStatus FudgeLayout_setDateTime ( FudgeLayout layout, size_t slot, const FudgeDateTime * value );
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif
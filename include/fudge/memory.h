@@ -45,17 +45,93 @@ typedef struct
 
 } FudgeMemoryManager;
 
+/* The extended memory manager structure. Provides the same services as
+   FudgeMemoryManager and is subject to the same assumptions, but each call
+   is passed the manager's context pointer and the size and alignment of the
+   memory involved. This allows arenas, pools and accounting allocators to
+   be used without maintaining a side table of allocations.
+
+   The alignment is zero (the library's own allocations only require the
+   alignment provided by malloc) or a power of two. The size passed to the
+   deallocator, and the old size passed to the reallocator, are those
+   originally requested; they are zero only for memory freed or resized by
+   the user through FudgeMemory_free or FudgeMemroy_realloc, which do not
+   know the size of the memory. The reallocator must behave as the
+   allocator when passed a NULL pointer. */
+typedef struct
+{
+    void * context;
+    void * ( *allocate ) ( void * context, size_t size, size_t alignment );
+    void * ( *reallocate ) ( void * context, void * ptr, size_t oldsize, size_t size, size_t alignment );
+    void ( *deallocate ) ( void * context, void * ptr, size_t size, size_t alignment );
+
+} FudgeMemoryManagerEx;
+
 /* Returns a pointer to the default memory manager (the one that will be
    used if none is specified using Fudge_init). The default manager simply
    calls the system's malloc and free implementations. */
 FUDGEAPI FudgeMemoryManager * FudgeMemory_defaultManager ( );
 
+/* Returns a pointer to the slab memory manager, which can be passed to
+   Fudge_initEx in place of the default manager. It is intended for
+   processes that create and destroy many small Fudge objects (messages,
+   strings, fields, etc).
+
+   Allocations of up to 256 bytes are rounded up to one of a small number of
+   size classes and served from a cache belonging to the calling thread,
+   without locking. Memory freed by the thread that allocated it goes back
+   on to that thread's cache; memory freed by another thread is handed back
+   to the owning cache with a single atomic operation. Larger allocations
+   are passed to malloc.
+
+   The caches are refilled in slabs of 16KB, which are never returned to the
+   system: the memory is kept for reuse by the process. The cache of a
+   thread that exits is taken over by the next new thread (where pthreads
+   are available). In threaded builds on platforms without thread local
+   storage or atomic pointer operations, this returns the default manager.
+
+   Memory returned by the library under this manager must be freed with
+   FudgeMemory_free rather than free. */
+FUDGEAPI FudgeMemoryManager * FudgeMemory_slabManager ( );
+
 /* Access to the current memory managers allocate/deallocate
    functionality */
 FUDGEAPI void * FudgeMemory_malloc ( size_t size );
 FUDGEAPI void * FudgeMemroy_realloc ( void * ptr, size_t size );
 FUDGEAPI void FudgeMemory_free ( void * ptr );
 
+/* As FudgeMemory_free, but passes the size of the memory on to the memory
+   manager. The size must be that returned by the library along with the
+   memory (for example the numbytes output of FudgeCodec_encodeMsg). */
+FUDGEAPI void FudgeMemory_freeSized ( void * ptr, size_t size );
+
+/* The categories of memory reported by Fudge_getMemoryStats (see
+   fudge/fudge.h). Memory held in a FudgeArena is not included. */
+typedef enum
+{
+    FUDGE_MEMORY_MESSAGES = 0,      /* FudgeMsg instances */
+    FUDGE_MEMORY_FIELDS,            /* The field arrays of messages */
+    FUDGE_MEMORY_STRINGS,           /* FudgeString instances and their contents */
+    FUDGE_MEMORY_BYTES,             /* Byte data owned by message fields and cached encodings */
+    FUDGE_MEMORY_REFCOUNTS,         /* Reference counts of messages and envelopes */
+    FUDGE_MEMORY_ENVELOPES,         /* FudgeMsgEnvelope instances */
+
+    FUDGE_MEMORY_NUM_CATEGORIES
+} FudgeMemoryCategory;
+
+typedef struct
+{
+    size_t currentbytes;            /* Bytes currently allocated */
+    size_t peakbytes;               /* Highest value seen for currentbytes */
+    size_t allocations;             /* Total number of allocations */
+    size_t frees;                   /* Total number of frees */
+} FudgeMemoryCounters;
+
+typedef struct
+{
+    FudgeMemoryCounters categories [ FUDGE_MEMORY_NUM_CATEGORIES ];
+} FudgeMemoryStats;
+
 #ifdef __cplusplus
     }
 #endif
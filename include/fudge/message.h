@@ -35,7 +35,8 @@
    across multiple threads if access is strictly READ-ONLY in nature. However
    the Fudge-C encoding operations are NOT read-only (they use per-message
    storage for efficiency) and as such should not be used concurrently on any
-   single FudgeMsg instance. */
+   single FudgeMsg instance, unless the message has been frozen (see
+   FudgeMsg_freeze). */
 
 /* FudgeMsg objects are reference counted and should only be created or freed
    using the API provided. On creation (using FudgeMsg_create or as the output
@@ -48,6 +49,110 @@ FUDGEAPI FudgeStatus FudgeMsg_create ( FudgeMsg * messageptr );
 FUDGEAPI FudgeStatus FudgeMsg_retain ( FudgeMsg message );
 FUDGEAPI FudgeStatus FudgeMsg_release ( FudgeMsg message );
 
+/* Makes a message created with thread confinement enabled (see
+   Fudge_setThreadConfinement) safe to retain and release from any thread,
+   along with the names, strings and submessages of its fields. Anything
+   added to the message afterwards is shared as it is added. Returns
+   immediately if the message has already been shared. */
+FUDGEAPI FudgeStatus FudgeMsg_share ( FudgeMsg message );
+
+/* Creates a message in the arena provided (see fudge/arena.h). The message
+   is not reference counted: retaining and releasing it does nothing and it
+   is destroyed when the arena is reset or released. Its fields and their
+   byte data are also held in the arena. Passing a NULL arena creates an
+   ordinary message. */
+FUDGEAPI FudgeStatus FudgeMsg_createInArena ( FudgeMsg * messageptr, FudgeArena arena );
+
+/* Returns the arena holding the message, or NULL if it isn't in one */
+FUDGEAPI FudgeArena FudgeMsg_getArena ( const FudgeMsg message );
+
+/* Removes every field from the message, releasing them as if the message
+   had been destroyed, but keeps the message and the capacity of its field
+   storage for reuse. The caller must hold the only reference to the
+   message. */
+FUDGEAPI FudgeStatus FudgeMsg_clear ( FudgeMsg message );
+
+/* Message recycling. When the recycle limit is non-zero, each thread keeps
+   up to that many released messages (emptied, but with their field storage
+   intact) and FudgeMsg_create reuses these before allocating new ones. A
+   loop that creates and releases messages of a similar size can then run
+   without allocating any message, reference count or field storage.
+   Messages with very large field arrays are freed rather than kept.
+
+   The limit is zero (disabled) by default. As with the other global
+   settings it should be set before any threads that use messages are
+   started. A thread's recycled messages are freed when it exits (where
+   pthreads are available) or by calling FudgeMsg_flushRecycled from that
+   thread. In threaded builds on platforms without thread local storage the
+   limit is always zero. */
+FUDGEAPI void FudgeMsg_setRecycleLimit ( size_t limit );
+FUDGEAPI size_t FudgeMsg_getRecycleLimit ( );
+FUDGEAPI void FudgeMsg_flushRecycled ( );
+
+/* Deferred release. Releasing the last reference to a large message tree
+   destroys every field and submessage in it, which can take a noticeable
+   time on a latency sensitive thread. When deferred release is enabled the
+   message is instead added to the releasing thread's retire list, and is
+   only destroyed at a later point chosen by the application:
+
+   - FudgeMsg_reclaimRetired destroys every message retired by the calling
+     thread. Call it at a quiescent point, such as between batches of work.
+   - FudgeMsg_startReclaimer starts a background thread. Each thread hands
+     its retired messages to the reclaimer in batches, and the reclaimer
+     destroys them. FudgeMsg_stopReclaimer stops the thread once it has
+     destroyed everything it was given. Returns FUDGE_NOT_SUPPORTED where
+     pthreads are not available. The two functions must not be called
+     concurrently.
+
+   Only shared messages (see FudgeMsg_share and Fudge_setThreadConfinement)
+   are handed to the reclaimer thread. A confined message is reclaimed by
+   FudgeMsg_reclaimRetired on the thread that retired it, or when that
+   thread exits (where pthreads are available).
+
+   Deferred release is disabled by default. As with the other global
+   settings it should be set before any threads that use messages are
+   started. Without thread local storage it cannot be enabled and the
+   getter always returns false. */
+FUDGEAPI void FudgeMsg_setDeferredRelease ( fudge_bool enabled );
+FUDGEAPI fudge_bool FudgeMsg_getDeferredRelease ( );
+FUDGEAPI void FudgeMsg_reclaimRetired ( );
+FUDGEAPI FudgeStatus FudgeMsg_startReclaimer ( );
+FUDGEAPI FudgeStatus FudgeMsg_stopReclaimer ( );
+
+/* Enables (or disables) caching of the message's encoded form. When enabled,
+   the first encode of the message keeps a copy of the encoded fields and
+   later encodes (whether as the top-level message or as a submessage) copy
+   these bytes rather than walking the fields again. The cache is discarded
+   whenever the message or any submessage beneath it is changed, or caching
+   is disabled.
+
+   This is intended for messages that are built once and then attached
+   unchanged to many others. Each message that isn't frozen keeps track of
+   the messages it has been added to, so that a change can be passed up to
+   every cached encoding above it. */
+FUDGEAPI FudgeStatus FudgeMsg_setEncodingCache ( FudgeMsg message, fudge_bool enabled );
+
+/* Freezes the message and every submessage beneath it. The encoded widths
+   of the whole tree are calculated and stored, and if cacheencoding is true
+   the message's encoded form is cached too (as with
+   FudgeMsg_setEncodingCache, but done now rather than on the first encode).
+   The message is also shared (see FudgeMsg_share).
+
+   A frozen message can't be changed: adding fields, clearing it or
+   changing its encoding cache returns FUDGE_MESSAGE_FROZEN. In return, it
+   may be encoded, read, retained and released by any number of threads at
+   once without further synchronisation. This makes it possible to build a
+   message once and hand it to several threads for encoding, rather than
+   each taking its own copy.
+
+   The message must not be in use by any other thread while it is being
+   frozen. Freezing a message that is already frozen does nothing (the
+   cacheencoding argument is ignored). If freezing fails some of the
+   submessages may have been frozen. A message remains frozen until it is
+   destroyed. */
+FUDGEAPI FudgeStatus FudgeMsg_freeze ( FudgeMsg message, fudge_bool cacheencoding );
+FUDGEAPI fudge_bool FudgeMsg_isFrozen ( const FudgeMsg message );
+
 /* Returns the number of fields within the message, zero if the message is
    a NULL pointer. */
 FUDGEAPI unsigned long FudgeMsg_numFields ( FudgeMsg message );
@@ -107,7 +212,8 @@ FUDGEAPI FudgeStatus FudgeMsg_addFieldOpaque ( FudgeMsg message,
    are optional and can be NULL, other values must be valid.
    Note that for byte data (strings, arrays, etc), the memory is not copied.
    It is the job of the calling code to ensure that this memory is not
-   destroyed. The FudgeMsg will destroy the memory when it is released.
+   destroyed. The FudgeMsg will destroy the memory when it is released, so
+   it must come from FudgeMemory_malloc with numbytes being its size.
    The same applies to submessage fields: the message's reference count will
    not be increased, but it will be decreased when the parent is destroyed. */
 FUDGEAPI FudgeStatus FudgeMsg_addFieldData ( FudgeMsg message,
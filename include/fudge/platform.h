@@ -40,6 +40,9 @@
 #ifdef FUDGE_HAVE_ARPA_INET_H
 #   include <arpa/inet.h>
 #endif /* ifdef FUDGE_HAVE_ARPA_INET_H */
+#ifdef FUDGE_HAVE_SYS_UIO_H
+#   include <sys/uio.h>
+#endif /* ifdef FUDGE_HAVE_SYS_UIO_H */
 #ifdef FUDGE_ARPA_INET_WINSOCK_HACK
 /* This is a *really* temporary hack to get the library to build with MSVC */
 #   include <winsock.h>
@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_QUEUE_H
+#define INC_FUDGE_QUEUE_H
+
+#include "fudge/envelope.h"
+#include "fudge/message.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/* A FudgeQueue is a bounded, lock-free queue for passing envelopes or
+   messages from one thread to another, such as from the threads that
+   decode incoming messages to those that process them.
+
+   The queue takes over the references held by the caller: pushing an
+   envelope (or message) moves the caller's reference in to the queue, and
+   popping it moves that reference to the popping thread, which must
+   eventually release it. No retain or release is needed on either side.
+   Objects are shared (see FudgeMsgEnvelope_share and FudgeMsg_share) as
+   they are pushed, so objects created with thread confinement enabled can
+   be passed through a queue. If pushing fails, the caller keeps its
+   reference. Objects in an arena may be pushed, but the arena must not be
+   reset until the popping thread is done with them.
+
+   The push and pop functions never block: they return FUDGE_QUEUE_FULL or
+   FUDGE_QUEUE_EMPTY immediately if nothing can be done. The batch versions
+   move as many objects as they can (up to the number requested) in a
+   single step, which is cheaper than moving them one at a time.
+
+   Thread safety:
+
+   A FUDGE_QUEUE_MPMC queue may be used by any number of pushing and popping
+   threads at once. A FUDGE_QUEUE_SPSC queue is faster, but may only be used
+   by one pushing thread and one popping thread at any given time. */
+#ifdef _FUDGEQUEUEIMPL_DEFINED
+typedef struct FudgeQueueImpl * FudgeQueue;
+#else /* ifdef _FUDGEQUEUEIMPL_DEFINED */
+typedef struct { void * reserved; } * FudgeQueue;
+#endif /* ifdef _FUDGEQUEUEIMPL_DEFINED */
+
+typedef enum
+{
+    FUDGE_QUEUE_ENVELOPES   = 0x0,  /* The queue holds FudgeMsgEnvelope instances */
+    FUDGE_QUEUE_MESSAGES    = 0x1   /* The queue holds FudgeMsg instances */
+} FudgeQueueContents;
+
+typedef enum
+{
+    FUDGE_QUEUE_MPMC        = 0x0,  /* Multiple pushing and popping threads */
+    FUDGE_QUEUE_SPSC        = 0x1   /* A single pushing and a single popping thread */
+} FudgeQueueMode;
+
+/* Creates a queue that can hold at least capacity objects (the capacity is
+   rounded up to a power of two, and is never less than two). Objects left
+   in the queue when it is destroyed are released. Returns
+   FUDGE_OUT_OF_MEMORY if the capacity is too large to allocate, and
+   FUDGE_NOT_SUPPORTED in threaded builds without atomic operations. */
+FUDGEAPI FudgeStatus FudgeQueue_create ( FudgeQueue * queue,
+                                         FudgeQueueContents contents,
+                                         size_t capacity,
+                                         FudgeQueueMode mode );
+FUDGEAPI FudgeStatus FudgeQueue_retain ( FudgeQueue queue );
+FUDGEAPI FudgeStatus FudgeQueue_release ( FudgeQueue queue );
+
+FUDGEAPI size_t FudgeQueue_getCapacity ( FudgeQueue queue );
+
+/* Returns the number of objects in the queue. If other threads are using
+   the queue this may be out of date by the time it's returned. */
+FUDGEAPI size_t FudgeQueue_getSize ( FudgeQueue queue );
+
+/* Single object push and pop functions. Each returns
+   FUDGE_QUEUE_INVALID_CONTENTS if the queue doesn't hold that type of
+   object. A pop that fails leaves its output unchanged. */
+FUDGEAPI FudgeStatus FudgeQueue_pushEnvelope ( FudgeQueue queue, FudgeMsgEnvelope envelope );
+FUDGEAPI FudgeStatus FudgeQueue_popEnvelope ( FudgeQueue queue, FudgeMsgEnvelope * envelope );
+FUDGEAPI FudgeStatus FudgeQueue_pushMsg ( FudgeQueue queue, FudgeMsg message );
+FUDGEAPI FudgeStatus FudgeQueue_popMsg ( FudgeQueue queue, FudgeMsg * message );
+
+/* Batch push and pop functions. The push functions move as many objects as
+   will fit, starting with the first, and the pop functions fill the array
+   from the start. The number moved is written to pushed/popped (which may
+   be NULL). Returns FUDGE_QUEUE_FULL or FUDGE_QUEUE_EMPTY only if no
+   objects could be moved. */
+FUDGEAPI FudgeStatus FudgeQueue_pushEnvelopes ( FudgeQueue queue, const FudgeMsgEnvelope * envelopes, size_t count, size_t * pushed );
+FUDGEAPI FudgeStatus FudgeQueue_popEnvelopes ( FudgeQueue queue, FudgeMsgEnvelope * envelopes, size_t count, size_t * popped );
+FUDGEAPI FudgeStatus FudgeQueue_pushMsgs ( FudgeQueue queue, const FudgeMsg * messages, size_t count, size_t * pushed );
+FUDGEAPI FudgeStatus FudgeQueue_popMsgs ( FudgeQueue queue, FudgeMsg * messages, size_t count, size_t * popped );
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif
@@ -50,12 +50,16 @@ typedef enum
 /* Registers a user defined type in the registry. Returns FUDGE_OK if the type
    information is registered, FUDGE_NULL_POINTER if any of the function
    pointers are NULL, FUDGE_INVALID_USER_TYPE if the new type's payload is not
-   one of FUDGE_TYPE_PAYLOAD_BYTES or FUDGE_TYPE_PAYLOAD_SUBMSG.
-   
-   Note that there is no thread protection around the registry;
-   multiple reader threads is fine, but the calling code must ensure that one
-   and only one thread is accessing the registry during a write operation such
-   as this. */
+   one of FUDGE_TYPE_PAYLOAD_BYTES or FUDGE_TYPE_PAYLOAD_SUBMSG, or
+   FUDGE_OUT_OF_MEMORY.
+
+   Types may be registered (or re-registered) at any time after the library
+   has been initialised, including while other threads are encoding or
+   decoding: the new type information replaces the old in a single atomic
+   step, and readers are never blocked. A thread that is part way through
+   decoding or encoding a message may use either version of the type for
+   that message. The memory used by each registration is kept until the
+   process exits. */
 FUDGEAPI FudgeStatus FudgeRegistry_registerType ( fudge_type_id type,
                                                   FudgeTypePayload payload,
                                                   FudgeTypeDecoder decoder,
@@ -27,6 +27,7 @@ typedef enum
     FUDGE_OK                            = 0x0000,
     FUDGE_OUT_OF_MEMORY                 = 0x0001,
     FUDGE_NULL_POINTER                  = 0x0002,
+    FUDGE_NOT_SUPPORTED                 = 0x0003,
 
     FUDGE_INVALID_INDEX                 = 0x0010,
     FUDGE_INVALID_NAME                  = 0x0011,
@@ -49,6 +50,7 @@ typedef enum
 
     FUDGE_OUT_OF_BYTES                  = 0x0100,
     FUDGE_UNKNOWN_FIELD_WIDTH           = 0x0101,
+    FUDGE_INVALID_COMPRESSED_PAYLOAD    = 0x0102,
 
     FUDGE_DATETIME_INVALID_YEAR         = 0x0200,
     FUDGE_DATETIME_INVALID_MONTH        = 0x0201,
@@ -61,6 +63,15 @@ typedef enum
     FUDGE_PTHREAD_MUTEX_INVALID         = 0x0302,
     FUDGE_PTHREAD_MUTEX_UNKNOWN         = 0x0303,
 
+    FUDGE_WRITER_NOT_IN_MSG             = 0x0400,
+    FUDGE_WRITER_UNBALANCED_SUBMSG      = 0x0401,
+
+    FUDGE_MESSAGE_FROZEN                = 0x0500,
+
+    FUDGE_QUEUE_FULL                    = 0x0600,
+    FUDGE_QUEUE_EMPTY                   = 0x0601,
+    FUDGE_QUEUE_INVALID_CONTENTS        = 0x0602,
+
     FUDGE_INTERNAL_LIST_STATE           = 0x1000,
     FUDGE_INTERNAL_PAYLOAD              = 0x1001,
 
@@ -16,6 +16,7 @@
 #ifndef INC_FUDGE_STRING_H
 #define INC_FUDGE_STRING_H
 
+#include "fudge/arena.h"
 #include "fudge/status.h"
 #include "fudge/types.h"
 
@@ -61,9 +62,38 @@ FUDGEAPI FudgeStatus FudgeString_createFromUTF8 ( FudgeString * string, const fu
 FUDGEAPI FudgeStatus FudgeString_createFromUTF16 ( FudgeString * string, const fudge_byte * bytes, size_t numbytes );
 FUDGEAPI FudgeStatus FudgeString_createFromUTF32 ( FudgeString * string, const fudge_byte * bytes, size_t numbytes );
 
+/* As above, but the string is created in the arena provided (see
+   fudge/arena.h). It is not reference counted and is destroyed when the
+   arena is reset or released. Passing a NULL arena creates an ordinary
+   string. */
+FUDGEAPI FudgeStatus FudgeString_createFromASCIIInArena ( FudgeString * string, const char * chars, size_t numchars, FudgeArena arena );
+FUDGEAPI FudgeStatus FudgeString_createFromASCIIZInArena ( FudgeString * string, const char * chars, FudgeArena arena );
+FUDGEAPI FudgeStatus FudgeString_createFromUTF8InArena ( FudgeString * string, const fudge_byte * bytes, size_t numbytes, FudgeArena arena );
+FUDGEAPI FudgeStatus FudgeString_createFromUTF16InArena ( FudgeString * string, const fudge_byte * bytes, size_t numbytes, FudgeArena arena );
+FUDGEAPI FudgeStatus FudgeString_createFromUTF32InArena ( FudgeString * string, const fudge_byte * bytes, size_t numbytes, FudgeArena arena );
+
+/* Interning: returns the canonical instance of a string with the contents
+   provided, creating it on first use. Interned strings with the same
+   contents are always the same instance, so comparing them (and looking up
+   fields by an interned name) short-circuits on pointer identity.
+
+   The intern table is process-wide and lock-free for readers; threads may
+   intern strings concurrently. Interned strings are immortal: they are
+   never freed, and retaining or releasing them has no effect (although the
+   interned reference should still be released as with any other string).
+   Interning is therefore intended for a bounded set of strings, such as
+   field names. */
+FUDGEAPI FudgeStatus FudgeString_intern ( FudgeString * interned, const FudgeString string );
+FUDGEAPI FudgeStatus FudgeString_internUTF8 ( FudgeString * interned, const fudge_byte * bytes, size_t numbytes );
+
 FUDGEAPI FudgeStatus FudgeString_retain ( FudgeString string );
 FUDGEAPI FudgeStatus FudgeString_release ( FudgeString string );
 
+/* Makes a string created with thread confinement enabled (see
+   Fudge_setThreadConfinement) safe to retain and release from any thread.
+   Does nothing for strings that are already shared. */
+FUDGEAPI FudgeStatus FudgeString_share ( FudgeString string );
+
 FUDGEAPI size_t FudgeString_getSize ( const FudgeString string );
 FUDGEAPI const fudge_byte * FudgeString_getData ( const FudgeString string );
 
@@ -79,6 +109,34 @@ FUDGEAPI size_t FudgeString_copyToUTF32 ( fudge_byte * buffer, size_t buffersize
 
 FUDGEAPI int FudgeString_compare ( const FudgeString left, const FudgeString right );
 
+/* Equality and hashing, consistent with FudgeString_compare: strings that
+   compare as equal (including those that differ only by BOMs) are equal and
+   have the same hash. The hash is calculated on first use and then held by
+   the string, so equality checks between strings that have been hashed
+   before reject most differing strings without reading their contents. Two
+   NULL strings are equal; the hash of NULL is zero. */
+FUDGEAPI uint32_t FudgeString_hash ( const FudgeString string );
+FUDGEAPI fudge_bool FudgeString_equals ( const FudgeString left, const FudgeString right );
+
+/* Static strings: a FudgeStringStatic wraps UTF8 bytes with static storage
+   duration (typically a string literal) so they can be used as a FudgeString
+   without being copied. FudgeString_fromStatic returns the same immortal
+   string every time it is called for a given FudgeStringStatic; the string
+   refers directly to the caller's bytes, which must outlive it. As with
+   interned strings, retaining or releasing the result has no effect and it
+   is never freed.
+
+   The reserved member must be zero initially. FUDGESTRING_STATIC declares
+   and initialises a static instance from a string literal, e.g.
+
+       FUDGESTRING_STATIC( s_fieldName, "name" );
+       ...
+       FudgeMsg_addFieldI32 ( msg, FudgeString_fromStatic ( &s_fieldName ), 0, value );
+
+   FudgeString_fromStatic may be called by multiple threads concurrently.
+   The bytes are validated on first use, as for FudgeString_createFromUTF8.
+   It returns NULL if they are not valid UTF8 or if the string could not be
+   allocated. */
 #pragma pack(push,8)
 typedef struct {
   void * reserved;
@@ -87,7 +145,10 @@ typedef struct {
 } FudgeStringStatic;
 #pragma pack(pop)
 
-FUDGEAPI FudgeString FudgeString_fromStatic (FudgeStringStatic * string);
+#define FUDGESTRING_STATIC_INIT( literal ) { 0, ( const fudge_byte * ) ( literal ), sizeof ( literal ) - 1 }
+#define FUDGESTRING_STATIC( name, literal ) static FudgeStringStatic name = FUDGESTRING_STATIC_INIT( literal )
+
+FUDGEAPI FudgeString FudgeString_fromStatic ( FudgeStringStatic * string );
 
 #ifdef __cplusplus
     }
@@ -22,16 +22,18 @@
     extern "C" {
 #endif
 
-/* The FudgeStringPool provides a simple collection for FudgeString
-   references. When the pool is destroyed, any strings acquired by the pool
-   have their reference counts reduced by one (and so are destroyed if the
-   pool held the only reference).
+/* The FudgeStringPool provides a collection for FudgeString references.
+   When the pool is destroyed, any strings acquired by the pool have their
+   reference counts reduced by one (and so are destroyed if the pool held the
+   only reference).
 
-   The pool is of limited use in most production systems and is provided to
-   make test/example code less verbose. However it is reasonably efficient
-   (acquiring a string is a fixed cost, releasing the pool is a linear time
-   operation) and there's no reason why it could not be used in a production
-   environment if the design benefitted from it.
+   The pool also acts as a string cache: it keeps an index of the strings it
+   holds by content, and the createString functions return the string
+   already in the pool if there is one with the same contents rather than
+   creating another. A pool can therefore be used to share the field names
+   used by a session's messages, as well as to make test/example code less
+   verbose. Acquiring a string and looking one up are (amortised) fixed cost
+   operations and clearing the pool is linear in the number of strings.
 
    Thread safety:
 
@@ -65,14 +67,16 @@ FUDGEAPI FudgeStatus FudgeStringPool_acquire ( FudgeStringPool pool, FudgeString
    structure itself is not destroyed and can be reused. */
 FUDGEAPI FudgeStatus FudgeStringPool_clear ( FudgeStringPool pool );
 
-/* Helper functions that mimic the FudgeString constructors. They create a new
-   FudgeString instance and the pool acquires. The new string is returned and
-   can be used as normal. It should NOT be released without an additional
-   retain call; the pool will release the initial reference when cleared.
-   If the string creation fails, NULL will be returned and the status varible
-   updated. */
+/* Helper functions that mimic the FudgeString constructors. If the pool
+   already holds a string with exactly the same bytes it is returned;
+   otherwise they create a new FudgeString instance and the pool acquires
+   it. The string returned can be used as normal. It should NOT be released
+   without an additional retain call; the pool will release its reference
+   when cleared. If the string creation fails, NULL will be returned and the
+   status variable updated. */
 FUDGEAPI FudgeString FudgeStringPool_createStringFromASCII ( FudgeStringPool pool, FudgeStatus * status, const char * chars, size_t numchars );
 FUDGEAPI FudgeString FudgeStringPool_createStringFromASCIIZ ( FudgeStringPool pool, FudgeStatus * status, const char * chars );
+FUDGEAPI FudgeString FudgeStringPool_createStringFromUTF8 ( FudgeStringPool pool, FudgeStatus * status, const fudge_byte * bytes, size_t numbytes );
 
 #ifdef __cplusplus
     }
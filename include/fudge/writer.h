@@ -0,0 +1,116 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_WRITER_H
+#define INC_FUDGE_WRITER_H
+
+#include "fudge/datetime.h"
+#include "fudge/string.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/* The FudgeWriter encodes fields directly in to an output buffer, without
+   building a FudgeMsg first. The output is identical to that produced by
+   FudgeCodec_encodeMsg for a message with the same fields.
+
+   A message is written by calling FudgeWriter_beginMsg, adding the fields and
+   then calling FudgeWriter_endMsg to retrieve the encoded bytes. Submessages
+   are written in place: FudgeWriter_beginSubMsg opens a new submessage field,
+   the fields that follow are added to it and FudgeWriter_endSubMsg closes it
+   (filling in its width). Submessages can be nested to any depth.
+
+   The writer's buffer grows as required and is reused for each message, so
+   once a writer has reached its working size, encoding further messages
+   requires no additional allocation.
+
+   Thread safety:
+
+   Each writer instance must only be used by a single thread at any given
+   time. */
+#ifdef _FUDGEWRITERIMPL_DEFINED
+typedef struct FudgeWriterImpl * FudgeWriter;
+#else /* ifdef _FUDGEWRITERIMPL_DEFINED */
+typedef struct { void * reserved; } * FudgeWriter;
+#endif /* ifdef _FUDGEWRITERIMPL_DEFINED */
+
+/* Creates a writer with an output buffer of the capacity provided (in bytes).
+   The writer is reference counted, as with the other Fudge-C objects. */
+FUDGEAPI FudgeStatus FudgeWriter_create ( FudgeWriter * writer, fudge_i32 capacity );
+FUDGEAPI FudgeStatus FudgeWriter_retain ( FudgeWriter writer );
+FUDGEAPI FudgeStatus FudgeWriter_release ( FudgeWriter writer );
+
+/* Starts a new message, discarding the contents of any previous one. The
+   envelope values are written in to the message header. */
+FUDGEAPI FudgeStatus FudgeWriter_beginMsg ( FudgeWriter writer, fudge_byte directives, fudge_byte schemaversion, fudge_i16 taxonomy );
+
+/* Completes the message and sets bytes/numbytes to the encoded form. The
+   bytes remain owned by the writer and are only valid until the next call
+   to FudgeWriter_beginMsg or the writer is destroyed. Returns
+   FUDGE_WRITER_UNBALANCED_SUBMSG if any submessages are still open. */
+FUDGEAPI FudgeStatus FudgeWriter_endMsg ( FudgeWriter writer, const fudge_byte * * bytes, fudge_i32 * numbytes );
+
+/* Opens and closes a submessage field. Fields added between the two calls
+   are written in to the submessage. */
+FUDGEAPI FudgeStatus FudgeWriter_beginSubMsg ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal );
+FUDGEAPI FudgeStatus FudgeWriter_endSubMsg ( FudgeWriter writer );
+
+/* The add field functions mirror those in message.h: the name and ordinal
+   are optional and integer values are written using the smallest type that
+   can hold them. Nothing is retained or copied beyond the encoded bytes, so
+   the values only need to remain valid for the duration of the call. All
+   return FUDGE_WRITER_NOT_IN_MSG if called outside of a
+   FudgeWriter_beginMsg/FudgeWriter_endMsg pair. */
+FUDGEAPI FudgeStatus FudgeWriter_addFieldIndicator ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal );
+
+FUDGEAPI FudgeStatus FudgeWriter_addFieldBool ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_bool value );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldByte ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_byte value );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldI16  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_i16 value );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldI32  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_i32 value );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldI64  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_i64 value );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldF32  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_f32 value );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldF64  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, fudge_f64 value );
+
+FUDGEAPI FudgeStatus FudgeWriter_addFieldByteArray ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const fudge_byte * bytes,  fudge_i32 numbytes );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldI16Array  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const fudge_i16 * ints,    fudge_i32 numints );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldI32Array  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const fudge_i32 * ints,    fudge_i32 numints );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldI64Array  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const fudge_i64 * ints,    fudge_i32 numints );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldF32Array  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const fudge_f32 * floats,  fudge_i32 numfloats );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldF64Array  ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const fudge_f64 * doubles, fudge_i32 numdoubles );
+
+FUDGEAPI FudgeStatus FudgeWriter_addFieldString ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeString string );
+
+FUDGEAPI FudgeStatus FudgeWriter_addFieldDate     ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeDate * date );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldTime     ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeTime * time );
+FUDGEAPI FudgeStatus FudgeWriter_addFieldDateTime ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeDateTime * datetime );
+
+/* Writes an existing message as a submessage field */
+FUDGEAPI FudgeStatus FudgeWriter_addFieldMsg ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeMsg message );
+
+/* As FudgeMsg_addFieldOpaque: the bytes are written as-is, with no endian
+   conversion. */
+FUDGEAPI FudgeStatus FudgeWriter_addFieldOpaque ( FudgeWriter writer,
+                                                fudge_type_id type,
+                                                const FudgeString name,
+                                                const fudge_i16 * ordinal,
+                                                const fudge_byte * bytes,
+                                                fudge_i32 numbytes );
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif
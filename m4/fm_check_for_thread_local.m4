@@ -0,0 +1,22 @@
+dnl @synopsis FM_CHECK_FOR_THREAD_LOCAL( )
+dnl
+dnl Checks that the target can compile and link a program using the __thread
+dnl storage class; the GCC thread local storage extension.
+dnl
+dnl If the target does provided the functionality fm_cv_check_for_thread_local
+dnl is set to "yes", otherwise it's set to "no".
+dnl
+dnl @category Misc
+dnl @author Vrai Stacey <vrai.stacey@gmail.com>
+dnl @version 2010-06-25
+dnl @license AllPermissive
+AC_DEFUN([FM_CHECK_FOR_THREAD_LOCAL],dnl
+[dnl
+AC_CACHE_CHECK([for __thread], [fm_cv_check_for_thread_local],dnl
+    [dnl
+        AC_TRY_LINK([static __thread int value;],[value = 1;
+                        return value - 1;],dnl
+            [fm_cv_check_for_thread_local='yes'],dnl
+            [fm_cv_check_for_thread_local='no'])dnl
+    ])dnl
+])
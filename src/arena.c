@@ -0,0 +1,194 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _FUDGEARENAIMPL_DEFINED 1
+#include "arena_internal.h"
+#include "memory_internal.h"
+#include "reference.h"
+#include "fudge/types.h"
+
+#define FUDGEARENA_DEFAULT_BLOCK_SIZE 16384
+
+/* Allocations are rounded up to a multiple of this, which is sufficient for
+   any of the library's types */
+#define FUDGEARENA_ALIGNMENT 8
+
+/* The block header is a multiple of the alignment in size, so the memory
+   following it is suitably aligned */
+typedef struct FudgeArenaBlock
+{
+    struct FudgeArenaBlock * next;
+    size_t numbytes;
+} FudgeArenaBlock;
+
+struct FudgeArenaImpl
+{
+    FudgeRefCount refcount;
+    size_t blocksize;
+    FudgeArenaBlock * blocks;       /* Every block held, in the order they are used */
+    FudgeArenaBlock * current;      /* NULL until the first allocation after a reset */
+    fudge_byte * top;
+    fudge_byte * end;
+    size_t numbytes;
+    size_t capacity;
+    FudgeArenaCleanup * cleanups;
+};
+
+FudgeStatus FudgeArena_create ( FudgeArena * arena, size_t blocksize )
+{
+    FudgeStatus status;
+
+    if ( ! arena )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! ( *arena = FUDGEMEMORY_MALLOC( FudgeArena, sizeof ( struct FudgeArenaImpl ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    ( *arena )->blocksize = blocksize ? blocksize : FUDGEARENA_DEFAULT_BLOCK_SIZE;
+    ( *arena )->blocks = ( *arena )->current = 0;
+    ( *arena )->top = ( *arena )->end = 0;
+    ( *arena )->numbytes = ( *arena )->capacity = 0;
+    ( *arena )->cleanups = 0;
+
+    if ( ( status = FudgeRefCount_create ( &( ( *arena )->refcount ) ) ) != FUDGE_OK )
+        FUDGEMEMORY_FREE( *arena, sizeof ( struct FudgeArenaImpl ) );
+    return status;
+}
+
+void FudgeArena_runCleanups ( FudgeArena arena )
+{
+    FudgeArenaCleanup * cleanup = arena->cleanups;
+
+    arena->cleanups = 0;
+    while ( cleanup )
+    {
+        /* The cleanup is part of an arena object, so read the next one
+           first */
+        FudgeArenaCleanup * next = cleanup->next;
+        cleanup->run ( cleanup );
+        cleanup = next;
+    }
+}
+
+void FudgeArena_destroy ( FudgeArena arena )
+{
+    FudgeArenaBlock * block, * next;
+
+    FudgeArena_runCleanups ( arena );
+    for ( block = arena->blocks; block; block = next )
+    {
+        next = block->next;
+        FUDGEMEMORY_FREE( block, sizeof ( FudgeArenaBlock ) + block->numbytes );
+    }
+    FudgeRefCount_destroy ( arena->refcount );
+    FUDGEMEMORY_FREE( arena, sizeof ( struct FudgeArenaImpl ) );
+}
+
+FudgeStatus FudgeArena_retain ( FudgeArena arena )
+{
+    if ( ! arena )
+        return FUDGE_NULL_POINTER;
+
+    FudgeRefCount_increment ( arena->refcount );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeArena_release ( FudgeArena arena )
+{
+    if ( ! arena )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! FudgeRefCount_decrementAndReturn ( arena->refcount ) )
+        FudgeArena_destroy ( arena );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeArena_reset ( FudgeArena arena )
+{
+    if ( ! arena )
+        return FUDGE_NULL_POINTER;
+
+    FudgeArena_runCleanups ( arena );
+    arena->current = 0;
+    arena->top = arena->end = 0;
+    arena->numbytes = 0;
+    return FUDGE_OK;
+}
+
+size_t FudgeArena_getNumBytes ( FudgeArena arena )
+{
+    return arena ? arena->numbytes : 0;
+}
+
+size_t FudgeArena_getCapacity ( FudgeArena arena )
+{
+    return arena ? arena->capacity : 0;
+}
+
+/* Moves on to the next block that can hold numbytes. Blocks kept from
+   before a reset are reused where possible; otherwise a new block is
+   inserted after the current one. */
+fudge_bool FudgeArena_nextBlock ( FudgeArena arena, size_t numbytes )
+{
+    FudgeArenaBlock * block = arena->current ? arena->current->next : arena->blocks;
+
+    if ( ! block || block->numbytes < numbytes )
+    {
+        FudgeArenaBlock * created;
+        size_t blocksize = numbytes > arena->blocksize ? numbytes : arena->blocksize;
+
+        if ( blocksize > ( size_t ) -1 - sizeof ( FudgeArenaBlock ) )
+            return FUDGE_FALSE;
+        if ( ! ( created = FUDGEMEMORY_MALLOC( FudgeArenaBlock *, sizeof ( FudgeArenaBlock ) + blocksize ) ) )
+            return FUDGE_FALSE;
+        created->next = block;
+        created->numbytes = blocksize;
+        if ( arena->current )
+            arena->current->next = created;
+        else
+            arena->blocks = created;
+        arena->capacity += blocksize;
+        block = created;
+    }
+
+    arena->current = block;
+    arena->top = ( fudge_byte * ) ( block + 1 );
+    arena->end = arena->top + block->numbytes;
+    return FUDGE_TRUE;
+}
+
+void * FudgeArena_allocate ( FudgeArena arena, size_t numbytes )
+{
+    fudge_byte * memory;
+
+    /* Sizes this close to the limit would wrap when rounded up */
+    if ( numbytes > ( size_t ) -1 - ( FUDGEARENA_ALIGNMENT - 1 ) )
+        return 0;
+    numbytes = ( numbytes + FUDGEARENA_ALIGNMENT - 1 ) & ~( size_t ) ( FUDGEARENA_ALIGNMENT - 1 );
+    if ( ( size_t ) ( arena->end - arena->top ) < numbytes || ! arena->top )
+        if ( ! FudgeArena_nextBlock ( arena, numbytes ) )
+            return 0;
+
+    memory = arena->top;
+    arena->top += numbytes;
+    arena->numbytes += numbytes;
+    return memory;
+}
+
+void FudgeArena_addCleanup ( FudgeArena arena, FudgeArenaCleanup * cleanup )
+{
+    cleanup->next = arena->cleanups;
+    arena->cleanups = cleanup;
+}
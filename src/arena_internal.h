@@ -0,0 +1,37 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_ARENA_INTERNAL_H
+#define INC_FUDGE_ARENA_INTERNAL_H
+
+#include "fudge/arena.h"
+
+/* Arena objects that hold references to objects outside the arena register
+   a cleanup, which is run when the arena is reset or released. The cleanup
+   is embedded in the object, so registering one can't fail. */
+typedef struct FudgeArenaCleanup
+{
+    struct FudgeArenaCleanup * next;
+    void ( *run ) ( struct FudgeArenaCleanup * cleanup );
+} FudgeArenaCleanup;
+
+/* Returns numbytes of memory from the arena, aligned for any of the
+   library's types, or NULL if no more memory is available. The memory is
+   only reclaimed when the arena is reset or released. */
+void * FudgeArena_allocate ( FudgeArena arena, size_t numbytes );
+
+void FudgeArena_addCleanup ( FudgeArena arena, FudgeArenaCleanup * cleanup );
+
+#endif
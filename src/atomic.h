@@ -16,23 +16,99 @@
 #ifndef INC_FUDGE_ATOMIC_H
 #define INC_FUDGE_ATOMIC_H
 
+/* FUDGE_HAS_ATOMICS is defined when the operations below are genuinely
+   atomic, or there is only one thread. Threaded builds without intrin.h or
+   the __sync functions (which configure only allows where pthreads are
+   available) get plain reads and writes; code that relies on these
+   operations for synchronisation must check for it. */
+
 #if defined(_MT) && defined(FUDGE_HAVE_INTRIN_H)
     // Microsoft compilers, use INTRIN.H functions in MultiThread builds
 #   include <intrin.h>
+#   define FUDGE_HAS_ATOMICS 1
 #   define AtomicIncrementAndReturn(var) _InterlockedIncrement(&var)
 #   define AtomicDecrementAndReturn(var) _InterlockedDecrement(&var)
-#   define AtomicExchangePointer(var,val) (void*)_InterlockedExchange((long*)&var,(long)val)
+#   define AtomicExchangePointer(var,val) _InterlockedExchangePointer((void*volatile*)&var,(void*)val)
+#   define AtomicCompareExchangePointer(var,oldval,newval) _InterlockedCompareExchangePointer((void*volatile*)&var,newval,oldval)
+#   define AtomicLoadPointer(var) (var) /* Volatile reads have acquire semantics */
+#   define AtomicLoadSize(var) (var)
+#   define AtomicStorePointer(var,val) (var=(val)) /* Volatile writes have release semantics */
+#   define AtomicStoreSize(var,val) (var=(val))
+#   define AtomicLoadRelaxed(var) (var) /* Aligned volatile accesses are atomic */
+#   define AtomicStoreRelaxed(var,val) (var=(val))
+#   if defined(_WIN64)
+#       define AtomicAddSize(var,val) ((size_t)_InterlockedExchangeAdd64((volatile __int64*)&var,(__int64)(val))+(val))
+#       define AtomicCompareExchangeSize(var,oldval,newval) ((size_t)_InterlockedCompareExchange64((volatile __int64*)&var,(__int64)(newval),(__int64)(oldval)))
+#   else
+#       define AtomicAddSize(var,val) ((size_t)_InterlockedExchangeAdd((volatile long*)&var,(long)(val))+(val))
+#       define AtomicCompareExchangeSize(var,oldval,newval) ((size_t)_InterlockedCompareExchange((volatile long*)&var,(long)(newval),(long)(oldval)))
+#   endif
 #elif defined(_MT) && defined(FUDGE_HAS_SYNC_FETCH_AND_ADD)
     // GCC 4.1+ atomic functions
+#   define FUDGE_HAS_ATOMICS 1
 #   define AtomicIncrementAndReturn(var) __sync_add_and_fetch ( &var, 1 )
 #   define AtomicDecrementAndReturn(var) __sync_sub_and_fetch ( &var, 1 )
 #   define AtomicExchangePointer(var, val) __sync_lock_test_and_set ( &var, val )
+#   define AtomicCompareExchangePointer(var, oldval, newval) __sync_val_compare_and_swap ( &var, oldval, newval )
+#   define AtomicAddSize(var, val) __sync_add_and_fetch ( &var, val )
+#   define AtomicCompareExchangeSize(var, oldval, newval) __sync_val_compare_and_swap ( &var, oldval, newval )
+#   if defined(__ATOMIC_ACQUIRE)
+#       define AtomicLoadPointer(var) __atomic_load_n ( &var, __ATOMIC_ACQUIRE )
+#       define AtomicLoadSize(var) __atomic_load_n ( &var, __ATOMIC_ACQUIRE )
+#       define AtomicStorePointer(var, val) __atomic_store_n ( &var, val, __ATOMIC_RELEASE )
+#       define AtomicStoreSize(var, val) __atomic_store_n ( &var, val, __ATOMIC_RELEASE )
+#       define AtomicLoadRelaxed(var) __atomic_load_n ( &var, __ATOMIC_RELAXED )
+#       define AtomicStoreRelaxed(var, val) __atomic_store_n ( &var, val, __ATOMIC_RELAXED )
+#   else
+#       define AtomicLoadPointer(var) __sync_val_compare_and_swap ( &var, 0, 0 )
+#       define AtomicLoadSize(var) __sync_val_compare_and_swap ( &var, 0, 0 )
+#       define AtomicStorePointer(var, val) ( __sync_synchronize ( ), var = ( val ) )
+#       define AtomicStoreSize(var, val) ( __sync_synchronize ( ), var = ( val ) )
+#       define AtomicLoadRelaxed(var) (var)
+#       define AtomicStoreRelaxed(var, val) ( var = ( val ) )
+#   endif
 #else
-    // No multi-threading support - just use standard operations
-    // TODO AtomicExchangePointer generates errors on GCC due to size mismatch
+    // No multi-threading support - just use standard operations. Both of the
+    // pointer operations return the previous value of var, as does the
+    // size_t compare and exchange.
+#   if ! defined(_MT)
+#       define FUDGE_HAS_ATOMICS 1
+#   endif
 #   define AtomicIncrementAndReturn(var) (++var)
 #   define AtomicDecrementAndReturn(var) (--var)
-#   define AtomicExchangePointer(var,val) ((var=val)&&0)
+#   define AtomicExchangePointer(var,val) AtomicExchangePointerImpl((void**)&var,(void*)val)
+#   define AtomicCompareExchangePointer(var,oldval,newval) AtomicCompareExchangePointerImpl((void**)&var,(void*)oldval,(void*)newval)
+#   define AtomicLoadPointer(var) (var)
+#   define AtomicLoadSize(var) (var)
+#   define AtomicStorePointer(var,val) (var=(val))
+#   define AtomicStoreSize(var,val) (var=(val))
+#   define AtomicLoadRelaxed(var) (var)
+#   define AtomicStoreRelaxed(var,val) (var=(val))
+#   define AtomicAddSize(var,val) (var+=(val))
+#   define AtomicCompareExchangeSize(var,oldval,newval) AtomicCompareExchangeSizeImpl((size_t*)&var,oldval,newval)
+
+static inline void * AtomicExchangePointerImpl ( void * * var, void * val )
+{
+    void * previous = *var;
+    *var = val;
+    return previous;
+}
+
+static inline void * AtomicCompareExchangePointerImpl ( void * * var, void * oldval, void * newval )
+{
+    void * previous = *var;
+    if ( previous == oldval )
+        *var = newval;
+    return previous;
+}
+
+static inline size_t AtomicCompareExchangeSizeImpl ( size_t * var, size_t oldval, size_t newval )
+{
+    size_t previous = *var;
+    if ( previous == oldval )
+        *var = newval;
+    return previous;
+}
 #endif
 
 #endif /* ifndef INC_FUDGE_ATOMIC_H */
@@ -16,11 +16,17 @@
 #include "fudge/envelope.h"
 #include "fudge/string.h"
 #include "codec_decode.h"
+#include "compress.h"
 #include "fudge/header.h"
+#include "arena_internal.h"
 #include "memory_internal.h"
+#include "message_internal.h"
 #include "registry_internal.h"
 #include <assert.h>
 
+/* If true, decoded field names are interned */
+static fudge_bool s_internFieldNames = FUDGE_FALSE;
+
 fudge_i32 FudgeCodec_getNumBytes ( const FudgeTypeDesc * typedesc, fudge_i32 width )
 {
     if ( ( typedesc->payload == FUDGE_TYPE_PAYLOAD_BYTES ) || ( typedesc->payload == FUDGE_TYPE_PAYLOAD_STRING ) )
@@ -29,6 +35,44 @@ fudge_i32 FudgeCodec_getNumBytes ( const FudgeTypeDesc * typedesc, fudge_i32 wid
         return 0;
 }
 
+/* Decodes the payload of a field that is being added to a message held in
+   an arena. Submessages, strings and plain byte arrays are built directly in
+   the arena (arenabytes is set for the latter); everything else goes through
+   the type's registered decoder and is moved in to the arena when the field
+   is appended. */
+static FudgeStatus FudgeCodec_decodeFieldInArena ( const FudgeTypeDesc * typedesc,
+                                                   const fudge_byte * bytes,
+                                                   fudge_i32 width,
+                                                   FudgeFieldData * data,
+                                                   FudgeArena arena,
+                                                   fudge_bool * arenabytes )
+{
+    FudgeStatus status;
+
+    if ( typedesc->decoder == FudgeCodec_decodeFieldFudgeMsg )
+    {
+        /* A partially decoded submessage is left for the arena to reclaim */
+        if ( ( status = FudgeMsg_createInArena ( &( data->message ), arena ) ) != FUDGE_OK )
+            return status;
+        return FudgeCodec_decodeMsgFields ( data->message, bytes, width );
+    }
+    else if ( typedesc->decoder == FudgeCodec_decodeFieldString )
+        return FudgeString_createFromUTF8InArena ( &( data->string ), bytes, width, arena );
+    else if ( ! typedesc->decoder || typedesc->decoder == FudgeCodec_decodeFieldByteArray )
+    {
+        if ( width )
+        {
+            if ( ! ( data->bytes = ( fudge_byte * ) FudgeArena_allocate ( arena, width ) ) )
+                return FUDGE_OUT_OF_MEMORY;
+            memcpy ( ( fudge_byte * ) data->bytes, bytes, width );
+        }
+        *arenabytes = FUDGE_TRUE;
+        return FUDGE_OK;
+    }
+    else
+        return typedesc->decoder ( bytes, width, data );
+}
+
 FudgeStatus FudgeCodec_decodeField ( FudgeMsg message, FudgeFieldHeader header, fudge_i32 width, const fudge_byte * bytes, fudge_i32 numbytes )
 {
     FudgeStatus status;
@@ -36,6 +80,8 @@ FudgeStatus FudgeCodec_decodeField ( FudgeMsg message, FudgeFieldHeader header,
     FudgeFieldData data;
     FudgeString name;
     const FudgeTypeDesc * typedesc = FudgeRegistry_getTypeDesc ( header.type );
+    FudgeArena arena = FudgeMsg_getArena ( message );
+    fudge_bool arenabytes = FUDGE_FALSE;
 
     if ( width > numbytes )
         return FUDGE_OUT_OF_BYTES;
@@ -47,30 +93,35 @@ FudgeStatus FudgeCodec_decodeField ( FudgeMsg message, FudgeFieldHeader header,
 
     memset ( &data, 0, sizeof ( data ) );
 
-    if ( ( status = decoder ( bytes, width, &data ) ) != FUDGE_OK )
+    if ( ( status = arena ? FudgeCodec_decodeFieldInArena ( typedesc, bytes, width, &data, arena, &arenabytes )
+                          : decoder ( bytes, width, &data ) ) != FUDGE_OK )
         return status;
 
-    /* Construct the name string if required */
+    /* Construct (or look up) the name string if required */
     if ( header.name )
     {
-        if ( ( status = FudgeString_createFromUTF8 ( &name, header.name, header.namelen ) ) != FUDGE_OK )
+        if ( s_internFieldNames )
+            status = FudgeString_internUTF8 ( &name, header.name, header.namelen );
+        else
+            status = FudgeString_createFromUTF8InArena ( &name, header.name, header.namelen, arena );
+        if ( status != FUDGE_OK )
             return status;
     }
     else
         name = 0;
 
-    status = FudgeMsg_addFieldData ( message,
-                                     header.type,
-                                     name,
-                                     FudgeHeader_getOrdinal ( &header ),
-                                     &data,
-                                     FudgeCodec_getNumBytes ( typedesc, width ) );
+    status = FudgeMsg_appendField ( message,
+                                    header.type,
+                                    name,
+                                    FudgeHeader_getOrdinal ( &header ),
+                                    &data,
+                                    FudgeCodec_getNumBytes ( typedesc, width ),
+                                    arenabytes );
     if ( header.name )
         FudgeString_release ( name );
     return status;
 }
 
-
 FudgeStatus FudgeCodec_decodeMsgFields ( FudgeMsg message, const fudge_byte * bytes, fudge_i32 numbytes )
 {
     FudgeStatus status;
@@ -300,10 +351,17 @@ FudgeStatus FudgeCodec_decodeFieldDateTime ( const fudge_byte * bytes, const fud
  */
 
 FudgeStatus FudgeCodec_decodeMsg ( FudgeMsgEnvelope * envelope, const fudge_byte * bytes, fudge_i32 numbytes )
+{
+    return FudgeCodec_decodeMsgInArena ( envelope, bytes, numbytes, 0 );
+}
+
+FudgeStatus FudgeCodec_decodeMsgInArena ( FudgeMsgEnvelope * envelope, const fudge_byte * bytes, fudge_i32 numbytes, FudgeArena arena )
 {
     FudgeStatus status;
     FudgeMsgHeader header;
     FudgeMsg message;
+    fudge_byte * payload = 0;
+    size_t payloadsize = 0;
 
     if ( ! envelope )
         return FUDGE_NULL_POINTER;
@@ -313,34 +371,73 @@ FudgeStatus FudgeCodec_decodeMsg ( FudgeMsgEnvelope * envelope, const fudge_byte
         return status;
     if ( numbytes < header.numbytes )
         return FUDGE_OUT_OF_BYTES;
-    if ( ( status = FudgeMsg_create ( &message ) ) != FUDGE_OK )
-        return status;
 
-    if ( ( status = FudgeMsgEnvelope_create ( envelope,
-                                              header.directives,
-                                              header.schemaversion,
-                                              header.taxonomy,
-                                              message ) ) != FUDGE_OK )
+    /* Advance to the end of the header */
+    bytes += sizeof ( FudgeMsgHeader );
+    numbytes -= sizeof ( FudgeMsgHeader );
+
+    /* A compressed payload is expanded in to a temporary buffer, which is
+       decoded in place of the original bytes */
+    if ( header.directives & FUDGE_DIRECTIVE_COMPRESSED )
+    {
+        if ( header.numbytes < 12 )
+            return FUDGE_OUT_OF_BYTES;
+        numbytes = FudgeCodec_decodeI32 ( bytes );
+
+        /* The size comes from the sender: check it is possible for the block
+           before allocating anything */
+        if ( numbytes < 0 || numbytes > FudgeCompress_maxDecompressedSize ( header.numbytes - 12 ) )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+        payloadsize = numbytes ? numbytes : 1;
+        if ( ! ( payload = FUDGEMEMORY_MALLOC( fudge_byte *, payloadsize ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        if ( ( status = FudgeCompress_decompress ( bytes + 4, header.numbytes - 12, payload, numbytes ) ) != FUDGE_OK )
+            goto release_payload_and_fail;
+        bytes = payload;
+        header.directives &= ~FUDGE_DIRECTIVE_COMPRESSED;
+    }
+
+    if ( ( status = FudgeMsg_createInArena ( &message, arena ) ) != FUDGE_OK )
+        goto release_payload_and_fail;
+
+    if ( ( status = FudgeMsgEnvelope_createInArena ( envelope,
+                                                     header.directives,
+                                                     header.schemaversion,
+                                                     header.taxonomy,
+                                                     message,
+                                                     arena ) ) != FUDGE_OK )
         goto release_message_and_fail;
 
     /* Envelope now has a message reference */
     FudgeMsg_release ( message );
 
-    /* Advance to the end of the header */
-    bytes += sizeof ( FudgeMsgHeader );
-    numbytes -= sizeof ( FudgeMsgHeader );
-
     /* Consume fields */
     if ( ( status = FudgeCodec_decodeMsgFields ( message, bytes, numbytes ) ) != FUDGE_OK )
         goto release_envelope_and_fail;
 
+    FUDGEMEMORY_FREE( payload, payloadsize );
     return status;
 
 release_envelope_and_fail:
     FudgeMsgEnvelope_release ( *envelope );
+    FUDGEMEMORY_FREE( payload, payloadsize );
+    return status;
 
 release_message_and_fail:
     FudgeMsg_release ( message );
+
+release_payload_and_fail:
+    FUDGEMEMORY_FREE( payload, payloadsize );
     return status;
 }
 
+void FudgeCodec_setInternFieldNames ( fudge_bool intern )
+{
+    s_internFieldNames = intern;
+}
+
+fudge_bool FudgeCodec_getInternFieldNames ( )
+{
+    return s_internFieldNames;
+}
+
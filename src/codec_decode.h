@@ -43,5 +43,9 @@ FudgeStatus FudgeCodec_decodeFieldDate       ( const fudge_byte * bytes, const f
 FudgeStatus FudgeCodec_decodeFieldTime       ( const fudge_byte * bytes, const fudge_i32 width, FudgeFieldData * data );
 FudgeStatus FudgeCodec_decodeFieldDateTime   ( const fudge_byte * bytes, const fudge_i32 width, FudgeFieldData * data );
 
+/* Decodes the fields in the byte array provided, adding them to the
+   message */
+FudgeStatus FudgeCodec_decodeMsgFields ( FudgeMsg message, const fudge_byte * bytes, fudge_i32 numbytes );
+
 #endif
 
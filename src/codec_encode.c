@@ -16,6 +16,7 @@
 #include "fudge/envelope.h"
 #include "fudge/string.h"
 #include "codec_encode.h"
+#include "compress.h"
 #include "fudge/header.h"
 #include "memory_internal.h"
 #include "message_internal.h"
@@ -23,10 +24,8 @@
 #include "registry_internal.h"
 #include <assert.h>
 
-/* The recursive nature of FudgeMsg encoding means these have to be forward
-   declared. */
-FudgeStatus FudgeCodec_getMessageLength ( const FudgeMsg message, fudge_i32 * numbytes );
-FudgeStatus FudgeCodec_encodeMsgFields ( const FudgeMsg message, fudge_byte * * writepos );
+/* Payload size at which messages are compressed, negative if disabled */
+static fudge_i32 s_compressionThreshold = -1;
 
 fudge_byte FudgeCodec_calculateBytesToHoldSize ( fudge_i32 size )
 {
@@ -92,7 +91,10 @@ FudgeStatus FudgeCodec_getMessageLength ( const FudgeMsg message, fudge_i32 * nu
     if ( ! ( message && numbytes ) )
         return FUDGE_NULL_POINTER;
 
-    /* Has the length been cached? */
+    /* Has the length been cached? A cached encoding is checked first, as
+       the width is discarded along with it if it's out of date. */
+    if ( FudgeMsg_getEncodedCache ( message, numbytes ) )
+        return FUDGE_OK;
     if ( ( *numbytes = FudgeMsg_getWidth ( message ) ) >= 0 )
         return FUDGE_OK;
 
@@ -110,47 +112,120 @@ FudgeStatus FudgeCodec_getMessageLength ( const FudgeMsg message, fudge_i32 * nu
     return FUDGE_OK;
 }
 
-FudgeStatus FudgeCodec_populateFieldHeader ( const FudgeField * field, FudgeFieldHeader * header )
+FudgeStatus FudgeCodec_getEnvelopeLength ( const FudgeMsgEnvelope envelope, fudge_i32 * numbytes )
 {
-    if ( ! ( field && header ) )
+    FudgeMsg message;
+    FudgeStatus status;
+
+    if ( ! ( message = FudgeMsgEnvelope_getMessage ( envelope ) ) )
         return FUDGE_NULL_POINTER;
 
-    header->type = field->type;
-    if ( FudgeType_typeIsFixedWidth ( field->type ) )
-        header->widthofwidth = 0;
-    else
-        header->widthofwidth = FudgeCodec_calculateBytesToHoldSize ( FudgeCodec_getFieldDataLength ( field ) );;
+    if ( ( status = FudgeCodec_getMessageLength ( message, numbytes ) ) != FUDGE_OK )
+        return status;
+    *numbytes += 8; // sizeof ( FudgeMsgHeader );
+    return FUDGE_OK;
+}
 
-    header->hasordinal = field->flags & FUDGE_FIELD_HAS_ORDINAL;
-    header->ordinal = header->hasordinal ? field->ordinal : 0;
+void FudgeCodec_encodeEnvelopeHeader ( const FudgeMsgEnvelope envelope, fudge_i32 numbytes, fudge_byte * * writepos )
+{
+    /* The compressed bit is only set once the payload has been compressed */
+    FudgeCodec_encodeByte ( FudgeMsgEnvelope_getDirectives ( envelope ) & ~FUDGE_DIRECTIVE_COMPRESSED, writepos );
+    FudgeCodec_encodeByte ( FudgeMsgEnvelope_getSchemaVersion ( envelope ), writepos );
+    FudgeCodec_encodeI16 ( FudgeMsgEnvelope_getTaxonomy ( envelope ), writepos );
+    FudgeCodec_encodeI32 ( numbytes, writepos );
+}
 
-    if ( field->flags & FUDGE_FIELD_HAS_NAME )
+FudgeStatus FudgeCodec_encodeEnvelope ( const FudgeMsgEnvelope envelope, fudge_i32 numbytes, fudge_byte * * writepos )
+{
+    FudgeStatus status;
+    fudge_byte * start = *writepos;
+
+    /* Write the message envelope, followed by the top-level fields */
+    FudgeCodec_encodeEnvelopeHeader ( envelope, numbytes, writepos );
+    if ( ( status = FudgeCodec_encodeMsgFields ( FudgeMsgEnvelope_getMessage ( envelope ), writepos ) ) != FUDGE_OK )
+        return status;
+
+    /* Ensure that all bytes have been written */
+    if ( *writepos != start + numbytes )
+        return FUDGE_OUT_OF_BYTES;
+    return FUDGE_OK;
+}
+
+void FudgeCodec_compressEnvelope ( fudge_byte * * bytes, fudge_i32 * numbytes )
+{
+    fudge_i32 payloadsize = *numbytes - 8, compressedsize;
+    size_t buffersize;
+    fudge_byte * compressed, * shrunk, * writepos;
+
+    /* Payloads no bigger than the uncompressed size field can't shrink */
+    if ( s_compressionThreshold < 0 || payloadsize < s_compressionThreshold || payloadsize <= 4 )
+        return;
+
+    /* The compressed payload follows the header and the uncompressed size;
+       give up as soon as it can't be smaller than the original. Compression
+       is only an optimisation, so if there's no memory for the buffer the
+       uncompressed envelope is kept. */
+    buffersize = 12 + FudgeCompress_bound ( payloadsize );
+    if ( ! ( compressed = FUDGEMEMORY_MALLOC( fudge_byte *, buffersize ) ) )
+        return;
+    if ( ! ( compressedsize = FudgeCompress_compress ( *bytes + 8, payloadsize, compressed + 12, payloadsize - 5 ) ) )
     {
-        header->namelen = field->name ? ( fudge_i32 ) FudgeString_getSize ( field->name ) : 0;
+        FUDGEMEMORY_FREE( compressed, buffersize );
+        return;
+    }
+    compressedsize += 12;
 
-        /* Allocate the space for the field name: as a NULL pointer indicates
-           no name, allocate a single byte if the field name is NULL (used to
-           indicate a field with a name of zero bytes in length). */
-        if ( ! ( header->name = FUDGEMEMORY_MALLOC( fudge_byte *, field->name ? header->namelen : 1 ) ) )
-            return FUDGE_OUT_OF_MEMORY;
+    /* Trim the buffer so the size returned is also the allocated size (as
+       required by FudgeMemory_freeSized); keep the uncompressed form if
+       that isn't possible */
+    if ( ! ( shrunk = FUDGEMEMORY_REALLOC( fudge_byte *, compressed, buffersize, compressedsize ) ) )
+    {
+        FUDGEMEMORY_FREE( compressed, buffersize );
+        return;
+    }
+    compressed = shrunk;
+
+    /* Copy the header, updating the directives and size */
+    memcpy ( compressed, *bytes, 8 );
+    compressed [ 0 ] |= FUDGE_DIRECTIVE_COMPRESSED;
+    writepos = compressed + 4;
+    FudgeCodec_encodeI32 ( compressedsize, &writepos );
+    FudgeCodec_encodeI32 ( payloadsize, &writepos );
+
+    FUDGEMEMORY_FREE( *bytes, *numbytes );
+    *bytes = compressed;
+    *numbytes = compressedsize;
+}
+
+FudgeStatus FudgeCodec_encodeFieldHeader ( const FudgeField * field, fudge_byte * * writepos )
+{
+    FudgeFieldPrefix prefix;
+
+    if ( ! ( field && writepos && *writepos ) )
+        return FUDGE_NULL_POINTER;
+
+    /* Populate and encode the prefix */
+    prefix.fixedwidth = FudgeType_typeIsFixedWidth ( field->type );
+    prefix.variablewidth = prefix.fixedwidth ? 0 : FudgeCodec_calculateBytesToHoldSize ( FudgeCodec_getFieldDataLength ( field ) );
+    prefix.ordinal = ( field->flags & FUDGE_FIELD_HAS_ORDINAL ) != 0;
+    prefix.name = ( field->flags & FUDGE_FIELD_HAS_NAME ) != 0;
+
+    FudgeCodec_encodeByte ( FudgePrefix_encodeFieldPrefix ( prefix ), writepos );
 
+    /* Encode the rest of the header. The name is written straight from the
+       field's string: a NULL name is encoded as a zero length name. */
+    FudgeCodec_encodeByte ( field->type, writepos );
+    if ( prefix.ordinal )
+        FudgeCodec_encodeI16 ( field->ordinal, writepos );
+    if ( prefix.name )
+    {
         if ( field->name )
-        {
-            /* Field name is non-null, copy it across in to the header */
-            memcpy ( header->name, FudgeString_getData ( field->name ), header->namelen );
-        }
+            FudgeCodec_encodeByteArray ( FudgeString_getData ( field->name ),
+                                         ( fudge_i32 ) FudgeString_getSize ( field->name ),
+                                         FUDGE_FALSE,
+                                         writepos );
         else
-        {
-            /* Field name is null, set the placeholder byte to be NULL and
-               indicate the true length of the name in the length field */
-            *( header->name ) = 0;
-        }
-    }
-    else
-    {
-        /* No name: zero the fields to indicate this */
-        header->name = 0;
-        header->namelen = 0;
+            FudgeCodec_encodeByte ( 0, writepos );
     }
 
     return FUDGE_OK;
@@ -158,21 +233,17 @@ FudgeStatus FudgeCodec_populateFieldHeader ( const FudgeField * field, FudgeFiel
 
 FudgeStatus FudgeCodec_encodeField ( const FudgeField * field, fudge_byte * * writepos )
 {
-    FudgeFieldHeader header;
     FudgeStatus status;
     FudgeTypeEncoder encoder;
-    const FudgeTypeDesc * typedesc = FudgeRegistry_getTypeDesc ( field->type );
+    const FudgeTypeDesc * typedesc;
 
     if ( ! field || ! writepos || ! *writepos )
         return FUDGE_NULL_POINTER;
 
-    /* Populate and encode the header */
-    if ( ( status = FudgeCodec_populateFieldHeader ( field, &header ) ) != FUDGE_OK )
-        return status;
-    status = FudgeHeader_encodeFieldHeader ( &header, writepos );
-    FudgeHeader_destroyFieldHeader ( header );
-    if ( status != FUDGE_OK )
+    /* Encode the header directly from the field */
+    if ( ( status = FudgeCodec_encodeFieldHeader ( field, writepos ) ) != FUDGE_OK )
         return status;
+    typedesc = FudgeRegistry_getTypeDesc ( field->type );
 
     /* If available for this type, use the registered encoder. Failing that,
        treat it as an array of bytes. */
@@ -187,10 +258,22 @@ FudgeStatus FudgeCodec_encodeMsgFields ( const FudgeMsg message, fudge_byte * *
     FudgeStatus status;
     FudgeField field;
     unsigned long index, numfields;
+    const fudge_byte * cached;
+    fudge_byte * start;
+    fudge_i32 numbytes;
 
     if ( ! writepos || ! writepos || ! *writepos )
         return FUDGE_NULL_POINTER;
 
+    /* If the message has a cached encoding, simply copy that */
+    if ( ( cached = FudgeMsg_getEncodedCache ( message, &numbytes ) ) )
+    {
+        memcpy ( *writepos, cached, numbytes );
+        *writepos += numbytes;
+        return FUDGE_OK;
+    }
+
+    start = *writepos;
     for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
         if ( ( status = FudgeMsg_getFieldAtIndex ( &field, message, index ) ) != FUDGE_OK )
             return status;
@@ -198,6 +281,9 @@ FudgeStatus FudgeCodec_encodeMsgFields ( const FudgeMsg message, fudge_byte * *
             if ( ( status = FudgeCodec_encodeField ( &field, writepos ) ) != FUDGE_OK )
                 return status;
 
+    /* Keep a copy of the encoding, if the message wants one. The cache is
+       only an optimisation, so failing to store it doesn't fail the encode. */
+    FudgeMsg_setEncodedCache ( message, start, ( fudge_i32 ) ( *writepos - start ) );
     return FUDGE_OK;
 }
 
@@ -294,52 +380,135 @@ FudgeStatus FudgeCodec_encodeFieldDateTime  ( const FudgeField * field, fudge_by
  * Functions from fudge/codec.h
  */
 
-FudgeStatus FudgeCodec_encodeMsg ( FudgeMsgEnvelope envelope, fudge_byte * * bytes, fudge_i32 * numbytes )
+FudgeStatus FudgeCodec_encodeUncompressedMsg ( const FudgeMsgEnvelope envelope, fudge_byte * * bytes, fudge_i32 * numbytes )
 {
-    FudgeMsg message;
     FudgeStatus status;
     fudge_byte * writepos;
 
     if ( ! ( bytes && numbytes && envelope ) )
         return FUDGE_NULL_POINTER;
 
-    if ( ! ( message = FudgeMsgEnvelope_getMessage ( envelope ) ) )
-        return FUDGE_NULL_POINTER;
-
     /* Get the length of the message, plus the envelope header */
-    if ( ( status = FudgeCodec_getMessageLength ( message, numbytes ) ) != FUDGE_OK )
+    if ( ( status = FudgeCodec_getEnvelopeLength ( envelope, numbytes ) ) != FUDGE_OK )
         return status;
-    *numbytes += 8; // sizeof ( FudgeMsgHeader );
 
     /* Allocate the space required for the encoded message */
     if ( ! ( *bytes = FUDGEMEMORY_MALLOC( fudge_byte *,  *numbytes ) ) )
         return FUDGE_OUT_OF_MEMORY;
 
-    /* Write the message envelope */
     writepos = *bytes;
-    FudgeCodec_encodeByte ( FudgeMsgEnvelope_getDirectives ( envelope ), &writepos );
-    FudgeCodec_encodeByte ( FudgeMsgEnvelope_getSchemaVersion ( envelope ), &writepos );
-    FudgeCodec_encodeI16 ( FudgeMsgEnvelope_getTaxonomy ( envelope ), &writepos );
-    FudgeCodec_encodeI32 ( *numbytes, &writepos );
+    if ( ( status = FudgeCodec_encodeEnvelope ( envelope, *numbytes, &writepos ) ) != FUDGE_OK )
+        FUDGEMEMORY_FREE( *bytes, *numbytes );
+    return status;
+}
 
-    /* Write the top-level fields */
-    if ( ( status = FudgeCodec_encodeMsgFields ( message, &writepos ) ) != FUDGE_OK )
-        goto release_bytes_and_fail;
+FudgeStatus FudgeCodec_encodeMsg ( FudgeMsgEnvelope envelope, fudge_byte * * bytes, fudge_i32 * numbytes )
+{
+    FudgeStatus status;
 
-    /* Ensure that all bytes have been written */
-    if ( writepos != *bytes + *numbytes )
+    if ( ( status = FudgeCodec_encodeUncompressedMsg ( envelope, bytes, numbytes ) ) != FUDGE_OK )
+        return status;
+    FudgeCodec_compressEnvelope ( bytes, numbytes );
+    return FUDGE_OK;
+}
+
+void FudgeCodec_setCompressionThreshold ( fudge_i32 threshold )
+{
+    s_compressionThreshold = threshold;
+}
+
+fudge_i32 FudgeCodec_getCompressionThreshold ( )
+{
+    return s_compressionThreshold;
+}
+
+/* Sizes every envelope in the batch, setting numbytes to the total and (if
+   provided) filling in the offset of each envelope */
+FudgeStatus FudgeCodec_getBatchLength ( const FudgeMsgEnvelope * envelopes, size_t numenvelopes, size_t * numbytes, size_t * offsets )
+{
+    FudgeStatus status;
+    fudge_i32 envelopebytes;
+    size_t index;
+
+    for ( index = 0, *numbytes = 0; index < numenvelopes; ++index )
     {
-        status = FUDGE_OUT_OF_BYTES;
-        goto release_bytes_and_fail;
+        if ( ! envelopes [ index ] )
+            return FUDGE_NULL_POINTER;
+        if ( ( status = FudgeCodec_getEnvelopeLength ( envelopes [ index ], &envelopebytes ) ) != FUDGE_OK )
+            return status;
+        if ( offsets )
+            offsets [ index ] = *numbytes;
+        *numbytes += envelopebytes;
     }
+    return FUDGE_OK;
+}
 
-    return status;
+/* Writes every envelope in the batch, one after the other. The lengths
+   calculated by FudgeCodec_getBatchLength are cached in the messages, so
+   they aren't recalculated here. */
+FudgeStatus FudgeCodec_encodeBatchEnvelopes ( const FudgeMsgEnvelope * envelopes, size_t numenvelopes, fudge_byte * writepos )
+{
+    FudgeStatus status;
+    fudge_i32 envelopebytes;
+    size_t index;
+
+    for ( index = 0; index < numenvelopes; ++index )
+    {
+        if ( ( status = FudgeCodec_getEnvelopeLength ( envelopes [ index ], &envelopebytes ) ) != FUDGE_OK )
+            return status;
+        if ( ( status = FudgeCodec_encodeEnvelope ( envelopes [ index ], envelopebytes, &writepos ) ) != FUDGE_OK )
+            return status;
+    }
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeCodec_encodeBatch ( const FudgeMsgEnvelope * envelopes,
+                                     size_t numenvelopes,
+                                     fudge_byte * * bytes,
+                                     size_t * numbytes,
+                                     size_t * offsets )
+{
+    FudgeStatus status;
+
+    if ( ! ( ( envelopes || ! numenvelopes ) && bytes && numbytes ) )
+        return FUDGE_NULL_POINTER;
+
+    if ( ( status = FudgeCodec_getBatchLength ( envelopes, numenvelopes, numbytes, offsets ) ) != FUDGE_OK )
+        return status;
+
+    if ( ! *numbytes )
+    {
+        *bytes = 0;
+        return FUDGE_OK;
+    }
+    if ( ! ( *bytes = FUDGEMEMORY_MALLOC( fudge_byte *, *numbytes ) ) )
+        return FUDGE_OUT_OF_MEMORY;
 
-release_bytes_and_fail:
-    FUDGEMEMORY_FREE( *bytes );
+    if ( ( status = FudgeCodec_encodeBatchEnvelopes ( envelopes, numenvelopes, *bytes ) ) != FUDGE_OK )
+        FUDGEMEMORY_FREE( *bytes, *numbytes );
     return status;
 }
 
+FudgeStatus FudgeCodec_encodeBatchToBuffer ( const FudgeMsgEnvelope * envelopes,
+                                             size_t numenvelopes,
+                                             fudge_byte * buffer,
+                                             size_t buffersize,
+                                             size_t * numbytes,
+                                             size_t * offsets )
+{
+    FudgeStatus status;
+
+    if ( ! ( ( envelopes || ! numenvelopes ) && ( buffer || ! buffersize ) && numbytes ) )
+        return FUDGE_NULL_POINTER;
+
+    if ( ( status = FudgeCodec_getBatchLength ( envelopes, numenvelopes, numbytes, offsets ) ) != FUDGE_OK )
+        return status;
+    if ( *numbytes > buffersize )
+        return FUDGE_OUT_OF_BYTES;
+
+    return FudgeCodec_encodeBatchEnvelopes ( envelopes, numenvelopes, buffer );
+}
+
 /*****************************************************************************
  * Functions from fudge/codec_ex.h
  */
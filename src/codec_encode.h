@@ -18,6 +18,51 @@
 
 #include "fudge/codec.h"
 
+/* Returns the number of bytes used to hold a variable width field's width */
+fudge_byte FudgeCodec_calculateBytesToHoldSize ( fudge_i32 size );
+
+/* Returns the encoded length of the field's data, excluding the header */
+fudge_i32 FudgeCodec_getFieldDataLength ( const FudgeField * field );
+
+/* Returns the encoded length of the field, including the header */
+fudge_i32 FudgeCodec_getFieldLength ( const FudgeField * field );
+
+/* Sets numbytes to the encoded length of the message's fields (excluding any
+   envelope header). The result is cached in the message. */
+FudgeStatus FudgeCodec_getMessageLength ( const FudgeMsg message, fudge_i32 * numbytes );
+
+/* Sets numbytes to the encoded length of the envelope, including the header.
+   The message length is cached, as with FudgeCodec_getMessageLength. */
+FudgeStatus FudgeCodec_getEnvelopeLength ( const FudgeMsgEnvelope envelope, fudge_i32 * numbytes );
+
+/* Writes the envelope header, using the total encoded length provided */
+void FudgeCodec_encodeEnvelopeHeader ( const FudgeMsgEnvelope envelope, fudge_i32 numbytes, fudge_byte * * writepos );
+
+/* Writes the complete envelope: header followed by the message fields. The
+   length provided must be that returned by FudgeCodec_getEnvelopeLength. */
+FudgeStatus FudgeCodec_encodeEnvelope ( const FudgeMsgEnvelope envelope, fudge_i32 numbytes, fudge_byte * * writepos );
+
+/* Encodes the envelope in to a newly allocated buffer, as FudgeCodec_encodeMsg
+   does but without ever compressing it. Used by callers that work with the
+   layout of the encoded fields. */
+FudgeStatus FudgeCodec_encodeUncompressedMsg ( const FudgeMsgEnvelope envelope, fudge_byte * * bytes, fudge_i32 * numbytes );
+
+/* If compression is enabled and the payload of the encoded envelope is large
+   enough, replaces the bytes with the compressed form of the envelope. The
+   bytes are left unchanged if compression would not make them smaller, or if
+   there is not enough memory to compress them. */
+void FudgeCodec_compressEnvelope ( fudge_byte * * bytes, fudge_i32 * numbytes );
+
+/* Encodes all of the message's fields (excluding any envelope header) */
+FudgeStatus FudgeCodec_encodeMsgFields ( const FudgeMsg message, fudge_byte * * writepos );
+
+/* Writes the field header (prefix, type, ordinal and name) directly from the
+   field; the name bytes are taken from the field's string without copying */
+FudgeStatus FudgeCodec_encodeFieldHeader ( const FudgeField * field, fudge_byte * * writepos );
+
+/* Writes the complete field: header followed by the data */
+FudgeStatus FudgeCodec_encodeField ( const FudgeField * field, fudge_byte * * writepos );
+
 /* Registry compatible field data encoding functions: writes only the data,
    not the field header */
 FudgeStatus FudgeCodec_encodeFieldIndicator ( const FudgeField * field, fudge_byte * * data );
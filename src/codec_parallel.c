@@ -0,0 +1,303 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "fudge/codec.h"
+#include "fudge/envelope.h"
+#include "atomic.h"
+#include "codec_encode.h"
+#include "memory_internal.h"
+#include "message_internal.h"
+
+/* Parallel encoding needs both threads and an atomic counter for workers to
+   claim tasks with; without them the serial encoder is used */
+#if defined(_MT) && defined(FUDGE_HAS_PTHREADS) && defined(FUDGE_HAS_ATOMICS)
+#   define FUDGECODEC_PARALLEL 1
+#   include <pthread.h>
+#endif
+
+#ifdef FUDGECODEC_PARALLEL
+
+/* Regions smaller than this aren't worth handing to another thread */
+#define FUDGECODEC_MIN_TASK_BYTES 65536
+
+/* No more threads than this are used for one message */
+#define FUDGECODEC_MAX_THREADS 64
+
+/* A run of fields from a single message, encoded in to the output starting
+   at the offset provided */
+typedef struct
+{
+    FudgeMsg message;
+    unsigned long first;
+    unsigned long last;
+    size_t offset;
+    FudgeStatus status;         /* Written only by the thread that ran the task */
+} FudgeEncodeTask;
+
+typedef struct
+{
+    fudge_byte * buffer;
+    fudge_i32 tasksize;
+    FudgeEncodeTask * tasks;
+    size_t numtasks;
+    size_t maxtasks;
+    volatile int next;
+} FudgeEncodePlan;
+
+/* Populates the encoded cache of every submessage that has caching enabled.
+   This would otherwise happen during encoding, at which point two workers
+   could be writing the cache of a message that appears in the tree twice. */
+FudgeStatus FudgeCodec_primeEncodedCaches ( const FudgeMsg message )
+{
+    FudgeStatus status;
+    FudgeField field;
+    unsigned long index, numfields;
+    fudge_i32 numbytes;
+    fudge_byte * bytes, * writepos;
+
+    for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
+    {
+        if ( ( status = FudgeMsg_getFieldAtIndex ( &field, message, index ) ) != FUDGE_OK )
+            return status;
+        if ( field.type != FUDGE_TYPE_FUDGE_MSG )
+            continue;
+
+        /* Cached messages are encoded as a whole, so there's no need to
+           descend in to them */
+        if ( ! FudgeMsg_isEncodingCached ( field.data.message ) )
+            status = FudgeCodec_primeEncodedCaches ( field.data.message );
+        else if ( FudgeMsg_getEncodedCache ( field.data.message, &numbytes ) )
+            continue;
+        else
+        {
+            if ( ( status = FudgeCodec_getMessageLength ( field.data.message, &numbytes ) ) != FUDGE_OK )
+                return status;
+            if ( ! ( bytes = FUDGEMEMORY_MALLOC( fudge_byte *, numbytes ? numbytes : 1 ) ) )
+                return FUDGE_OUT_OF_MEMORY;
+
+            writepos = bytes;
+            status = FudgeCodec_encodeMsgFields ( field.data.message, &writepos );
+            FUDGEMEMORY_FREE( bytes, numbytes ? numbytes : 1 );
+        }
+
+        if ( status != FUDGE_OK )
+            return status;
+    }
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeCodec_addTask ( FudgeEncodePlan * plan, const FudgeMsg message, unsigned long first, unsigned long last, size_t offset )
+{
+    FudgeEncodeTask * task;
+
+    if ( plan->numtasks == plan->maxtasks )
+    {
+        size_t maxtasks = plan->maxtasks ? plan->maxtasks * 2 : 32;
+        FudgeEncodeTask * tasks;
+
+        if ( ! ( tasks = FUDGEMEMORY_REALLOC( FudgeEncodeTask *, plan->tasks, plan->maxtasks * sizeof ( FudgeEncodeTask ), maxtasks * sizeof ( FudgeEncodeTask ) ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        plan->tasks = tasks;
+        plan->maxtasks = maxtasks;
+    }
+
+    task = plan->tasks + plan->numtasks++;
+    task->message = message;
+    task->first = first;
+    task->last = last;
+    task->offset = offset;
+    task->status = FUDGE_OK;
+    return FUDGE_OK;
+}
+
+/* Splits the message's fields (which start at offset) in to tasks of
+   roughly plan->tasksize bytes. Submessages larger than that have their
+   header written immediately and their contents split in turn. */
+FudgeStatus FudgeCodec_planFields ( FudgeEncodePlan * plan, const FudgeMsg message, size_t offset )
+{
+    FudgeStatus status;
+    FudgeField field;
+    unsigned long index, numfields, first = 0;
+    size_t start = offset;
+    fudge_i32 length, cachedsize;
+    fudge_byte * writepos;
+
+    for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
+    {
+        if ( ( status = FudgeMsg_getFieldAtIndex ( &field, message, index ) ) != FUDGE_OK )
+            return status;
+        length = FudgeCodec_getFieldLength ( &field );
+
+        if ( field.type == FUDGE_TYPE_FUDGE_MSG &&
+             length > plan->tasksize &&
+             ! FudgeMsg_getEncodedCache ( field.data.message, &cachedsize ) )
+        {
+            if ( index > first && ( status = FudgeCodec_addTask ( plan, message, first, index, start ) ) != FUDGE_OK )
+                return status;
+
+            writepos = plan->buffer + offset;
+            if ( ( status = FudgeCodec_encodeFieldHeader ( &field, &writepos ) ) != FUDGE_OK )
+                return status;
+            FudgeCodec_encodeFieldLength ( FudgeCodec_getFieldDataLength ( &field ), &writepos );
+
+            if ( ( status = FudgeCodec_planFields ( plan, field.data.message, writepos - plan->buffer ) ) != FUDGE_OK )
+                return status;
+
+            first = index + 1;
+            start = offset + length;
+        }
+        else if ( offset + length - start >= ( size_t ) plan->tasksize )
+        {
+            if ( ( status = FudgeCodec_addTask ( plan, message, first, index + 1, start ) ) != FUDGE_OK )
+                return status;
+
+            first = index + 1;
+            start = offset + length;
+        }
+
+        offset += length;
+    }
+
+    if ( numfields > first )
+        return FudgeCodec_addTask ( plan, message, first, numfields, start );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeCodec_runTask ( const FudgeEncodePlan * plan, const FudgeEncodeTask * task )
+{
+    FudgeStatus status;
+    FudgeField field;
+    unsigned long index;
+    fudge_byte * writepos = plan->buffer + task->offset;
+
+    for ( index = task->first; index < task->last; ++index )
+    {
+        if ( ( status = FudgeMsg_getFieldAtIndex ( &field, task->message, index ) ) != FUDGE_OK )
+            return status;
+        if ( ( status = FudgeCodec_encodeField ( &field, &writepos ) ) != FUDGE_OK )
+            return status;
+    }
+    return FUDGE_OK;
+}
+
+/* Claims and runs tasks until there are none left. Run by each of the worker
+   threads and by the calling thread. */
+void * FudgeCodec_encodeWorker ( void * context )
+{
+    FudgeEncodePlan * plan = ( FudgeEncodePlan * ) context;
+    int index;
+
+    while ( ( index = AtomicIncrementAndReturn ( plan->next ) - 1 ) < ( int ) plan->numtasks )
+        plan->tasks [ index ].status = FudgeCodec_runTask ( plan, plan->tasks + index );
+    return 0;
+}
+
+#endif /* ifdef FUDGECODEC_PARALLEL */
+
+FudgeStatus FudgeCodec_encodeMsgParallel ( FudgeMsgEnvelope envelope, unsigned int numthreads, fudge_byte * * bytes, fudge_i32 * numbytes )
+{
+#ifdef FUDGECODEC_PARALLEL
+    FudgeStatus status;
+    FudgeEncodePlan plan;
+    FudgeMsg message;
+    pthread_t * threads = 0;
+    unsigned int index, numstarted = 0;
+    fudge_byte * writepos;
+    fudge_i32 cachedsize;
+
+    if ( ! ( bytes && numbytes && envelope ) )
+        return FUDGE_NULL_POINTER;
+    if ( ! ( message = FudgeMsgEnvelope_getMessage ( envelope ) ) )
+        return FUDGE_NULL_POINTER;
+
+    /* A message with a cached encoding is just a copy */
+    if ( numthreads < 2 || FudgeMsg_getEncodedCache ( message, &cachedsize ) )
+        return FudgeCodec_encodeMsg ( envelope, bytes, numbytes );
+
+    /* Calculate (and cache) every width and encoded cache up front: after
+       this the message tree is only read, so it can be shared by the
+       workers */
+    if ( ( status = FudgeCodec_getEnvelopeLength ( envelope, numbytes ) ) != FUDGE_OK )
+        return status;
+    if ( *numbytes < 2 * FUDGECODEC_MIN_TASK_BYTES )
+        return FudgeCodec_encodeMsg ( envelope, bytes, numbytes );
+    if ( ( status = FudgeCodec_primeEncodedCaches ( message ) ) != FUDGE_OK )
+        return status;
+
+    if ( ! ( *bytes = FUDGEMEMORY_MALLOC( fudge_byte *, *numbytes ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    /* Aim for several tasks per thread, so they finish at around the same
+       time even if the tasks vary in cost */
+    if ( numthreads > FUDGECODEC_MAX_THREADS )
+        numthreads = FUDGECODEC_MAX_THREADS;
+    plan.buffer = *bytes;
+    plan.tasksize = *numbytes / ( fudge_i32 ) ( numthreads * 4 );
+    if ( plan.tasksize < FUDGECODEC_MIN_TASK_BYTES )
+        plan.tasksize = FUDGECODEC_MIN_TASK_BYTES;
+    plan.tasks = 0;
+    plan.numtasks = plan.maxtasks = 0;
+    plan.next = 0;
+
+    writepos = *bytes;
+    FudgeCodec_encodeEnvelopeHeader ( envelope, *numbytes, &writepos );
+    if ( ( status = FudgeCodec_planFields ( &plan, message, writepos - *bytes ) ) != FUDGE_OK )
+        goto release_plan_and_fail;
+
+    /* Start the workers and join in. There's no point in having more
+       threads than tasks. If a thread can't be started, the threads that
+       are running take on its share of the work. */
+    if ( numthreads > plan.numtasks )
+        numthreads = ( unsigned int ) plan.numtasks;
+    if ( numthreads > 1 )
+    {
+        if ( ! ( threads = FUDGEMEMORY_MALLOC( pthread_t *, ( numthreads - 1 ) * sizeof ( pthread_t ) ) ) )
+        {
+            status = FUDGE_OUT_OF_MEMORY;
+            goto release_plan_and_fail;
+        }
+        for ( ; numstarted < numthreads - 1; ++numstarted )
+            if ( pthread_create ( threads + numstarted, 0, FudgeCodec_encodeWorker, &plan ) )
+                break;
+    }
+
+    FudgeCodec_encodeWorker ( &plan );
+    if ( numthreads > 1 )
+    {
+        for ( index = 0; index < numstarted; ++index )
+            pthread_join ( threads [ index ], 0 );
+        FUDGEMEMORY_FREE( threads, ( numthreads - 1 ) * sizeof ( pthread_t ) );
+    }
+
+    /* Report the failure of the earliest task, whichever thread ran it */
+    for ( index = 0; index < plan.numtasks; ++index )
+        if ( ( status = plan.tasks [ index ].status ) != FUDGE_OK )
+            goto release_plan_and_fail;
+    FUDGEMEMORY_FREE( plan.tasks, plan.maxtasks * sizeof ( FudgeEncodeTask ) );
+
+    /* Store the encoding if the message has opted in to caching; as with
+       the serial encoder, a failure to do so doesn't fail the encode */
+    FudgeMsg_setEncodedCache ( message, *bytes + 8, *numbytes - 8 );
+    FudgeCodec_compressEnvelope ( bytes, numbytes );
+    return FUDGE_OK;
+
+release_plan_and_fail:
+    FUDGEMEMORY_FREE( plan.tasks, plan.maxtasks * sizeof ( FudgeEncodeTask ) );
+    FUDGEMEMORY_FREE( *bytes, *numbytes );
+    return status;
+#else /* ifdef FUDGECODEC_PARALLEL */
+    return FudgeCodec_encodeMsg ( envelope, bytes, numbytes );
+#endif /* ifdef FUDGECODEC_PARALLEL */
+}
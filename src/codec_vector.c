@@ -0,0 +1,253 @@
+/**
+ * Copyright (C) 2026 - 2026, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "fudge/envelope.h"
+#include "fudge/string.h"
+#include "codec_encode.h"
+#include "memory_internal.h"
+#include "message_internal.h"
+#include "registry_internal.h"
+
+/* State used while encoding a message in to a vector: the descriptors
+   written so far and the start of the current (not yet added) run of scratch
+   bytes. */
+typedef struct
+{
+    fudge_i32 threshold;
+    FudgeIOVec * vectors;
+    size_t numvectors;
+    fudge_byte * segment;
+    fudge_byte * writepos;
+} FudgeVectorWriter;
+
+/* Precedes the descriptors in the block returned by
+   FudgeCodec_encodeMsgVector, recording the size of the whole block so that
+   FudgeCodec_freeVector can pass it back to the memory manager. The union
+   keeps the descriptors that follow correctly aligned. */
+typedef union
+{
+    size_t blocksize;
+    FudgeIOVec alignment;
+} FudgeVectorHeader;
+
+/* Returns the payload of the field if it can be referenced in place, NULL
+   otherwise. Only strings and byte arrays whose registered encoder copies
+   the payload unchanged qualify: anything else (such as the other array
+   types, which are byte-swapped) is left to the encoder. */
+static const fudge_byte * FudgeCodec_getReferencePayload ( const FudgeField * field, fudge_i32 threshold, fudge_i32 * numbytes )
+{
+    const FudgeTypeDesc * typedesc = FudgeRegistry_getTypeDesc ( field->type );
+    FudgeTypeEncoder encoder = typedesc->encoder ? typedesc->encoder : FudgeCodec_encodeFieldByteArray;
+    const fudge_byte * payload;
+
+    if ( typedesc->payload == FUDGE_TYPE_PAYLOAD_STRING && encoder == FudgeCodec_encodeFieldString )
+        payload = field->data.string ? FudgeString_getData ( field->data.string ) : 0;
+    else if ( typedesc->payload == FUDGE_TYPE_PAYLOAD_BYTES && encoder == FudgeCodec_encodeFieldByteArray )
+        payload = field->data.bytes;
+    else
+        return 0;
+
+    *numbytes = FudgeCodec_getFieldDataLength ( field );
+    return payload && *numbytes > 0 && *numbytes >= threshold ? payload : 0;
+}
+
+/* Walks the message tree, totalling up the number and size of the payloads
+   that will be referenced in place */
+static FudgeStatus FudgeCodec_measureReferences ( const FudgeMsg message, fudge_i32 threshold, fudge_i32 * numbytes, size_t * numreferences )
+{
+    FudgeStatus status;
+    FudgeField field;
+    fudge_i32 payloadsize;
+    unsigned long index, numfields;
+
+    for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
+    {
+        if ( ( status = FudgeMsg_getFieldAtIndex ( &field, message, index ) ) != FUDGE_OK )
+            return status;
+
+        if ( field.type == FUDGE_TYPE_FUDGE_MSG )
+        {
+            /* Submessages with a cached encoding are not descended in to:
+               the cache is either referenced or copied as a whole */
+            if ( FudgeMsg_getEncodedCache ( field.data.message, &payloadsize ) )
+            {
+                if ( payloadsize > 0 && payloadsize >= threshold )
+                {
+                    *numbytes += payloadsize;
+                    ++( *numreferences );
+                }
+            }
+            else if ( ( status = FudgeCodec_measureReferences ( field.data.message, threshold, numbytes, numreferences ) ) != FUDGE_OK )
+                return status;
+        }
+        else if ( FudgeCodec_getReferencePayload ( &field, threshold, &payloadsize ) )
+        {
+            *numbytes += payloadsize;
+            ++( *numreferences );
+        }
+    }
+    return FUDGE_OK;
+}
+
+static void FudgeVectorWriter_append ( FudgeVectorWriter * writer, const fudge_byte * bytes, size_t numbytes )
+{
+    writer->vectors [ writer->numvectors ].iov_base = ( void * ) bytes;
+    writer->vectors [ writer->numvectors ].iov_len = numbytes;
+    ++( writer->numvectors );
+}
+
+/* Adds any scratch bytes written since the end of the previous segment */
+static void FudgeVectorWriter_closeSegment ( FudgeVectorWriter * writer )
+{
+    if ( writer->writepos > writer->segment )
+        FudgeVectorWriter_append ( writer, writer->segment, writer->writepos - writer->segment );
+    writer->segment = writer->writepos;
+}
+
+static FudgeStatus FudgeVectorWriter_encodeFields ( FudgeVectorWriter * writer, const FudgeMsg message )
+{
+    FudgeStatus status;
+    FudgeField field;
+    const fudge_byte * payload;
+    fudge_i32 payloadsize;
+    unsigned long index, numfields;
+
+    for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
+    {
+        if ( ( status = FudgeMsg_getFieldAtIndex ( &field, message, index ) ) != FUDGE_OK )
+            return status;
+
+        if ( field.type == FUDGE_TYPE_FUDGE_MSG )
+        {
+            if ( ( status = FudgeCodec_encodeFieldHeader ( &field, &( writer->writepos ) ) ) != FUDGE_OK )
+                return status;
+            FudgeCodec_encodeFieldLength ( FudgeCodec_getFieldDataLength ( &field ), &( writer->writepos ) );
+
+            /* A large enough cached encoding can be referenced directly.
+               Otherwise descend in to the submessage (rather than using the
+               registered encoder) as it may contain referenced payloads. */
+            if ( ( payload = FudgeMsg_getEncodedCache ( field.data.message, &payloadsize ) ) && payloadsize > 0 && payloadsize >= writer->threshold )
+            {
+                FudgeVectorWriter_closeSegment ( writer );
+                FudgeVectorWriter_append ( writer, payload, payloadsize );
+            }
+            else if ( payload )
+            {
+                if ( ( status = FudgeCodec_encodeMsgFields ( field.data.message, &( writer->writepos ) ) ) != FUDGE_OK )
+                    return status;
+            }
+            else if ( ( status = FudgeVectorWriter_encodeFields ( writer, field.data.message ) ) != FUDGE_OK )
+                return status;
+        }
+        else if ( ( payload = FudgeCodec_getReferencePayload ( &field, writer->threshold, &payloadsize ) ) )
+        {
+            /* Header and width go in to the scratch buffer, the payload is
+               referenced from the field */
+            if ( ( status = FudgeCodec_encodeFieldHeader ( &field, &( writer->writepos ) ) ) != FUDGE_OK )
+                return status;
+            if ( ! FudgeType_typeIsFixedWidth ( field.type ) )
+                FudgeCodec_encodeFieldLength ( payloadsize, &( writer->writepos ) );
+            FudgeVectorWriter_closeSegment ( writer );
+            FudgeVectorWriter_append ( writer, payload, payloadsize );
+        }
+        else if ( ( status = FudgeCodec_encodeField ( &field, &( writer->writepos ) ) ) != FUDGE_OK )
+            return status;
+    }
+    return FUDGE_OK;
+}
+
+/*****************************************************************************
+ * Functions from fudge/codec.h
+ */
+
+FudgeStatus FudgeCodec_encodeMsgVector ( FudgeMsgEnvelope envelope,
+                                         fudge_i32 threshold,
+                                         FudgeIOVec * * vectors,
+                                         size_t * numvectors,
+                                         fudge_i32 * numbytes )
+{
+    FudgeStatus status;
+    FudgeMsg message;
+    FudgeVectorWriter writer;
+    FudgeVectorHeader * header;
+    fudge_i32 referencedbytes = 0, scratchbytes;
+    size_t numreferences = 0, maxvectors, blocksize;
+    fudge_byte * scratch;
+
+    if ( ! ( envelope && vectors && numvectors && numbytes ) )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! ( message = FudgeMsgEnvelope_getMessage ( envelope ) ) )
+        return FUDGE_NULL_POINTER;
+
+    /* Get the length of the message, plus the envelope header */
+    if ( ( status = FudgeCodec_getEnvelopeLength ( envelope, numbytes ) ) != FUDGE_OK )
+        return status;
+
+    /* Work out how much of that will be referenced in place: everything else
+       goes in to the scratch buffer. Each reference can split the scratch
+       buffer, so there are at most two descriptors per reference, plus one. */
+    if ( ( status = FudgeCodec_measureReferences ( message, threshold, &referencedbytes, &numreferences ) ) != FUDGE_OK )
+        return status;
+    scratchbytes = *numbytes - referencedbytes;
+    maxvectors = numreferences * 2 + 1;
+
+    /* The header, descriptors and scratch buffer share a single allocation */
+    blocksize = sizeof ( FudgeVectorHeader ) + maxvectors * sizeof ( FudgeIOVec ) + scratchbytes;
+    if ( ! ( header = FUDGEMEMORY_MALLOC( FudgeVectorHeader *, blocksize ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    header->blocksize = blocksize;
+    *vectors = ( FudgeIOVec * ) ( header + 1 );
+    scratch = ( fudge_byte * ) ( *vectors + maxvectors );
+
+    writer.threshold = threshold;
+    writer.vectors = *vectors;
+    writer.numvectors = 0;
+    writer.segment = writer.writepos = scratch;
+
+    /* Write the message envelope */
+    FudgeCodec_encodeEnvelopeHeader ( envelope, *numbytes, &( writer.writepos ) );
+
+    /* Write the fields and add any trailing scratch bytes */
+    if ( ( status = FudgeVectorWriter_encodeFields ( &writer, message ) ) != FUDGE_OK )
+        goto release_vectors_and_fail;
+    FudgeVectorWriter_closeSegment ( &writer );
+
+    /* Ensure that all of the scratch bytes have been written */
+    if ( writer.writepos != scratch + scratchbytes )
+    {
+        status = FUDGE_OUT_OF_BYTES;
+        goto release_vectors_and_fail;
+    }
+
+    *numvectors = writer.numvectors;
+    return FUDGE_OK;
+
+release_vectors_and_fail:
+    FUDGEMEMORY_FREE( header, blocksize );
+    *vectors = 0;
+    return status;
+}
+
+void FudgeCodec_freeVector ( FudgeIOVec * vectors )
+{
+    FudgeVectorHeader * header;
+
+    if ( vectors )
+    {
+        header = ( ( FudgeVectorHeader * ) vectors ) - 1;
+        FUDGEMEMORY_FREE( header, header->blocksize );
+    }
+}
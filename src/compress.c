@@ -0,0 +1,245 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "compress.h"
+
+#ifdef FUDGE_HAS_LZ4
+
+#include <lz4.h>
+
+fudge_i32 FudgeCompress_bound ( fudge_i32 numbytes )
+{
+    return LZ4_compressBound ( numbytes );
+}
+
+fudge_i32 FudgeCompress_compress ( const fudge_byte * source, fudge_i32 sourcesize, fudge_byte * target, fudge_i32 targetsize )
+{
+    return LZ4_compress_default ( ( const char * ) source, ( char * ) target, sourcesize, targetsize );
+}
+
+FudgeStatus FudgeCompress_decompress ( const fudge_byte * source, fudge_i32 sourcesize, fudge_byte * target, fudge_i32 targetsize )
+{
+    return LZ4_decompress_safe ( ( const char * ) source, ( char * ) target, sourcesize, targetsize ) == targetsize
+        ? FUDGE_OK
+        : FUDGE_INVALID_COMPRESSED_PAYLOAD;
+}
+
+#else /* ifdef FUDGE_HAS_LZ4 */
+
+/* Limits imposed by the block format: a match is at least four bytes long and
+   no more than 64K bytes back, the last five bytes are always literals and
+   the last match must start at least twelve bytes before the end */
+#define FUDGECOMPRESS_MIN_MATCH     4
+#define FUDGECOMPRESS_MAX_DISTANCE  65535
+#define FUDGECOMPRESS_LAST_LITERALS 5
+#define FUDGECOMPRESS_MF_LIMIT      12
+
+/* Size of the match finder's hash table (as a power of two) */
+#define FUDGECOMPRESS_HASH_BITS     12
+
+typedef uint8_t fudge_ubyte;
+
+uint32_t FudgeCompress_read32 ( const fudge_ubyte * bytes )
+{
+    uint32_t value;
+    memcpy ( &value, bytes, sizeof ( value ) );
+    return value;
+}
+
+uint32_t FudgeCompress_hash ( uint32_t sequence )
+{
+    return ( sequence * 2654435761U ) >> ( 32 - FUDGECOMPRESS_HASH_BITS );
+}
+
+/* Writes the 255 valued continuation bytes used for lengths of fifteen or
+   more. The caller has already checked there is room. */
+void FudgeCompress_writeLength ( fudge_i32 length, fudge_ubyte * * writepos )
+{
+    for ( length -= 15; length >= 255; length -= 255 )
+        *( *writepos )++ = 255;
+    *( *writepos )++ = ( fudge_ubyte ) length;
+}
+
+/* Writes a sequence: the literals followed by a match. A matchlength of zero
+   is used for the final sequence, which has no match. Returns FUDGE_FALSE if
+   the sequence will not fit in the space remaining. */
+fudge_bool FudgeCompress_writeSequence ( const fudge_ubyte * literals,
+                                         fudge_i32 numliterals,
+                                         fudge_i32 offset,
+                                         fudge_i32 matchlength,
+                                         fudge_ubyte * * writepos,
+                                         const fudge_ubyte * end )
+{
+    fudge_i32 required = 1 + numliterals + ( numliterals >= 15 ? 1 + ( numliterals - 15 ) / 255 : 0 );
+    fudge_ubyte token;
+
+    if ( matchlength )
+    {
+        matchlength -= FUDGECOMPRESS_MIN_MATCH;
+        required += 2 + ( matchlength >= 15 ? 1 + ( matchlength - 15 ) / 255 : 0 );
+    }
+    if ( end - *writepos < required )
+        return FUDGE_FALSE;
+
+    token = ( fudge_ubyte ) ( ( numliterals < 15 ? numliterals : 15 ) << 4 );
+    if ( offset )
+        token |= ( fudge_ubyte ) ( matchlength < 15 ? matchlength : 15 );
+    *( *writepos )++ = token;
+    if ( numliterals >= 15 )
+        FudgeCompress_writeLength ( numliterals, writepos );
+    memcpy ( *writepos, literals, numliterals );
+    *writepos += numliterals;
+
+    if ( offset )
+    {
+        /* Offsets are little endian */
+        *( *writepos )++ = ( fudge_ubyte ) ( offset & 0xff );
+        *( *writepos )++ = ( fudge_ubyte ) ( offset >> 8 );
+        if ( matchlength >= 15 )
+            FudgeCompress_writeLength ( matchlength, writepos );
+    }
+    return FUDGE_TRUE;
+}
+
+/* Reads the continuation bytes of a length, adding them to length. Returns
+   FUDGE_FALSE if the source runs out or the length exceeds limit. */
+fudge_bool FudgeCompress_readLength ( fudge_i32 * length, fudge_i32 limit, const fudge_ubyte * * readpos, const fudge_ubyte * end )
+{
+    fudge_ubyte byte;
+
+    do
+    {
+        if ( *readpos == end )
+            return FUDGE_FALSE;
+        byte = *( *readpos )++;
+        *length += byte;
+        if ( *length > limit )
+            return FUDGE_FALSE;
+    } while ( byte == 255 );
+    return FUDGE_TRUE;
+}
+
+fudge_i32 FudgeCompress_bound ( fudge_i32 numbytes )
+{
+    return numbytes + numbytes / 255 + 16;
+}
+
+fudge_i32 FudgeCompress_compress ( const fudge_byte * source, fudge_i32 sourcesize, fudge_byte * target, fudge_i32 targetsize )
+{
+    fudge_i32 table [ 1 << FUDGECOMPRESS_HASH_BITS ];
+    const fudge_ubyte * bytes = ( const fudge_ubyte * ) source;
+    fudge_ubyte * writepos = ( fudge_ubyte * ) target;
+    const fudge_ubyte * end = writepos + targetsize;
+    fudge_i32 position = 0, anchor = 0, candidate, matchlength;
+    uint32_t sequence, hash;
+
+    /* Blocks too short to hold a match are written as a single literal run */
+    if ( sourcesize > FUDGECOMPRESS_MF_LIMIT )
+    {
+        memset ( table, 0, sizeof ( table ) );
+
+        for ( ; position + FUDGECOMPRESS_MF_LIMIT < sourcesize; )
+        {
+            /* Look up the last position with the same hash and check that it
+               is a real (and reachable) match */
+            sequence = FudgeCompress_read32 ( bytes + position );
+            hash = FudgeCompress_hash ( sequence );
+            candidate = table [ hash ];
+            table [ hash ] = position;
+
+            if ( candidate >= position ||
+                 position - candidate > FUDGECOMPRESS_MAX_DISTANCE ||
+                 FudgeCompress_read32 ( bytes + candidate ) != sequence )
+            {
+                ++position;
+                continue;
+            }
+
+            matchlength = FUDGECOMPRESS_MIN_MATCH;
+            while ( position + matchlength < sourcesize - FUDGECOMPRESS_LAST_LITERALS &&
+                    bytes [ candidate + matchlength ] == bytes [ position + matchlength ] )
+                ++matchlength;
+
+            if ( ! FudgeCompress_writeSequence ( bytes + anchor, position - anchor, position - candidate, matchlength, &writepos, end ) )
+                return 0;
+            position += matchlength;
+            anchor = position;
+        }
+    }
+
+    if ( ! FudgeCompress_writeSequence ( bytes + anchor, sourcesize - anchor, 0, 0, &writepos, end ) )
+        return 0;
+    return ( fudge_i32 ) ( writepos - ( fudge_ubyte * ) target );
+}
+
+FudgeStatus FudgeCompress_decompress ( const fudge_byte * source, fudge_i32 sourcesize, fudge_byte * target, fudge_i32 targetsize )
+{
+    const fudge_ubyte * readpos = ( const fudge_ubyte * ) source;
+    const fudge_ubyte * end = readpos + sourcesize;
+    fudge_ubyte * start = ( fudge_ubyte * ) target;
+    fudge_ubyte * writepos = start;
+    fudge_i32 numliterals, offset, matchlength;
+    fudge_ubyte token;
+
+    while ( readpos < end )
+    {
+        token = *readpos++;
+
+        /* Copy the literals */
+        numliterals = token >> 4;
+        if ( numliterals == 15 && ! FudgeCompress_readLength ( &numliterals, targetsize, &readpos, end ) )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+        if ( numliterals > end - readpos || numliterals > targetsize - ( writepos - start ) )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+        memcpy ( writepos, readpos, numliterals );
+        readpos += numliterals;
+        writepos += numliterals;
+
+        /* The final sequence has no match */
+        if ( readpos == end )
+            break;
+
+        if ( end - readpos < 2 )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+        offset = readpos [ 0 ] | ( readpos [ 1 ] << 8 );
+        readpos += 2;
+        if ( offset == 0 || offset > writepos - start )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+
+        matchlength = token & 15;
+        if ( matchlength == 15 && ! FudgeCompress_readLength ( &matchlength, targetsize, &readpos, end ) )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+        matchlength += FUDGECOMPRESS_MIN_MATCH;
+        if ( matchlength > targetsize - ( writepos - start ) )
+            return FUDGE_INVALID_COMPRESSED_PAYLOAD;
+
+        /* The match may overlap the bytes it produces, so copy byte by byte */
+        for ( ; matchlength; --matchlength, ++writepos )
+            *writepos = *( writepos - offset );
+    }
+
+    return writepos - start == targetsize ? FUDGE_OK : FUDGE_INVALID_COMPRESSED_PAYLOAD;
+}
+
+#endif /* ifdef FUDGE_HAS_LZ4 */
+
+fudge_i32 FudgeCompress_maxDecompressedSize ( fudge_i32 compressedsize )
+{
+    /* A block byte expands to at most 255 bytes (a length extension byte),
+       plus the literals and minimum match of the final sequence */
+    if ( compressedsize > ( 0x7fffffff - 16 ) / 255 )
+        return 0x7fffffff;
+    return compressedsize * 255 + 16;
+}
@@ -0,0 +1,43 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_COMPRESS_H
+#define INC_FUDGE_COMPRESS_H
+
+#include "fudge/status.h"
+#include "fudge/types.h"
+
+/* Block compression used for compressed envelope payloads. The blocks use
+   the LZ4 block format: the LZ4 library is used if it was available at build
+   time, otherwise the in-tree implementation. Either can decompress blocks
+   produced by the other. */
+
+/* Returns the largest size the compressed form of numbytes bytes can be */
+fudge_i32 FudgeCompress_bound ( fudge_i32 numbytes );
+
+/* Compresses the source bytes in to the target, returning the number of
+   bytes written or zero if the target is too small to hold them */
+fudge_i32 FudgeCompress_compress ( const fudge_byte * source, fudge_i32 sourcesize, fudge_byte * target, fudge_i32 targetsize );
+
+/* Decompresses the source block in to the target, which must be exactly the
+   size of the uncompressed data. Returns FUDGE_INVALID_COMPRESSED_PAYLOAD if
+   the block is malformed or does not decompress to targetsize bytes. */
+FudgeStatus FudgeCompress_decompress ( const fudge_byte * source, fudge_i32 sourcesize, fudge_byte * target, fudge_i32 targetsize );
+
+/* Returns the largest size a block of compressedsize bytes can decompress
+   to. Used to reject a claimed uncompressed size before allocating for it. */
+fudge_i32 FudgeCompress_maxDecompressedSize ( fudge_i32 compressedsize );
+
+#endif
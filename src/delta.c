@@ -0,0 +1,408 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "fudge/delta.h"
+#include "codec_encode.h"
+#include "memory_internal.h"
+#include "registry_internal.h"
+#include <string.h>
+
+/* Retrieves all of the message's fields in to a newly allocated array, which
+   the caller must free. Empty messages result in a NULL array. */
+FudgeStatus FudgeDelta_getFields ( FudgeField * * fields, fudge_i32 * numfields, const FudgeMsg message )
+{
+    *numfields = ( fudge_i32 ) FudgeMsg_numFields ( message );
+    if ( ! *numfields )
+    {
+        *fields = 0;
+        return FUDGE_OK;
+    }
+
+    if ( ! ( *fields = FUDGEMEMORY_MALLOC( FudgeField *, *numfields * sizeof ( FudgeField ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    FudgeMsg_getFields ( *fields, *numfields, message );
+    return FUDGE_OK;
+}
+
+fudge_bool FudgeDelta_hasKey ( const FudgeField * field )
+{
+    return ( field->flags & ( FUDGE_FIELD_HAS_NAME | FUDGE_FIELD_HAS_ORDINAL ) ) != 0;
+}
+
+fudge_bool FudgeDelta_keysEqual ( const FudgeField * left, const FudgeField * right )
+{
+    if ( ( left->flags & FUDGE_FIELD_HAS_ORDINAL ) != ( right->flags & FUDGE_FIELD_HAS_ORDINAL ) ||
+         ( left->flags & FUDGE_FIELD_HAS_NAME ) != ( right->flags & FUDGE_FIELD_HAS_NAME ) )
+        return FUDGE_FALSE;
+
+    if ( ( left->flags & FUDGE_FIELD_HAS_ORDINAL ) && left->ordinal != right->ordinal )
+        return FUDGE_FALSE;
+
+    if ( left->flags & FUDGE_FIELD_HAS_NAME )
+        return FudgeString_equals ( left->name, right->name );
+    return FUDGE_TRUE;
+}
+
+/* Returns true if every field has a key and no two fields share one */
+fudge_bool FudgeDelta_keysUnique ( const FudgeField * fields, fudge_i32 numfields )
+{
+    fudge_i32 outer, inner;
+
+    for ( outer = 0; outer < numfields; ++outer )
+    {
+        if ( ! FudgeDelta_hasKey ( fields + outer ) )
+            return FUDGE_FALSE;
+        for ( inner = outer + 1; inner < numfields; ++inner )
+            if ( FudgeDelta_keysEqual ( fields + outer, fields + inner ) )
+                return FUDGE_FALSE;
+    }
+    return FUDGE_TRUE;
+}
+
+fudge_bool FudgeDelta_messagesEqual ( const FudgeMsg left, const FudgeMsg right );
+
+fudge_bool FudgeDelta_valuesEqual ( const FudgeField * left, const FudgeField * right )
+{
+    const FudgeTypeDesc * typedesc;
+    fudge_byte leftbytes [ 16 ], rightbytes [ 16 ], * leftpos, * rightpos;
+
+    if ( left->type != right->type )
+        return FUDGE_FALSE;
+
+    typedesc = FudgeRegistry_getTypeDesc ( left->type );
+    switch ( typedesc->payload )
+    {
+        case FUDGE_TYPE_PAYLOAD_STRING:
+            return FudgeString_equals ( left->data.string, right->data.string );
+
+        case FUDGE_TYPE_PAYLOAD_SUBMSG:
+            return FudgeDelta_messagesEqual ( left->data.message, right->data.message );
+
+        case FUDGE_TYPE_PAYLOAD_BYTES:
+            return left->numbytes == right->numbytes &&
+                   ( ! left->numbytes || memcmp ( left->data.bytes, right->data.bytes, left->numbytes ) == 0 );
+
+        default:
+            /* Compare the encoded forms of local types: this avoids any
+               padding within the value and treats floating point values as
+               equal only if they are bitwise identical */
+            if ( ! typedesc->encoder || typedesc->fixedwidth < 0 || typedesc->fixedwidth > ( fudge_i32 ) sizeof ( leftbytes ) )
+                return FUDGE_FALSE;
+            leftpos = leftbytes;
+            rightpos = rightbytes;
+            if ( typedesc->encoder ( left, &leftpos ) != FUDGE_OK || typedesc->encoder ( right, &rightpos ) != FUDGE_OK )
+                return FUDGE_FALSE;
+            return memcmp ( leftbytes, rightbytes, typedesc->fixedwidth ) == 0;
+    }
+}
+
+fudge_bool FudgeDelta_messagesEqual ( const FudgeMsg left, const FudgeMsg right )
+{
+    unsigned long index, numfields;
+    FudgeField leftfield, rightfield;
+
+    if ( left == right )
+        return FUDGE_TRUE;
+    if ( ( numfields = FudgeMsg_numFields ( left ) ) != FudgeMsg_numFields ( right ) )
+        return FUDGE_FALSE;
+
+    for ( index = 0; index < numfields; ++index )
+    {
+        FudgeMsg_getFieldAtIndex ( &leftfield, left, index );
+        FudgeMsg_getFieldAtIndex ( &rightfield, right, index );
+        if ( ! ( FudgeDelta_keysEqual ( &leftfield, &rightfield ) && FudgeDelta_valuesEqual ( &leftfield, &rightfield ) ) )
+            return FUDGE_FALSE;
+    }
+    return FUDGE_TRUE;
+}
+
+/* Adds a copy of the field to the message. Strings and submessages are
+   shared by reference, byte arrays are copied. */
+FudgeStatus FudgeDelta_addFieldCopy ( FudgeMsg message, const FudgeField * field )
+{
+    FudgeFieldData data;
+    FudgeString name = field->flags & FUDGE_FIELD_HAS_NAME ? field->name : 0;
+    const fudge_i16 * ordinal = field->flags & FUDGE_FIELD_HAS_ORDINAL ? &( field->ordinal ) : 0;
+
+    switch ( FudgeRegistry_getTypeDesc ( field->type )->payload )
+    {
+        case FUDGE_TYPE_PAYLOAD_STRING:
+            return FudgeMsg_addFieldString ( message, name, ordinal, field->data.string );
+
+        case FUDGE_TYPE_PAYLOAD_SUBMSG:
+            return FudgeMsg_addFieldMsg ( message, name, ordinal, field->data.message );
+
+        case FUDGE_TYPE_PAYLOAD_BYTES:
+            return FudgeMsg_addFieldOpaque ( message, field->type, name, ordinal, field->data.bytes, field->numbytes );
+
+        default:
+            data = field->data;
+            return FudgeMsg_addFieldData ( message, field->type, name, ordinal, &data, field->numbytes );
+    }
+}
+
+/* Creates a patch that replaces the baseline with the target outright */
+FudgeStatus FudgeDelta_createReplace ( FudgeMsg * patch, const FudgeMsg target )
+{
+    FudgeStatus status;
+    fudge_i16 ordinal = FUDGEDELTA_REPLACE_ORDINAL;
+
+    if ( ( status = FudgeMsg_create ( patch ) ) != FUDGE_OK )
+        return status;
+    if ( ( status = FudgeMsg_addFieldMsg ( *patch, 0, &ordinal, target ) ) != FUDGE_OK )
+        FudgeMsg_release ( *patch );
+    return status;
+}
+
+/* Adds the submessage to the patch (if it has been created) and releases
+   the local reference to it */
+FudgeStatus FudgeDelta_addSection ( FudgeMsg patch, FudgeMsg section, fudge_i16 ordinal )
+{
+    FudgeStatus status;
+
+    if ( ! section )
+        return FUDGE_OK;
+    status = FudgeMsg_addFieldMsg ( patch, 0, &ordinal, section );
+    FudgeMsg_release ( section );
+    return status;
+}
+
+FudgeStatus FudgeDelta_create ( FudgeMsg * patch, const FudgeMsg baseline, const FudgeMsg target )
+{
+    FudgeStatus status;
+    FudgeField * basefields, * targetfields;
+    fudge_i32 numbase, numtarget, index, inner, lastmatch, * matches = 0, patchsize, targetsize;
+    fudge_bool * removed = 0;
+    FudgeMsg set = 0, remove = 0;
+
+    if ( ! ( patch && baseline && target ) )
+        return FUDGE_NULL_POINTER;
+
+    if ( ( status = FudgeDelta_getFields ( &basefields, &numbase, baseline ) ) != FUDGE_OK )
+        return status;
+    if ( ( status = FudgeDelta_getFields ( &targetfields, &numtarget, target ) ) != FUDGE_OK )
+        goto free_base_and_fail;
+
+    if ( ! ( FudgeDelta_keysUnique ( basefields, numbase ) && FudgeDelta_keysUnique ( targetfields, numtarget ) ) )
+        goto replace;
+
+    /* Match each target field with its baseline equivalent (if any). The
+       matched fields must be in baseline order, with any new fields after
+       them, for the patch to reproduce the target's field order. */
+    if ( ! ( matches = FUDGEMEMORY_MALLOC( fudge_i32 *, ( numtarget + 1 ) * sizeof ( fudge_i32 ) ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto free_target_and_fail;
+    }
+    if ( ! ( removed = FUDGEMEMORY_MALLOC( fudge_bool *, ( numbase + 1 ) * sizeof ( fudge_bool ) ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto free_matches;
+    }
+    for ( inner = 0; inner < numbase; ++inner )
+        removed [ inner ] = FUDGE_TRUE;
+
+    for ( index = 0, lastmatch = -1; index < numtarget; ++index )
+    {
+        for ( matches [ index ] = -1, inner = 0; inner < numbase; ++inner )
+        {
+            if ( FudgeDelta_keysEqual ( targetfields + index, basefields + inner ) )
+            {
+                matches [ index ] = inner;
+                break;
+            }
+        }
+
+        if ( matches [ index ] >= 0 )
+        {
+            if ( lastmatch == numbase || matches [ index ] < lastmatch )
+                goto replace;
+            removed [ matches [ index ] ] = FUDGE_FALSE;
+            lastmatch = matches [ index ];
+        }
+        else
+            lastmatch = numbase;
+    }
+
+    /* Collect the new and changed fields, followed by the removed ones */
+    for ( index = 0; index < numtarget; ++index )
+    {
+        if ( matches [ index ] >= 0 && FudgeDelta_valuesEqual ( targetfields + index, basefields + matches [ index ] ) )
+            continue;
+        if ( ! set && ( status = FudgeMsg_create ( &set ) ) != FUDGE_OK )
+            goto release_sections_and_fail;
+        if ( ( status = FudgeDelta_addFieldCopy ( set, targetfields + index ) ) != FUDGE_OK )
+            goto release_sections_and_fail;
+    }
+    for ( inner = 0; inner < numbase; ++inner )
+    {
+        if ( ! removed [ inner ] )
+            continue;
+        if ( ! remove && ( status = FudgeMsg_create ( &remove ) ) != FUDGE_OK )
+            goto release_sections_and_fail;
+        if ( ( status = FudgeMsg_addFieldIndicator ( remove,
+                                                     basefields [ inner ].flags & FUDGE_FIELD_HAS_NAME ? basefields [ inner ].name : 0,
+                                                     basefields [ inner ].flags & FUDGE_FIELD_HAS_ORDINAL ? &( basefields [ inner ].ordinal ) : 0 ) ) != FUDGE_OK )
+            goto release_sections_and_fail;
+    }
+
+    if ( ( status = FudgeMsg_create ( patch ) ) != FUDGE_OK )
+        goto release_sections_and_fail;
+    status = FudgeDelta_addSection ( *patch, set, FUDGEDELTA_SET_ORDINAL );
+    set = 0;
+    if ( status == FUDGE_OK )
+        status = FudgeDelta_addSection ( *patch, remove, FUDGEDELTA_REMOVE_ORDINAL );
+    remove = 0;
+    if ( status != FUDGE_OK )
+        goto release_patch_and_fail;
+
+    /* A delta can be larger than the target if most of the fields have
+       changed: send the target instead */
+    if ( ( status = FudgeCodec_getMessageLength ( *patch, &patchsize ) ) != FUDGE_OK ||
+         ( status = FudgeCodec_getMessageLength ( target, &targetsize ) ) != FUDGE_OK )
+        goto release_patch_and_fail;
+    if ( patchsize > targetsize )
+    {
+        FudgeMsg_release ( *patch );
+        goto replace;
+    }
+
+    FUDGEMEMORY_FREE( removed, ( numbase + 1 ) * sizeof ( fudge_bool ) );
+    FUDGEMEMORY_FREE( matches, ( numtarget + 1 ) * sizeof ( fudge_i32 ) );
+    FUDGEMEMORY_FREE( targetfields, numtarget * sizeof ( FudgeField ) );
+    FUDGEMEMORY_FREE( basefields, numbase * sizeof ( FudgeField ) );
+    return FUDGE_OK;
+
+replace:
+    status = FudgeDelta_createReplace ( patch, target );
+    goto free_matches;
+
+release_patch_and_fail:
+    FudgeMsg_release ( *patch );
+release_sections_and_fail:
+    if ( set )
+        FudgeMsg_release ( set );
+    if ( remove )
+        FudgeMsg_release ( remove );
+free_matches:
+    if ( removed )
+        FUDGEMEMORY_FREE( removed, ( numbase + 1 ) * sizeof ( fudge_bool ) );
+    FUDGEMEMORY_FREE( matches, ( numtarget + 1 ) * sizeof ( fudge_i32 ) );
+free_target_and_fail:
+    FUDGEMEMORY_FREE( targetfields, numtarget * sizeof ( FudgeField ) );
+free_base_and_fail:
+    FUDGEMEMORY_FREE( basefields, numbase * sizeof ( FudgeField ) );
+    return status;
+}
+
+/* Retrieves the fields of the patch submessage with the ordinal provided.
+   A missing submessage results in no fields. */
+FudgeStatus FudgeDelta_getSection ( FudgeField * * fields, fudge_i32 * numfields, fudge_bool * present, const FudgeMsg patch, fudge_i16 ordinal )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    *fields = 0;
+    *numfields = 0;
+    *present = FUDGE_FALSE;
+
+    if ( ( status = FudgeMsg_getFieldByOrdinal ( &field, patch, ordinal ) ) != FUDGE_OK )
+        return status == FUDGE_INVALID_ORDINAL ? FUDGE_OK : status;
+    if ( field.type != FUDGE_TYPE_FUDGE_MSG )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    *present = FUDGE_TRUE;
+    return FudgeDelta_getFields ( fields, numfields, field.data.message );
+}
+
+FudgeStatus FudgeDelta_apply ( FudgeMsg * result, const FudgeMsg baseline, const FudgeMsg patch )
+{
+    FudgeStatus status;
+    FudgeField * basefields = 0, * setfields = 0, * removefields = 0, * replacefields = 0;
+    fudge_i32 numbase = 0, numset = 0, numremove = 0, numreplace, index, inner;
+    fudge_bool * applied = 0, replace, present;
+
+    if ( ! ( result && baseline && patch ) )
+        return FUDGE_NULL_POINTER;
+
+    if ( ( status = FudgeDelta_getSection ( &replacefields, &numreplace, &replace, patch, FUDGEDELTA_REPLACE_ORDINAL ) ) != FUDGE_OK )
+        return status;
+    if ( ( status = FudgeMsg_create ( result ) ) != FUDGE_OK )
+        goto free_fields;
+
+    /* A replacement patch holds the entire result */
+    if ( replace )
+    {
+        for ( index = 0; index < numreplace; ++index )
+            if ( ( status = FudgeDelta_addFieldCopy ( *result, replacefields + index ) ) != FUDGE_OK )
+                goto release_result_and_fail;
+        goto free_fields;
+    }
+
+    if ( ( status = FudgeDelta_getSection ( &setfields, &numset, &present, patch, FUDGEDELTA_SET_ORDINAL ) ) != FUDGE_OK ||
+         ( status = FudgeDelta_getSection ( &removefields, &numremove, &present, patch, FUDGEDELTA_REMOVE_ORDINAL ) ) != FUDGE_OK ||
+         ( status = FudgeDelta_getFields ( &basefields, &numbase, baseline ) ) != FUDGE_OK )
+        goto release_result_and_fail;
+
+    if ( numset && ! ( applied = FUDGEMEMORY_MALLOC( fudge_bool *, numset * sizeof ( fudge_bool ) ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto release_result_and_fail;
+    }
+    for ( inner = 0; inner < numset; ++inner )
+        applied [ inner ] = FUDGE_FALSE;
+
+    /* Changed fields take the place of their baseline equivalents */
+    for ( index = 0; index < numbase; ++index )
+    {
+        const FudgeField * source = basefields + index;
+
+        for ( inner = 0; inner < numremove; ++inner )
+            if ( FudgeDelta_keysEqual ( source, removefields + inner ) )
+                break;
+        if ( inner < numremove )
+            continue;
+
+        for ( inner = 0; inner < numset; ++inner )
+        {
+            if ( ! applied [ inner ] && FudgeDelta_keysEqual ( source, setfields + inner ) )
+            {
+                applied [ inner ] = FUDGE_TRUE;
+                source = setfields + inner;
+                break;
+            }
+        }
+
+        if ( ( status = FudgeDelta_addFieldCopy ( *result, source ) ) != FUDGE_OK )
+            goto release_result_and_fail;
+    }
+
+    /* Any remaining fields are new */
+    for ( inner = 0; inner < numset; ++inner )
+        if ( ! applied [ inner ] && ( status = FudgeDelta_addFieldCopy ( *result, setfields + inner ) ) != FUDGE_OK )
+            goto release_result_and_fail;
+
+    goto free_fields;
+
+release_result_and_fail:
+    FudgeMsg_release ( *result );
+free_fields:
+    FUDGEMEMORY_FREE( applied, numset * sizeof ( fudge_bool ) );
+    FUDGEMEMORY_FREE( basefields, numbase * sizeof ( FudgeField ) );
+    FUDGEMEMORY_FREE( removefields, numremove * sizeof ( FudgeField ) );
+    FUDGEMEMORY_FREE( setfields, numset * sizeof ( FudgeField ) );
+    FUDGEMEMORY_FREE( replacefields, numreplace * sizeof ( FudgeField ) );
+    return status;
+}
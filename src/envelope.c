@@ -17,8 +17,11 @@
 #define _FUDGEMSGENVELOPEIMPL_DEFINED 1
 #include "fudge/envelope.h"
 #include "fudge/message.h"
+#include "arena_internal.h"
 #include "memory_internal.h"
+#include "message_internal.h"
 #include "reference.h"
+#include <stddef.h>
 
 struct FudgeMsgEnvelopeImpl
 {
@@ -27,6 +30,10 @@ struct FudgeMsgEnvelopeImpl
     fudge_byte schemaversion;
     fudge_i16 taxonomy;
     FudgeMsg message;
+
+    /* Envelopes in an arena have no reference count. If the message isn't
+       in an arena its reference is released by the cleanup. */
+    FudgeArenaCleanup cleanup;
 };
 
 FudgeStatus FudgeMsgEnvelope_create ( FudgeMsgEnvelope * envelopeptr,
@@ -39,6 +46,7 @@ FudgeStatus FudgeMsgEnvelope_create ( FudgeMsgEnvelope * envelopeptr,
 
     if ( ! ( *envelopeptr = FUDGEMEMORY_MALLOC( FudgeMsgEnvelope, sizeof ( struct FudgeMsgEnvelopeImpl ) ) ) )
         return FUDGE_OUT_OF_MEMORY;
+    FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_ENVELOPES, sizeof ( struct FudgeMsgEnvelopeImpl ) );
 
     if ( ( status = FudgeRefCount_create ( &( ( *envelopeptr )->refcount ) ) ) != FUDGE_OK )
         goto release_and_fail;
@@ -54,16 +62,57 @@ FudgeStatus FudgeMsgEnvelope_create ( FudgeMsgEnvelope * envelopeptr,
     return FUDGE_OK;
 
 release_and_fail:
-    FUDGEMEMORY_FREE( *envelopeptr );
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_ENVELOPES, sizeof ( struct FudgeMsgEnvelopeImpl ) );
+    FUDGEMEMORY_FREE( *envelopeptr, sizeof ( struct FudgeMsgEnvelopeImpl ) );
     return status;
 }
 
+void FudgeMsgEnvelope_releaseExternal ( FudgeArenaCleanup * cleanup )
+{
+    FudgeMsgEnvelope envelope = ( FudgeMsgEnvelope ) ( ( fudge_byte * ) cleanup - offsetof ( struct FudgeMsgEnvelopeImpl, cleanup ) );
+    FudgeMsg_release ( envelope->message );
+}
+
+FudgeStatus FudgeMsgEnvelope_createInArena ( FudgeMsgEnvelope * envelopeptr,
+                                          fudge_byte directives,
+                                          fudge_byte schemaversion,
+                                          fudge_i16 taxonomy,
+                                          FudgeMsg message,
+                                          FudgeArena arena )
+{
+    FudgeStatus status;
+
+    if ( ! arena )
+        return FudgeMsgEnvelope_create ( envelopeptr, directives, schemaversion, taxonomy, message );
+
+    if ( ! envelopeptr )
+        return FUDGE_NULL_POINTER;
+    if ( ! ( *envelopeptr = ( FudgeMsgEnvelope ) FudgeArena_allocate ( arena, sizeof ( struct FudgeMsgEnvelopeImpl ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    if ( ( status = FudgeMsg_retain ( message ) ) != FUDGE_OK )
+        return status;
+
+    ( *envelopeptr )->refcount = 0;
+    ( *envelopeptr )->directives = directives;
+    ( *envelopeptr )->schemaversion = schemaversion;
+    ( *envelopeptr )->taxonomy = taxonomy;
+    ( *envelopeptr )->message = message;
+
+    if ( ! FudgeMsg_getArena ( message ) )
+    {
+        ( *envelopeptr )->cleanup.run = FudgeMsgEnvelope_releaseExternal;
+        FudgeArena_addCleanup ( arena, &( ( *envelopeptr )->cleanup ) );
+    }
+    return FUDGE_OK;
+}
+
 FudgeStatus FudgeMsgEnvelope_retain ( FudgeMsgEnvelope envelope )
 {
     if ( ! envelope )
         return FUDGE_NULL_POINTER;
 
-    FudgeRefCount_increment ( envelope->refcount );
+    if ( envelope->refcount )
+        FudgeRefCount_increment ( envelope->refcount );
     return FUDGE_OK;
 }
 
@@ -72,7 +121,7 @@ FudgeStatus FudgeMsgEnvelope_release ( FudgeMsgEnvelope envelope )
     if ( ! envelope )
         return FUDGE_NULL_POINTER;
 
-    if ( ! FudgeRefCount_decrementAndReturn ( envelope->refcount ) )
+    if ( envelope->refcount && ! FudgeRefCount_decrementAndReturn ( envelope->refcount ) )
     {
         /* Last reference has been released - release the message and destroy the envelope */
         FudgeStatus status;
@@ -83,11 +132,22 @@ FudgeStatus FudgeMsgEnvelope_release ( FudgeMsgEnvelope envelope )
         if ( ( status = FudgeRefCount_destroy ( envelope->refcount ) ) != FUDGE_OK )
             return status;
 
-        FUDGEMEMORY_FREE( envelope );
+        FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_ENVELOPES, sizeof ( struct FudgeMsgEnvelopeImpl ) );
+        FUDGEMEMORY_FREE( envelope, sizeof ( struct FudgeMsgEnvelopeImpl ) );
     }
     return FUDGE_OK;
 }
 
+FudgeStatus FudgeMsgEnvelope_share ( FudgeMsgEnvelope envelope )
+{
+    if ( ! envelope )
+        return FUDGE_NULL_POINTER;
+
+    if ( envelope->refcount )
+        FudgeRefCount_share ( envelope->refcount );
+    return FudgeMsg_share ( envelope->message );
+}
+
 fudge_byte FudgeMsgEnvelope_getDirectives ( const FudgeMsgEnvelope envelope )
 {
     return envelope ? envelope->directives : 0;
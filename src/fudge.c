@@ -30,3 +30,10 @@ FudgeStatus Fudge_initEx ( FudgeMemoryManager * mm )
     return FudgeRegistry_init ( );
 }
 
+FudgeStatus Fudge_initManagerEx ( FudgeMemoryManagerEx * mm )
+{
+    FudgeStatus status;
+    if ( ( status = FudgeMemory_initEx ( mm ) ) )
+        return status;
+    return FudgeRegistry_init ( );
+}
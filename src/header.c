@@ -121,7 +121,7 @@ FudgeStatus FudgeHeader_encodeFieldHeader ( const FudgeFieldHeader * header, fud
 
 FudgeStatus FudgeHeader_destroyFieldHeader ( FudgeFieldHeader header )
 {
-    FUDGEMEMORY_FREE( header.name );
+    FUDGEMEMORY_FREE( header.name, header.namelen );
     return FUDGE_OK;
 }
 
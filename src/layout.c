@@ -0,0 +1,771 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _FUDGELAYOUTIMPL_DEFINED 1
+#include "fudge/layout.h"
+#include "fudge/codec.h"
+#include "codec_encode.h"
+#include "memory_internal.h"
+#include "prefix.h"
+#include "reference.h"
+#include "registry_internal.h"
+#include <string.h>
+
+/* A submessage field: the offsets (in to the layout's buffer) of its prefix
+   and width, along with the current width. The parent is the index of the
+   enclosing submessage plus one, or zero for a top level field. */
+typedef struct
+{
+    size_t prefix;
+    size_t width;
+    fudge_byte widthofwidth;
+    fudge_i32 numbytes;
+    size_t parent;
+} LayoutSubMsg;
+
+/* A value slot. For fixed width types the offset is that of the value, for
+   variable width types it is that of the width preceding the value. */
+typedef struct
+{
+    fudge_type_id type;
+    FudgeString name;
+    fudge_i16 ordinal;
+    fudge_bool hasordinal;
+    size_t prefix;
+    size_t offset;
+    fudge_byte widthofwidth;
+    fudge_i32 numbytes;
+    size_t parent;
+} LayoutSlot;
+
+struct FudgeLayoutImpl
+{
+    FudgeRefCount refcount;
+    fudge_byte * buffer;
+    size_t capacity;
+    size_t numbytes;
+    LayoutSlot * slots;
+    size_t numslots, maxslots;
+    LayoutSubMsg * submsgs;
+    size_t numsubmsgs, maxsubmsgs;
+};
+
+/* The most a submessage width can grow by: from one byte to four */
+#define FUDGELAYOUT_MAX_WIDTH_GROWTH 3
+
+/* Used to initialise fixed width byte array slots when compiling from a
+   field list */
+static const fudge_byte s_zeroBytes [ 512 ] = { 0 };
+
+void FudgeLayout_countFields ( const FudgeMsg message, size_t * numslots, size_t * numsubmsgs )
+{
+    unsigned long index, numfields;
+    FudgeField field;
+
+    for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
+    {
+        FudgeMsg_getFieldAtIndex ( &field, message, index );
+        if ( field.type == FUDGE_TYPE_FUDGE_MSG )
+        {
+            ++( *numsubmsgs );
+            FudgeLayout_countFields ( field.data.message, numslots, numsubmsgs );
+        }
+        else
+            ++( *numslots );
+    }
+}
+
+/* Walks the message in encoding order, recording the offset of every field.
+   The offset is that of the next field to be encoded. */
+FudgeStatus FudgeLayout_mapFields ( FudgeLayout layout, const FudgeMsg message, size_t parent, size_t * offset )
+{
+    FudgeStatus status;
+    unsigned long index, numfields;
+    FudgeField field;
+    fudge_i32 numbytes, headerbytes;
+    fudge_byte widthofwidth;
+
+    for ( index = 0, numfields = FudgeMsg_numFields ( message ); index < numfields; ++index )
+    {
+        if ( ( status = FudgeMsg_getFieldAtIndex ( &field, message, index ) ) != FUDGE_OK )
+            return status;
+
+        numbytes = FudgeCodec_getFieldDataLength ( &field );
+        widthofwidth = FudgeType_typeIsFixedWidth ( field.type ) ? 0 : FudgeCodec_calculateBytesToHoldSize ( numbytes );
+        headerbytes = FudgeCodec_getFieldLength ( &field ) - numbytes - widthofwidth;
+
+        if ( field.type == FUDGE_TYPE_FUDGE_MSG )
+        {
+            LayoutSubMsg * submsg = layout->submsgs + layout->numsubmsgs++;
+
+            submsg->prefix = *offset;
+            submsg->width = *offset + headerbytes;
+            submsg->widthofwidth = widthofwidth;
+            submsg->numbytes = numbytes;
+            submsg->parent = parent;
+
+            *offset = submsg->width + widthofwidth;
+            if ( ( status = FudgeLayout_mapFields ( layout, field.data.message, layout->numsubmsgs, offset ) ) != FUDGE_OK )
+                return status;
+        }
+        else
+        {
+            LayoutSlot * slot = layout->slots + layout->numslots;
+
+            if ( field.flags & FUDGE_FIELD_HAS_NAME && field.name )
+            {
+                if ( ( status = FudgeString_retain ( field.name ) ) != FUDGE_OK )
+                    return status;
+                slot->name = field.name;
+            }
+            else
+                slot->name = 0;
+            ++layout->numslots;
+
+            slot->type = field.type;
+            slot->ordinal = field.ordinal;
+            slot->hasordinal = ( field.flags & FUDGE_FIELD_HAS_ORDINAL ) != 0;
+            slot->prefix = *offset;
+            slot->offset = *offset + headerbytes;
+            slot->widthofwidth = widthofwidth;
+            slot->numbytes = numbytes;
+            slot->parent = parent;
+
+            *offset = slot->offset + widthofwidth + numbytes;
+        }
+    }
+    return FUDGE_OK;
+}
+
+void FudgeLayout_destroy ( FudgeLayout layout )
+{
+    size_t index;
+
+    for ( index = 0; index < layout->numslots; ++index )
+        if ( layout->slots [ index ].name )
+            FudgeString_release ( layout->slots [ index ].name );
+
+    FUDGEMEMORY_FREE( layout->slots, layout->maxslots * sizeof ( LayoutSlot ) );
+    FUDGEMEMORY_FREE( layout->submsgs, layout->maxsubmsgs * sizeof ( LayoutSubMsg ) );
+    FUDGEMEMORY_FREE( layout->buffer, layout->capacity );
+    FUDGEMEMORY_FREE( layout, sizeof ( struct FudgeLayoutImpl ) );
+}
+
+FudgeStatus FudgeLayout_create ( FudgeLayout * layout, FudgeMsgEnvelope prototype )
+{
+    FudgeStatus status;
+    FudgeMsg message;
+    fudge_i32 numbytes;
+    size_t numslots = 0, numsubmsgs = 0, offset = 8;
+
+    if ( ! ( layout && prototype ) )
+        return FUDGE_NULL_POINTER;
+    if ( ! ( message = FudgeMsgEnvelope_getMessage ( prototype ) ) )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! ( *layout = FUDGEMEMORY_MALLOC( FudgeLayout, sizeof ( struct FudgeLayoutImpl ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    memset ( *layout, 0, sizeof ( struct FudgeLayoutImpl ) );
+
+    /* The prototype's encoded form is the initial contents of the layout;
+       the slots are mapped on to the uncompressed fields */
+    if ( ( status = FudgeCodec_encodeUncompressedMsg ( prototype, &( ( *layout )->buffer ), &numbytes ) ) != FUDGE_OK )
+        goto destroy_layout_and_fail;
+    ( *layout )->capacity = ( *layout )->numbytes = numbytes;
+
+    FudgeLayout_countFields ( message, &numslots, &numsubmsgs );
+    if ( numslots && ! ( ( *layout )->slots = FUDGEMEMORY_MALLOC( LayoutSlot *, numslots * sizeof ( LayoutSlot ) ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto destroy_layout_and_fail;
+    }
+    ( *layout )->maxslots = numslots;
+    if ( numsubmsgs && ! ( ( *layout )->submsgs = FUDGEMEMORY_MALLOC( LayoutSubMsg *, numsubmsgs * sizeof ( LayoutSubMsg ) ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto destroy_layout_and_fail;
+    }
+    ( *layout )->maxsubmsgs = numsubmsgs;
+
+    if ( ( status = FudgeLayout_mapFields ( *layout, message, 0, &offset ) ) != FUDGE_OK )
+        goto destroy_layout_and_fail;
+
+    /* The mapped fields must account for the entire message */
+    if ( offset != ( *layout )->numbytes )
+    {
+        status = FUDGE_OUT_OF_BYTES;
+        goto destroy_layout_and_fail;
+    }
+
+    if ( ( status = FudgeRefCount_create ( &( ( *layout )->refcount ) ) ) != FUDGE_OK )
+        goto destroy_layout_and_fail;
+
+    return FUDGE_OK;
+
+destroy_layout_and_fail:
+    FudgeLayout_destroy ( *layout );
+    return status;
+}
+
+/* Adds a zero (or empty) value field for the descriptor to the message */
+FudgeStatus FudgeLayout_addEmptyField ( FudgeMsg message, const FudgeLayoutField * descriptor )
+{
+    FudgeStatus status;
+    FudgeFieldData data;
+    FudgeString string;
+    const FudgeTypeDesc * typedesc;
+
+    if ( ! ( typedesc = FudgeRegistry_getTypeDesc ( descriptor->type ) ) )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    switch ( typedesc->payload )
+    {
+        case FUDGE_TYPE_PAYLOAD_STRING:
+            if ( ( status = FudgeString_createFromASCII ( &string, 0, 0 ) ) != FUDGE_OK )
+                return status;
+            status = FudgeMsg_addFieldString ( message, descriptor->name, descriptor->ordinal, string );
+            FudgeString_release ( string );
+            return status;
+
+        case FUDGE_TYPE_PAYLOAD_BYTES:
+            if ( typedesc->fixedwidth > ( fudge_i32 ) sizeof ( s_zeroBytes ) )
+                return FUDGE_INVALID_TYPE_ACCESSOR;
+            return FudgeMsg_addFieldOpaque ( message,
+                                             descriptor->type,
+                                             descriptor->name,
+                                             descriptor->ordinal,
+                                             s_zeroBytes,
+                                             typedesc->fixedwidth > 0 ? typedesc->fixedwidth : 0 );
+
+        case FUDGE_TYPE_PAYLOAD_LOCAL:
+            memset ( &data, 0, sizeof ( data ) );
+            return FudgeMsg_addFieldData ( message, descriptor->type, descriptor->name, descriptor->ordinal, &data, 0 );
+
+        default:
+            return FUDGE_INVALID_TYPE_ACCESSOR;
+    }
+}
+
+FudgeStatus FudgeLayout_createFromFields ( FudgeLayout * layout,
+                                           fudge_byte directives,
+                                           fudge_byte schemaversion,
+                                           fudge_i16 taxonomy,
+                                           const FudgeLayoutField * fields,
+                                           size_t numfields )
+{
+    FudgeStatus status;
+    FudgeMsgEnvelope envelope;
+    FudgeMsg * stack, submsg;
+    size_t index, depth = 0;
+
+    if ( ! ( layout && ( fields || ! numfields ) ) )
+        return FUDGE_NULL_POINTER;
+
+    /* Each submessage descriptor can increase the depth by at most one, so
+       the stack of open messages will never exceed the number of fields */
+    if ( ! ( stack = FUDGEMEMORY_MALLOC( FudgeMsg *, ( numfields + 1 ) * sizeof ( FudgeMsg ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    if ( ( status = FudgeMsg_create ( stack ) ) != FUDGE_OK )
+        goto free_stack_and_fail;
+
+    for ( index = 0; index < numfields; ++index )
+    {
+        const FudgeLayoutField * descriptor = fields + index;
+
+        if ( descriptor->depth < 0 || ( size_t ) descriptor->depth > depth )
+        {
+            status = FUDGE_INVALID_INDEX;
+            goto release_message_and_fail;
+        }
+        depth = ( size_t ) descriptor->depth;
+
+        if ( descriptor->type == FUDGE_TYPE_FUDGE_MSG )
+        {
+            if ( ( status = FudgeMsg_create ( &submsg ) ) != FUDGE_OK )
+                goto release_message_and_fail;
+
+            /* The parent takes its own reference to the submessage */
+            status = FudgeMsg_addFieldMsg ( stack [ depth ], descriptor->name, descriptor->ordinal, submsg );
+            FudgeMsg_release ( submsg );
+            if ( status != FUDGE_OK )
+                goto release_message_and_fail;
+
+            stack [ ++depth ] = submsg;
+        }
+        else if ( ( status = FudgeLayout_addEmptyField ( stack [ depth ], descriptor ) ) != FUDGE_OK )
+            goto release_message_and_fail;
+    }
+
+    if ( ( status = FudgeMsgEnvelope_create ( &envelope, directives, schemaversion, taxonomy, stack [ 0 ] ) ) != FUDGE_OK )
+        goto release_message_and_fail;
+
+    status = FudgeLayout_create ( layout, envelope );
+    FudgeMsgEnvelope_release ( envelope );
+
+release_message_and_fail:
+    FudgeMsg_release ( stack [ 0 ] );
+free_stack_and_fail:
+    FUDGEMEMORY_FREE( stack, ( numfields + 1 ) * sizeof ( FudgeMsg ) );
+    return status;
+}
+
+FudgeStatus FudgeLayout_retain ( FudgeLayout layout )
+{
+    if ( ! layout )
+        return FUDGE_NULL_POINTER;
+    FudgeRefCount_increment ( layout->refcount );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeLayout_release ( FudgeLayout layout )
+{
+    if ( ! layout )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! FudgeRefCount_decrementAndReturn ( layout->refcount ) )
+    {
+        FudgeStatus status;
+
+        if ( ( status = FudgeRefCount_destroy ( layout->refcount ) ) != FUDGE_OK )
+            return status;
+        FudgeLayout_destroy ( layout );
+    }
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeLayout_getBytes ( FudgeLayout layout, const fudge_byte * * bytes, fudge_i32 * numbytes )
+{
+    if ( ! ( layout && bytes && numbytes ) )
+        return FUDGE_NULL_POINTER;
+
+    *bytes = layout->buffer;
+    *numbytes = ( fudge_i32 ) layout->numbytes;
+    return FUDGE_OK;
+}
+
+size_t FudgeLayout_numSlots ( FudgeLayout layout )
+{
+    return layout ? layout->numslots : 0;
+}
+
+FudgeStatus FudgeLayout_getSlotType ( fudge_type_id * type, FudgeLayout layout, size_t slot )
+{
+    if ( ! ( type && layout ) )
+        return FUDGE_NULL_POINTER;
+    if ( slot >= layout->numslots )
+        return FUDGE_INVALID_INDEX;
+
+    *type = layout->slots [ slot ].type;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeLayout_findSlotByName ( size_t * slot, FudgeLayout layout, const FudgeString name )
+{
+    size_t index;
+
+    if ( ! ( slot && layout && name ) )
+        return FUDGE_NULL_POINTER;
+
+    for ( index = 0; index < layout->numslots; ++index )
+    {
+        if ( layout->slots [ index ].name && FudgeString_equals ( layout->slots [ index ].name, name ) )
+        {
+            *slot = index;
+            return FUDGE_OK;
+        }
+    }
+    return FUDGE_INVALID_NAME;
+}
+
+FudgeStatus FudgeLayout_findSlotByOrdinal ( size_t * slot, FudgeLayout layout, fudge_i16 ordinal )
+{
+    size_t index;
+
+    if ( ! ( slot && layout ) )
+        return FUDGE_NULL_POINTER;
+
+    for ( index = 0; index < layout->numslots; ++index )
+    {
+        if ( layout->slots [ index ].hasordinal && layout->slots [ index ].ordinal == ordinal )
+        {
+            *slot = index;
+            return FUDGE_OK;
+        }
+    }
+    return FUDGE_INVALID_ORDINAL;
+}
+
+/* Makes sure there's space in the buffer for an additional numbytes */
+FudgeStatus FudgeLayout_reserve ( FudgeLayout layout, size_t numbytes )
+{
+    fudge_byte * buffer;
+    size_t capacity;
+
+    if ( layout->numbytes + numbytes <= layout->capacity )
+        return FUDGE_OK;
+
+    /* Encoded messages are limited to the size of a signed 32 bit integer */
+    if ( layout->numbytes + numbytes > 0x7FFFFFFF )
+        return FUDGE_PAYLOAD_TOO_LONG;
+
+    capacity = layout->capacity * 2;
+    if ( capacity < layout->numbytes + numbytes )
+        capacity = layout->numbytes + numbytes;
+
+    if ( ! ( buffer = FUDGEMEMORY_REALLOC( fudge_byte *, layout->buffer, layout->capacity, capacity ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    layout->buffer = buffer;
+    layout->capacity = capacity;
+    return FUDGE_OK;
+}
+
+void FudgeLayout_shiftOffset ( size_t * offset, size_t oldend, size_t newend )
+{
+    if ( *offset >= oldend )
+        *offset = *offset - oldend + newend;
+}
+
+/* Changes the size of the region starting at offset from oldsize to newsize,
+   moving the bytes that follow it and updating the offsets of any slots or
+   submessages that have moved. The space must already have been reserved. */
+void FudgeLayout_resize ( FudgeLayout layout, size_t offset, size_t oldsize, size_t newsize )
+{
+    size_t index, oldend = offset + oldsize, newend = offset + newsize;
+
+    memmove ( layout->buffer + newend, layout->buffer + oldend, layout->numbytes - oldend );
+    layout->numbytes = layout->numbytes - oldend + newend;
+
+    for ( index = 0; index < layout->numslots; ++index )
+    {
+        FudgeLayout_shiftOffset ( &( layout->slots [ index ].prefix ), oldend, newend );
+        FudgeLayout_shiftOffset ( &( layout->slots [ index ].offset ), oldend, newend );
+    }
+    for ( index = 0; index < layout->numsubmsgs; ++index )
+    {
+        FudgeLayout_shiftOffset ( &( layout->submsgs [ index ].prefix ), oldend, newend );
+        FudgeLayout_shiftOffset ( &( layout->submsgs [ index ].width ), oldend, newend );
+    }
+}
+
+FudgeStatus FudgeLayout_setPrefixWidth ( FudgeLayout layout, size_t offset, fudge_byte widthofwidth )
+{
+    FudgeStatus status;
+    FudgeFieldPrefix prefix;
+
+    if ( ( status = FudgePrefix_decodeFieldPrefix ( &prefix, layout->buffer [ offset ] ) ) != FUDGE_OK )
+        return status;
+    prefix.variablewidth = widthofwidth;
+    layout->buffer [ offset ] = FudgePrefix_encodeFieldPrefix ( prefix );
+    return FUDGE_OK;
+}
+
+/* Adjusts the widths of the submessages enclosing a slot (starting with the
+   innermost) by delta bytes, followed by the envelope's message size. A
+   submessage whose width needs a different number of bytes is resized,
+   which in turn changes the delta applied to its parents. */
+FudgeStatus FudgeLayout_updateWidths ( FudgeLayout layout, size_t parent, fudge_i32 delta )
+{
+    FudgeStatus status;
+    fudge_byte * writepos;
+
+    while ( parent )
+    {
+        LayoutSubMsg * submsg = layout->submsgs + parent - 1;
+        fudge_i32 numbytes = submsg->numbytes + delta;
+        fudge_byte widthofwidth = FudgeCodec_calculateBytesToHoldSize ( numbytes );
+
+        if ( widthofwidth != submsg->widthofwidth )
+        {
+            FudgeLayout_resize ( layout, submsg->width, submsg->widthofwidth, widthofwidth );
+            if ( ( status = FudgeLayout_setPrefixWidth ( layout, submsg->prefix, widthofwidth ) ) != FUDGE_OK )
+                return status;
+            delta += ( fudge_i32 ) widthofwidth - ( fudge_i32 ) submsg->widthofwidth;
+            submsg->widthofwidth = widthofwidth;
+        }
+
+        submsg->numbytes = numbytes;
+        writepos = layout->buffer + submsg->width;
+        FudgeCodec_encodeFieldLength ( numbytes, &writepos );
+        parent = submsg->parent;
+    }
+
+    writepos = layout->buffer + 4;
+    FudgeCodec_encodeI32 ( ( fudge_i32 ) layout->numbytes, &writepos );
+    return FUDGE_OK;
+}
+
+/* Encodes the field's value in to the slot, moving the rest of the message
+   and updating the enclosing widths if the value's size has changed */
+FudgeStatus FudgeLayout_storeValue ( FudgeLayout layout, LayoutSlot * slot, const FudgeField * field )
+{
+    FudgeStatus status;
+    FudgeTypeEncoder encoder;
+    const FudgeTypeDesc * typedesc = FudgeRegistry_getTypeDesc ( slot->type );
+    fudge_byte * writepos, widthofwidth;
+    fudge_i32 numbytes;
+    size_t oldsize = 0, newsize = 0;
+
+    /* As with FudgeCodec_encodeField, types without an encoder are treated as
+       arrays of bytes */
+    encoder = typedesc->encoder ? typedesc->encoder : FudgeCodec_encodeFieldByteArray;
+
+    if ( typedesc->fixedwidth < 0 )
+    {
+        numbytes = FudgeCodec_getFieldDataLength ( field );
+        widthofwidth = FudgeCodec_calculateBytesToHoldSize ( numbytes );
+        oldsize = slot->widthofwidth + ( size_t ) slot->numbytes;
+        newsize = widthofwidth + ( size_t ) numbytes;
+
+        if ( newsize != oldsize )
+        {
+            /* Reserve enough for every enclosing width to grow as well, so
+               that the layout can't be left partially updated */
+            if ( newsize > oldsize &&
+                 ( status = FudgeLayout_reserve ( layout, newsize - oldsize + FUDGELAYOUT_MAX_WIDTH_GROWTH * layout->numsubmsgs ) ) != FUDGE_OK )
+                return status;
+
+            FudgeLayout_resize ( layout, slot->offset, oldsize, newsize );
+        }
+
+        if ( widthofwidth != slot->widthofwidth &&
+             ( status = FudgeLayout_setPrefixWidth ( layout, slot->prefix, widthofwidth ) ) != FUDGE_OK )
+            return status;
+
+        slot->widthofwidth = widthofwidth;
+        slot->numbytes = numbytes;
+    }
+
+    writepos = layout->buffer + slot->offset;
+    if ( ( status = encoder ( field, &writepos ) ) != FUDGE_OK )
+        return status;
+
+    if ( typedesc->fixedwidth < 0 && newsize != oldsize )
+        return FudgeLayout_updateWidths ( layout, slot->parent, ( fudge_i32 ) newsize - ( fudge_i32 ) oldsize );
+    return FUDGE_OK;
+}
+
+/* Retrieves the slot and initialises a field of its type, ready for the
+   value to be filled in */
+FudgeStatus FudgeLayout_initField ( LayoutSlot * * slot, FudgeField * field, FudgeLayout layout, size_t index )
+{
+    if ( ! layout )
+        return FUDGE_NULL_POINTER;
+    if ( index >= layout->numslots )
+        return FUDGE_INVALID_INDEX;
+
+    *slot = layout->slots + index;
+    field->type = ( *slot )->type;
+    field->numbytes = 0;
+    field->flags = 0;
+    field->name = 0;
+    field->ordinal = 0;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeLayout_setBool ( FudgeLayout layout, size_t slot, fudge_bool value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_BOOLEAN )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.boolean = value;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setInteger ( FudgeLayout layout, size_t slot, fudge_i64 value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+
+    switch ( target->type )
+    {
+        case FUDGE_TYPE_BYTE:
+            if ( value > INT8_MAX || value < INT8_MIN )
+                return FUDGE_INVALID_TYPE_COERCION;
+            field.data.byte = ( fudge_byte ) value;
+            break;
+        case FUDGE_TYPE_SHORT:
+            if ( value > INT16_MAX || value < INT16_MIN )
+                return FUDGE_INVALID_TYPE_COERCION;
+            field.data.i16 = ( fudge_i16 ) value;
+            break;
+        case FUDGE_TYPE_INT:
+            if ( value > INT32_MAX || value < INT32_MIN )
+                return FUDGE_INVALID_TYPE_COERCION;
+            field.data.i32 = ( fudge_i32 ) value;
+            break;
+        case FUDGE_TYPE_LONG:
+            field.data.i64 = value;
+            break;
+        default:
+            return FUDGE_INVALID_TYPE_ACCESSOR;
+    }
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setByte ( FudgeLayout layout, size_t slot, fudge_byte value )
+{
+    return FudgeLayout_setInteger ( layout, slot, value );
+}
+
+FudgeStatus FudgeLayout_setI16 ( FudgeLayout layout, size_t slot, fudge_i16 value )
+{
+    return FudgeLayout_setInteger ( layout, slot, value );
+}
+
+FudgeStatus FudgeLayout_setI32 ( FudgeLayout layout, size_t slot, fudge_i32 value )
+{
+    return FudgeLayout_setInteger ( layout, slot, value );
+}
+
+FudgeStatus FudgeLayout_setI64 ( FudgeLayout layout, size_t slot, fudge_i64 value )
+{
+    return FudgeLayout_setInteger ( layout, slot, value );
+}
+
+FudgeStatus FudgeLayout_setF32 ( FudgeLayout layout, size_t slot, fudge_f32 value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_FLOAT )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.f32 = value;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setF64 ( FudgeLayout layout, size_t slot, fudge_f64 value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_DOUBLE )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.f64 = value;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setString ( FudgeLayout layout, size_t slot, const FudgeString value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ! value )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_STRING )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+    if ( FudgeString_getSize ( value ) > 0x7FFFFFFF )
+        return FUDGE_PAYLOAD_TOO_LONG;
+
+    field.data.string = value;
+    field.numbytes = ( fudge_i32 ) FudgeString_getSize ( value );
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setBytes ( FudgeLayout layout, size_t slot, const fudge_byte * bytes, fudge_i32 numbytes )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+    const FudgeTypeDesc * typedesc;
+
+    if ( ( ! bytes && numbytes ) || numbytes < 0 )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+
+    typedesc = FudgeRegistry_getTypeDesc ( target->type );
+    if ( typedesc->payload != FUDGE_TYPE_PAYLOAD_BYTES )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+    if ( typedesc->fixedwidth >= 0 && typedesc->fixedwidth != numbytes )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.bytes = bytes;
+    field.numbytes = numbytes;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setDate ( FudgeLayout layout, size_t slot, const FudgeDate * value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ! value )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_DATE )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.datetime.date = *value;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setTime ( FudgeLayout layout, size_t slot, const FudgeTime * value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ! value )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_TIME )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.datetime.time = *value;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
+
+FudgeStatus FudgeLayout_setDateTime ( FudgeLayout layout, size_t slot, const FudgeDateTime * value )
+{
+    FudgeStatus status;
+    FudgeField field;
+    LayoutSlot * target;
+
+    if ( ! value )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeLayout_initField ( &target, &field, layout, slot ) ) != FUDGE_OK )
+        return status;
+    if ( target->type != FUDGE_TYPE_DATETIME )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.datetime = *value;
+    return FudgeLayout_storeValue ( layout, target, &field );
+}
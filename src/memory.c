@@ -16,8 +16,9 @@
 #include "memory_internal.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-FudgeMemoryManager * s_memoryManager = 0;
+FudgeMemoryManagerEx * s_memoryManager = 0;
 
 FudgeMemoryManager FudgeMemory_default =
 {
@@ -26,7 +27,78 @@ FudgeMemoryManager FudgeMemory_default =
     free        /* Deallocate */
 };
 
+/* The largest alignment that can be assumed of memory returned by malloc
+   (and so by a FudgeMemoryManager). Larger alignments are provided by over
+   allocating and storing the original pointer immediately before the
+   aligned block. */
+#define FUDGEMEMORY_NATURAL_ALIGNMENT ( 2 * sizeof ( void * ) )
+
+void * FudgeMemory_legacyAllocate ( void * context, size_t size, size_t alignment )
+{
+    FudgeMemoryManager * manager = ( FudgeMemoryManager * ) context;
+    void * block, * aligned;
+
+    if ( alignment <= FUDGEMEMORY_NATURAL_ALIGNMENT )
+        return manager->allocate ( size );
+
+    if ( ! ( block = manager->allocate ( size + alignment + sizeof ( void * ) ) ) )
+        return 0;
+    aligned = ( void * ) ( ( ( size_t ) block + sizeof ( void * ) + alignment - 1 ) & ~( alignment - 1 ) );
+    ( ( void * * ) aligned ) [ -1 ] = block;
+    return aligned;
+}
+
+void FudgeMemory_legacyDeallocate ( void * context, void * ptr, size_t size, size_t alignment )
+{
+    FudgeMemoryManager * manager = ( FudgeMemoryManager * ) context;
+
+    ( void ) size;
+    if ( alignment > FUDGEMEMORY_NATURAL_ALIGNMENT && ptr )
+        ptr = ( ( void * * ) ptr ) [ -1 ];
+    manager->deallocate ( ptr );
+}
+
+void * FudgeMemory_legacyReallocate ( void * context, void * ptr, size_t oldsize, size_t size, size_t alignment )
+{
+    FudgeMemoryManager * manager = ( FudgeMemoryManager * ) context;
+    void * moved;
+
+    if ( alignment <= FUDGEMEMORY_NATURAL_ALIGNMENT )
+        return manager->reallocate ( ptr, size );
+
+    /* The offset of the aligned block may change, so always move */
+    if ( ! ( moved = FudgeMemory_legacyAllocate ( context, size, alignment ) ) )
+        return 0;
+    if ( ptr )
+    {
+        memcpy ( moved, ptr, oldsize < size ? oldsize : size );
+        FudgeMemory_legacyDeallocate ( context, ptr, oldsize, alignment );
+    }
+    return moved;
+}
+
+static FudgeMemoryManagerEx s_legacyManager =
+{
+    0,                              /* Context: the wrapped manager */
+    FudgeMemory_legacyAllocate,
+    FudgeMemory_legacyReallocate,
+    FudgeMemory_legacyDeallocate
+};
+
 FudgeStatus FudgeMemory_init ( FudgeMemoryManager * manager )
+{
+    if ( ! manager )
+        return FUDGE_NULL_POINTER;
+
+    if ( s_memoryManager && ! ( s_memoryManager == &s_legacyManager && s_legacyManager.context == manager ) )
+        return FUDGE_CHANGED_MEMORY_MANAGER;
+
+    s_legacyManager.context = manager;
+    s_memoryManager = &s_legacyManager;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeMemory_initEx ( FudgeMemoryManagerEx * manager )
 {
     if ( ! manager )
         return FUDGE_NULL_POINTER;
@@ -45,16 +117,20 @@ FudgeMemoryManager * FudgeMemory_defaultManager ( )
 
 void * FudgeMemory_malloc ( size_t size )
 {
-    return s_memoryManager->allocate ( size );
+    return FUDGEMEMORY_MALLOC( void *, size );
 }
 
 void * FudgeMemroy_realloc ( void * ptr, size_t size )
 {
-    return s_memoryManager->reallocate ( ptr, size );
+    return FUDGEMEMORY_REALLOC( void *, ptr, 0, size );
 }
 
 void FudgeMemory_free ( void * ptr )
 {
-    s_memoryManager->deallocate ( ptr );
+    FUDGEMEMORY_FREE( ptr, 0 );
 }
 
+void FudgeMemory_freeSized ( void * ptr, size_t size )
+{
+    FUDGEMEMORY_FREE( ptr, size );
+}
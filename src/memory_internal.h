@@ -18,17 +18,42 @@
 
 #include "fudge/memory.h"
 #include "fudge/status.h"
+#include "fudge/types.h"
 
-extern FudgeMemoryManager * s_memoryManager;
+extern FudgeMemoryManagerEx * s_memoryManager;
 
-/* Initialise the memory manager. Usually only called from fudge.c. */
+/* Initialise the memory manager. Usually only called from fudge.c. A
+   FudgeMemoryManager is wrapped in an adapter that discards the context,
+   sizes and (where malloc's is sufficient) alignments. */
 FudgeStatus FudgeMemory_init ( FudgeMemoryManager * manager );
+FudgeStatus FudgeMemory_initEx ( FudgeMemoryManagerEx * manager );
+
+/* The adapter functions used to wrap a FudgeMemoryManager, whose address is
+   passed as the context */
+void * FudgeMemory_legacyAllocate ( void * context, size_t size, size_t alignment );
+void * FudgeMemory_legacyReallocate ( void * context, void * ptr, size_t oldsize, size_t size, size_t alignment );
+void FudgeMemory_legacyDeallocate ( void * context, void * ptr, size_t size, size_t alignment );
 
 /* Internal macros around memory manager - avoids function call overhead and
-   hides the need to cast the return types */
-#define FUDGEMEMORY_MALLOC( TYPE, SIZE ) ( TYPE ) s_memoryManager->allocate ( SIZE )
-#define FUDGEMEMORY_REALLOC( TYPE, PTR, SIZE ) ( TYPE ) s_memoryManager->reallocate ( PTR, SIZE )
-#define FUDGEMEMORY_FREE( PTR ) s_memoryManager->deallocate ( PTR )
+   hides the need to cast the return types. The sizes passed to REALLOC and
+   FREE must be those used when the memory was allocated. */
+#define FUDGEMEMORY_MALLOC( TYPE, SIZE ) ( TYPE ) s_memoryManager->allocate ( s_memoryManager->context, SIZE, 0 )
+#define FUDGEMEMORY_REALLOC( TYPE, PTR, OLDSIZE, SIZE ) ( TYPE ) s_memoryManager->reallocate ( s_memoryManager->context, PTR, OLDSIZE, SIZE, 0 )
+#define FUDGEMEMORY_FREE( PTR, SIZE ) s_memoryManager->deallocate ( s_memoryManager->context, PTR, SIZE, 0 )
+
+/* Memory statistics (see Fudge_getMemoryStats). The library records the
+   allocations in each category itself, once they have succeeded; the
+   macros skip the call entirely while collection is disabled. A resize
+   changes the byte counts without counting as an allocation or free. */
+extern volatile fudge_bool s_memoryStatsEnabled;
+
+void FudgeMemory_recordAllocation ( FudgeMemoryCategory category, size_t size );
+void FudgeMemory_recordFree ( FudgeMemoryCategory category, size_t size );
+void FudgeMemory_recordResize ( FudgeMemoryCategory category, size_t oldsize, size_t size );
+
+#define FUDGEMEMORY_RECORD_ALLOCATION( CATEGORY, SIZE ) ( s_memoryStatsEnabled ? FudgeMemory_recordAllocation ( CATEGORY, SIZE ) : ( void ) 0 )
+#define FUDGEMEMORY_RECORD_FREE( CATEGORY, SIZE ) ( s_memoryStatsEnabled ? FudgeMemory_recordFree ( CATEGORY, SIZE ) : ( void ) 0 )
+#define FUDGEMEMORY_RECORD_RESIZE( CATEGORY, OLDSIZE, SIZE ) ( s_memoryStatsEnabled ? FudgeMemory_recordResize ( CATEGORY, OLDSIZE, SIZE ) : ( void ) 0 )
 
 #endif
 
@@ -0,0 +1,245 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "fudge/memory.h"
+#include "atomic.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The slab manager needs thread local storage and atomic pointer operations
+   in threaded builds; without either it is replaced by the default
+   manager */
+#if defined(FUDGE_HAS_ATOMICS) && defined(FUDGE_THREAD_LOCAL)
+
+/* Allocations of up to FUDGESLAB_MAX_SMALL bytes are rounded up to one of
+   the size classes and taken from the calling thread's cache; anything
+   larger goes straight to malloc. Each cache refills a size class by
+   carving a FUDGESLAB_SLAB_BYTES block in to pieces. */
+#define FUDGESLAB_NUM_CLASSES   8
+#define FUDGESLAB_MAX_SMALL     256
+#define FUDGESLAB_SLAB_BYTES    16384
+
+static const size_t s_classSizes [ FUDGESLAB_NUM_CLASSES ] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+/* The size class for each multiple of sixteen bytes, from 0 to 256 */
+static const unsigned char s_classForSize [ FUDGESLAB_MAX_SMALL / 16 + 1 ] = { 0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7 };
+
+struct FudgeSlabCache;
+
+/* Precedes every allocation, recording where it came from. Padded to
+   sixteen bytes so that the memory that follows is aligned as well as
+   malloc's. */
+typedef union
+{
+    struct
+    {
+        struct FudgeSlabCache * owner;      /* NULL for large allocations */
+        size_t sizeclass;
+    } info;
+    double padding [ 2 ];
+} FudgeSlabHeader;
+
+/* A free block: the link is held in the memory that follows the header */
+typedef struct FudgeSlabBlock
+{
+    struct FudgeSlabBlock * next;
+} FudgeSlabBlock;
+
+/* A thread's cache. Only the owning thread touches the free lists. Other
+   threads return blocks to the cache by pushing them on to the remote list,
+   which the owner takes in one go when a free list runs dry. */
+typedef struct FudgeSlabCache
+{
+    FudgeThreadCache thread;                /* Must be first */
+    FudgeSlabBlock * free [ FUDGESLAB_NUM_CLASSES ];
+    FudgeSlabBlock * volatile remote;
+} FudgeSlabCache;
+
+/* Every cache ever created. A thread's cache outlives it, as the blocks in
+   it (and those handed out from it) may still be in use. */
+static FudgeThreadCache * volatile s_caches = 0;
+
+static FUDGE_THREAD_LOCAL FudgeThreadCache * s_cache = 0;
+
+FudgeSlabCache * FudgeSlab_getCache ( void )
+{
+    if ( s_cache )
+        return ( FudgeSlabCache * ) s_cache;
+    return ( FudgeSlabCache * ) FudgeThread_acquireCache ( &s_caches, sizeof ( FudgeSlabCache ), &s_cache );
+}
+
+/* Moves the blocks freed by other threads on to the cache's free lists */
+void FudgeSlab_collectRemote ( FudgeSlabCache * cache )
+{
+    FudgeSlabBlock * block, * next;
+
+    if ( ! cache->remote )
+        return;
+
+    for ( block = AtomicExchangePointer ( cache->remote, 0 ); block; block = next )
+    {
+        size_t sizeclass = ( ( FudgeSlabHeader * ) block - 1 )->info.sizeclass;
+        next = block->next;
+        block->next = cache->free [ sizeclass ];
+        cache->free [ sizeclass ] = block;
+    }
+}
+
+/* Adds a new slab's worth of blocks to the size class's free list */
+int FudgeSlab_refill ( FudgeSlabCache * cache, size_t sizeclass )
+{
+    const size_t blocksize = sizeof ( FudgeSlabHeader ) + s_classSizes [ sizeclass ];
+    size_t offset;
+    char * slab;
+
+    if ( ! ( slab = ( char * ) malloc ( FUDGESLAB_SLAB_BYTES ) ) )
+        return 0;
+
+    for ( offset = 0; offset + blocksize <= FUDGESLAB_SLAB_BYTES; offset += blocksize )
+    {
+        FudgeSlabHeader * header = ( FudgeSlabHeader * ) ( slab + offset );
+        FudgeSlabBlock * block = ( FudgeSlabBlock * ) ( header + 1 );
+
+        header->info.owner = cache;
+        header->info.sizeclass = sizeclass;
+        block->next = cache->free [ sizeclass ];
+        cache->free [ sizeclass ] = block;
+    }
+    return 1;
+}
+
+void * FudgeSlab_allocate ( size_t size )
+{
+    FudgeSlabCache * cache;
+    FudgeSlabBlock * block;
+    size_t sizeclass;
+
+    if ( size > FUDGESLAB_MAX_SMALL )
+    {
+        FudgeSlabHeader * header;
+
+        if ( size > ( size_t ) -1 - sizeof ( FudgeSlabHeader ) )
+            return 0;
+        if ( ! ( header = ( FudgeSlabHeader * ) malloc ( sizeof ( FudgeSlabHeader ) + size ) ) )
+            return 0;
+        header->info.owner = 0;
+        header->info.sizeclass = FUDGESLAB_NUM_CLASSES;
+        return header + 1;
+    }
+
+    if ( ! ( cache = FudgeSlab_getCache ( ) ) )
+        return 0;
+
+    sizeclass = s_classForSize [ ( size + 15 ) >> 4 ];
+    if ( ! cache->free [ sizeclass ] )
+    {
+        FudgeSlab_collectRemote ( cache );
+        if ( ! cache->free [ sizeclass ] && ! FudgeSlab_refill ( cache, sizeclass ) )
+            return 0;
+    }
+
+    block = cache->free [ sizeclass ];
+    cache->free [ sizeclass ] = block->next;
+    return block;
+}
+
+void FudgeSlab_deallocate ( void * ptr )
+{
+    FudgeSlabHeader * header;
+    FudgeSlabCache * owner;
+    FudgeSlabBlock * block = ( FudgeSlabBlock * ) ptr, * head;
+
+    if ( ! ptr )
+        return;
+
+    header = ( FudgeSlabHeader * ) ptr - 1;
+    if ( ! ( owner = header->info.owner ) )
+    {
+        free ( header );
+        return;
+    }
+
+    if ( &( owner->thread ) == s_cache )
+    {
+        block->next = owner->free [ header->info.sizeclass ];
+        owner->free [ header->info.sizeclass ] = block;
+    }
+    else
+    {
+        do
+        {
+            head = AtomicLoadPointer ( owner->remote );
+            block->next = head;
+        } while ( AtomicCompareExchangePointer ( owner->remote, head, block ) != head );
+    }
+}
+
+void * FudgeSlab_reallocate ( void * ptr, size_t size )
+{
+    FudgeSlabHeader * header;
+    size_t capacity;
+    void * moved;
+
+    if ( ! ptr )
+        return FudgeSlab_allocate ( size );
+
+    header = ( FudgeSlabHeader * ) ptr - 1;
+    if ( header->info.owner )
+    {
+        /* Blocks are never shrunk in place, but may grow within their class */
+        if ( size <= ( capacity = s_classSizes [ header->info.sizeclass ] ) )
+            return ptr;
+    }
+    else
+    {
+        if ( size > FUDGESLAB_MAX_SMALL )
+        {
+            if ( size > ( size_t ) -1 - sizeof ( FudgeSlabHeader ) )
+                return 0;
+            if ( ! ( header = ( FudgeSlabHeader * ) realloc ( header, sizeof ( FudgeSlabHeader ) + size ) ) )
+                return 0;
+            return header + 1;
+        }
+        capacity = size;
+    }
+
+    if ( ! ( moved = FudgeSlab_allocate ( size ) ) )
+        return 0;
+    memcpy ( moved, ptr, capacity < size ? capacity : size );
+    FudgeSlab_deallocate ( ptr );
+    return moved;
+}
+
+FudgeMemoryManager FudgeMemory_slab =
+{
+    FudgeSlab_allocate,     /* Allocate */
+    FudgeSlab_reallocate,   /* Reallocate */
+    FudgeSlab_deallocate    /* Deallocate */
+};
+
+FudgeMemoryManager * FudgeMemory_slabManager ( )
+{
+    return &FudgeMemory_slab;
+}
+
+#else
+
+FudgeMemoryManager * FudgeMemory_slabManager ( )
+{
+    return FudgeMemory_defaultManager ( );
+}
+
+#endif
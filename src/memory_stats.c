@@ -0,0 +1,200 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "fudge/fudge.h"
+#include "atomic.h"
+#include "memory_internal.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+volatile fudge_bool s_memoryStatsEnabled = FUDGE_FALSE;
+
+/* As with the slab manager, the per-thread counters need thread local
+   storage and atomic operations in threaded builds; without either the
+   statistics can't be enabled */
+#if defined(FUDGE_HAS_ATOMICS) && defined(FUDGE_THREAD_LOCAL)
+
+/* A thread's net change in a category is added to the global total (and
+   the peak updated) each time it moves by this many bytes */
+#define FUDGESTATS_BATCH_BYTES 16384
+
+/* A thread's counters. Only the owning thread writes to them; readers sum
+   the counters of every thread. The byte counts only ever increase, so a
+   thread may free more than it allocated without any count going
+   negative. */
+typedef struct FudgeStatsCache
+{
+    FudgeThreadCache thread;                        /* Must be first */
+    size_t allocated [ FUDGE_MEMORY_NUM_CATEGORIES ];
+    size_t freed [ FUDGE_MEMORY_NUM_CATEGORIES ];
+    size_t allocations [ FUDGE_MEMORY_NUM_CATEGORIES ];
+    size_t frees [ FUDGE_MEMORY_NUM_CATEGORIES ];
+    long pending [ FUDGE_MEMORY_NUM_CATEGORIES ];   /* Net bytes not yet added to s_total */
+} FudgeStatsCache;
+
+/* Every set of counters ever created. The counters of a thread that exits
+   are adopted by the next new thread, which keeps the sums intact. */
+static FudgeThreadCache * volatile s_caches = 0;
+
+static FUDGE_THREAD_LOCAL FudgeThreadCache * s_cache = 0;
+
+/* The sampled total and peak for each category */
+static volatile size_t s_total [ FUDGE_MEMORY_NUM_CATEGORIES ];
+static volatile size_t s_peak [ FUDGE_MEMORY_NUM_CATEGORIES ];
+
+FudgeStatsCache * FudgeStats_getCache ( void )
+{
+    if ( s_cache )
+        return ( FudgeStatsCache * ) s_cache;
+    return ( FudgeStatsCache * ) FudgeThread_acquireCache ( &s_caches, sizeof ( FudgeStatsCache ), &s_cache );
+}
+
+/* Raises the category's peak to total, if it is higher. The total is
+   unsigned but may have wrapped below zero if frees were counted before
+   the matching allocations. */
+void FudgeStats_updatePeak ( FudgeMemoryCategory category, size_t total )
+{
+    size_t peak;
+
+    if ( total > ( ( size_t ) -1 ) / 2 )
+        return;
+
+    while ( total > ( peak = s_peak [ category ] ) )
+        if ( AtomicCompareExchangeSize ( s_peak [ category ], peak, total ) == peak )
+            break;
+}
+
+void FudgeStats_adjust ( FudgeStatsCache * cache, FudgeMemoryCategory category, long delta )
+{
+    long pending = cache->pending [ category ] + delta;
+
+    if ( pending >= FUDGESTATS_BATCH_BYTES || pending <= -FUDGESTATS_BATCH_BYTES )
+    {
+        FudgeStats_updatePeak ( category, AtomicAddSize ( s_total [ category ], ( size_t ) pending ) );
+        pending = 0;
+    }
+    cache->pending [ category ] = pending;
+}
+
+void FudgeMemory_recordAllocation ( FudgeMemoryCategory category, size_t size )
+{
+    FudgeStatsCache * cache;
+
+    if ( ( cache = FudgeStats_getCache ( ) ) )
+    {
+        cache->allocated [ category ] += size;
+        ++( cache->allocations [ category ] );
+        FudgeStats_adjust ( cache, category, ( long ) size );
+    }
+}
+
+void FudgeMemory_recordFree ( FudgeMemoryCategory category, size_t size )
+{
+    FudgeStatsCache * cache;
+
+    if ( ( cache = FudgeStats_getCache ( ) ) )
+    {
+        cache->freed [ category ] += size;
+        ++( cache->frees [ category ] );
+        FudgeStats_adjust ( cache, category, -( long ) size );
+    }
+}
+
+void FudgeMemory_recordResize ( FudgeMemoryCategory category, size_t oldsize, size_t size )
+{
+    FudgeStatsCache * cache;
+
+    if ( ( cache = FudgeStats_getCache ( ) ) )
+    {
+        cache->allocated [ category ] += size;
+        cache->freed [ category ] += oldsize;
+        FudgeStats_adjust ( cache, category, ( long ) size - ( long ) oldsize );
+    }
+}
+
+/*****************************************************************************
+ * Functions from fudge/fudge.h
+ */
+
+void Fudge_setMemoryStatsEnabled ( fudge_bool enabled )
+{
+    s_memoryStatsEnabled = enabled;
+}
+
+FudgeStatus Fudge_getMemoryStats ( FudgeMemoryStats * stats )
+{
+    FudgeStatsCache * cache;
+    FudgeMemoryCounters * counters;
+    size_t allocated [ FUDGE_MEMORY_NUM_CATEGORIES ],
+           freed [ FUDGE_MEMORY_NUM_CATEGORIES ];
+    int category;
+
+    if ( ! stats )
+        return FUDGE_NULL_POINTER;
+
+    memset ( stats, 0, sizeof ( FudgeMemoryStats ) );
+    memset ( allocated, 0, sizeof ( allocated ) );
+    memset ( freed, 0, sizeof ( freed ) );
+
+    /* The counters are read without synchronisation, so those of threads
+       that are busy allocating may be slightly behind */
+    for ( cache = ( FudgeStatsCache * ) AtomicLoadPointer ( s_caches ); cache; cache = ( FudgeStatsCache * ) cache->thread.next )
+    {
+        for ( category = 0; category < FUDGE_MEMORY_NUM_CATEGORIES; ++category )
+        {
+            counters = &( stats->categories [ category ] );
+            allocated [ category ] += cache->allocated [ category ];
+            freed [ category ] += cache->freed [ category ];
+            counters->allocations += cache->allocations [ category ];
+            counters->frees += cache->frees [ category ];
+        }
+    }
+
+    for ( category = 0; category < FUDGE_MEMORY_NUM_CATEGORIES; ++category )
+    {
+        counters = &( stats->categories [ category ] );
+        counters->currentbytes = allocated [ category ] > freed [ category ] ? allocated [ category ] - freed [ category ] : 0;
+        FudgeStats_updatePeak ( ( FudgeMemoryCategory ) category, counters->currentbytes );
+        counters->peakbytes = s_peak [ category ];
+    }
+    return FUDGE_OK;
+}
+
+#else
+
+void FudgeMemory_recordAllocation ( FudgeMemoryCategory category, size_t size ) { }
+void FudgeMemory_recordFree ( FudgeMemoryCategory category, size_t size ) { }
+void FudgeMemory_recordResize ( FudgeMemoryCategory category, size_t oldsize, size_t size ) { }
+
+void Fudge_setMemoryStatsEnabled ( fudge_bool enabled )
+{
+}
+
+FudgeStatus Fudge_getMemoryStats ( FudgeMemoryStats * stats )
+{
+    if ( ! stats )
+        return FUDGE_NULL_POINTER;
+
+    memset ( stats, 0, sizeof ( FudgeMemoryStats ) );
+    return FUDGE_OK;
+}
+
+#endif
+
+fudge_bool Fudge_getMemoryStatsEnabled ( )
+{
+    return s_memoryStatsEnabled;
+}
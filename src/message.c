@@ -18,12 +18,35 @@
 #include "fudge/message.h"
 #include "fudge/platform.h"
 #include "fudge/string.h"
+#include "arena_internal.h"
+#include "atomic.h"
+#include "codec_encode.h"
 #include "memory_internal.h"
 #include "message_internal.h"
 #include "fudge/header.h"
 #include "reference.h"
 #include "registry_internal.h"
+#include "string_internal.h"
+#include "thread.h"
 #include <assert.h>
+#include <stddef.h>
+
+/* Recycling and deferred release need somewhere to keep each thread's
+   released messages; the reclaimer thread needs pthreads */
+#if defined(FUDGE_THREAD_LOCAL)
+#   define FUDGEMSG_RECYCLING 1
+#   if defined(_MT) && defined(FUDGE_HAS_PTHREADS)
+#       define FUDGEMSG_RECYCLING_PTHREADS 1
+#       include <pthread.h>
+#   endif
+#endif
+
+/* Messages whose field arrays have grown beyond this are not recycled */
+#define FUDGEMSG_RECYCLE_MAX_FIELDS 1024
+
+/* Number of shared messages a thread retires before handing them to the
+   reclaimer thread */
+#define FUDGEMSG_RETIRE_BATCH 64
 
 void FudgeField_destroy ( FudgeField * fld )
 {
@@ -59,7 +82,9 @@ void FudgeField_destroy ( FudgeField * fld )
 
         /* Every other type will store its data in the bytes array */
         default:
-            FUDGEMEMORY_FREE( ( fudge_byte * ) fld->data.bytes );
+            if ( fld->data.bytes )
+                FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_BYTES, fld->numbytes );
+            FUDGEMEMORY_FREE( ( fudge_byte * ) fld->data.bytes, fld->numbytes );
             break;
     }
 
@@ -74,20 +99,24 @@ typedef struct FieldVector
            top;
 } FieldVector;
 
-FudgeStatus FieldVector_init ( FieldVector * vec, size_t initialcap )
+/* Vectors belonging to a message in an arena are allocated from the arena;
+   when they grow the old array is abandoned */
+FudgeStatus FieldVector_init ( FieldVector * vec, size_t initialcap, FudgeArena arena )
 {
     if ( ! vec ) return FUDGE_NULL_POINTER;
 
     vec->capacity = initialcap > 0u ? initialcap : 1u;;
     vec->top = 0u;
 
-    if ( ! ( vec->fields = FUDGEMEMORY_MALLOC( FudgeField *,
-                                               sizeof ( FudgeField ) * vec->capacity ) ) )
+    if ( ! ( vec->fields = arena ? ( FudgeField * ) FudgeArena_allocate ( arena, sizeof ( FudgeField ) * vec->capacity )
+                                 : FUDGEMEMORY_MALLOC( FudgeField *, sizeof ( FudgeField ) * vec->capacity ) ) )
         return FUDGE_OUT_OF_MEMORY;
+    if ( ! arena )
+        FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_FIELDS, sizeof ( FudgeField ) * vec->capacity );
     return FUDGE_OK;
 }
 
-FudgeStatus FieldVector_grow ( FieldVector * vec, size_t size )
+FudgeStatus FieldVector_grow ( FieldVector * vec, size_t size, FudgeArena arena )
 {
     FudgeField * newflds;
     size_t newcap;
@@ -98,87 +127,385 @@ FudgeStatus FieldVector_grow ( FieldVector * vec, size_t size )
     if ( ( newcap = vec->capacity * 2 ) <= size )
         newcap = size + 1;
 
-    if ( ! ( newflds = FUDGEMEMORY_REALLOC( FudgeField *,
+    if ( arena )
+    {
+        if ( ! ( newflds = ( FudgeField * ) FudgeArena_allocate ( arena, sizeof ( FudgeField ) * newcap ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        memcpy ( newflds, vec->fields, sizeof ( FudgeField ) * vec->top );
+    }
+    else if ( ! ( newflds = FUDGEMEMORY_REALLOC( FudgeField *,
                                             vec->fields,
+                                            sizeof ( FudgeField ) * vec->capacity,
                                             sizeof ( FudgeField ) * newcap ) ) )
         return FUDGE_OUT_OF_MEMORY;
+    else
+        FUDGEMEMORY_RECORD_RESIZE( FUDGE_MEMORY_FIELDS, sizeof ( FudgeField ) * vec->capacity, sizeof ( FudgeField ) * newcap );
     vec->fields = newflds;
     vec->capacity = newcap;
     return FUDGE_OK;
 }
 
-FudgeStatus FieldVector_append ( FieldVector * vec, FudgeField * fld )
+/* Makes room for the next field to be appended */
+FudgeStatus FieldVector_reserve ( FieldVector * vec, FudgeArena arena )
 {
-    size_t newtop;
-    FudgeStatus status;
+    if ( vec->top + 1 >= vec->capacity )
+        return FieldVector_grow ( vec, vec->top + 2, arena );
+    return FUDGE_OK;
+}
 
-    if ( ! ( vec && fld ) ) return FUDGE_NULL_POINTER;
+/* Appends the field: FieldVector_reserve must have been called first */
+void FieldVector_append ( FieldVector * vec, FudgeField * fld )
+{
+    assert ( vec->top < vec->capacity );
+    vec->fields [ vec->top++ ] = *fld;
+}
 
-    if ( ( newtop = vec->top + 1 ) >= vec->capacity )
-        if ( (status = FieldVector_grow ( vec, newtop + 1 ) ) )
-            return status;
+/* Destroys the fields, leaving the vector empty but with its capacity */
+void FieldVector_clear ( FieldVector * vec )
+{
+    size_t idx;
 
-    vec->fields [ vec->top ] = *fld;
-    vec->top = newtop;
-    return FUDGE_OK;
+    for ( idx = 0u; idx < vec->top; ++idx )
+        FudgeField_destroy ( &( vec->fields [ idx ] ) );
+    vec->top = 0u;
 }
 
 void FieldVector_destroy ( FieldVector * vec )
 {
-	size_t idx;
-
     assert ( vec && vec->fields );
 
-    for ( idx = 0u; idx < vec->top; ++idx )
-        FudgeField_destroy ( &( vec->fields [ idx ] ) );
+    FieldVector_clear ( vec );
 
-    FUDGEMEMORY_FREE( vec->fields );
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_FIELDS, sizeof ( FudgeField ) * vec->capacity );
+    FUDGEMEMORY_FREE( vec->fields, sizeof ( FudgeField ) * vec->capacity );
 }
 
+/* One of the messages holding a submessage, see FudgeMsgImpl::parents */
+typedef struct FudgeMsgParent
+{
+    struct FudgeMsgImpl * message;
+    struct FudgeMsgParent * next;
+} FudgeMsgParent;
+
 struct FudgeMsgImpl
 {
     FudgeRefCount refcount;
     FieldVector fields;
     fudge_i32 width;
+
+    /* Set by FudgeMsg_freeze: the fields, width and encoding are fixed */
+    fudge_bool frozen;
+
+    /* Optional copy of the encoded fields, see FudgeMsg_setEncodingCache */
+    fudge_bool cacheencoding;
+    fudge_byte * encoded;
+    fudge_i32 encodedsize;
+
+    /* The cache epoch when the message, or anything beneath it, last
+       changed */
+    size_t modified;
+
+    /* The messages holding this one as a submessage, so that a change can
+       be passed up to them (see FudgeMsg_touch). The first is held here and
+       any others in a list. Frozen messages can't change, so they aren't
+       linked to the messages they're added to. */
+    struct FudgeMsgImpl * parent;
+    FudgeMsgParent * parents;
+
+    /* Set for messages in an arena, which have no reference count. The
+       cleanup is registered with the arena once the message holds a
+       reference to an object outside the arena. */
+    FudgeArena arena;
+    FudgeArenaCleanup cleanup;
+
+    /* Links a released message in to its thread's recycle or retire list */
+    struct FudgeMsgImpl * recyclenext;
 };
 
+static size_t s_recycleLimit = 0;
+static fudge_bool s_deferRelease = FUDGE_FALSE;
+
+#ifdef FUDGEMSG_RECYCLING
+static FUDGE_THREAD_LOCAL FudgeMsg s_recycled = 0;
+static FUDGE_THREAD_LOCAL size_t s_numRecycled = 0;
+
+/* Retired messages: shared ones may be handed to the reclaimer thread,
+   confined ones are only ever destroyed by the thread that retired them */
+static FUDGE_THREAD_LOCAL FudgeMsg s_retired = 0;
+static FUDGE_THREAD_LOCAL FudgeMsg s_retiredTail = 0;
+static FUDGE_THREAD_LOCAL size_t s_numRetired = 0;
+static FUDGE_THREAD_LOCAL FudgeMsg s_retiredConfined = 0;
+
+/* Set while the thread is destroying retired messages, so that the
+   messages they release are destroyed immediately */
+static FUDGE_THREAD_LOCAL fudge_bool s_reclaiming = FUDGE_FALSE;
+
+/* Called as a thread exits: destroys its retired messages and then frees
+   its recycled ones */
+void FudgeMsg_releaseRecycled ( FudgeThreadExit * hook )
+{
+    ( void ) hook;
+    FudgeMsg_reclaimRetired ( );
+    FudgeMsg_flushRecycled ( );
+}
+
+static FUDGE_THREAD_LOCAL FudgeThreadExit s_recycleExit = { FudgeMsg_releaseRecycled, 0, FUDGE_FALSE };
+#endif /* ifdef FUDGEMSG_RECYCLING */
+
+#ifdef FUDGEMSG_RECYCLING_PTHREADS
+static pthread_mutex_t s_reclaimerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_reclaimerWake = PTHREAD_COND_INITIALIZER;
+static pthread_t s_reclaimer;
+static fudge_bool s_reclaimerRunning = FUDGE_FALSE;
+static fudge_bool s_reclaimerStop = FUDGE_FALSE;
+
+/* Retired messages handed off by other threads; protected by the lock */
+static FudgeMsg s_handedOff = 0;
+#endif /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+
+/* The cache epoch advances each time an encoding is cached. A change to a
+   message records the epoch it was made in, which lets FudgeMsg_markChanged
+   stop early when passing a change up the tree. Threaded builds without
+   atomic operations (which configure only allows where pthreads are
+   available) use a lock instead. */
+static volatile size_t s_cacheEpoch = 1;
+
+#if defined(_MT) && ! defined(FUDGE_HAS_ATOMICS)
+#   define FUDGEMSG_EPOCH_LOCKED 1
+#   include <pthread.h>
+static pthread_mutex_t s_cacheEpochLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+size_t FudgeMsg_currentEpoch ( )
+{
+#ifdef FUDGEMSG_EPOCH_LOCKED
+    size_t epoch;
+
+    pthread_mutex_lock ( &s_cacheEpochLock );
+    epoch = s_cacheEpoch;
+    pthread_mutex_unlock ( &s_cacheEpochLock );
+    return epoch;
+#else /* ifdef FUDGEMSG_EPOCH_LOCKED */
+    return AtomicLoadSize ( s_cacheEpoch );
+#endif /* ifdef FUDGEMSG_EPOCH_LOCKED */
+}
+
+/* Starts a new epoch, once an encoding has been cached */
+void FudgeMsg_advanceEpoch ( )
+{
+#ifdef FUDGEMSG_EPOCH_LOCKED
+    pthread_mutex_lock ( &s_cacheEpochLock );
+    ++s_cacheEpoch;
+    pthread_mutex_unlock ( &s_cacheEpochLock );
+#else /* ifdef FUDGEMSG_EPOCH_LOCKED */
+    ( void ) AtomicAddSize ( s_cacheEpoch, 1 );
+#endif /* ifdef FUDGEMSG_EPOCH_LOCKED */
+}
+
+void FudgeMsg_clearEncodedCache ( FudgeMsg message )
+{
+    if ( message->encoded )
+    {
+        if ( ! message->arena )
+        {
+            FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_BYTES, message->encodedsize ? message->encodedsize : 1 );
+            FUDGEMEMORY_FREE( message->encoded, message->encodedsize ? message->encodedsize : 1 );
+        }
+        message->encoded = 0;
+        message->encodedsize = 0;
+    }
+}
+
+/* Discards the width and encoded form of the message and of every message
+   holding it, directly or further up. The walk stops at a message that has
+   already changed in the current epoch and has not been measured or cached
+   since: everything above it was reset when it changed (or when it was
+   linked to its parents), and measuring any of those messages would have
+   measured it too. Caching an encoding starts a new epoch. */
+void FudgeMsg_markChanged ( FudgeMsg message, size_t epoch )
+{
+    FudgeMsgParent * link;
+
+    while ( message && ! ( message->modified == epoch && message->width < 0 && ! message->encoded ) )
+    {
+        message->width = -1;
+        message->modified = epoch;
+        FudgeMsg_clearEncodedCache ( message );
+
+        for ( link = message->parents; link; link = link->next )
+            FudgeMsg_markChanged ( link->message, epoch );
+        message = message->parent;
+    }
+}
+
+/* Records a change to the message, which invalidates its width and encoded
+   form, and those of every message that holds it */
+void FudgeMsg_touch ( FudgeMsg message )
+{
+    FudgeMsg_markChanged ( message, FudgeMsg_currentEpoch ( ) );
+}
+
+/* Records that parent holds the submessage. Frozen submessages are not
+   linked, as they can't change. */
+FudgeStatus FudgeMsg_linkParent ( FudgeMsg submessage, FudgeMsg parent )
+{
+    FudgeMsgParent * link;
+
+    if ( submessage->frozen )
+        return FUDGE_OK;
+    if ( ! submessage->parent )
+    {
+        submessage->parent = parent;
+        return FUDGE_OK;
+    }
+
+    /* Links for a message in an arena come from the arena, and so last as
+       long as the message */
+    if ( ! ( link = submessage->arena ? ( FudgeMsgParent * ) FudgeArena_allocate ( submessage->arena, sizeof ( FudgeMsgParent ) )
+                                      : FUDGEMEMORY_MALLOC( FudgeMsgParent *, sizeof ( FudgeMsgParent ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    link->message = parent;
+    link->next = submessage->parents;
+    submessage->parents = link;
+    return FUDGE_OK;
+}
+
+/* Removes one link between the submessage and parent, if there is one */
+void FudgeMsg_unlinkParent ( FudgeMsg submessage, FudgeMsg parent )
+{
+    FudgeMsgParent * link, * * previous;
+
+    if ( submessage->parent == parent )
+    {
+        submessage->parent = 0;
+        return;
+    }
+
+    for ( previous = &( submessage->parents ); ( link = *previous ); previous = &( link->next ) )
+    {
+        if ( link->message == parent )
+        {
+            *previous = link->next;
+            if ( ! submessage->arena )
+                FUDGEMEMORY_FREE( link, sizeof ( FudgeMsgParent ) );
+            return;
+        }
+    }
+}
+
+/* Unlinks the message from all of its submessages, before its fields are
+   destroyed */
+void FudgeMsg_unlinkSubmessages ( FudgeMsg message )
+{
+    size_t index;
+
+    for ( index = 0; index < message->fields.top; ++index )
+        if ( FudgeRegistry_getTypeDesc ( message->fields.fields [ index ].type )->payload == FUDGE_TYPE_PAYLOAD_SUBMSG )
+            FudgeMsg_unlinkParent ( message->fields.fields [ index ].data.message, message );
+}
+
+/* Releases the references held by an arena message's fields. Only those to
+   objects outside the arena do anything. */
+void FudgeMsg_releaseExternal ( FudgeArenaCleanup * cleanup )
+{
+    FudgeMsg message = ( FudgeMsg ) ( ( fudge_byte * ) cleanup - offsetof ( struct FudgeMsgImpl, cleanup ) );
+    size_t index;
+
+    FudgeMsg_unlinkSubmessages ( message );
+    for ( index = 0; index < message->fields.top; ++index )
+    {
+        FudgeField * field = message->fields.fields + index;
+
+        if ( field->name )
+            FudgeString_release ( field->name );
+        switch ( FudgeRegistry_getTypeDesc ( field->type )->payload )
+        {
+            case FUDGE_TYPE_PAYLOAD_SUBMSG: FudgeMsg_release ( field->data.message ); break;
+            case FUDGE_TYPE_PAYLOAD_STRING: FudgeString_release ( field->data.string ); break;
+            default:                        break;
+        }
+    }
+}
+
+/* Shares the objects referenced by a field (see FudgeMsg_share) */
+void FudgeMsg_shareField ( FudgeField * field )
+{
+    if ( field->name )
+        FudgeString_share ( field->name );
+    switch ( FudgeRegistry_getTypeDesc ( field->type )->payload )
+    {
+        case FUDGE_TYPE_PAYLOAD_SUBMSG: FudgeMsg_share ( field->data.message ); break;
+        case FUDGE_TYPE_PAYLOAD_STRING: FudgeString_share ( field->data.string ); break;
+        default:                        break;
+    }
+}
+
 FudgeStatus FudgeMsg_addFieldData ( FudgeMsg message,
                                     fudge_type_id type,
                                     const FudgeString name,
                                     const fudge_i16 * ordinal,
                                     FudgeFieldData * data,
                                     fudge_i32 numbytes )
+{
+    return FudgeMsg_appendField ( message, type, name, ordinal, data, numbytes, FUDGE_FALSE );
+}
+
+FudgeStatus FudgeMsg_appendField ( FudgeMsg message,
+                                   fudge_type_id type,
+                                   const FudgeString name,
+                                   const fudge_i16 * ordinal,
+                                   FudgeFieldData * data,
+                                   fudge_i32 numbytes,
+                                   fudge_bool arenabytes )
 {
     FudgeStatus status;
     FudgeField field;
     const FudgeTypeDesc * typedesc = FudgeRegistry_getTypeDesc ( type );
+    fudge_byte * original = 0;
 
     if ( ! ( message && data ) )
         return FUDGE_NULL_POINTER;
 
-    /* Adding a field will invalidate the message's width */
-    message->width = -1;
-
-    /* Initialise the new new */
-    field.type = type;
-    field.numbytes = numbytes;
-    field.flags = 0;
-
-    /* Copy across the data */
     if ( typedesc->payload == FUDGE_TYPE_PAYLOAD_SUBMSG && ! data->message )
         return FUDGE_NULL_POINTER;
     else if ( typedesc->payload == FUDGE_TYPE_PAYLOAD_STRING && ! data->string )
         return FUDGE_NULL_POINTER;
+
+    if ( message->frozen )
+        return FUDGE_MESSAGE_FROZEN;
+
+    /* Names may not have a length greater than 255 bytes (only one byte is
+       available for their length) */
+    if ( name && FudgeString_getSize ( name ) >= 256 )
+        return FUDGE_NAME_TOO_LONG;
+
+    /* Make room for the field first: once this succeeds the message takes
+       responsibility for the data */
+    if ( ( status = FieldVector_reserve ( &message->fields, message->arena ) ) != FUDGE_OK )
+        return status;
+
     field.data = *data;
+    if ( message->arena && ! arenabytes && typedesc->payload == FUDGE_TYPE_PAYLOAD_BYTES && numbytes )
+    {
+        /* Byte data is moved in to the arena, so the arena never needs to
+           free it */
+        if ( ! ( field.data.bytes = ( fudge_byte * ) FudgeArena_allocate ( message->arena, numbytes ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        memcpy ( ( fudge_byte * ) field.data.bytes, data->bytes, numbytes );
+        original = ( fudge_byte * ) data->bytes;
+    }
+
+    /* Adding a field will invalidate the message's width and encoded form */
+    FudgeMsg_touch ( message );
+
+    /* Initialise the new field */
+    field.type = type;
+    field.numbytes = numbytes;
+    field.flags = 0;
 
     /* Set the field name (if required) */
     if ( name )
     {
-        /* Names may not have a length greater than 255 bytes (only one byte is
-           available for their length) */
-        if ( FudgeString_getSize ( name ) >= 256 )
-            return FUDGE_NAME_TOO_LONG;
-
         if ( ( status = FudgeString_retain ( name ) ) != FUDGE_OK )
             return status;
 
@@ -197,41 +524,262 @@ FudgeStatus FudgeMsg_addFieldData ( FudgeMsg message,
     else
         field.ordinal = 0;
 
-    /* Append the node to the message's list */
-    if ( ( status = FieldVector_append ( &message->fields, &field ) ) )
+    /* Changes to the submessage must reach this message too */
+    if ( typedesc->payload == FUDGE_TYPE_PAYLOAD_SUBMSG &&
+         ( status = FudgeMsg_linkParent ( field.data.message, message ) ) != FUDGE_OK )
     {
-        FudgeField_destroy ( &field );
+        if ( name )
+            FudgeString_release ( name );
         return status;
     }
+
+    /* Append the node to the message's list */
+    FieldVector_append ( &message->fields, &field );
+
+    if ( ! message->arena )
+    {
+        if ( typedesc->payload == FUDGE_TYPE_PAYLOAD_BYTES && field.data.bytes )
+            FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_BYTES, numbytes );
+
+        /* Everything held by a shared message must be shared too */
+        if ( FudgeRefCount_isShared ( message->refcount ) )
+            FudgeMsg_shareField ( &field );
+    }
+    else
+    {
+        FUDGEMEMORY_FREE( original, numbytes );
+
+        /* References to objects outside the arena are released with it */
+        if ( ! message->cleanup.run &&
+             ( ( name && FudgeString_isReferenceCounted ( name ) ) ||
+               ( typedesc->payload == FUDGE_TYPE_PAYLOAD_STRING && FudgeString_isReferenceCounted ( field.data.string ) ) ||
+               ( typedesc->payload == FUDGE_TYPE_PAYLOAD_SUBMSG && field.data.message->refcount ) ) )
+        {
+            message->cleanup.run = FudgeMsg_releaseExternal;
+            FudgeArena_addCleanup ( message->arena, &message->cleanup );
+        }
+    }
     return FUDGE_OK;
 }
 
+/* Frees an empty message */
+FudgeStatus FudgeMsg_deallocate ( FudgeMsg message )
+{
+    FudgeStatus status;
+
+    if ( ( status = FudgeRefCount_destroy ( message->refcount ) ) != FUDGE_OK )
+        return status;
+
+    FieldVector_destroy ( &message->fields );
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_MESSAGES, sizeof ( struct FudgeMsgImpl ) );
+    FUDGEMEMORY_FREE( message, sizeof ( struct FudgeMsgImpl ) );
+    return FUDGE_OK;
+}
+
+/* Adds an empty message to the calling thread's recycle list, returning
+   false if the list is full or the message shouldn't be kept */
+fudge_bool FudgeMsg_recycle ( FudgeMsg message )
+{
+#ifdef FUDGEMSG_RECYCLING
+    if ( s_numRecycled >= s_recycleLimit || message->fields.capacity > FUDGEMSG_RECYCLE_MAX_FIELDS )
+        return FUDGE_FALSE;
+
+    FudgeThread_atExit ( &s_recycleExit );
+
+    message->recyclenext = s_recycled;
+    s_recycled = message;
+    ++s_numRecycled;
+    return FUDGE_TRUE;
+#else /* ifdef FUDGEMSG_RECYCLING */
+    return FUDGE_FALSE;
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+/* Takes a message from the calling thread's recycle list, if there are
+   any */
+fudge_bool FudgeMsg_reuseRecycled ( FudgeMsg * messageptr )
+{
+#ifdef FUDGEMSG_RECYCLING
+    if ( ! ( *messageptr = s_recycled ) )
+        return FUDGE_FALSE;
+
+    s_recycled = ( *messageptr )->recyclenext;
+    --s_numRecycled;
+    FudgeRefCount_reset ( ( *messageptr )->refcount );
+    return FUDGE_TRUE;
+#else /* ifdef FUDGEMSG_RECYCLING */
+    return FUDGE_FALSE;
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+/* Destroys a message whose last reference has been released: its fields
+   are released and the message itself is recycled or freed */
+FudgeStatus FudgeMsg_destroy ( FudgeMsg message )
+{
+    FudgeMsg_unlinkSubmessages ( message );
+    FieldVector_clear ( &message->fields );
+    FudgeMsg_clearEncodedCache ( message );
+
+    if ( ! FudgeMsg_recycle ( message ) )
+        return FudgeMsg_deallocate ( message );
+    return FUDGE_OK;
+}
+
+/* Destroys a list of retired messages */
+void FudgeMsg_destroyRetired ( FudgeMsg retired )
+{
+#ifdef FUDGEMSG_RECYCLING
+    FudgeMsg next;
+
+    s_reclaiming = FUDGE_TRUE;
+    for ( ; retired; retired = next )
+    {
+        next = retired->recyclenext;
+        FudgeMsg_destroy ( retired );
+    }
+    s_reclaiming = FUDGE_FALSE;
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+#ifdef FUDGEMSG_RECYCLING_PTHREADS
+void * FudgeMsg_runReclaimer ( void * unused )
+{
+    FudgeMsg retired;
+    fudge_bool stop;
+
+    ( void ) unused;
+    do
+    {
+        pthread_mutex_lock ( &s_reclaimerLock );
+        while ( ! s_reclaimerStop && ! s_handedOff )
+            pthread_cond_wait ( &s_reclaimerWake, &s_reclaimerLock );
+        retired = s_handedOff;
+        s_handedOff = 0;
+        stop = s_reclaimerStop;
+        pthread_mutex_unlock ( &s_reclaimerLock );
+
+        /* Messages are not kept for reuse on this thread: nothing here
+           would create them */
+        FudgeMsg_destroyRetired ( retired );
+        FudgeMsg_flushRecycled ( );
+    } while ( ! stop );
+    return 0;
+}
+
+/* Passes the calling thread's shared retired messages to the reclaimer
+   thread, if it is running */
+void FudgeMsg_handOffRetired ( )
+{
+    pthread_mutex_lock ( &s_reclaimerLock );
+    if ( s_reclaimerRunning )
+    {
+        s_retiredTail->recyclenext = s_handedOff;
+        s_handedOff = s_retired;
+        s_retired = s_retiredTail = 0;
+        s_numRetired = 0;
+        pthread_cond_signal ( &s_reclaimerWake );
+    }
+    pthread_mutex_unlock ( &s_reclaimerLock );
+}
+#endif /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+
+/* Adds a message whose last reference has been released to the calling
+   thread's retire list, returning false if it should be destroyed now */
+fudge_bool FudgeMsg_retire ( FudgeMsg message )
+{
+#ifdef FUDGEMSG_RECYCLING
+    if ( ! s_deferRelease || s_reclaiming )
+        return FUDGE_FALSE;
+
+    FudgeThread_atExit ( &s_recycleExit );
+
+    /* Destroying a confined message on another thread would race with this
+       thread's use of the (non-atomic) counts of the objects it holds */
+    if ( ! FudgeRefCount_isShared ( message->refcount ) )
+    {
+        message->recyclenext = s_retiredConfined;
+        s_retiredConfined = message;
+        return FUDGE_TRUE;
+    }
+
+    if ( ! s_retired )
+        s_retiredTail = message;
+    message->recyclenext = s_retired;
+    s_retired = message;
+
+#ifdef FUDGEMSG_RECYCLING_PTHREADS
+    if ( ++s_numRetired % FUDGEMSG_RETIRE_BATCH == 0 )
+        FudgeMsg_handOffRetired ( );
+#endif /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+    return FUDGE_TRUE;
+#else /* ifdef FUDGEMSG_RECYCLING */
+    return FUDGE_FALSE;
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
 FudgeStatus FudgeMsg_create ( FudgeMsg * messageptr )
+{
+    return FudgeMsg_createInArena ( messageptr, 0 );
+}
+
+FudgeStatus FudgeMsg_createInArena ( FudgeMsg * messageptr, FudgeArena arena )
 {
     FudgeStatus status;
 
-    if ( ! ( *messageptr = FUDGEMEMORY_MALLOC( FudgeMsg, sizeof ( struct FudgeMsgImpl ) ) ) )
-        return FUDGE_OUT_OF_MEMORY;
+    if ( ! messageptr )
+        return FUDGE_NULL_POINTER;
+
+    if ( arena )
+    {
+        if ( ! ( *messageptr = ( FudgeMsg ) FudgeArena_allocate ( arena, sizeof ( struct FudgeMsgImpl ) ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        if ( ( status = FieldVector_init ( &( *messageptr )->fields, 16, arena ) ) )
+            return status;
+        ( *messageptr )->refcount = 0;
+    }
+    else if ( ! FudgeMsg_reuseRecycled ( messageptr ) )
+    {
+        if ( ! ( *messageptr = FUDGEMEMORY_MALLOC( FudgeMsg, sizeof ( struct FudgeMsgImpl ) ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_MESSAGES, sizeof ( struct FudgeMsgImpl ) );
 
-    if ( ( status = FudgeRefCount_create ( &( ( *messageptr )->refcount ) ) ) )
-        goto release_message_and_fail;
-    if ( ( status = FieldVector_init ( &( *messageptr )->fields, 16 ) ) )
-        goto release_message_and_fail;
+        if ( ( status = FudgeRefCount_create ( &( ( *messageptr )->refcount ) ) ) )
+            goto release_message_and_fail;
+        if ( ( status = FieldVector_init ( &( *messageptr )->fields, 16, 0 ) ) )
+            goto release_message_and_fail;
+    }
 
     ( *messageptr )->width = -1;
+    ( *messageptr )->frozen = FUDGE_FALSE;
+    ( *messageptr )->cacheencoding = FUDGE_FALSE;
+    ( *messageptr )->encoded = 0;
+    ( *messageptr )->encodedsize = 0;
+    ( *messageptr )->modified = FudgeMsg_currentEpoch ( );
+    ( *messageptr )->parent = 0;
+    ( *messageptr )->parents = 0;
+    ( *messageptr )->arena = arena;
+    ( *messageptr )->cleanup.run = 0;
     return FUDGE_OK;
 
 release_message_and_fail:
-    FUDGEMEMORY_FREE( *messageptr );
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_MESSAGES, sizeof ( struct FudgeMsgImpl ) );
+    FUDGEMEMORY_FREE( *messageptr, sizeof ( struct FudgeMsgImpl ) );
     return status;
 }
 
+FudgeArena FudgeMsg_getArena ( const FudgeMsg message )
+{
+    return message->arena;
+}
+
 FudgeStatus FudgeMsg_retain ( FudgeMsg message )
 {
     if ( ! message )
         return FUDGE_NULL_POINTER;
 
-    FudgeRefCount_increment ( message->refcount );
+    /* Messages in an arena aren't reference counted */
+    if ( message->refcount )
+        FudgeRefCount_increment ( message->refcount );
     return FUDGE_OK;
 }
 
@@ -240,20 +788,211 @@ FudgeStatus FudgeMsg_release ( FudgeMsg message )
     if ( ! message )
         return FUDGE_NULL_POINTER;
 
-    if ( ! FudgeRefCount_decrementAndReturn ( message->refcount ) )
+    if ( message->refcount && ! FudgeRefCount_decrementAndReturn ( message->refcount ) )
     {
-        /* Last reference has been released - destroy the message and all of its fields */
-        FudgeStatus status;
+        /* Last reference has been released - retire the message or destroy
+           it now */
+        if ( ! FudgeMsg_retire ( message ) )
+            return FudgeMsg_destroy ( message );
+    }
+    return FUDGE_OK;
+}
 
-        if ( ( status = FudgeRefCount_destroy ( message->refcount ) ) != FUDGE_OK )
+FudgeStatus FudgeMsg_share ( FudgeMsg message )
+{
+    size_t index;
+
+    if ( ! message )
+        return FUDGE_NULL_POINTER;
+
+    /* The fields of a message that is already shared are shared too */
+    if ( ! message->refcount || FudgeRefCount_isShared ( message->refcount ) )
+        return FUDGE_OK;
+
+    FudgeRefCount_share ( message->refcount );
+    for ( index = 0; index < message->fields.top; ++index )
+        FudgeMsg_shareField ( message->fields.fields + index );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeMsg_freeze ( FudgeMsg message, fudge_bool cacheencoding )
+{
+    FudgeStatus status;
+    size_t index;
+    fudge_i32 numbytes;
+    fudge_byte * bytes, * writepos;
+
+    if ( ! message )
+        return FUDGE_NULL_POINTER;
+    if ( message->frozen )
+        return FUDGE_OK;
+
+    /* Submessages are frozen first, so their widths (and any encodings they
+       cache) are in place before this message's are calculated. Only the
+       top-level message is given an encoding cache: there's no need for a
+       copy of every level of the tree. */
+    for ( index = 0; index < message->fields.top; ++index )
+        if ( FudgeRegistry_getTypeDesc ( message->fields.fields [ index ].type )->payload == FUDGE_TYPE_PAYLOAD_SUBMSG )
+            if ( ( status = FudgeMsg_freeze ( message->fields.fields [ index ].data.message, FUDGE_FALSE ) ) != FUDGE_OK )
+                return status;
+
+    if ( cacheencoding )
+        message->cacheencoding = FUDGE_TRUE;
+
+    if ( ( status = FudgeCodec_getMessageLength ( message, &numbytes ) ) != FUDGE_OK )
+        return status;
+
+    /* Encoding the message populates its cache; the bytes written here are
+       only needed for the duration of the encode */
+    if ( message->cacheencoding && ! message->encoded )
+    {
+        if ( ! ( bytes = FUDGEMEMORY_MALLOC( fudge_byte *, numbytes ? numbytes : 1 ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        writepos = bytes;
+        status = FudgeCodec_encodeMsgFields ( message, &writepos );
+        FUDGEMEMORY_FREE( bytes, numbytes ? numbytes : 1 );
+        if ( status != FUDGE_OK )
             return status;
+    }
 
-        FieldVector_destroy ( &message->fields );
-        FUDGEMEMORY_FREE( message );
+    if ( ( status = FudgeMsg_share ( message ) ) != FUDGE_OK )
+        return status;
+    message->frozen = FUDGE_TRUE;
+    return FUDGE_OK;
+}
+
+fudge_bool FudgeMsg_isFrozen ( const FudgeMsg message )
+{
+    return message && message->frozen;
+}
+
+FudgeStatus FudgeMsg_clear ( FudgeMsg message )
+{
+    if ( ! message )
+        return FUDGE_NULL_POINTER;
+    if ( message->frozen )
+        return FUDGE_MESSAGE_FROZEN;
+
+    /* The fields of a message in an arena only hold references to objects
+       outside it */
+    if ( message->arena )
+    {
+        FudgeMsg_releaseExternal ( &message->cleanup );
+        message->fields.top = 0u;
     }
+    else
+    {
+        FudgeMsg_unlinkSubmessages ( message );
+        FieldVector_clear ( &message->fields );
+    }
+
+    FudgeMsg_touch ( message );
     return FUDGE_OK;
 }
 
+void FudgeMsg_setRecycleLimit ( size_t limit )
+{
+#ifdef FUDGEMSG_RECYCLING
+    s_recycleLimit = limit;
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+size_t FudgeMsg_getRecycleLimit ( )
+{
+    return s_recycleLimit;
+}
+
+void FudgeMsg_flushRecycled ( )
+{
+#ifdef FUDGEMSG_RECYCLING
+    FudgeMsg message;
+
+    while ( ( message = s_recycled ) )
+    {
+        s_recycled = message->recyclenext;
+        --s_numRecycled;
+        FudgeMsg_deallocate ( message );
+    }
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+void FudgeMsg_setDeferredRelease ( fudge_bool enabled )
+{
+#ifdef FUDGEMSG_RECYCLING
+    s_deferRelease = enabled;
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+fudge_bool FudgeMsg_getDeferredRelease ( )
+{
+    return s_deferRelease;
+}
+
+void FudgeMsg_reclaimRetired ( )
+{
+#ifdef FUDGEMSG_RECYCLING
+    FudgeMsg retired = s_retired,
+             confined = s_retiredConfined;
+
+    s_retired = s_retiredTail = s_retiredConfined = 0;
+    s_numRetired = 0;
+    FudgeMsg_destroyRetired ( retired );
+    FudgeMsg_destroyRetired ( confined );
+#endif /* ifdef FUDGEMSG_RECYCLING */
+}
+
+FudgeStatus FudgeMsg_startReclaimer ( )
+{
+#ifdef FUDGEMSG_RECYCLING_PTHREADS
+    FudgeStatus status = FUDGE_OK;
+
+    pthread_mutex_lock ( &s_reclaimerLock );
+    if ( ! s_reclaimerRunning )
+    {
+        s_reclaimerStop = FUDGE_FALSE;
+        if ( pthread_create ( &s_reclaimer, 0, FudgeMsg_runReclaimer, 0 ) )
+            status = FUDGE_OUT_OF_MEMORY;
+        else
+            s_reclaimerRunning = FUDGE_TRUE;
+    }
+    pthread_mutex_unlock ( &s_reclaimerLock );
+    return status;
+#else /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+    return FUDGE_NOT_SUPPORTED;
+#endif /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+}
+
+FudgeStatus FudgeMsg_stopReclaimer ( )
+{
+#ifdef FUDGEMSG_RECYCLING_PTHREADS
+    FudgeMsg retired;
+
+    pthread_mutex_lock ( &s_reclaimerLock );
+    if ( ! s_reclaimerRunning )
+    {
+        pthread_mutex_unlock ( &s_reclaimerLock );
+        return FUDGE_OK;
+    }
+    s_reclaimerStop = FUDGE_TRUE;
+    pthread_cond_signal ( &s_reclaimerWake );
+    pthread_mutex_unlock ( &s_reclaimerLock );
+
+    pthread_join ( s_reclaimer, 0 );
+
+    /* Destroy anything handed off after the reclaimer's last pass */
+    pthread_mutex_lock ( &s_reclaimerLock );
+    s_reclaimerRunning = FUDGE_FALSE;
+    retired = s_handedOff;
+    s_handedOff = 0;
+    pthread_mutex_unlock ( &s_reclaimerLock );
+
+    FudgeMsg_destroyRetired ( retired );
+    return FUDGE_OK;
+#else /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+    return FUDGE_NOT_SUPPORTED;
+#endif /* ifdef FUDGEMSG_RECYCLING_PTHREADS */
+}
+
 unsigned long FudgeMsg_numFields ( FudgeMsg message )
 {
     return message ? message->fields.top : 0lu;
@@ -361,15 +1100,17 @@ FudgeStatus FudgeMsg_addFieldOpaque ( FudgeMsg message,
 
     if ( numbytes )
     {
-        if ( ! ( data.bytes = FUDGEMEMORY_MALLOC( fudge_byte *, numbytes ) ) )
+        if ( ! ( data.bytes = message->arena ? ( fudge_byte * ) FudgeArena_allocate ( message->arena, numbytes )
+                                             : FUDGEMEMORY_MALLOC( fudge_byte *, numbytes ) ) )
             return FUDGE_OUT_OF_MEMORY;
         memcpy ( ( fudge_byte * ) data.bytes, bytes, numbytes );
     }
     else
         data.bytes = 0;
 
-    if ( ( status = FudgeMsg_addFieldData ( message, type, name, ordinal, &data, numbytes ) ) != FUDGE_OK )
-        FUDGEMEMORY_FREE( ( fudge_byte * ) data.bytes );
+    if ( ( status = FudgeMsg_appendField ( message, type, name, ordinal, &data, numbytes, FUDGE_TRUE ) ) != FUDGE_OK &&
+         ! message->arena )
+        FUDGEMEMORY_FREE( ( fudge_byte * ) data.bytes, numbytes );
     return status;
 }
 
@@ -483,7 +1224,7 @@ FudgeStatus FudgeMsg_getFieldByName ( FudgeField * field, const FudgeMsg message
         return FUDGE_NULL_POINTER;
 
     for ( idx = 0u; idx < message->fields.top; ++idx )
-        if ( FudgeString_compare ( message->fields.fields [ idx ].name, name ) == 0 )
+        if ( FudgeString_equals ( message->fields.fields [ idx ].name, name ) )
         {
             *field = message->fields.fields [ idx ];
             return FUDGE_OK;
@@ -526,6 +1267,8 @@ FudgeStatus FudgeMsg_setWidth ( FudgeMsg message, fudge_i32 width )
 {
     if ( ! message )
         return FUDGE_NULL_POINTER;
+    if ( message->frozen )
+        return FUDGE_MESSAGE_FROZEN;
 
     message->width = width;
     return FUDGE_OK;
@@ -536,3 +1279,58 @@ fudge_i32 FudgeMsg_getWidth ( const FudgeMsg message )
     return message ? message->width : -1;
 }
 
+
+FudgeStatus FudgeMsg_setEncodingCache ( FudgeMsg message, fudge_bool enabled )
+{
+    if ( ! message )
+        return FUDGE_NULL_POINTER;
+    if ( message->frozen )
+        return FUDGE_MESSAGE_FROZEN;
+
+    message->cacheencoding = enabled;
+    if ( ! enabled )
+        FudgeMsg_clearEncodedCache ( message );
+    return FUDGE_OK;
+}
+
+fudge_bool FudgeMsg_isEncodingCached ( const FudgeMsg message )
+{
+    return message && message->cacheencoding;
+}
+
+const fudge_byte * FudgeMsg_getEncodedCache ( const FudgeMsg message, fudge_i32 * numbytes )
+{
+    if ( ! ( message && message->encoded ) )
+        return 0;
+
+    *numbytes = message->encodedsize;
+    return message->encoded;
+}
+
+FudgeStatus FudgeMsg_setEncodedCache ( FudgeMsg message, const fudge_byte * bytes, fudge_i32 numbytes )
+{
+    if ( ! ( message && bytes ) )
+        return FUDGE_NULL_POINTER;
+
+    /* Only store the encoding if the message has opted in to caching. A
+       frozen message's cache (if it has one) was filled when it was frozen
+       and must not change, as other threads may be reading it. */
+    if ( ! message->cacheencoding || message->frozen )
+        return FUDGE_OK;
+
+    FudgeMsg_clearEncodedCache ( message );
+
+    /* Empty messages use a dummy allocation so they can be cached too */
+    if ( ! ( message->encoded = message->arena ? ( fudge_byte * ) FudgeArena_allocate ( message->arena, numbytes ? numbytes : 1 )
+                                               : FUDGEMEMORY_MALLOC( fudge_byte *, numbytes ? numbytes : 1 ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    if ( ! message->arena )
+        FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_BYTES, numbytes ? numbytes : 1 );
+    memcpy ( message->encoded, bytes, numbytes );
+    message->encodedsize = numbytes;
+
+    /* A change beneath the message must now reach it, see
+       FudgeMsg_markChanged */
+    FudgeMsg_advanceEpoch ( );
+    return FUDGE_OK;
+}
@@ -19,5 +19,29 @@
 FudgeStatus FudgeMsg_setWidth ( FudgeMsg message, fudge_i32 width );
 fudge_i32 FudgeMsg_getWidth ( const FudgeMsg message );
 
+/* Access to the message's cached encoding (see FudgeMsg_setEncodingCache).
+   The get function returns NULL if there is no cached encoding; a change to
+   the message or anything beneath it discards the cache straight away. The
+   set function copies
+   the bytes provided, but only if the message has caching enabled;
+   otherwise it does nothing. */
+fudge_bool FudgeMsg_isEncodingCached ( const FudgeMsg message );
+const fudge_byte * FudgeMsg_getEncodedCache ( const FudgeMsg message, fudge_i32 * numbytes );
+FudgeStatus FudgeMsg_setEncodedCache ( FudgeMsg message, const fudge_byte * bytes, fudge_i32 numbytes );
+
+/* As FudgeMsg_addFieldData, but if arenabytes is true any byte data is
+   already in the message's arena (and so isn't copied in to it) */
+FudgeStatus FudgeMsg_appendField ( FudgeMsg message,
+                                   fudge_type_id type,
+                                   const FudgeString name,
+                                   const fudge_i16 * ordinal,
+                                   FudgeFieldData * data,
+                                   fudge_i32 numbytes,
+                                   fudge_bool arenabytes );
+
+/* Returns the smallest integer type that can hold the value, but no smaller
+   than the type provided */
+fudge_type_id FudgeMsg_pickIntegerType ( const fudge_type_id type, const fudge_i64 value );
+
 #endif
 
@@ -0,0 +1,329 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _FUDGEQUEUEIMPL_DEFINED 1
+#include "fudge/queue.h"
+#include "atomic.h"
+#include "memory_internal.h"
+#include "reference.h"
+#include <stddef.h>
+
+/* The push and pop positions are kept at least this far apart, so that the
+   pushing and popping threads aren't contending for the same cache line */
+#define FUDGEQUEUE_CACHE_LINE 64
+
+/* The MPMC queue is a ring of cells, each with a sequence number that says
+   whether it's ready to be pushed to or popped from at a given position
+   (the number of objects pushed or popped before it, which only ever
+   increases). A cell is free for the push at position p when its sequence
+   is p, and holds the object for the pop at p when its sequence is p + 1.
+   Popping sets it to p + capacity, freeing it for the next pass around the
+   ring. Threads claim a run of positions with a single compare and
+   exchange, having first checked that every cell in the run is ready.
+
+   The SPSC queue uses the same cells, but only the push and pop positions
+   are needed: each is written by a single thread. */
+typedef struct
+{
+    volatile size_t sequence;
+    union
+    {
+        FudgeMsgEnvelope envelope;
+        FudgeMsg message;
+    } item;
+} FudgeQueueCell;
+
+struct FudgeQueueImpl
+{
+    FudgeRefCount refcount;
+    FudgeQueueContents contents;
+    FudgeQueueMode mode;
+    size_t mask;
+    FudgeQueueCell * cells;
+
+    char pushpadding [ FUDGEQUEUE_CACHE_LINE ];
+    volatile size_t pushpos;
+    size_t poppedcache;         /* SPSC only: the pushing thread's copy of poppos */
+
+    char poppadding [ FUDGEQUEUE_CACHE_LINE ];
+    volatile size_t poppos;
+    size_t pushedcache;         /* SPSC only: the popping thread's copy of pushpos */
+
+    char endpadding [ FUDGEQUEUE_CACHE_LINE ];
+};
+
+/* Claims up to count positions for pushing, returning the number claimed
+   and setting pos to the first of them */
+size_t FudgeQueue_claimPush ( FudgeQueue queue, size_t count, size_t * pos )
+{
+    size_t num, previous, sequence;
+
+    if ( queue->mode == FUDGE_QUEUE_SPSC )
+    {
+        *pos = queue->pushpos;
+        if ( queue->mask + 1 - ( *pos - queue->poppedcache ) < count )
+            queue->poppedcache = AtomicLoadSize ( queue->poppos );
+        num = queue->mask + 1 - ( *pos - queue->poppedcache );
+        return num < count ? num : count;
+    }
+
+    *pos = AtomicLoadSize ( queue->pushpos );
+    for ( ;; )
+    {
+        for ( num = 0; num < count; ++num )
+            if ( AtomicLoadSize ( queue->cells [ ( *pos + num ) & queue->mask ].sequence ) != *pos + num )
+                break;
+
+        if ( ! num )
+        {
+            /* If the first cell is still waiting to be popped from the
+               previous pass the queue is full; otherwise another thread has
+               pushed to it, so try again from the new position */
+            sequence = AtomicLoadSize ( queue->cells [ *pos & queue->mask ].sequence );
+            if ( ( ptrdiff_t ) ( sequence - *pos ) < 0 )
+                return 0;
+            *pos = AtomicLoadSize ( queue->pushpos );
+        }
+        else if ( ( previous = AtomicCompareExchangeSize ( queue->pushpos, *pos, *pos + num ) ) == *pos )
+            return num;
+        else
+            *pos = previous;
+    }
+}
+
+/* Makes the objects written to the claimed cells available for popping */
+void FudgeQueue_completePush ( FudgeQueue queue, size_t pos, size_t num )
+{
+    size_t index;
+
+    if ( queue->mode == FUDGE_QUEUE_SPSC )
+        AtomicStoreSize ( queue->pushpos, pos + num );
+    else
+        for ( index = 0; index < num; ++index )
+            AtomicStoreSize ( queue->cells [ ( pos + index ) & queue->mask ].sequence, pos + index + 1 );
+}
+
+/* Claims up to count positions for popping, returning the number claimed
+   and setting pos to the first of them */
+size_t FudgeQueue_claimPop ( FudgeQueue queue, size_t count, size_t * pos )
+{
+    size_t num, previous, sequence;
+
+    if ( queue->mode == FUDGE_QUEUE_SPSC )
+    {
+        *pos = queue->poppos;
+        if ( queue->pushedcache - *pos < count )
+            queue->pushedcache = AtomicLoadSize ( queue->pushpos );
+        num = queue->pushedcache - *pos;
+        return num < count ? num : count;
+    }
+
+    *pos = AtomicLoadSize ( queue->poppos );
+    for ( ;; )
+    {
+        for ( num = 0; num < count; ++num )
+            if ( AtomicLoadSize ( queue->cells [ ( *pos + num ) & queue->mask ].sequence ) != *pos + num + 1 )
+                break;
+
+        if ( ! num )
+        {
+            /* Either nothing has been pushed to the first cell yet (the
+               queue is empty) or another thread has popped it */
+            sequence = AtomicLoadSize ( queue->cells [ *pos & queue->mask ].sequence );
+            if ( ( ptrdiff_t ) ( sequence - ( *pos + 1 ) ) < 0 )
+                return 0;
+            *pos = AtomicLoadSize ( queue->poppos );
+        }
+        else if ( ( previous = AtomicCompareExchangeSize ( queue->poppos, *pos, *pos + num ) ) == *pos )
+            return num;
+        else
+            *pos = previous;
+    }
+}
+
+/* Frees the claimed cells, once their objects have been read */
+void FudgeQueue_completePop ( FudgeQueue queue, size_t pos, size_t num )
+{
+    size_t index;
+
+    if ( queue->mode == FUDGE_QUEUE_SPSC )
+        AtomicStoreSize ( queue->poppos, pos + num );
+    else
+        for ( index = 0; index < num; ++index )
+            AtomicStoreSize ( queue->cells [ ( pos + index ) & queue->mask ].sequence, pos + index + queue->mask + 1 );
+}
+
+FudgeStatus FudgeQueue_create ( FudgeQueue * queue,
+                                FudgeQueueContents contents,
+                                size_t capacity,
+                                FudgeQueueMode mode )
+{
+    FudgeStatus status;
+    size_t index, size;
+
+    if ( ! queue )
+        return FUDGE_NULL_POINTER;
+
+#ifndef FUDGE_HAS_ATOMICS
+    /* The cells and positions are claimed with compare and exchange, which
+       would be a plain read and write here */
+    return FUDGE_NOT_SUPPORTED;
+#endif /* ifndef FUDGE_HAS_ATOMICS */
+
+    for ( size = 2; size < capacity; size <<= 1 )
+        if ( ! ( size << 1 ) )
+            return FUDGE_OUT_OF_MEMORY;
+    if ( size > ( size_t ) -1 / sizeof ( FudgeQueueCell ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    if ( ! ( *queue = FUDGEMEMORY_MALLOC( FudgeQueue, sizeof ( struct FudgeQueueImpl ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    if ( ! ( ( *queue )->cells = FUDGEMEMORY_MALLOC( FudgeQueueCell *, sizeof ( FudgeQueueCell ) * size ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto release_queue_and_fail;
+    }
+    if ( ( status = FudgeRefCount_create ( &( ( *queue )->refcount ) ) ) != FUDGE_OK )
+        goto release_cells_and_fail;
+
+    ( *queue )->contents = contents;
+    ( *queue )->mode = mode;
+    ( *queue )->mask = size - 1;
+    ( *queue )->pushpos = ( *queue )->poppedcache = 0;
+    ( *queue )->poppos = ( *queue )->pushedcache = 0;
+    for ( index = 0; index < size; ++index )
+        ( *queue )->cells [ index ].sequence = index;
+    return FUDGE_OK;
+
+release_cells_and_fail:
+    FUDGEMEMORY_FREE( ( *queue )->cells, sizeof ( FudgeQueueCell ) * size );
+release_queue_and_fail:
+    FUDGEMEMORY_FREE( *queue, sizeof ( struct FudgeQueueImpl ) );
+    return status;
+}
+
+void FudgeQueue_destroy ( FudgeQueue queue )
+{
+    size_t pos;
+
+    /* Release anything left in the queue */
+    for ( pos = queue->poppos; pos != queue->pushpos; ++pos )
+    {
+        if ( queue->contents == FUDGE_QUEUE_ENVELOPES )
+            FudgeMsgEnvelope_release ( queue->cells [ pos & queue->mask ].item.envelope );
+        else
+            FudgeMsg_release ( queue->cells [ pos & queue->mask ].item.message );
+    }
+
+    FudgeRefCount_destroy ( queue->refcount );
+    FUDGEMEMORY_FREE( queue->cells, sizeof ( FudgeQueueCell ) * ( queue->mask + 1 ) );
+    FUDGEMEMORY_FREE( queue, sizeof ( struct FudgeQueueImpl ) );
+}
+
+FudgeStatus FudgeQueue_retain ( FudgeQueue queue )
+{
+    if ( ! queue )
+        return FUDGE_NULL_POINTER;
+
+    FudgeRefCount_increment ( queue->refcount );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeQueue_release ( FudgeQueue queue )
+{
+    if ( ! queue )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! FudgeRefCount_decrementAndReturn ( queue->refcount ) )
+        FudgeQueue_destroy ( queue );
+    return FUDGE_OK;
+}
+
+size_t FudgeQueue_getCapacity ( FudgeQueue queue )
+{
+    return queue ? queue->mask + 1 : 0;
+}
+
+size_t FudgeQueue_getSize ( FudgeQueue queue )
+{
+    size_t popped;
+
+    if ( ! queue )
+        return 0;
+
+    /* Read the pop position first, so the difference can't be negative */
+    popped = AtomicLoadSize ( queue->poppos );
+    return AtomicLoadSize ( queue->pushpos ) - popped;
+}
+
+/* The push and pop functions are the same for envelopes and messages, other
+   than the type of object and how it is shared */
+#define FUDGE_QUEUEFUNCTIONS_IMPL( typename, type, member, contenttype, sharefn )                           \
+    FudgeStatus FudgeQueue_push##typename##s ( FudgeQueue queue, const type * items, size_t count, size_t * pushed ) \
+    {                                                                                                       \
+        FudgeStatus status;                                                                                 \
+        size_t index, pos, num;                                                                             \
+        if ( pushed )                                                                                       \
+            *pushed = 0;                                                                                    \
+        if ( ! ( queue && ( items || ! count ) ) )                                                          \
+            return FUDGE_NULL_POINTER;                                                                      \
+        if ( queue->contents != contenttype )                                                               \
+            return FUDGE_QUEUE_INVALID_CONTENTS;                                                            \
+        for ( index = 0; index < count; ++index )                                                           \
+            if ( ( status = sharefn ( items [ index ] ) ) != FUDGE_OK )                                     \
+                return status;                                                                              \
+        if ( ! ( num = FudgeQueue_claimPush ( queue, count, &pos ) ) )                                      \
+            return count ? FUDGE_QUEUE_FULL : FUDGE_OK;                                                     \
+        for ( index = 0; index < num; ++index )                                                             \
+            queue->cells [ ( pos + index ) & queue->mask ].item.member = items [ index ];                   \
+        FudgeQueue_completePush ( queue, pos, num );                                                        \
+        if ( pushed )                                                                                       \
+            *pushed = num;                                                                                  \
+        return FUDGE_OK;                                                                                    \
+    }                                                                                                       \
+                                                                                                            \
+    FudgeStatus FudgeQueue_pop##typename##s ( FudgeQueue queue, type * items, size_t count, size_t * popped ) \
+    {                                                                                                       \
+        size_t index, pos, num;                                                                             \
+        if ( popped )                                                                                       \
+            *popped = 0;                                                                                    \
+        if ( ! ( queue && ( items || ! count ) ) )                                                          \
+            return FUDGE_NULL_POINTER;                                                                      \
+        if ( queue->contents != contenttype )                                                               \
+            return FUDGE_QUEUE_INVALID_CONTENTS;                                                            \
+        if ( ! ( num = FudgeQueue_claimPop ( queue, count, &pos ) ) )                                       \
+            return count ? FUDGE_QUEUE_EMPTY : FUDGE_OK;                                                    \
+        for ( index = 0; index < num; ++index )                                                             \
+            items [ index ] = queue->cells [ ( pos + index ) & queue->mask ].item.member;                   \
+        FudgeQueue_completePop ( queue, pos, num );                                                         \
+        if ( popped )                                                                                       \
+            *popped = num;                                                                                  \
+        return FUDGE_OK;                                                                                    \
+    }                                                                                                       \
+                                                                                                            \
+    FudgeStatus FudgeQueue_push##typename ( FudgeQueue queue, type item )                                   \
+    {                                                                                                       \
+        if ( ! item )                                                                                       \
+            return FUDGE_NULL_POINTER;                                                                      \
+        return FudgeQueue_push##typename##s ( queue, &item, 1, 0 );                                         \
+    }                                                                                                       \
+                                                                                                            \
+    FudgeStatus FudgeQueue_pop##typename ( FudgeQueue queue, type * item )                                  \
+    {                                                                                                       \
+        return item ? FudgeQueue_pop##typename##s ( queue, item, 1, 0 ) : FUDGE_NULL_POINTER;               \
+    }
+
+FUDGE_QUEUEFUNCTIONS_IMPL( Envelope, FudgeMsgEnvelope, envelope, FUDGE_QUEUE_ENVELOPES, FudgeMsgEnvelope_share )
+FUDGE_QUEUEFUNCTIONS_IMPL( Msg,      FudgeMsg,         message,  FUDGE_QUEUE_MESSAGES,  FudgeMsg_share )
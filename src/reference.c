@@ -21,6 +21,14 @@
 #define _FUDGEREFCOUNTIMPL_DEFINED 1
 #include "reference.h"
 #include "fudge/config.h"
+#include "fudge/fudge.h"
+
+static fudge_bool s_confineRefCounts = FUDGE_FALSE;
+
+fudge_bool FudgeRefCount_isConfined ( )
+{
+    return s_confineRefCounts;
+}
 
 #if defined(_MT)
 #   if defined(FUDGE_HAS_SYNC_FETCH_AND_ADD) || defined(FUDGE_HAVE_INTRIN_H)
@@ -34,3 +42,17 @@
 #else
 #   include "reference_default.c"
 #endif
+
+/*****************************************************************************
+ * Functions from fudge/fudge.h
+ */
+
+void Fudge_setThreadConfinement ( fudge_bool enabled )
+{
+    s_confineRefCounts = enabled;
+}
+
+fudge_bool Fudge_getThreadConfinement ( )
+{
+    return s_confineRefCounts;
+}
@@ -17,6 +17,7 @@
 #define INC_FUDGE_REFERENCE_H
 
 #include "fudge/status.h"
+#include "fudge/types.h"
 
 #ifdef _FUDGEREFCOUNTIMPL_DEFINED
 typedef struct FudgeRefCountImpl * FudgeRefCount;
@@ -27,6 +28,30 @@ typedef struct { void * reserved; } * FudgeRefCount;
 FudgeStatus FudgeRefCount_create ( FudgeRefCount * refcountptr );
 FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount );
 
+/* In place reference counts live within another object's allocation, rather
+   than having one of their own. The storage provided must be at least
+   FudgeRefCount_getStorageSize bytes and suitably aligned for a pointer; it
+   is not freed by FudgeRefCount_destroyInPlace. */
+size_t FudgeRefCount_getStorageSize ( );
+FudgeStatus FudgeRefCount_createInPlace ( FudgeRefCount * refcountptr, void * storage );
+FudgeStatus FudgeRefCount_destroyInPlace ( FudgeRefCount refcount );
+
+/* Returns the count to one, for an object that is being reused. There must
+   be no other references to the object. */
+void FudgeRefCount_reset ( FudgeRefCount refcount );
+
+/* Returns true if new reference counts are confined (see
+   Fudge_setThreadConfinement) to the thread that created them, and so are
+   updated without atomic operations or locking. FudgeRefCount_share makes a
+   count safe to update from any thread; it must be called by the owning
+   thread before the object is made available to other threads. In single
+   threaded builds every count is treated as shared, as none need atomic
+   updates. */
+fudge_bool FudgeRefCount_isConfined ( );
+
+void FudgeRefCount_share ( FudgeRefCount refcount );
+fudge_bool FudgeRefCount_isShared ( FudgeRefCount refcount );
+
 void FudgeRefCount_increment ( FudgeRefCount refcount );
 int FudgeRefCount_decrementAndReturn ( FudgeRefCount refcount );
 int FudgeRefCount_count ( FudgeRefCount refcount );
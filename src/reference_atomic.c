@@ -23,28 +23,74 @@
 struct FudgeRefCountImpl
 {
     volatile int count;
+    fudge_bool confined;    /* Only used by the creating thread */
 };
 
 FudgeStatus FudgeRefCount_create ( FudgeRefCount * refcountptr )
 {
-    if ( ! ( *refcountptr = FUDGEMEMORY_MALLOC( FudgeRefCount, sizeof ( struct FudgeRefCountImpl ) ) ) )
+    void * storage;
+
+    if ( ! ( storage = FUDGEMEMORY_MALLOC( void *, sizeof ( struct FudgeRefCountImpl ) ) ) )
         return FUDGE_OUT_OF_MEMORY;
+    FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_REFCOUNTS, sizeof ( struct FudgeRefCountImpl ) );
+
+    return FudgeRefCount_createInPlace ( refcountptr, storage );
+}
+
+FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount )
+{
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_REFCOUNTS, sizeof ( struct FudgeRefCountImpl ) );
+    FUDGEMEMORY_FREE( refcount, sizeof ( struct FudgeRefCountImpl ) );
+    return FUDGE_OK;
+}
+
+size_t FudgeRefCount_getStorageSize ( )
+{
+    return sizeof ( struct FudgeRefCountImpl );
+}
 
+FudgeStatus FudgeRefCount_createInPlace ( FudgeRefCount * refcountptr, void * storage )
+{
+    *refcountptr = ( FudgeRefCount ) storage;
     ( *refcountptr )->count = 1u;
+    ( *refcountptr )->confined = FudgeRefCount_isConfined ( );
 
     return FUDGE_OK;
 }
 
-FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount )
+FudgeStatus FudgeRefCount_destroyInPlace ( FudgeRefCount refcount )
 {
-    FUDGEMEMORY_FREE( refcount );
+    ( void ) refcount;
     return FUDGE_OK;
 }
 
+void FudgeRefCount_reset ( FudgeRefCount refcount )
+{
+    refcount->count = 1;
+    refcount->confined = FudgeRefCount_isConfined ( );
+}
+
+void FudgeRefCount_share ( FudgeRefCount refcount )
+{
+    /* Other threads may already be reading a shared count's flag */
+    if ( refcount->confined )
+        refcount->confined = FUDGE_FALSE;
+}
+
+fudge_bool FudgeRefCount_isShared ( FudgeRefCount refcount )
+{
+    return ! refcount->confined;
+}
+
 void FudgeRefCount_increment ( FudgeRefCount refcount )
 {
     if ( refcount )
-        AtomicIncrementAndReturn ( refcount->count );
+    {
+        if ( refcount->confined )
+            ++( refcount->count );
+        else
+            AtomicIncrementAndReturn ( refcount->count );
+    }
     else
         assert ( refcount );
 }
@@ -53,7 +99,8 @@ int FudgeRefCount_decrementAndReturn ( FudgeRefCount refcount )
 {
     if ( refcount )
     {
-        const int decremented = AtomicDecrementAndReturn ( refcount->count );
+        const int decremented = refcount->confined ? --( refcount->count )
+                                                   : AtomicDecrementAndReturn ( refcount->count );
         assert ( decremented >= 0 );
         return decremented;
     }
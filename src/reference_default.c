@@ -25,20 +25,56 @@ struct FudgeRefCountImpl
 
 FudgeStatus FudgeRefCount_create ( FudgeRefCount * refcountptr )
 {
-    if ( ! ( *refcountptr = FUDGEMEMORY_MALLOC( FudgeRefCount, sizeof ( struct FudgeRefCountImpl ) ) ) )
+    void * storage;
+
+    if ( ! ( storage = FUDGEMEMORY_MALLOC( void *, sizeof ( struct FudgeRefCountImpl ) ) ) )
         return FUDGE_OUT_OF_MEMORY;
+    FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_REFCOUNTS, sizeof ( struct FudgeRefCountImpl ) );
+
+    return FudgeRefCount_createInPlace ( refcountptr, storage );
+}
+
+FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount )
+{
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_REFCOUNTS, sizeof ( struct FudgeRefCountImpl ) );
+    FUDGEMEMORY_FREE( refcount, sizeof ( struct FudgeRefCountImpl ) );
+    return FUDGE_OK;
+}
+
+size_t FudgeRefCount_getStorageSize ( )
+{
+    return sizeof ( struct FudgeRefCountImpl );
+}
 
+FudgeStatus FudgeRefCount_createInPlace ( FudgeRefCount * refcountptr, void * storage )
+{
+    *refcountptr = ( FudgeRefCount ) storage;
     ( *refcountptr )->count = 1u;
 
     return FUDGE_OK;
 }
 
-FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount )
+FudgeStatus FudgeRefCount_destroyInPlace ( FudgeRefCount refcount )
 {
-    FUDGEMEMORY_FREE( refcount );
     return FUDGE_OK;
 }
 
+void FudgeRefCount_reset ( FudgeRefCount refcount )
+{
+    refcount->count = 1;
+}
+
+void FudgeRefCount_share ( FudgeRefCount refcount )
+{
+    ( void ) refcount;
+}
+
+fudge_bool FudgeRefCount_isShared ( FudgeRefCount refcount )
+{
+    ( void ) refcount;
+    return FUDGE_TRUE;
+}
+
 void FudgeRefCount_increment ( FudgeRefCount refcount )
 {
     if ( refcount )
@@ -51,7 +87,7 @@ int FudgeRefCount_decrementAndReturn ( FudgeRefCount refcount )
 {
     if ( refcount )
     {
-        assert ( refcount->count >= 1u );
+        assert ( refcount->count >= 1 );
         return refcount->count -= 1u;
     }
     else
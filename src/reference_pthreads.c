@@ -38,36 +38,83 @@ struct FudgeRefCountImpl
 {
     pthread_mutex_t mutex;
     int count;
+    fudge_bool confined;    /* Only used by the creating thread */
 };
 
 FudgeStatus FudgeRefCount_create ( FudgeRefCount * refcountptr )
 {
-    int result;
+    FudgeStatus status;
+    void * storage;
 
-    if ( ! ( *refcountptr = FUDGEMEMORY_MALLOC( FudgeRefCount, sizeof ( struct FudgeRefCountImpl ) ) ) )
+    if ( ! ( storage = FUDGEMEMORY_MALLOC( void *, sizeof ( struct FudgeRefCountImpl ) ) ) )
         return FUDGE_OUT_OF_MEMORY;
 
+    if ( ( status = FudgeRefCount_createInPlace ( refcountptr, storage ) ) != FUDGE_OK )
+        FUDGEMEMORY_FREE( storage, sizeof ( struct FudgeRefCountImpl ) );
+    else
+        FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_REFCOUNTS, sizeof ( struct FudgeRefCountImpl ) );
+    return status;
+}
+
+FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount )
+{
+    FudgeStatus status;
+
+    status = FudgeRefCount_destroyInPlace ( refcount );
+    FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_REFCOUNTS, sizeof ( struct FudgeRefCountImpl ) );
+    FUDGEMEMORY_FREE( refcount, sizeof ( struct FudgeRefCountImpl ) );
+    return status;
+}
+
+size_t FudgeRefCount_getStorageSize ( )
+{
+    return sizeof ( struct FudgeRefCountImpl );
+}
+
+FudgeStatus FudgeRefCount_createInPlace ( FudgeRefCount * refcountptr, void * storage )
+{
+    int result;
+
+    *refcountptr = ( FudgeRefCount ) storage;
     if ( ( result = pthread_mutex_init ( &( ( *refcountptr )->mutex ), NULL ) ) )
-    {
-        FUDGEMEMORY_FREE( *refcountptr );
         return Reference_pthreadResultToFudgeStatus ( result );
-    }
 
     ( *refcountptr )->count = 1u;
+    ( *refcountptr )->confined = FudgeRefCount_isConfined ( );
     return FUDGE_OK;
 }
 
-FudgeStatus FudgeRefCount_destroy ( FudgeRefCount refcount )
+FudgeStatus FudgeRefCount_destroyInPlace ( FudgeRefCount refcount )
 {
-    int result;
+    return Reference_pthreadResultToFudgeStatus ( pthread_mutex_destroy ( &( refcount->mutex ) ) );
+}
+
+void FudgeRefCount_reset ( FudgeRefCount refcount )
+{
+    refcount->count = 1;
+    refcount->confined = FudgeRefCount_isConfined ( );
+}
 
-    result = pthread_mutex_destroy ( &( refcount->mutex ) );
-    FUDGEMEMORY_FREE( refcount );
-    return Reference_pthreadResultToFudgeStatus ( result );
+void FudgeRefCount_share ( FudgeRefCount refcount )
+{
+    /* Other threads may already be reading a shared count's flag */
+    if ( refcount->confined )
+        refcount->confined = FUDGE_FALSE;
+}
+
+fudge_bool FudgeRefCount_isShared ( FudgeRefCount refcount )
+{
+    return ! refcount->confined;
 }
 
 void FudgeRefCount_increment ( FudgeRefCount refcount )
 {
+    if ( refcount->confined )
+    {
+        refcount->count += 1u;
+        return;
+    }
+
     pthread_mutex_lock ( &( refcount->mutex ) );
     if ( refcount )
         refcount->count += 1u;
@@ -80,6 +127,12 @@ int FudgeRefCount_decrementAndReturn ( FudgeRefCount refcount )
 {
     int count;
 
+    if ( refcount->confined )
+    {
+        assert ( refcount->count >= 1u );
+        return refcount->count -= 1u;
+    }
+
     pthread_mutex_lock ( &( refcount->mutex ) );
     if ( refcount )
     {
@@ -16,19 +16,46 @@
 #include "codec_encode.h"
 #include "codec_decode.h"
 #include "coerce.h"
+#include "atomic.h"
+#include "memory_internal.h"
 #include "registry_internal.h"
 
+/* Each registry entry points to the current description of its type.
+   Registering a type publishes a complete new description by swapping the
+   entry's pointer, so a reader sees either the old description or the new
+   one, never a mix of the two, and needs no locking (except in threaded
+   builds without atomic operations, see FUDGEREGISTRY_LOCKED). */
 static fudge_bool s_registryInitialised = FUDGE_FALSE;
-static FudgeTypeDesc s_registry [ FUDGE_REGISTRY_SIZE ];
+static FudgeTypeDesc s_builtinTypes [ FUDGE_REGISTRY_SIZE ];
+static const FudgeTypeDesc * volatile s_registry [ FUDGE_REGISTRY_SIZE ];
 
-void FudgeRegistry_registerTypeInternal ( fudge_type_id type,
-                                          fudge_i32 fixedwidth,
-                                          FudgeTypePayload payload,
-                                          FudgeTypeDecoder decoder,
-                                          FudgeTypeEncoder encoder,
-                                          FudgeTypeCoercer coercer )
+/* Descriptions created by FudgeRegistry_registerType. These are never
+   freed: a reader may still be using a description after it has been
+   replaced. */
+typedef struct FudgeUserTypeDesc
+{
+    FudgeTypeDesc desc;
+    struct FudgeUserTypeDesc * next;
+} FudgeUserTypeDesc;
+
+static FudgeUserTypeDesc * volatile s_userTypes = 0;
+
+/* Threaded builds without atomic operations (which configure only allows
+   where pthreads are available) read and publish entries under a lock */
+#if defined(_MT) && ! defined(FUDGE_HAS_ATOMICS)
+#   define FUDGEREGISTRY_LOCKED 1
+#   include <pthread.h>
+static pthread_mutex_t s_registryLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void FudgeRegistry_initTypeDesc ( FudgeTypeDesc * desc,
+                                  fudge_type_id type,
+                                  fudge_i32 fixedwidth,
+                                  FudgeTypePayload payload,
+                                  FudgeTypeDecoder decoder,
+                                  FudgeTypeEncoder encoder,
+                                  FudgeTypeCoercer coercer )
 {
-    FudgeTypeDesc * desc = &( s_registry [ type ] );
     desc->type = type;
     desc->fixedwidth = fixedwidth;
     desc->payload = payload;
@@ -37,6 +64,18 @@ void FudgeRegistry_registerTypeInternal ( fudge_type_id type,
     desc->coercer = coercer;
 }
 
+/* Only used during initialisation, before there are any readers */
+void FudgeRegistry_registerTypeInternal ( fudge_type_id type,
+                                          fudge_i32 fixedwidth,
+                                          FudgeTypePayload payload,
+                                          FudgeTypeDecoder decoder,
+                                          FudgeTypeEncoder encoder,
+                                          FudgeTypeCoercer coercer )
+{
+    FudgeRegistry_initTypeDesc ( &( s_builtinTypes [ type ] ), type, fixedwidth, payload, decoder, encoder, coercer );
+    s_registry [ type ] = &( s_builtinTypes [ type ] );
+}
+
 FudgeStatus FudgeRegistry_init ( )
 {
     int index;
@@ -89,7 +128,18 @@ FudgeStatus FudgeRegistry_init ( )
 
 const FudgeTypeDesc * FudgeRegistry_getTypeDesc ( fudge_type_id type )
 {
-    return &( s_registry [ type ] );
+#ifdef FUDGEREGISTRY_LOCKED
+    const FudgeTypeDesc * desc;
+
+    pthread_mutex_lock ( &s_registryLock );
+    desc = s_registry [ type ];
+    pthread_mutex_unlock ( &s_registryLock );
+    return desc;
+#else /* ifdef FUDGEREGISTRY_LOCKED */
+    /* An acquire load: an ordinary load on x86, and on other platforms
+       makes sure the description is read after the pointer to it */
+    return AtomicLoadPointer ( s_registry [ type ] );
+#endif /* ifdef FUDGEREGISTRY_LOCKED */
 }
 
 FudgeStatus FudgeRegistry_registerType ( fudge_type_id type,
@@ -98,6 +148,8 @@ FudgeStatus FudgeRegistry_registerType ( fudge_type_id type,
                                          FudgeTypeEncoder encoder,
                                          FudgeTypeCoercer coercer )
 {
+    FudgeUserTypeDesc * user;
+
     if ( ! ( decoder && encoder && coercer ) )
         return FUDGE_NULL_POINTER;
 
@@ -105,11 +157,31 @@ FudgeStatus FudgeRegistry_registerType ( fudge_type_id type,
     {
         case FUDGE_TYPE_PAYLOAD_BYTES:
         case FUDGE_TYPE_PAYLOAD_SUBMSG:
-            FudgeRegistry_registerTypeInternal ( type, -1, payload, decoder, encoder, coercer );
-            return FUDGE_OK;
+            break;
 
         default:
             return FUDGE_INVALID_USER_TYPE;
     }
+
+    if ( ! ( user = FUDGEMEMORY_MALLOC( FudgeUserTypeDesc *, sizeof ( FudgeUserTypeDesc ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    FudgeRegistry_initTypeDesc ( &( user->desc ), type, -1, payload, decoder, encoder, coercer );
+
+#ifdef FUDGEREGISTRY_LOCKED
+    pthread_mutex_lock ( &s_registryLock );
+    user->next = s_userTypes;
+    s_userTypes = user;
+    s_registry [ type ] = &( user->desc );
+    pthread_mutex_unlock ( &s_registryLock );
+#else /* ifdef FUDGEREGISTRY_LOCKED */
+    do
+        user->next = AtomicLoadPointer ( s_userTypes );
+    while ( AtomicCompareExchangePointer ( s_userTypes, user->next, user ) != user->next );
+
+    /* A release store: the description is complete before readers can see
+       it. Writers need no ordering between them, the last one wins. */
+    AtomicStorePointer ( s_registry [ type ], &( user->desc ) );
+#endif /* ifdef FUDGEREGISTRY_LOCKED */
+    return FUDGE_OK;
 }
 
@@ -22,6 +22,7 @@ const char * FudgeStatus_strerror ( FudgeStatus status )
         case FUDGE_OK:                            return "OK";
         case FUDGE_OUT_OF_MEMORY:                 return "Out of Memory";
         case FUDGE_NULL_POINTER:                  return "Null Pointer";
+        case FUDGE_NOT_SUPPORTED:                 return "Not supported by this build";
         case FUDGE_INVALID_INDEX:                 return "Invalid Index";
         case FUDGE_INVALID_NAME:                  return "Invalid Name";
         case FUDGE_INVALID_ORDINAL:               return "Invalid Ordinal";
@@ -39,6 +40,7 @@ const char * FudgeStatus_strerror ( FudgeStatus status )
         case FUDGE_STRING_UNKNOWN_UNICODE_TYPE:   return "Unicode type was not recognised";
         case FUDGE_OUT_OF_BYTES:                  return "Out of Bytes";
         case FUDGE_UNKNOWN_FIELD_WIDTH:           return "Unknown Field Width";
+        case FUDGE_INVALID_COMPRESSED_PAYLOAD:    return "Compressed message payload is invalid";
         case FUDGE_DATETIME_INVALID_YEAR:         return "Invalid value for Year";
         case FUDGE_DATETIME_INVALID_MONTH:        return "Invalid value for Month";
         case FUDGE_DATETIME_INVALID_DAY:          return "Invalid value for Day of Month";
@@ -48,6 +50,12 @@ const char * FudgeStatus_strerror ( FudgeStatus status )
         case FUDGE_PTHREAD_MUTEX_BUSY:            return "Cannot destroy pthread mutex that's locked by another thread";
         case FUDGE_PTHREAD_MUTEX_INVALID:         return "Invalid pthread mutex handle";
         case FUDGE_PTHREAD_MUTEX_UNKNOWN:         return "Unknown pthread mutex error";
+        case FUDGE_WRITER_NOT_IN_MSG:             return "Writer has no message in progress";
+        case FUDGE_WRITER_UNBALANCED_SUBMSG:      return "Writer submessage begin/end calls do not match";
+        case FUDGE_MESSAGE_FROZEN:                return "Message is frozen and cannot be modified";
+        case FUDGE_QUEUE_FULL:                    return "Queue is full";
+        case FUDGE_QUEUE_EMPTY:                   return "Queue is empty";
+        case FUDGE_QUEUE_INVALID_CONTENTS:        return "Queue does not hold objects of this type";
         case FUDGE_INTERNAL_LIST_STATE:           return "Internal List State";
         case FUDGE_INTERNAL_PAYLOAD:              return "Internal Type Payload Is Invalid";
         case FUDGE_REGISTRY_UNINITIALISED:        return "Fudge Registry Not Initialised";
@@ -15,19 +15,85 @@
  */
 #define _FUDGESTRINGIMPL_DEFINED 1
 #include "fudge/string.h"
+#include "arena_internal.h"
 #include "atomic.h"
-#include "convertutf.h"
 #include "memory_internal.h"
 #include "reference.h"
+#include "string_internal.h"
+#include "transcode.h"
 #include <assert.h>
 
+/* A string is a single allocation: the header is followed by the storage
+   for the reference count and then the characters, so short strings (such as
+   field names) fit within a cache line or two. */
 struct FudgeStringImpl
 {
     FudgeRefCount refcount;
     fudge_byte * bytes;
     size_t numbytes;
+    volatile uint32_t hash;     /* Zero until calculated, see FudgeString_hashBytes */
+    fudge_i64 storage [ ];
 };
 
+/* Flags held in the bottom two bits of a string's hash */
+#define FUDGESTRING_HASH_CALCULATED 0x1
+#define FUDGESTRING_HASH_BOM        0x2
+
+/* The intern table: a fixed number of buckets, each holding a list of the
+   interned strings whose hashes map to it. Nodes are only ever prepended
+   (with a compare-and-swap on the bucket head, see FudgeString_publish) and
+   are never removed, so the lists can be read without locking. */
+#define FUDGESTRING_INTERN_BUCKETS 4096
+
+typedef struct FudgeInternNode
+{
+    FudgeString string;
+    uint32_t hash;
+    struct FudgeInternNode * next;
+} FudgeInternNode;
+
+static FudgeInternNode * volatile s_internTable [ FUDGESTRING_INTERN_BUCKETS ];
+
+/* Threaded builds without atomic operations (which configure only allows
+   where pthreads are available) publish strings under a lock instead */
+#if defined(_MT) && ! defined(FUDGE_HAS_ATOMICS)
+#   define FUDGESTRING_PUBLISH_LOCKED 1
+#   include <pthread.h>
+static pthread_mutex_t s_publishLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Returns the pointer held in slot, with acquire semantics */
+void * FudgeString_loadPublished ( void * volatile * slot )
+{
+#ifdef FUDGESTRING_PUBLISH_LOCKED
+    void * value;
+
+    pthread_mutex_lock ( &s_publishLock );
+    value = *slot;
+    pthread_mutex_unlock ( &s_publishLock );
+    return value;
+#else /* ifdef FUDGESTRING_PUBLISH_LOCKED */
+    return AtomicLoadPointer ( *slot );
+#endif /* ifdef FUDGESTRING_PUBLISH_LOCKED */
+}
+
+/* Sets slot to value if it still holds expected, returning the value it
+   held before */
+void * FudgeString_publish ( void * volatile * slot, void * expected, void * value )
+{
+#ifdef FUDGESTRING_PUBLISH_LOCKED
+    void * previous;
+
+    pthread_mutex_lock ( &s_publishLock );
+    if ( ( previous = *slot ) == expected )
+        *slot = value;
+    pthread_mutex_unlock ( &s_publishLock );
+    return previous;
+#else /* ifdef FUDGESTRING_PUBLISH_LOCKED */
+    return AtomicCompareExchangePointer ( *slot, expected, value );
+#endif /* ifdef FUDGESTRING_PUBLISH_LOCKED */
+}
+
 FudgeStatus FudgeString_convertUTFResultToStatus ( ConversionResult result )
 {
     switch ( result )
@@ -38,51 +104,130 @@ FudgeStatus FudgeString_convertUTFResultToStatus ( ConversionResult result )
     }
 }
 
-FudgeStatus FudgeString_allocate ( FudgeString * string, size_t numbytes )
+/* The refcount storage is rounded up so the characters start on a pointer
+   boundary */
+size_t FudgeString_getStorageSize ( )
+{
+    return ( FudgeRefCount_getStorageSize ( ) + sizeof ( void * ) - 1 ) & ~( sizeof ( void * ) - 1 );
+}
+
+/* Strings in an arena have no reference count, which makes them immortal:
+   they are destroyed with the arena */
+FudgeStatus FudgeString_allocate ( FudgeString * string, size_t numbytes, FudgeArena arena )
 {
     FudgeStatus status;
+    size_t storagesize;
 
     if ( ! string )
         return FUDGE_NULL_POINTER;
 
-    if ( ! ( *string = FUDGEMEMORY_MALLOC( FudgeString, sizeof ( struct FudgeStringImpl ) ) ) )
-        return FUDGE_OUT_OF_MEMORY;
+    if ( arena )
+    {
+        if ( ! ( *string = ( FudgeString ) FudgeArena_allocate ( arena, sizeof ( struct FudgeStringImpl ) + numbytes ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        ( *string )->refcount = 0;
+        ( *string )->bytes = numbytes ? ( fudge_byte * ) ( *string )->storage : 0;
+        ( *string )->numbytes = numbytes;
+        ( *string )->hash = 0;
+        return FUDGE_OK;
+    }
 
-    if ( ( status = FudgeRefCount_create ( &( ( *string )->refcount ) ) ) != FUDGE_OK )
-        goto free_string_and_fail;
+    storagesize = FudgeString_getStorageSize ( );
+    if ( ! ( *string = FUDGEMEMORY_MALLOC( FudgeString, sizeof ( struct FudgeStringImpl ) + storagesize + numbytes ) ) )
+        return FUDGE_OUT_OF_MEMORY;
 
-    if ( numbytes )
+    if ( ( status = FudgeRefCount_createInPlace ( &( ( *string )->refcount ), ( *string )->storage ) ) != FUDGE_OK )
     {
-        if ( ! ( ( *string )->bytes = FUDGEMEMORY_MALLOC( fudge_byte *, numbytes ) ) )
-        {
-            status = FUDGE_OUT_OF_MEMORY;
-            goto destroy_refcount_and_fail;
-        }
+        FUDGEMEMORY_FREE( *string, sizeof ( struct FudgeStringImpl ) + storagesize + numbytes );
+        return status;
     }
-    else
-        ( *string )->bytes = 0;
 
+    ( *string )->bytes = numbytes ? ( fudge_byte * ) ( *string )->storage + storagesize : 0;
+    ( *string )->numbytes = numbytes;
+    ( *string )->hash = 0;
+    FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_STRINGS, sizeof ( struct FudgeStringImpl ) + storagesize + numbytes );
     return FUDGE_OK;
-
-destroy_refcount_and_fail:
-    FudgeRefCount_destroy ( ( *string )->refcount );
-
-free_string_and_fail:
-    FUDGEMEMORY_FREE( string );
-    return status;
 }
 
 void FudgeString_destroy ( FudgeString string )
 {
     if ( string )
     {
-        FudgeRefCount_destroy ( string->refcount );
-        FUDGEMEMORY_FREE( string->bytes );
-        FUDGEMEMORY_FREE( string );
+        if ( string->refcount )
+            FudgeRefCount_destroyInPlace ( string->refcount );
+        FUDGEMEMORY_RECORD_FREE( FUDGE_MEMORY_STRINGS, sizeof ( struct FudgeStringImpl ) + FudgeString_getStorageSize ( ) + string->numbytes );
+        FUDGEMEMORY_FREE( string, sizeof ( struct FudgeStringImpl ) + FudgeString_getStorageSize ( ) + string->numbytes );
+    }
+}
+
+fudge_bool FudgeString_isReferenceCounted ( const FudgeString string )
+{
+    return string->refcount != 0;
+}
+
+/* Destroys a string that failed to initialise. Those in an arena are left
+   for the arena to reclaim. */
+void FudgeString_discard ( FudgeString string, FudgeArena arena )
+{
+    if ( ! arena )
+        FudgeString_destroy ( string );
+}
+
+/* FNV-1a hash of the string's bytes. Byte-order markers are skipped (as
+   they are by FudgeString_compare), so strings that compare as equal have
+   the same hash. The bottom two bits are replaced with flags: one that is
+   always set, so a calculated hash is never zero, and one that is set if the
+   string contains a BOM. */
+uint32_t FudgeString_hashBytes ( const fudge_byte * bytes, size_t numbytes )
+{
+    uint32_t hash = 2166136261U, flags = FUDGESTRING_HASH_CALCULATED;
+    size_t index;
+
+    for ( index = 0; index < numbytes; )
+    {
+        if ( ( UTF8 ) bytes [ index ] == 0xef && numbytes - index > 2 &&
+             ( UTF8 ) bytes [ index + 1 ] == 0xbb && ( UTF8 ) bytes [ index + 2 ] == 0xbf )
+        {
+            flags |= FUDGESTRING_HASH_BOM;
+            index += 3;
+        }
+        else
+            hash = ( hash ^ ( UTF8 ) bytes [ index++ ] ) * 16777619U;
     }
+    return ( hash & ~( uint32_t ) 3 ) | flags;
+}
+
+/* Returns the string's hash, calculating it on first use. Strings may be
+   shared between threads: every thread calculates the same value, so the
+   hash only needs to be read and written atomically, not ordered. */
+uint32_t FudgeString_getHash ( FudgeString string )
+{
+    uint32_t hash;
+
+    if ( ! ( hash = AtomicLoadRelaxed ( string->hash ) ) )
+    {
+        hash = FudgeString_hashBytes ( string->bytes, string->numbytes );
+        AtomicStoreRelaxed ( string->hash, hash );
+    }
+    return hash;
+}
+
+FudgeString FudgeString_findInterned ( FudgeInternNode * node, FudgeInternNode * end, uint32_t hash, const fudge_byte * bytes, size_t numbytes )
+{
+    for ( ; node != end; node = node->next )
+        if ( node->hash == hash &&
+             node->string->numbytes == numbytes &&
+             ( ! numbytes || memcmp ( node->string->bytes, bytes, numbytes ) == 0 ) )
+            return node->string;
+    return 0;
 }
 
 FudgeStatus FudgeString_createFromASCII ( FudgeString * string, const char * chars, size_t numchars )
+{
+    return FudgeString_createFromASCIIInArena ( string, chars, numchars, 0 );
+}
+
+FudgeStatus FudgeString_createFromASCIIInArena ( FudgeString * string, const char * chars, size_t numchars, FudgeArena arena )
 {
     FudgeStatus status;
     size_t index;
@@ -91,7 +236,7 @@ FudgeStatus FudgeString_createFromASCII ( FudgeString * string, const char * cha
     if ( ( ! chars ) && numchars )
         return FUDGE_NULL_POINTER;
 
-    if ( ( status = FudgeString_allocate ( string, numchars ) ) != FUDGE_OK )
+    if ( ( status = FudgeString_allocate ( string, numchars, arena ) ) != FUDGE_OK )
         return status;
 
     for ( index = 0; index < numchars; ++index )
@@ -100,7 +245,7 @@ FudgeStatus FudgeString_createFromASCII ( FudgeString * string, const char * cha
             ( *string )->bytes [ index ] = chars [ index ];
         else
         {
-            FudgeString_destroy ( *string );
+            FudgeString_discard ( *string, arena );
             return FUDGE_STRING_INVALID_ASCII;
         }
     }
@@ -113,7 +258,17 @@ FudgeStatus FudgeString_createFromASCIIZ ( FudgeString * string, const char * ch
     return FudgeString_createFromASCII ( string, chars, chars ? strlen ( chars ) : 0u );
 }
 
+FudgeStatus FudgeString_createFromASCIIZInArena ( FudgeString * string, const char * chars, FudgeArena arena )
+{
+    return FudgeString_createFromASCIIInArena ( string, chars, chars ? strlen ( chars ) : 0u, arena );
+}
+
 FudgeStatus FudgeString_createFromUTF8 ( FudgeString * string, const fudge_byte * bytes, size_t numbytes )
+{
+    return FudgeString_createFromUTF8InArena ( string, bytes, numbytes, 0 );
+}
+
+FudgeStatus FudgeString_createFromUTF8InArena ( FudgeString * string, const fudge_byte * bytes, size_t numbytes, FudgeArena arena )
 {
     FudgeStatus status;
 
@@ -123,96 +278,155 @@ FudgeStatus FudgeString_createFromUTF8 ( FudgeString * string, const fudge_byte
     if ( numbytes && ! isLegalUTF8Sequence ( ( const UTF8 * ) bytes, ( const UTF8 * ) bytes + numbytes ) )
         return FUDGE_STRING_INVALID_UNICODE;
 
-    if ( ( status = FudgeString_allocate ( string, numbytes ) ) != FUDGE_OK )
+    if ( ( status = FudgeString_allocate ( string, numbytes, arena ) ) != FUDGE_OK )
         return status;
 
     if ( numbytes )
         memcpy ( ( *string )->bytes, bytes, numbytes );
-    else
-        ( *string )->bytes = 0;
 
     ( *string )->numbytes = numbytes;
     return FUDGE_OK;
 }
 
 FudgeStatus FudgeString_createFromUTF16 ( FudgeString * string, const fudge_byte * bytes, size_t numbytes )
+{
+    return FudgeString_createFromUTF16InArena ( string, bytes, numbytes, 0 );
+}
+
+FudgeStatus FudgeString_createFromUTF16InArena ( FudgeString * string, const fudge_byte * bytes, size_t numbytes, FudgeArena arena )
 {
     FudgeStatus status;
+    ConversionResult result;
+    const UTF16 * sourceStart = ( const UTF16 * ) bytes, * sourceEnd;
+    UTF8 * targetStart;
+    size_t length;
 
     if ( ( ! bytes ) && numbytes )
         return FUDGE_NULL_POINTER;
 
-    if ( ( status = FudgeString_allocate ( string, numbytes * 2 ) ) != FUDGE_OK )
+    /* Size the string exactly, so the conversion can write straight in to
+       it; a trailing partial code unit is ignored */
+    sourceEnd = sourceStart + numbytes / 2;
+    length = FudgeTranscode_utf16ToUTF8Length ( sourceStart, sourceEnd );
+    if ( ( status = FudgeString_allocate ( string, length, arena ) ) != FUDGE_OK )
         return status;
 
-    if ( numbytes )
+    targetStart = ( UTF8 * ) ( *string )->bytes;
+    if ( ( result = FudgeTranscode_utf16ToUTF8 ( &sourceStart, sourceEnd, &targetStart, targetStart + length ) ) )
     {
-        ConversionResult result;
-        const UTF16 * sourceStart = ( const UTF16 * ) bytes;
-        UTF8 * targetStart = ( UTF8 * ) ( *string )->bytes;
-
-        if ( ( result = ConvertUTF16toUTF8 ( &sourceStart,
-                                             ( const UTF16 * ) ( bytes + numbytes ),
-                                             &targetStart,
-                                             ( UTF8 * ) ( ( *string )->bytes + numbytes * 2 ),
-                                             lenientConversion ) ) )
-        {
-            status = FudgeString_convertUTFResultToStatus ( result );
-            goto destroy_string_and_fail;
-        }
-        ( *string )->numbytes = ( size_t ) ( targetStart - ( const UTF8 * ) ( ( *string )->bytes ) );
+        status = FudgeString_convertUTFResultToStatus ( result );
+        goto destroy_string_and_fail;
     }
-    else
-        ( *string )->numbytes = 0;
+    ( *string )->numbytes = length;
     return FUDGE_OK;
 
 destroy_string_and_fail:
-    FudgeString_destroy ( *string );
+    FudgeString_discard ( *string, arena );
     return status;
 }
 
 FudgeStatus FudgeString_createFromUTF32 ( FudgeString * string, const fudge_byte * bytes, size_t numbytes )
+{
+    return FudgeString_createFromUTF32InArena ( string, bytes, numbytes, 0 );
+}
+
+FudgeStatus FudgeString_createFromUTF32InArena ( FudgeString * string, const fudge_byte * bytes, size_t numbytes, FudgeArena arena )
 {
     FudgeStatus status;
+    ConversionResult result;
+    const UTF32 * sourceStart = ( const UTF32 * ) bytes, * sourceEnd;
+    UTF8 * targetStart;
+    size_t length;
 
     if ( ( ! bytes ) && numbytes )
         return FUDGE_NULL_POINTER;
 
-    if ( ( status = FudgeString_allocate ( string, numbytes ) ) != FUDGE_OK )
+    /* Size the string exactly, so the conversion can write straight in to
+       it; a trailing partial code unit is ignored */
+    sourceEnd = sourceStart + numbytes / 4;
+    length = FudgeTranscode_utf32ToUTF8Length ( sourceStart, sourceEnd );
+    if ( ( status = FudgeString_allocate ( string, length, arena ) ) != FUDGE_OK )
         return status;
 
-    if ( numbytes )
+    targetStart = ( UTF8 * ) ( *string )->bytes;
+    if ( ( result = FudgeTranscode_utf32ToUTF8 ( &sourceStart, sourceEnd, &targetStart, targetStart + length ) ) )
     {
-        ConversionResult result;
-        const UTF32 * sourceStart = ( const UTF32 * ) bytes;
-        UTF8 * targetStart = ( UTF8 * ) ( *string )->bytes;
-
-        if ( ( result = ConvertUTF32toUTF8 ( &sourceStart,
-                                             ( const UTF32 * ) ( bytes + numbytes ),
-                                             &targetStart,
-                                             ( UTF8 * ) ( ( *string )->bytes + numbytes ),
-                                             lenientConversion ) ) )
-        {
-            status = FudgeString_convertUTFResultToStatus ( result );
-            goto destroy_string_and_fail;
-        }
-        ( *string )->numbytes = ( size_t ) ( targetStart - ( const UTF8 * ) ( ( *string )->bytes ) );
+        status = FudgeString_convertUTFResultToStatus ( result );
+        goto destroy_string_and_fail;
     }
-    else
-        ( *string )->numbytes = 0;
+    ( *string )->numbytes = length;
     return FUDGE_OK;
 
 destroy_string_and_fail:
-    FudgeString_destroy ( *string );
+    FudgeString_discard ( *string, arena );
     return status;
 }
 
+FudgeStatus FudgeString_intern ( FudgeString * interned, const FudgeString string )
+{
+    if ( ! string )
+        return FUDGE_NULL_POINTER;
+    return FudgeString_internUTF8 ( interned, string->bytes, string->numbytes );
+}
+
+FudgeStatus FudgeString_internUTF8 ( FudgeString * interned, const fudge_byte * bytes, size_t numbytes )
+{
+    FudgeStatus status;
+    FudgeInternNode * head, * observed, * node;
+    FudgeInternNode * volatile * bucket;
+    uint32_t hash;
+
+    if ( ! interned )
+        return FUDGE_NULL_POINTER;
+    if ( ( ! bytes ) && numbytes )
+        return FUDGE_NULL_POINTER;
+
+    hash = FudgeString_hashBytes ( bytes, numbytes );
+    bucket = s_internTable + ( ( hash >> 2 ) & ( FUDGESTRING_INTERN_BUCKETS - 1 ) );
+    head = ( FudgeInternNode * ) FudgeString_loadPublished ( ( void * volatile * ) bucket );
+    if ( ( *interned = FudgeString_findInterned ( head, 0, hash, bytes, numbytes ) ) )
+        return FUDGE_OK;
+
+    /* Not found: create an immortal string and try to publish it */
+    if ( ! ( node = FUDGEMEMORY_MALLOC( FudgeInternNode *, sizeof ( FudgeInternNode ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+    if ( ( status = FudgeString_createFromUTF8 ( &( node->string ), bytes, numbytes ) ) != FUDGE_OK )
+    {
+        FUDGEMEMORY_FREE( node, sizeof ( FudgeInternNode ) );
+        return status;
+    }
+    FudgeRefCount_destroyInPlace ( node->string->refcount );
+    node->string->refcount = 0;
+    node->string->hash = node->hash = hash;
+
+    for ( ; ; head = observed )
+    {
+        node->next = head;
+        if ( ( observed = ( FudgeInternNode * ) FudgeString_publish ( ( void * volatile * ) bucket, head, node ) ) == head )
+        {
+            *interned = node->string;
+            return FUDGE_OK;
+        }
+
+        /* Another thread has added to the bucket: it may have interned the
+           same string, so check the new entries before trying again */
+        if ( ( *interned = FudgeString_findInterned ( observed, head, hash, bytes, numbytes ) ) )
+        {
+            FudgeString_destroy ( node->string );
+            FUDGEMEMORY_FREE( node, sizeof ( FudgeInternNode ) );
+            return FUDGE_OK;
+        }
+    }
+}
+
 FudgeStatus FudgeString_retain ( FudgeString string )
 {
     if ( ! string )
         return FUDGE_NULL_POINTER;
 
-    FudgeRefCount_increment ( string->refcount );
+    /* Immortal strings have no reference count */
+    if ( string->refcount )
+        FudgeRefCount_increment ( string->refcount );
     return FUDGE_OK;
 }
 
@@ -221,11 +435,21 @@ FudgeStatus FudgeString_release ( FudgeString string )
     if ( ! string )
         return FUDGE_NULL_POINTER;
 
-    if ( ! FudgeRefCount_decrementAndReturn ( string->refcount ) )
+    if ( string->refcount && ! FudgeRefCount_decrementAndReturn ( string->refcount ) )
         FudgeString_destroy ( string );
     return FUDGE_OK;
 }
 
+FudgeStatus FudgeString_share ( FudgeString string )
+{
+    if ( ! string )
+        return FUDGE_NULL_POINTER;
+
+    if ( string->refcount )
+        FudgeRefCount_share ( string->refcount );
+    return FUDGE_OK;
+}
+
 size_t FudgeString_getSize ( const FudgeString string )
 {
     return string ? string->numbytes : 0;
@@ -289,7 +513,7 @@ FudgeStatus FudgeString_convertToASCIIZ ( char * * target, const FudgeString str
                    there's enough bytes in the source to complete it */
                 if ( readPosition + trailing > string->numbytes )
                 {
-                    FUDGEMEMORY_FREE( *target );
+                    FUDGEMEMORY_FREE( *target, string->numbytes + 1 );
                     return FUDGE_STRING_INCOMPLETE_UNICODE;
                 }
 
@@ -322,11 +546,30 @@ FudgeStatus FudgeString_convertToASCIIZ ( char * * target, const FudgeString str
     return FUDGE_OK;
 }
 
+/* The converted length is only an upper bound for malformed input that the
+   converters accept, so shrink the buffer if necessary: the size returned
+   must be the size allocated (see FudgeMemory_freeSized) */
+FudgeStatus FudgeString_trimConversion ( fudge_byte * * target, size_t numbytes, size_t allocated )
+{
+    fudge_byte * trimmed;
+
+    if ( numbytes == allocated )
+        return FUDGE_OK;
+    if ( ! ( trimmed = FUDGEMEMORY_REALLOC( fudge_byte *, *target, allocated, numbytes ) ) )
+    {
+        FUDGEMEMORY_FREE( *target, allocated );
+        return FUDGE_OUT_OF_MEMORY;
+    }
+    *target = trimmed;
+    return FUDGE_OK;
+}
+
 FudgeStatus FudgeString_convertToUTF16 ( fudge_byte * * target, size_t * numbytes, const FudgeString string )
 {
     ConversionResult result;
     const UTF8 * sourceStart;
     UTF16 * targetStart;
+    size_t length;
 
     if ( ! ( target && numbytes && string ) )
         return FUDGE_NULL_POINTER;
@@ -338,23 +581,22 @@ FudgeStatus FudgeString_convertToUTF16 ( fudge_byte * * target, size_t * numbyte
         return FUDGE_OK;
     }
 
-    if ( ! ( *target = FUDGEMEMORY_MALLOC( fudge_byte *, string->numbytes * 2 ) ) )
+    sourceStart = ( const UTF8 * ) string->bytes;
+    length = FudgeTranscode_utf8ToUTF16Length ( sourceStart, sourceStart + string->numbytes );
+    if ( ! ( *target = FUDGEMEMORY_MALLOC( fudge_byte *, length * 2 ) ) )
         return FUDGE_OUT_OF_MEMORY;
 
-    sourceStart = ( const UTF8 * ) string->bytes;
     targetStart = ( UTF16 * ) *target;
-
-    if ( ( result = ConvertUTF8toUTF16 ( &sourceStart,
-                                         ( const UTF8 * ) ( sourceStart + string->numbytes ),
-                                         &targetStart,
-                                         ( UTF16 * ) ( *target + string->numbytes * 2 ),
-                                         lenientConversion ) ) )
+    if ( ( result = FudgeTranscode_utf8ToUTF16 ( &sourceStart,
+                                                 sourceStart + string->numbytes,
+                                                 &targetStart,
+                                                 targetStart + length ) ) )
     {
-        FUDGEMEMORY_FREE( *target );
+        FUDGEMEMORY_FREE( *target, length * 2 );
         return FudgeString_convertUTFResultToStatus ( result );
     }
     *numbytes = ( size_t ) targetStart - ( size_t ) *target;
-    return FUDGE_OK;
+    return FudgeString_trimConversion ( target, *numbytes, length * 2 );
 }
 
 FudgeStatus FudgeString_convertToUTF32 ( fudge_byte * * target, size_t * numbytes, const FudgeString string )
@@ -362,6 +604,7 @@ FudgeStatus FudgeString_convertToUTF32 ( fudge_byte * * target, size_t * numbyte
     ConversionResult result;
     const UTF8 * sourceStart;
     UTF32 * targetStart;
+    size_t length;
 
     if ( ! ( target && numbytes && string ) )
         return FUDGE_NULL_POINTER;
@@ -373,23 +616,22 @@ FudgeStatus FudgeString_convertToUTF32 ( fudge_byte * * target, size_t * numbyte
         return FUDGE_OK;
     }
 
-    if ( ! ( *target = FUDGEMEMORY_MALLOC( fudge_byte *, string->numbytes * 4 ) ) )
+    sourceStart = ( const UTF8 * ) string->bytes;
+    length = FudgeTranscode_utf8ToUTF32Length ( sourceStart, sourceStart + string->numbytes );
+    if ( ! ( *target = FUDGEMEMORY_MALLOC( fudge_byte *, length * 4 ) ) )
         return FUDGE_OUT_OF_MEMORY;
 
-    sourceStart = ( const UTF8 * ) string->bytes;
     targetStart = ( UTF32 * ) *target;
-
-    if ( ( result = ConvertUTF8toUTF32 ( &sourceStart,
-                                         ( const UTF8 * ) ( sourceStart + string->numbytes ),
-                                         &targetStart,
-                                         ( UTF32 * ) ( *target + string->numbytes * 4 ),
-                                         lenientConversion ) ) )
+    if ( ( result = FudgeTranscode_utf8ToUTF32 ( &sourceStart,
+                                                 sourceStart + string->numbytes,
+                                                 &targetStart,
+                                                 targetStart + length ) ) )
     {
-        FUDGEMEMORY_FREE( *target );
+        FUDGEMEMORY_FREE( *target, length * 4 );
         return FudgeString_convertUTFResultToStatus ( result );
     }
     *numbytes = ( size_t ) targetStart - ( size_t ) *target;
-    return FUDGE_OK;
+    return FudgeString_trimConversion ( target, *numbytes, length * 4 );
 }
 
 FUDGEAPI size_t FudgeString_copyToASCII ( char * buffer, size_t buffersize, const FudgeString string )
@@ -436,11 +678,10 @@ FUDGEAPI size_t FudgeString_copyToUTF16 ( fudge_byte * buffer, size_t buffersize
         return 0;
     sourceStart = ( const UTF8 * ) string->bytes;
     bufferStart = ( UTF16 * ) buffer;
-    if ( ConvertUTF8toUTF16 ( &sourceStart,
-                              ( const UTF8 * ) ( sourceStart + string->numbytes ),
-                              &bufferStart,
-                              ( UTF16 * ) ( buffer + buffersize ),
-                              lenientConversion ) )
+    if ( FudgeTranscode_utf8ToUTF16 ( &sourceStart,
+                                      sourceStart + string->numbytes,
+                                      &bufferStart,
+                                      bufferStart + buffersize / 2 ) )
         return 0;
     return ( size_t ) bufferStart - ( size_t ) buffer;
 }
@@ -453,11 +694,10 @@ FUDGEAPI size_t FudgeString_copyToUTF32 ( fudge_byte * buffer, size_t buffersize
         return 0;
     sourceStart = ( const UTF8 * ) string->bytes;
     bufferStart = ( UTF32 * ) buffer;
-    if ( ConvertUTF8toUTF32 ( &sourceStart,
-                              ( const UTF8 * ) ( sourceStart + string->numbytes ),
-                              &bufferStart,
-                              ( UTF32 * ) ( buffer + buffersize ),
-                              lenientConversion ) )
+    if ( FudgeTranscode_utf8ToUTF32 ( &sourceStart,
+                                      sourceStart + string->numbytes,
+                                      &bufferStart,
+                                      bufferStart + buffersize / 4 ) )
         return 0;
     return ( size_t ) bufferStart - ( size_t ) buffer;
 }
@@ -486,9 +726,11 @@ int FudgeString_compare ( const FudgeString left, const FudgeString right )
     size_t leftpos, leftsize, rightpos, rightsize, newleftpos, newrightpos;
     int comparison;
 
-    /* Handle null pointers */
+    /* Handle null pointers and identical (for example, interned) strings */
+    if ( left == right )
+        return 0;
     if ( ! left )
-        return right ? -1 : 0;
+        return -1;
     if ( ! right )
         return 1;
 
@@ -527,19 +769,61 @@ int FudgeString_compare ( const FudgeString left, const FudgeString right )
     }
 }
 
-FudgeString FudgeString_fromStatic (FudgeStringStatic * string)
+uint32_t FudgeString_hash ( const FudgeString string )
+{
+    return string ? FudgeString_getHash ( string ) & ~( uint32_t ) FUDGESTRING_HASH_BOM : 0;
+}
+
+fudge_bool FudgeString_equals ( const FudgeString left, const FudgeString right )
+{
+    uint32_t lefthash, righthash;
+
+    if ( left == right )
+        return FUDGE_TRUE;
+    if ( ! ( left && right ) )
+        return FUDGE_FALSE;
+
+    /* Strings without BOMs are equal only if their bytes are identical;
+       those with need the full comparison */
+    lefthash = FudgeString_getHash ( left );
+    righthash = FudgeString_getHash ( right );
+    if ( ( lefthash ^ righthash ) & ~( uint32_t ) FUDGESTRING_HASH_BOM )
+        return FUDGE_FALSE;
+    if ( ( lefthash | righthash ) & FUDGESTRING_HASH_BOM )
+        return FudgeString_compare ( left, right ) == 0;
+    return left->numbytes == right->numbytes &&
+           ( ! left->numbytes || memcmp ( left->bytes, right->bytes, left->numbytes ) == 0 );
+}
+
+FudgeString FudgeString_fromStatic ( FudgeStringStatic * string )
 {
+    FudgeString str, existing;
+
     if ( ! string )
         return 0;
-    if ( ! string->reserved )
+    if ( ( str = FudgeString_loadPublished ( &string->reserved ) ) )
+        return str;
+
+    /* The bytes are checked once, as for the copying constructors; a string
+       that fails is never published, so every call returns NULL */
+    if ( string->numbytes && ! isLegalUTF8Sequence ( ( const UTF8 * ) string->bytes, ( const UTF8 * ) string->bytes + string->numbytes ) )
+        return 0;
+
+    /* First use: wrap the caller's bytes in an immortal string. Only the
+       header is allocated; the characters are never copied. */
+    if ( ! ( str = FUDGEMEMORY_MALLOC( FudgeString, sizeof ( struct FudgeStringImpl ) ) ) )
+        return 0;
+    str->refcount = 0;
+    str->bytes = string->numbytes ? ( fudge_byte * ) string->bytes : 0;
+    str->numbytes = string->numbytes;
+    str->hash = 0;
+
+    /* Publish it, unless another thread has got there first */
+    if ( ( existing = FudgeString_publish ( &string->reserved, 0, str ) ) )
     {
-        FudgeString str;
-        FudgeStatus status;
-        status = FudgeString_createFromUTF8 ( &str, ( fudge_byte * ) string->bytes, string->numbytes );
-        assert ( status == FUDGE_OK );
-        str = AtomicExchangePointer ( string->reserved, str );
-        if ( str )
-            FudgeString_release ( str );
+        FUDGEMEMORY_FREE( str, sizeof ( struct FudgeStringImpl ) );
+        return existing;
     }
-    return ( FudgeString ) string->reserved;
+    FUDGEMEMORY_RECORD_ALLOCATION( FUDGE_MEMORY_STRINGS, sizeof ( struct FudgeStringImpl ) );
+    return str;
 }
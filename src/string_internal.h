@@ -0,0 +1,32 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_STRING_INTERNAL_H
+#define INC_FUDGE_STRING_INTERNAL_H
+
+#include "fudge/string.h"
+
+/* The hash used internally by FudgeString: as FudgeString_hash, but with
+   flags in the bottom two bits (so it is never zero). The hash of a string
+   is always equal to the hash of its bytes, so collections can look strings
+   up by content without creating a string first. */
+uint32_t FudgeString_hashBytes ( const fudge_byte * bytes, size_t numbytes );
+uint32_t FudgeString_getHash ( FudgeString string );
+
+/* Returns false for the strings whose retain and release functions do
+   nothing: those in an arena, interned strings and static strings */
+fudge_bool FudgeString_isReferenceCounted ( const FudgeString string );
+
+#endif
@@ -17,17 +17,36 @@
 #include "fudge/stringpool.h"
 #include "memory_internal.h"
 #include "reference.h"
+#include "string_internal.h"
+#include <string.h>
+
+/* Nodes are allocated from slabs of a fixed number of nodes. Each node is
+   also in one of the pool's hash buckets, which are kept at no more than
+   three quarters full on average. */
+#define FUDGESTRINGPOOL_SLAB_SIZE   64
+#define FUDGESTRINGPOOL_MIN_BUCKETS 64
 
 typedef struct StringPoolNode
 {
     FudgeString string;
-    struct StringPoolNode * next;
+    uint32_t hash;
+    struct StringPoolNode * next;   /* The next node in the same bucket */
 } StringPoolNode;
 
+typedef struct StringPoolSlab
+{
+    struct StringPoolSlab * next;
+    size_t numnodes;
+    StringPoolNode nodes [ FUDGESTRINGPOOL_SLAB_SIZE ];
+} StringPoolSlab;
+
 struct FudgeStringPoolImpl
 {
     FudgeRefCount refcount;
-    StringPoolNode * stringhead;
+    StringPoolSlab * slabs;         /* The slab currently being filled is first */
+    StringPoolNode * * buckets;
+    size_t numbuckets;
+    size_t numstrings;
 };
 
 FudgeStatus FudgeStringPool_create ( FudgeStringPool * pool )
@@ -40,28 +59,45 @@ FudgeStatus FudgeStringPool_create ( FudgeStringPool * pool )
     if ( ! ( *pool = FUDGEMEMORY_MALLOC( FudgeStringPool, sizeof ( struct FudgeStringPoolImpl ) ) ) )
         return FUDGE_OUT_OF_MEMORY;
 
-    ( *pool )->stringhead = 0;
+    ( *pool )->slabs = 0;
+    ( *pool )->buckets = 0;
+    ( *pool )->numbuckets = 0;
+    ( *pool )->numstrings = 0;
 
     if ( ( status = FudgeRefCount_create ( &( ( *pool )->refcount ) ) ) != FUDGE_OK )
-        FUDGEMEMORY_FREE( pool );
+        FUDGEMEMORY_FREE( *pool, sizeof ( struct FudgeStringPoolImpl ) );
 
     return status;
 }
 
+/* Releases every string and empties the buckets. All but one of the slabs
+   are freed; the remaining slab is kept for reuse. */
 FudgeStatus FudgeStringPool_clear ( FudgeStringPool pool )
 {
-    StringPoolNode * node;
+    StringPoolSlab * slab;
+    size_t index;
 
     if ( ! pool )
         return FUDGE_NULL_POINTER;
 
-    while ( ( node = pool->stringhead ) )
+    for ( slab = pool->slabs; slab; slab = slab->next )
+        for ( index = 0; index < slab->numnodes; ++index )
+            FudgeString_release ( slab->nodes [ index ].string );
+
+    if ( ( slab = pool->slabs ) )
     {
-        FudgeString_release ( node->string );
-        pool->stringhead = node->next;
-        FUDGEMEMORY_FREE( node );
+        while ( slab->next )
+        {
+            StringPoolSlab * next = slab->next->next;
+            FUDGEMEMORY_FREE( slab->next, sizeof ( StringPoolSlab ) );
+            slab->next = next;
+        }
+        slab->numnodes = 0;
     }
 
+    if ( pool->buckets )
+        memset ( pool->buckets, 0, pool->numbuckets * sizeof ( StringPoolNode * ) );
+    pool->numstrings = 0;
     return FUDGE_OK;
 }
 
@@ -70,8 +106,10 @@ void FudgeStringPool_destroy ( FudgeStringPool pool )
     if ( pool )
     {
         FudgeStringPool_clear ( pool );
+        FUDGEMEMORY_FREE( pool->slabs, sizeof ( StringPoolSlab ) );
+        FUDGEMEMORY_FREE( pool->buckets, pool->numbuckets * sizeof ( StringPoolNode * ) );
         FudgeRefCount_destroy ( pool->refcount );
-        FUDGEMEMORY_FREE( pool );
+        FUDGEMEMORY_FREE( pool, sizeof ( struct FudgeStringPoolImpl ) );
     }
 }
 
@@ -94,31 +132,105 @@ FudgeStatus FudgeStringPool_release ( FudgeStringPool pool )
     return FUDGE_OK;
 }
 
-FudgeStatus FudgeStringPool_acquire ( FudgeStringPool pool, FudgeString string )
+StringPoolNode * * FudgeStringPool_getBucket ( StringPoolNode * * buckets, size_t numbuckets, uint32_t hash )
 {
-    StringPoolNode * node;
+    /* The bottom two bits of the hash are flags */
+    return buckets + ( ( hash >> 2 ) & ( numbuckets - 1 ) );
+}
 
-    if ( ! ( pool && string ) )
-        return FUDGE_NULL_POINTER;
+/* Doubles the number of buckets (or creates the initial set) and moves the
+   existing nodes in to them */
+FudgeStatus FudgeStringPool_growBuckets ( FudgeStringPool pool )
+{
+    size_t numbuckets = pool->numbuckets ? pool->numbuckets * 2 : FUDGESTRINGPOOL_MIN_BUCKETS, index;
+    StringPoolNode * * buckets;
+    StringPoolSlab * slab;
 
-    if ( ! ( node = FUDGEMEMORY_MALLOC( StringPoolNode *, sizeof ( StringPoolNode ) ) ) )
+    if ( ! ( buckets = FUDGEMEMORY_MALLOC( StringPoolNode * *, numbuckets * sizeof ( StringPoolNode * ) ) ) )
         return FUDGE_OUT_OF_MEMORY;
+    memset ( buckets, 0, numbuckets * sizeof ( StringPoolNode * ) );
+
+    for ( slab = pool->slabs; slab; slab = slab->next )
+    {
+        for ( index = 0; index < slab->numnodes; ++index )
+        {
+            StringPoolNode * node = slab->nodes + index,
+                           * * bucket = FudgeStringPool_getBucket ( buckets, numbuckets, node->hash );
+            node->next = *bucket;
+            *bucket = node;
+        }
+    }
+
+    FUDGEMEMORY_FREE( pool->buckets, pool->numbuckets * sizeof ( StringPoolNode * ) );
+    pool->buckets = buckets;
+    pool->numbuckets = numbuckets;
+    return FUDGE_OK;
+}
+
+/* Adds the string, whose hash is provided, to the pool */
+FudgeStatus FudgeStringPool_add ( FudgeStringPool pool, FudgeString string, uint32_t hash )
+{
+    FudgeStatus status;
+    StringPoolNode * node, * * bucket;
 
+    if ( pool->numstrings + 1 > pool->numbuckets / 4 * 3 )
+        if ( ( status = FudgeStringPool_growBuckets ( pool ) ) != FUDGE_OK )
+            return status;
+
+    if ( ! pool->slabs || pool->slabs->numnodes == FUDGESTRINGPOOL_SLAB_SIZE )
+    {
+        StringPoolSlab * slab;
+        if ( ! ( slab = FUDGEMEMORY_MALLOC( StringPoolSlab *, sizeof ( StringPoolSlab ) ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        slab->next = pool->slabs;
+        slab->numnodes = 0;
+        pool->slabs = slab;
+    }
+
+    node = pool->slabs->nodes + pool->slabs->numnodes++;
     node->string = string;
-    node->next = pool->stringhead ? pool->stringhead : 0;
+    node->hash = hash;
+
+    bucket = FudgeStringPool_getBucket ( pool->buckets, pool->numbuckets, hash );
+    node->next = *bucket;
+    *bucket = node;
 
-    pool->stringhead = node;
+    ++pool->numstrings;
     return FUDGE_OK;
 }
 
+/* Returns a string in the pool with exactly the bytes provided, or NULL if
+   there is none */
+FudgeString FudgeStringPool_find ( FudgeStringPool pool, uint32_t hash, const fudge_byte * bytes, size_t numbytes )
+{
+    StringPoolNode * node;
+
+    if ( ! pool->numstrings )
+        return 0;
+
+    for ( node = *FudgeStringPool_getBucket ( pool->buckets, pool->numbuckets, hash ); node; node = node->next )
+        if ( node->hash == hash && FudgeString_getSize ( node->string ) == numbytes
+                                && ( ! numbytes || ! memcmp ( FudgeString_getData ( node->string ), bytes, numbytes ) ) )
+            return node->string;
+    return 0;
+}
+
+FudgeStatus FudgeStringPool_acquire ( FudgeStringPool pool, FudgeString string )
+{
+    if ( ! ( pool && string ) )
+        return FUDGE_NULL_POINTER;
+
+    return FudgeStringPool_add ( pool, string, FudgeString_getHash ( string ) );
+}
+
 /* Used by the create+acquire functions, once the string has been successfully
    created. Handles the acquire failure case so can be immediately returned
    from in the calling function. */
-FudgeString FudgeStringPool_acquireInternal ( FudgeStringPool pool, FudgeString string, FudgeStatus * status )
+FudgeString FudgeStringPool_acquireInternal ( FudgeStringPool pool, FudgeString string, uint32_t hash, FudgeStatus * status )
 {
     FudgeStatus localstatus;
 
-    if ( ( localstatus = FudgeStringPool_acquire ( pool, string ) ) != FUDGE_OK )
+    if ( ( localstatus = FudgeStringPool_add ( pool, string, hash ) ) != FUDGE_OK )
     {
         FudgeString_release ( string );
         string = 0;
@@ -133,21 +245,39 @@ FudgeString FudgeStringPool_createStringFromASCII ( FudgeStringPool pool, FudgeS
 {
     FudgeStatus localstatus;
     FudgeString string;
+    uint32_t hash;
+    size_t index;
 
-    if ( ! pool )
+    if ( ! pool || ( ( ! chars ) && numchars ) )
     {
         localstatus = FUDGE_NULL_POINTER;
         string = 0;
         goto status_and_return;
     }
 
+    /* ASCII strings are held as is, so an existing string can be found
+       from the characters. The pool may also hold non-ASCII strings, so the
+       characters are only checked once a match has been found. */
+    hash = FudgeString_hashBytes ( ( const fudge_byte * ) chars, numchars );
+    if ( ( string = FudgeStringPool_find ( pool, hash, ( const fudge_byte * ) chars, numchars ) ) )
+    {
+        index = 0;
+        while ( index < numchars && chars [ index ] >= 0 )
+            ++index;
+        if ( index == numchars )
+        {
+            localstatus = FUDGE_OK;
+            goto status_and_return;
+        }
+    }
+
     if ( ( localstatus = FudgeString_createFromASCII ( &string, chars, numchars ) ) != FUDGE_OK )
     {
         string = 0;
         goto status_and_return;
     }
 
-    return FudgeStringPool_acquireInternal ( pool, string, status );
+    return FudgeStringPool_acquireInternal ( pool, string, hash, status );
 
 status_and_return:
     if ( status )
@@ -156,28 +286,40 @@ status_and_return:
 }
 
 FudgeString FudgeStringPool_createStringFromASCIIZ ( FudgeStringPool pool, FudgeStatus * status, const char * chars )
+{
+    return FudgeStringPool_createStringFromASCII ( pool, status, chars, chars ? strlen ( chars ) : 0u );
+}
+
+FudgeString FudgeStringPool_createStringFromUTF8 ( FudgeStringPool pool, FudgeStatus * status, const fudge_byte * bytes, size_t numbytes )
 {
     FudgeStatus localstatus;
     FudgeString string;
+    uint32_t hash;
 
-    if ( ! pool )
+    if ( ! pool || ( ( ! bytes ) && numbytes ) )
     {
         localstatus = FUDGE_NULL_POINTER;
         string = 0;
         goto status_and_return;
     }
 
-    if ( ( localstatus = FudgeString_createFromASCIIZ ( &string, chars ) ) != FUDGE_OK )
+    hash = FudgeString_hashBytes ( bytes, numbytes );
+    if ( ( string = FudgeStringPool_find ( pool, hash, bytes, numbytes ) ) )
+    {
+        localstatus = FUDGE_OK;
+        goto status_and_return;
+    }
+
+    if ( ( localstatus = FudgeString_createFromUTF8 ( &string, bytes, numbytes ) ) != FUDGE_OK )
     {
         string = 0;
         goto status_and_return;
     }
 
-    return FudgeStringPool_acquireInternal ( pool, string, status );
+    return FudgeStringPool_acquireInternal ( pool, string, hash, status );
 
 status_and_return:
     if ( status )
         *status = localstatus;
     return string;
 }
-
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FUDGE_THREAD_LOCAL
+
+#if defined(_MT) && defined(FUDGE_HAS_PTHREADS)
+#   define FUDGETHREAD_PTHREADS 1
+#   include <pthread.h>
+#endif
+
+/* The calling thread's exit hooks, most recently registered first */
+static FUDGE_THREAD_LOCAL FudgeThreadExit * s_exits = 0;
+
+#ifdef FUDGETHREAD_PTHREADS
+static pthread_once_t s_keyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t s_key;
+
+/* Called as a thread exits: runs its hooks. A hook may register further
+   hooks, which are run in turn. */
+static void FudgeThread_runExits ( void * unused )
+{
+    FudgeThreadExit * hook;
+
+    ( void ) unused;
+    while ( ( hook = s_exits ) )
+    {
+        s_exits = hook->next;
+        hook->next = 0;
+        hook->registered = FUDGE_FALSE;
+        hook->run ( hook );
+    }
+}
+
+static void FudgeThread_createKey ( void )
+{
+    pthread_key_create ( &s_key, FudgeThread_runExits );
+}
+#endif /* ifdef FUDGETHREAD_PTHREADS */
+
+void FudgeThread_atExit ( FudgeThreadExit * hook )
+{
+    if ( hook->registered )
+        return;
+
+#ifdef FUDGETHREAD_PTHREADS
+    /* The key's value only needs to be non-NULL for its destructor to run */
+    if ( ! s_exits )
+    {
+        pthread_once ( &s_keyOnce, FudgeThread_createKey );
+        pthread_setspecific ( s_key, &s_key );
+    }
+#endif /* ifdef FUDGETHREAD_PTHREADS */
+    hook->next = s_exits;
+    hook->registered = FUDGE_TRUE;
+    s_exits = hook;
+}
+
+#ifdef FUDGE_HAS_ATOMICS
+
+/* Exit hook for a cache: makes it available to other threads */
+static void FudgeThread_releaseCache ( FudgeThreadExit * hook )
+{
+    FudgeThreadCache * cache = ( FudgeThreadCache * ) hook;
+
+    *( cache->local ) = 0;
+    ( void ) AtomicCompareExchangePointer ( cache->inuse, cache, 0 );
+}
+
+FudgeThreadCache * FudgeThread_acquireCache ( FudgeThreadCache * volatile * list,
+                                              size_t size,
+                                              FudgeThreadCache * * local )
+{
+    FudgeThreadCache * cache, * head;
+
+    /* Adopt the cache of a thread that has exited, if there is one */
+    for ( cache = AtomicLoadPointer ( *list ); cache; cache = cache->next )
+        if ( ! AtomicCompareExchangePointer ( cache->inuse, 0, cache ) )
+            break;
+
+    if ( ! cache )
+    {
+        if ( ! ( cache = ( FudgeThreadCache * ) malloc ( size ) ) )
+            return 0;
+        memset ( cache, 0, size );
+        cache->inuse = cache;
+
+        do
+        {
+            head = AtomicLoadPointer ( *list );
+            cache->next = head;
+        } while ( AtomicCompareExchangePointer ( *list, head, cache ) != head );
+    }
+
+    cache->exit.run = FudgeThread_releaseCache;
+    cache->local = local;
+    FudgeThread_atExit ( &( cache->exit ) );
+    *local = cache;
+    return cache;
+}
+
+#endif /* ifdef FUDGE_HAS_ATOMICS */
+
+#endif /* ifdef FUDGE_THREAD_LOCAL */
@@ -0,0 +1,83 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_THREAD_H
+#define INC_FUDGE_THREAD_H
+
+#include "fudge/platform.h"
+#include "fudge/types.h"
+#include "atomic.h"
+#include <stddef.h>
+
+/* FUDGE_THREAD_LOCAL is the storage class for variables with a separate
+   instance per thread. In builds without threading support it is empty (as
+   there is only ever one thread); in threaded builds it is only defined if
+   the compiler supports thread local storage, so code that depends on it
+   must check that it is defined. */
+#if defined(_MT)
+#   if defined(_MSC_VER)
+#       define FUDGE_THREAD_LOCAL __declspec(thread)
+#   elif defined(FUDGE_HAS_THREAD_LOCAL)
+#       define FUDGE_THREAD_LOCAL __thread
+#   endif
+#else
+#   define FUDGE_THREAD_LOCAL
+#endif
+
+#ifdef FUDGE_THREAD_LOCAL
+
+/* A function to be run as the calling thread exits. Exit hooks are kept in
+   thread local storage (or in memory owned by the thread) and are run in
+   the reverse of the order they were registered. They are only run where
+   pthreads are available; elsewhere they are never called. */
+typedef struct FudgeThreadExit
+{
+    void ( *run ) ( struct FudgeThreadExit * hook );
+    struct FudgeThreadExit * next;
+    fudge_bool registered;
+} FudgeThreadExit;
+
+/* Arranges for the hook to be run when the calling thread exits. Does
+   nothing if the hook is already registered; once run, it can be
+   registered again. */
+void FudgeThread_atExit ( FudgeThreadExit * hook );
+
+#ifdef FUDGE_HAS_ATOMICS
+
+/* The start of a per-thread cache. Caches are kept on a list and never
+   freed: when a thread exits its cache is released for adoption by the
+   next thread that needs one, as whatever it holds may still be in use. */
+typedef struct FudgeThreadCache
+{
+    FudgeThreadExit exit;                       /* Releases the cache as its thread exits */
+    void * volatile inuse;                      /* Non-NULL while a thread owns the cache */
+    struct FudgeThreadCache * next;             /* The next cache on the list */
+    struct FudgeThreadCache * * local;          /* The owning thread's pointer to the cache */
+} FudgeThreadCache;
+
+/* Gives the calling thread a cache from the list, adopting one released by
+   an exited thread if there is one or allocating a zeroed cache of size
+   bytes if not. The cache is stored in *local (a thread local variable),
+   which is cleared again when the thread exits. Returns NULL if the
+   allocation fails. */
+FudgeThreadCache * FudgeThread_acquireCache ( FudgeThreadCache * volatile * list,
+                                              size_t size,
+                                              FudgeThreadCache * * local );
+
+#endif /* ifdef FUDGE_HAS_ATOMICS */
+
+#endif /* ifdef FUDGE_THREAD_LOCAL */
+
+#endif
@@ -0,0 +1,638 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "transcode.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#   define FUDGETRANSCODE_SSE2
+#   include <emmintrin.h>
+#endif
+
+#define FUDGETRANSCODE_SUR_HIGH_START   0xD800
+#define FUDGETRANSCODE_SUR_HIGH_END     0xDBFF
+#define FUDGETRANSCODE_SUR_LOW_START    0xDC00
+#define FUDGETRANSCODE_SUR_LOW_END      0xDFFF
+#define FUDGETRANSCODE_REPLACEMENT_CHAR 0xFFFD
+#define FUDGETRANSCODE_MAX_LEGAL_UTF32  0x10FFFF
+
+/* Number of source units examined by each ASCII block check. After a block
+   fails the check it is converted a character at a time before the next
+   block is tried. */
+#define FUDGETRANSCODE_BLOCK            16
+
+#define FUDGETRANSCODE_MIN( a, b ) ( ( a ) < ( b ) ? ( a ) : ( b ) )
+
+/*****************************************************************************
+ * ASCII block copies: each copies whole blocks of ASCII characters from
+ * source to target, stopping at the first block that contains anything
+ * else. Returns the number of units copied; the caller converts whatever
+ * remains.
+ */
+
+#ifdef FUDGETRANSCODE_SSE2
+
+size_t FudgeTranscode_copyASCII16to8 ( UTF8 * target, const UTF16 * source, size_t count )
+{
+    const __m128i highbits = _mm_set1_epi16 ( ( short ) 0xFF80 );
+    const __m128i zero = _mm_setzero_si128 ( );
+    size_t index;
+
+    for ( index = 0; index + 8 <= count; index += 8 )
+    {
+        __m128i units = _mm_loadu_si128 ( ( const __m128i * ) ( source + index ) );
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi16 ( _mm_and_si128 ( units, highbits ), zero ) ) != 0xFFFF )
+            break;
+        _mm_storel_epi64 ( ( __m128i * ) ( target + index ), _mm_packus_epi16 ( units, units ) );
+    }
+    return index;
+}
+
+size_t FudgeTranscode_copyASCII32to8 ( UTF8 * target, const UTF32 * source, size_t count )
+{
+    const __m128i highbits = _mm_set1_epi32 ( ( int ) 0xFFFFFF80 );
+    const __m128i zero = _mm_setzero_si128 ( );
+    size_t index;
+
+    for ( index = 0; index + 8 <= count; index += 8 )
+    {
+        __m128i low = _mm_loadu_si128 ( ( const __m128i * ) ( source + index ) ),
+                high = _mm_loadu_si128 ( ( const __m128i * ) ( source + index + 4 ) ),
+                packed;
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi32 ( _mm_and_si128 ( _mm_or_si128 ( low, high ), highbits ), zero ) ) != 0xFFFF )
+            break;
+        packed = _mm_packs_epi32 ( low, high );
+        _mm_storel_epi64 ( ( __m128i * ) ( target + index ), _mm_packus_epi16 ( packed, packed ) );
+    }
+    return index;
+}
+
+size_t FudgeTranscode_copyASCII8to16 ( UTF16 * target, const UTF8 * source, size_t count )
+{
+    const __m128i zero = _mm_setzero_si128 ( );
+    size_t index;
+
+    for ( index = 0; index + 16 <= count; index += 16 )
+    {
+        __m128i bytes = _mm_loadu_si128 ( ( const __m128i * ) ( source + index ) );
+        if ( _mm_movemask_epi8 ( bytes ) )
+            break;
+        _mm_storeu_si128 ( ( __m128i * ) ( target + index ), _mm_unpacklo_epi8 ( bytes, zero ) );
+        _mm_storeu_si128 ( ( __m128i * ) ( target + index + 8 ), _mm_unpackhi_epi8 ( bytes, zero ) );
+    }
+    return index;
+}
+
+size_t FudgeTranscode_copyASCII8to32 ( UTF32 * target, const UTF8 * source, size_t count )
+{
+    const __m128i zero = _mm_setzero_si128 ( );
+    size_t index;
+
+    for ( index = 0; index + 16 <= count; index += 16 )
+    {
+        __m128i bytes = _mm_loadu_si128 ( ( const __m128i * ) ( source + index ) ),
+                low = _mm_unpacklo_epi8 ( bytes, zero ),
+                high = _mm_unpackhi_epi8 ( bytes, zero );
+        if ( _mm_movemask_epi8 ( bytes ) )
+            break;
+        _mm_storeu_si128 ( ( __m128i * ) ( target + index ), _mm_unpacklo_epi16 ( low, zero ) );
+        _mm_storeu_si128 ( ( __m128i * ) ( target + index + 4 ), _mm_unpackhi_epi16 ( low, zero ) );
+        _mm_storeu_si128 ( ( __m128i * ) ( target + index + 8 ), _mm_unpacklo_epi16 ( high, zero ) );
+        _mm_storeu_si128 ( ( __m128i * ) ( target + index + 12 ), _mm_unpackhi_epi16 ( high, zero ) );
+    }
+    return index;
+}
+
+#else /* ifdef FUDGETRANSCODE_SSE2 */
+
+/* Without SSE2 the checks are done a 64 bit word at a time: a word holds
+   eight UTF8, four UTF16 or two UTF32 units and is ASCII if none of the bits
+   above the lowest seven of each unit are set */
+
+uint64_t FudgeTranscode_read64 ( const void * source )
+{
+    uint64_t word;
+    memcpy ( &word, source, sizeof ( word ) );
+    return word;
+}
+
+size_t FudgeTranscode_copyASCII16to8 ( UTF8 * target, const UTF16 * source, size_t count )
+{
+    size_t index, unit;
+
+    for ( index = 0; index + 4 <= count; index += 4 )
+    {
+        if ( FudgeTranscode_read64 ( source + index ) & 0xFF80FF80FF80FF80ULL )
+            break;
+        for ( unit = index; unit < index + 4; ++unit )
+            target [ unit ] = ( UTF8 ) source [ unit ];
+    }
+    return index;
+}
+
+size_t FudgeTranscode_copyASCII32to8 ( UTF8 * target, const UTF32 * source, size_t count )
+{
+    size_t index;
+
+    for ( index = 0; index + 2 <= count; index += 2 )
+    {
+        if ( FudgeTranscode_read64 ( source + index ) & 0xFFFFFF80FFFFFF80ULL )
+            break;
+        target [ index ] = ( UTF8 ) source [ index ];
+        target [ index + 1 ] = ( UTF8 ) source [ index + 1 ];
+    }
+    return index;
+}
+
+size_t FudgeTranscode_copyASCII8to16 ( UTF16 * target, const UTF8 * source, size_t count )
+{
+    size_t index, unit;
+
+    for ( index = 0; index + 8 <= count; index += 8 )
+    {
+        if ( FudgeTranscode_read64 ( source + index ) & 0x8080808080808080ULL )
+            break;
+        for ( unit = index; unit < index + 8; ++unit )
+            target [ unit ] = source [ unit ];
+    }
+    return index;
+}
+
+size_t FudgeTranscode_copyASCII8to32 ( UTF32 * target, const UTF8 * source, size_t count )
+{
+    size_t index, unit;
+
+    for ( index = 0; index + 8 <= count; index += 8 )
+    {
+        if ( FudgeTranscode_read64 ( source + index ) & 0x8080808080808080ULL )
+            break;
+        for ( unit = index; unit < index + 8; ++unit )
+            target [ unit ] = source [ unit ];
+    }
+    return index;
+}
+
+#endif /* ifdef FUDGETRANSCODE_SSE2 */
+
+/*****************************************************************************
+ * Single character helpers
+ */
+
+size_t FudgeTranscode_codePointUTF8Length ( UTF32 ch )
+{
+    if ( ch < 0x80 )
+        return 1;
+    if ( ch < 0x800 )
+        return 2;
+    if ( ch < 0x10000 )
+        return 3;
+    /* Values outside of the Unicode range become the replacement character */
+    return ch <= FUDGETRANSCODE_MAX_LEGAL_UTF32 ? 4 : 3;
+}
+
+/* Writes a code point as length UTF8 bytes, where length has come from
+   FudgeTranscode_codePointUTF8Length and the code point has already been
+   replaced if out of range */
+UTF8 * FudgeTranscode_writeUTF8 ( UTF8 * target, UTF32 ch, size_t length )
+{
+    switch ( length )
+    {
+        case 1:
+            target [ 0 ] = ( UTF8 ) ch;
+            break;
+        case 2:
+            target [ 0 ] = ( UTF8 ) ( 0xC0 | ( ch >> 6 ) );
+            target [ 1 ] = ( UTF8 ) ( 0x80 | ( ch & 0x3F ) );
+            break;
+        case 3:
+            target [ 0 ] = ( UTF8 ) ( 0xE0 | ( ch >> 12 ) );
+            target [ 1 ] = ( UTF8 ) ( 0x80 | ( ( ch >> 6 ) & 0x3F ) );
+            target [ 2 ] = ( UTF8 ) ( 0x80 | ( ch & 0x3F ) );
+            break;
+        default:
+            target [ 0 ] = ( UTF8 ) ( 0xF0 | ( ch >> 18 ) );
+            target [ 1 ] = ( UTF8 ) ( 0x80 | ( ( ch >> 12 ) & 0x3F ) );
+            target [ 2 ] = ( UTF8 ) ( 0x80 | ( ( ch >> 6 ) & 0x3F ) );
+            target [ 3 ] = ( UTF8 ) ( 0x80 | ( ch & 0x3F ) );
+            break;
+    }
+    return target + length;
+}
+
+/* Decodes the UTF8 sequence at source if it is complete and legal, setting
+   ch to the code point and returning the number of bytes used. Returns zero
+   for anything else, leaving the caller to pass the character to the
+   reference converter so that the result is unchanged. */
+size_t FudgeTranscode_readUTF8 ( UTF32 * ch, const UTF8 * source, const UTF8 * sourceEnd )
+{
+    const size_t available = ( size_t ) ( sourceEnd - source );
+    const UTF8 lead = source [ 0 ];
+
+    if ( lead < 0x80 )
+    {
+        *ch = lead;
+        return 1;
+    }
+    if ( lead < 0xC2 || lead > 0xF4 )
+        return 0;
+
+    if ( lead < 0xE0 )
+    {
+        if ( available < 2 || ( source [ 1 ] & 0xC0 ) != 0x80 )
+            return 0;
+        *ch = ( ( UTF32 ) ( lead & 0x1F ) << 6 ) | ( source [ 1 ] & 0x3F );
+        return 2;
+    }
+
+    if ( lead < 0xF0 )
+    {
+        if ( available < 3 || ( source [ 2 ] & 0xC0 ) != 0x80 )
+            return 0;
+        switch ( lead )
+        {
+            case 0xE0: if ( source [ 1 ] < 0xA0 || source [ 1 ] > 0xBF ) return 0; break;
+            case 0xED: if ( source [ 1 ] < 0x80 || source [ 1 ] > 0x9F ) return 0; break;
+            default:   if ( ( source [ 1 ] & 0xC0 ) != 0x80 ) return 0; break;
+        }
+        *ch = ( ( UTF32 ) ( lead & 0x0F ) << 12 ) | ( ( UTF32 ) ( source [ 1 ] & 0x3F ) << 6 ) | ( source [ 2 ] & 0x3F );
+        return 3;
+    }
+
+    if ( available < 4 || ( source [ 2 ] & 0xC0 ) != 0x80 || ( source [ 3 ] & 0xC0 ) != 0x80 )
+        return 0;
+    switch ( lead )
+    {
+        case 0xF0: if ( source [ 1 ] < 0x90 || source [ 1 ] > 0xBF ) return 0; break;
+        case 0xF4: if ( source [ 1 ] < 0x80 || source [ 1 ] > 0x8F ) return 0; break;
+        default:   if ( ( source [ 1 ] & 0xC0 ) != 0x80 ) return 0; break;
+    }
+    *ch = ( ( UTF32 ) ( lead & 0x07 ) << 18 ) | ( ( UTF32 ) ( source [ 1 ] & 0x3F ) << 12 )
+        | ( ( UTF32 ) ( source [ 2 ] & 0x3F ) << 6 ) | ( source [ 3 ] & 0x3F );
+    return 4;
+}
+
+/* Convert the single character at source using the reference converters */
+const UTF8 * FudgeTranscode_characterEnd ( const UTF8 * source, const UTF8 * sourceEnd )
+{
+    const UTF8 * end = source + trailingBytesForUTF8 [ *source ] + 1;
+    return end < sourceEnd ? end : sourceEnd;
+}
+
+ConversionResult FudgeTranscode_referenceUTF8toUTF16 ( const UTF8 * * source, const UTF8 * sourceEnd, UTF16 * * target, UTF16 * targetEnd )
+{
+    return ConvertUTF8toUTF16 ( source, FudgeTranscode_characterEnd ( *source, sourceEnd ), target, targetEnd, lenientConversion );
+}
+
+ConversionResult FudgeTranscode_referenceUTF8toUTF32 ( const UTF8 * * source, const UTF8 * sourceEnd, UTF32 * * target, UTF32 * targetEnd )
+{
+    return ConvertUTF8toUTF32 ( source, FudgeTranscode_characterEnd ( *source, sourceEnd ), target, targetEnd, lenientConversion );
+}
+
+/*****************************************************************************
+ * Output sizing
+ */
+
+size_t FudgeTranscode_utf16ToUTF8Length ( const UTF16 * source, const UTF16 * sourceEnd )
+{
+    size_t length = 0;
+
+    while ( source < sourceEnd )
+    {
+        const UTF16 * blockEnd;
+#ifdef FUDGETRANSCODE_SSE2
+        const __m128i highbits = _mm_set1_epi16 ( ( short ) 0xFF80 );
+        while ( sourceEnd - source >= 8 && _mm_movemask_epi8 ( _mm_cmpeq_epi16 (
+                    _mm_and_si128 ( _mm_loadu_si128 ( ( const __m128i * ) source ), highbits ),
+                    _mm_setzero_si128 ( ) ) ) == 0xFFFF )
+        {
+            length += 8;
+            source += 8;
+        }
+#endif
+        blockEnd = source + FUDGETRANSCODE_MIN( sourceEnd - source, FUDGETRANSCODE_BLOCK );
+        while ( source < blockEnd )
+        {
+            UTF32 ch = *source++;
+            if ( ch >= FUDGETRANSCODE_SUR_HIGH_START && ch <= FUDGETRANSCODE_SUR_HIGH_END
+                                                     && source < sourceEnd
+                                                     && *source >= FUDGETRANSCODE_SUR_LOW_START
+                                                     && *source <= FUDGETRANSCODE_SUR_LOW_END )
+            {
+                ++source;
+                length += 4;
+            }
+            else
+                length += FudgeTranscode_codePointUTF8Length ( ch );
+        }
+    }
+    return length;
+}
+
+size_t FudgeTranscode_utf32ToUTF8Length ( const UTF32 * source, const UTF32 * sourceEnd )
+{
+    size_t length = 0;
+
+    while ( source < sourceEnd )
+    {
+        const UTF32 * blockEnd;
+#ifdef FUDGETRANSCODE_SSE2
+        const __m128i highbits = _mm_set1_epi32 ( ( int ) 0xFFFFFF80 );
+        while ( sourceEnd - source >= 4 && _mm_movemask_epi8 ( _mm_cmpeq_epi32 (
+                    _mm_and_si128 ( _mm_loadu_si128 ( ( const __m128i * ) source ), highbits ),
+                    _mm_setzero_si128 ( ) ) ) == 0xFFFF )
+        {
+            length += 4;
+            source += 4;
+        }
+#endif
+        blockEnd = source + FUDGETRANSCODE_MIN( sourceEnd - source, FUDGETRANSCODE_BLOCK );
+        while ( source < blockEnd )
+            length += FudgeTranscode_codePointUTF8Length ( *source++ );
+    }
+    return length;
+}
+
+/* Counts the characters in a UTF8 sequence (the bytes that are not
+   continuation bytes), adding one more for each four byte lead if
+   surrogates is set. Invalid sequences are counted as if valid, which can
+   only overestimate the space needed before the conversion hits them. */
+size_t FudgeTranscode_countUTF8 ( const UTF8 * source, const UTF8 * sourceEnd, int surrogates )
+{
+    size_t length = 0;
+
+#ifdef FUDGETRANSCODE_SSE2
+    const __m128i lastContinuation = _mm_set1_epi8 ( ( char ) 0xBF ),
+                  firstFourByteLead = _mm_set1_epi8 ( ( char ) 0xF0 ),
+                  zero = _mm_setzero_si128 ( );
+
+    while ( sourceEnd - source >= 16 )
+    {
+        /* Each byte lane counts at most two per block, so the lanes can
+           safely accumulate 127 blocks before being summed */
+        size_t blocks = FUDGETRANSCODE_MIN( ( size_t ) ( sourceEnd - source ) / 16, 127 );
+        __m128i counts = zero, sums;
+
+        for ( ; blocks; --blocks, source += 16 )
+        {
+            __m128i bytes = _mm_loadu_si128 ( ( const __m128i * ) source );
+
+            /* Continuation bytes are 0x80 to 0xBF: as signed values they are
+               the only ones less than or equal to (signed) 0xBF */
+            counts = _mm_sub_epi8 ( counts, _mm_cmpgt_epi8 ( bytes, lastContinuation ) );
+            if ( surrogates )
+                counts = _mm_sub_epi8 ( counts, _mm_cmpeq_epi8 ( _mm_max_epu8 ( bytes, firstFourByteLead ), bytes ) );
+        }
+
+        sums = _mm_sad_epu8 ( counts, zero );
+        length += ( size_t ) _mm_cvtsi128_si32 ( sums ) + ( size_t ) _mm_cvtsi128_si32 ( _mm_srli_si128 ( sums, 8 ) );
+    }
+#else /* ifdef FUDGETRANSCODE_SSE2 */
+    /* Work a word at a time, gathering a flag in the top bit of each byte
+       then summing the flags with a multiply */
+    const uint64_t topbits = 0x8080808080808080ULL;
+
+    while ( sourceEnd - source >= 8 )
+    {
+        uint64_t word = FudgeTranscode_read64 ( source ),
+                 continuations = word & ~( word << 1 ) & topbits;
+        length += 8 - ( size_t ) ( ( ( continuations >> 7 ) * 0x0101010101010101ULL ) >> 56 );
+        if ( surrogates )
+        {
+            uint64_t leads = word & ( word << 1 ) & ( word << 2 ) & ( word << 3 ) & topbits;
+            length += ( size_t ) ( ( ( leads >> 7 ) * 0x0101010101010101ULL ) >> 56 );
+        }
+        source += 8;
+    }
+#endif /* ifdef FUDGETRANSCODE_SSE2 */
+
+    for ( ; source < sourceEnd; ++source )
+    {
+        if ( ( *source & 0xC0 ) != 0x80 )
+            ++length;
+        if ( surrogates && *source >= 0xF0 )
+            ++length;
+    }
+    return length;
+}
+
+size_t FudgeTranscode_utf8ToUTF16Length ( const UTF8 * source, const UTF8 * sourceEnd )
+{
+    return FudgeTranscode_countUTF8 ( source, sourceEnd, 1 );
+}
+
+size_t FudgeTranscode_utf8ToUTF32Length ( const UTF8 * source, const UTF8 * sourceEnd )
+{
+    return FudgeTranscode_countUTF8 ( source, sourceEnd, 0 );
+}
+
+/*****************************************************************************
+ * Conversions
+ */
+
+ConversionResult FudgeTranscode_utf16ToUTF8 ( const UTF16 * * sourceStart, const UTF16 * sourceEnd, UTF8 * * targetStart, UTF8 * targetEnd )
+{
+    ConversionResult result = conversionOK;
+    const UTF16 * source = *sourceStart;
+    UTF8 * target = *targetStart;
+
+    while ( source < sourceEnd )
+    {
+        const UTF16 * blockEnd;
+        size_t copied = FudgeTranscode_copyASCII16to8 ( target, source, FUDGETRANSCODE_MIN( ( size_t ) ( sourceEnd - source ),
+                                                                                            ( size_t ) ( targetEnd - target ) ) );
+        source += copied;
+        target += copied;
+
+        blockEnd = source + FUDGETRANSCODE_MIN( sourceEnd - source, FUDGETRANSCODE_BLOCK );
+        while ( source < blockEnd )
+        {
+            UTF32 ch = *source;
+            size_t consumed = 1, length;
+
+            if ( ch >= FUDGETRANSCODE_SUR_HIGH_START && ch <= FUDGETRANSCODE_SUR_HIGH_END )
+            {
+                if ( source + 1 == sourceEnd )
+                {
+                    result = sourceExhausted;
+                    goto finished;
+                }
+                /* Combine a surrogate pair; an unpaired high surrogate is
+                   written as is, matching a lenient conversion */
+                if ( source [ 1 ] >= FUDGETRANSCODE_SUR_LOW_START && source [ 1 ] <= FUDGETRANSCODE_SUR_LOW_END )
+                {
+                    ch = ( ( ch - FUDGETRANSCODE_SUR_HIGH_START ) << 10 ) + ( source [ 1 ] - FUDGETRANSCODE_SUR_LOW_START ) + 0x10000;
+                    consumed = 2;
+                }
+            }
+
+            length = FudgeTranscode_codePointUTF8Length ( ch );
+            if ( ( size_t ) ( targetEnd - target ) < length )
+            {
+                result = targetExhausted;
+                goto finished;
+            }
+            target = FudgeTranscode_writeUTF8 ( target, ch, length );
+            source += consumed;
+        }
+    }
+
+finished:
+    *sourceStart = source;
+    *targetStart = target;
+    return result;
+}
+
+ConversionResult FudgeTranscode_utf32ToUTF8 ( const UTF32 * * sourceStart, const UTF32 * sourceEnd, UTF8 * * targetStart, UTF8 * targetEnd )
+{
+    ConversionResult result = conversionOK;
+    const UTF32 * source = *sourceStart;
+    UTF8 * target = *targetStart;
+
+    while ( source < sourceEnd )
+    {
+        const UTF32 * blockEnd;
+        size_t copied = FudgeTranscode_copyASCII32to8 ( target, source, FUDGETRANSCODE_MIN( ( size_t ) ( sourceEnd - source ),
+                                                                                            ( size_t ) ( targetEnd - target ) ) );
+        source += copied;
+        target += copied;
+
+        blockEnd = source + FUDGETRANSCODE_MIN( sourceEnd - source, FUDGETRANSCODE_BLOCK );
+        while ( source < blockEnd )
+        {
+            UTF32 ch = *source;
+            size_t length = FudgeTranscode_codePointUTF8Length ( ch );
+
+            if ( ( size_t ) ( targetEnd - target ) < length )
+            {
+                result = targetExhausted;
+                goto finished;
+            }
+
+            /* Out of range values are replaced and flagged, but the
+               conversion continues */
+            if ( ch > FUDGETRANSCODE_MAX_LEGAL_UTF32 )
+            {
+                ch = FUDGETRANSCODE_REPLACEMENT_CHAR;
+                result = sourceIllegal;
+            }
+            target = FudgeTranscode_writeUTF8 ( target, ch, length );
+            ++source;
+        }
+    }
+
+finished:
+    *sourceStart = source;
+    *targetStart = target;
+    return result;
+}
+
+ConversionResult FudgeTranscode_utf8ToUTF16 ( const UTF8 * * sourceStart, const UTF8 * sourceEnd, UTF16 * * targetStart, UTF16 * targetEnd )
+{
+    ConversionResult result = conversionOK;
+    const UTF8 * source = *sourceStart;
+    UTF16 * target = *targetStart;
+
+    while ( source < sourceEnd )
+    {
+        const UTF8 * blockEnd;
+        size_t copied = FudgeTranscode_copyASCII8to16 ( target, source, FUDGETRANSCODE_MIN( ( size_t ) ( sourceEnd - source ),
+                                                                                            ( size_t ) ( targetEnd - target ) ) );
+        source += copied;
+        target += copied;
+
+        blockEnd = source + FUDGETRANSCODE_MIN( sourceEnd - source, FUDGETRANSCODE_BLOCK );
+        while ( source < blockEnd )
+        {
+            UTF32 ch;
+            size_t consumed;
+
+            if ( ! ( consumed = FudgeTranscode_readUTF8 ( &ch, source, sourceEnd ) ) )
+            {
+                if ( ( result = FudgeTranscode_referenceUTF8toUTF16 ( &source, sourceEnd, &target, targetEnd ) ) != conversionOK )
+                    goto finished;
+                continue;
+            }
+
+            if ( ch < 0x10000 )
+            {
+                if ( target == targetEnd )
+                {
+                    result = targetExhausted;
+                    goto finished;
+                }
+                *target++ = ( UTF16 ) ch;
+            }
+            else
+            {
+                if ( targetEnd - target < 2 )
+                {
+                    result = targetExhausted;
+                    goto finished;
+                }
+                ch -= 0x10000;
+                *target++ = ( UTF16 ) ( ( ch >> 10 ) + FUDGETRANSCODE_SUR_HIGH_START );
+                *target++ = ( UTF16 ) ( ( ch & 0x3FF ) + FUDGETRANSCODE_SUR_LOW_START );
+            }
+            source += consumed;
+        }
+    }
+
+finished:
+    *sourceStart = source;
+    *targetStart = target;
+    return result;
+}
+
+ConversionResult FudgeTranscode_utf8ToUTF32 ( const UTF8 * * sourceStart, const UTF8 * sourceEnd, UTF32 * * targetStart, UTF32 * targetEnd )
+{
+    ConversionResult result = conversionOK;
+    const UTF8 * source = *sourceStart;
+    UTF32 * target = *targetStart;
+
+    while ( source < sourceEnd )
+    {
+        const UTF8 * blockEnd;
+        size_t copied = FudgeTranscode_copyASCII8to32 ( target, source, FUDGETRANSCODE_MIN( ( size_t ) ( sourceEnd - source ),
+                                                                                            ( size_t ) ( targetEnd - target ) ) );
+        source += copied;
+        target += copied;
+
+        blockEnd = source + FUDGETRANSCODE_MIN( sourceEnd - source, FUDGETRANSCODE_BLOCK );
+        while ( source < blockEnd )
+        {
+            UTF32 ch;
+            size_t consumed;
+
+            if ( ! ( consumed = FudgeTranscode_readUTF8 ( &ch, source, sourceEnd ) ) )
+            {
+                if ( ( result = FudgeTranscode_referenceUTF8toUTF32 ( &source, sourceEnd, &target, targetEnd ) ) != conversionOK )
+                    goto finished;
+                continue;
+            }
+            if ( target == targetEnd )
+            {
+                result = targetExhausted;
+                goto finished;
+            }
+            *target++ = ch;
+            source += consumed;
+        }
+    }
+
+finished:
+    *sourceStart = source;
+    *targetStart = target;
+    return result;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2009 - 2009, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INC_FUDGE_TRANSCODE_H
+#define INC_FUDGE_TRANSCODE_H
+
+#include "convertutf.h"
+
+/* Transcoders used by FudgeString. These produce exactly the same results as
+   the lenient conversions in convertutf.h, but handle runs of ASCII a block
+   at a time (using SSE2 where available) and BMP characters without leaving
+   the main loop; anything else is passed to the reference implementation.
+
+   The length functions return the exact size of the output (in bytes for
+   UTF8, in code units otherwise) for valid input, so the target can be
+   allocated before converting. For invalid input they return a size that
+   will allow the conversion to reach the error. */
+
+size_t FudgeTranscode_utf16ToUTF8Length ( const UTF16 * source, const UTF16 * sourceEnd );
+size_t FudgeTranscode_utf32ToUTF8Length ( const UTF32 * source, const UTF32 * sourceEnd );
+size_t FudgeTranscode_utf8ToUTF16Length ( const UTF8 * source, const UTF8 * sourceEnd );
+size_t FudgeTranscode_utf8ToUTF32Length ( const UTF8 * source, const UTF8 * sourceEnd );
+
+ConversionResult FudgeTranscode_utf16ToUTF8 ( const UTF16 * * sourceStart, const UTF16 * sourceEnd, UTF8 * * targetStart, UTF8 * targetEnd );
+ConversionResult FudgeTranscode_utf32ToUTF8 ( const UTF32 * * sourceStart, const UTF32 * sourceEnd, UTF8 * * targetStart, UTF8 * targetEnd );
+ConversionResult FudgeTranscode_utf8ToUTF16 ( const UTF8 * * sourceStart, const UTF8 * sourceEnd, UTF16 * * targetStart, UTF16 * targetEnd );
+ConversionResult FudgeTranscode_utf8ToUTF32 ( const UTF8 * * sourceStart, const UTF8 * sourceEnd, UTF32 * * targetStart, UTF32 * targetEnd );
+
+#endif
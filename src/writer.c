@@ -0,0 +1,501 @@
+/**
+ * Copyright (C) 2009 - 2010, Vrai Stacey.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _FUDGEWRITERIMPL_DEFINED 1
+#include "fudge/writer.h"
+#include "fudge/header.h"
+#include "codec_encode.h"
+#include "memory_internal.h"
+#include "message_internal.h"
+#include "prefix.h"
+#include "reference.h"
+#include "registry_internal.h"
+
+/* Offsets (in to the writer's buffer) of the prefix and width placeholder of
+   an open submessage field */
+typedef struct
+{
+    size_t prefix;
+    size_t width;
+} SubMsgMark;
+
+struct FudgeWriterImpl
+{
+    FudgeRefCount refcount;
+    fudge_byte * buffer;
+    size_t capacity;
+    size_t numbytes;
+    fudge_bool inmsg;
+    SubMsgMark * submsgs;
+    size_t numsubmsgs;
+    size_t maxsubmsgs;
+};
+
+/* Submessage widths aren't known until the submessage is closed, so space
+   for the largest possible width is reserved and the contents moved down
+   if a smaller one will do */
+#define FUDGEWRITER_RESERVED_WIDTH 4
+
+FudgeStatus FudgeWriter_reserve ( FudgeWriter writer, size_t numbytes )
+{
+    fudge_byte * buffer;
+    size_t capacity;
+
+    if ( writer->numbytes + numbytes <= writer->capacity )
+        return FUDGE_OK;
+
+    /* Encoded messages are limited to the size of a signed 32 bit integer */
+    if ( writer->numbytes + numbytes > 0x7FFFFFFF )
+        return FUDGE_PAYLOAD_TOO_LONG;
+
+    capacity = writer->capacity * 2;
+    if ( capacity < writer->numbytes + numbytes )
+        capacity = writer->numbytes + numbytes;
+
+    if ( ! ( buffer = FUDGEMEMORY_REALLOC( fudge_byte *, writer->buffer, writer->capacity, capacity ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_initField ( FudgeWriter writer, FudgeField * field, fudge_type_id type, const FudgeString name, const fudge_i16 * ordinal )
+{
+    if ( ! writer )
+        return FUDGE_NULL_POINTER;
+    if ( ! writer->inmsg )
+        return FUDGE_WRITER_NOT_IN_MSG;
+
+    field->type = type;
+    field->numbytes = 0;
+    field->flags = 0;
+
+    if ( name )
+    {
+        /* Names may not have a length greater than 255 bytes (only one byte is
+           available for their length) */
+        if ( FudgeString_getSize ( name ) >= 256 )
+            return FUDGE_NAME_TOO_LONG;
+        field->name = name;
+        field->flags |= FUDGE_FIELD_HAS_NAME;
+    }
+    else
+        field->name = 0;
+
+    if ( ordinal )
+    {
+        field->ordinal = *ordinal;
+        field->flags |= FUDGE_FIELD_HAS_ORDINAL;
+    }
+    else
+        field->ordinal = 0;
+
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_writeField ( FudgeWriter writer, const FudgeField * field )
+{
+    FudgeStatus status;
+    fudge_byte * writepos;
+
+    if ( ( status = FudgeWriter_reserve ( writer, FudgeCodec_getFieldLength ( field ) ) ) != FUDGE_OK )
+        return status;
+
+    writepos = writer->buffer + writer->numbytes;
+    if ( ( status = FudgeCodec_encodeField ( field, &writepos ) ) != FUDGE_OK )
+        return status;
+    writer->numbytes = writepos - writer->buffer;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_create ( FudgeWriter * writer, fudge_i32 capacity )
+{
+    FudgeStatus status;
+
+    if ( ! writer )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! ( *writer = FUDGEMEMORY_MALLOC( FudgeWriter, sizeof ( struct FudgeWriterImpl ) ) ) )
+        return FUDGE_OUT_OF_MEMORY;
+
+    /* There's always room for the message header */
+    ( *writer )->capacity = capacity > 8 ? capacity : 8;
+    ( *writer )->numbytes = 0;
+    ( *writer )->inmsg = FUDGE_FALSE;
+    ( *writer )->submsgs = 0;
+    ( *writer )->numsubmsgs = ( *writer )->maxsubmsgs = 0;
+
+    if ( ! ( ( *writer )->buffer = FUDGEMEMORY_MALLOC( fudge_byte *, ( *writer )->capacity ) ) )
+    {
+        status = FUDGE_OUT_OF_MEMORY;
+        goto release_writer_and_fail;
+    }
+
+    if ( ( status = FudgeRefCount_create ( &( ( *writer )->refcount ) ) ) != FUDGE_OK )
+        goto release_buffer_and_fail;
+
+    return FUDGE_OK;
+
+release_buffer_and_fail:
+    FUDGEMEMORY_FREE( ( *writer )->buffer, ( *writer )->capacity );
+release_writer_and_fail:
+    FUDGEMEMORY_FREE( *writer, sizeof ( struct FudgeWriterImpl ) );
+    return status;
+}
+
+FudgeStatus FudgeWriter_retain ( FudgeWriter writer )
+{
+    if ( ! writer )
+        return FUDGE_NULL_POINTER;
+
+    FudgeRefCount_increment ( writer->refcount );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_release ( FudgeWriter writer )
+{
+    if ( ! writer )
+        return FUDGE_NULL_POINTER;
+
+    if ( ! FudgeRefCount_decrementAndReturn ( writer->refcount ) )
+    {
+        FudgeStatus status;
+
+        if ( ( status = FudgeRefCount_destroy ( writer->refcount ) ) != FUDGE_OK )
+            return status;
+
+        FUDGEMEMORY_FREE( writer->submsgs, writer->maxsubmsgs * sizeof ( SubMsgMark ) );
+        FUDGEMEMORY_FREE( writer->buffer, writer->capacity );
+        FUDGEMEMORY_FREE( writer, sizeof ( struct FudgeWriterImpl ) );
+    }
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_beginMsg ( FudgeWriter writer, fudge_byte directives, fudge_byte schemaversion, fudge_i16 taxonomy )
+{
+    fudge_byte * writepos;
+
+    if ( ! writer )
+        return FUDGE_NULL_POINTER;
+
+    writer->numbytes = 0;
+    writer->numsubmsgs = 0;
+    writer->inmsg = FUDGE_TRUE;
+
+    /* The message length is filled in by FudgeWriter_endMsg. Written
+       messages are never compressed, so the directive is cleared. */
+    writepos = writer->buffer;
+    FudgeCodec_encodeByte ( directives & ~FUDGE_DIRECTIVE_COMPRESSED, &writepos );
+    FudgeCodec_encodeByte ( schemaversion, &writepos );
+    FudgeCodec_encodeI16 ( taxonomy, &writepos );
+    FudgeCodec_encodeI32 ( 0, &writepos );
+    writer->numbytes = writepos - writer->buffer;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_endMsg ( FudgeWriter writer, const fudge_byte * * bytes, fudge_i32 * numbytes )
+{
+    fudge_byte * writepos;
+
+    if ( ! ( writer && bytes && numbytes ) )
+        return FUDGE_NULL_POINTER;
+    if ( ! writer->inmsg )
+        return FUDGE_WRITER_NOT_IN_MSG;
+    if ( writer->numsubmsgs )
+        return FUDGE_WRITER_UNBALANCED_SUBMSG;
+
+    /* Backfill the message length in the header */
+    writepos = writer->buffer + 4;
+    FudgeCodec_encodeI32 ( ( fudge_i32 ) writer->numbytes, &writepos );
+
+    writer->inmsg = FUDGE_FALSE;
+    *bytes = writer->buffer;
+    *numbytes = ( fudge_i32 ) writer->numbytes;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_beginSubMsg ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal )
+{
+    FudgeStatus status;
+    FudgeField field;
+    FudgeFieldPrefix prefix;
+    SubMsgMark * mark;
+    fudge_byte * writepos;
+
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_FUDGE_MSG, name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    /* Make sure there's room to record the submessage */
+    if ( writer->numsubmsgs == writer->maxsubmsgs )
+    {
+        size_t maxsubmsgs = writer->maxsubmsgs ? writer->maxsubmsgs * 2 : 8;
+        SubMsgMark * submsgs;
+
+        if ( ! ( submsgs = FUDGEMEMORY_REALLOC( SubMsgMark *, writer->submsgs, writer->maxsubmsgs * sizeof ( SubMsgMark ), maxsubmsgs * sizeof ( SubMsgMark ) ) ) )
+            return FUDGE_OUT_OF_MEMORY;
+        writer->submsgs = submsgs;
+        writer->maxsubmsgs = maxsubmsgs;
+    }
+
+    /* Prefix, type, ordinal, name and width */
+    if ( ( status = FudgeWriter_reserve ( writer, 2 + ( ordinal ? 2 : 0 )
+                                                    + ( name ? 1 + FudgeString_getSize ( name ) : 0 )
+                                                    + FUDGEWRITER_RESERVED_WIDTH ) ) != FUDGE_OK )
+        return status;
+
+    mark = writer->submsgs + writer->numsubmsgs++;
+    mark->prefix = writer->numbytes;
+
+    prefix.fixedwidth = FUDGE_FALSE;
+    prefix.variablewidth = FUDGEWRITER_RESERVED_WIDTH;
+    prefix.ordinal = ordinal != 0;
+    prefix.name = name != 0;
+
+    writepos = writer->buffer + writer->numbytes;
+    FudgeCodec_encodeByte ( FudgePrefix_encodeFieldPrefix ( prefix ), &writepos );
+    FudgeCodec_encodeByte ( FUDGE_TYPE_FUDGE_MSG, &writepos );
+    if ( ordinal )
+        FudgeCodec_encodeI16 ( *ordinal, &writepos );
+    if ( name )
+        FudgeCodec_encodeByteArray ( FudgeString_getData ( name ), ( fudge_i32 ) FudgeString_getSize ( name ), FUDGE_FALSE, &writepos );
+
+    /* Leave space for the width */
+    mark->width = writepos - writer->buffer;
+    writer->numbytes = mark->width + FUDGEWRITER_RESERVED_WIDTH;
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_endSubMsg ( FudgeWriter writer )
+{
+    FudgeStatus status;
+    FudgeFieldPrefix prefix;
+    SubMsgMark mark;
+    fudge_i32 width;
+    fudge_byte widthofwidth, * writepos;
+
+    if ( ! writer )
+        return FUDGE_NULL_POINTER;
+    if ( ! writer->inmsg )
+        return FUDGE_WRITER_NOT_IN_MSG;
+    if ( ! writer->numsubmsgs )
+        return FUDGE_WRITER_UNBALANCED_SUBMSG;
+
+    mark = writer->submsgs [ --writer->numsubmsgs ];
+    width = ( fudge_i32 ) ( writer->numbytes - mark.width - FUDGEWRITER_RESERVED_WIDTH );
+
+    /* Shift the submessage contents down if the width needs fewer bytes than
+       were reserved, then update the prefix to match */
+    if ( ( widthofwidth = FudgeCodec_calculateBytesToHoldSize ( width ) ) < FUDGEWRITER_RESERVED_WIDTH )
+    {
+        memmove ( writer->buffer + mark.width + widthofwidth,
+                  writer->buffer + mark.width + FUDGEWRITER_RESERVED_WIDTH,
+                  width );
+        writer->numbytes -= FUDGEWRITER_RESERVED_WIDTH - widthofwidth;
+
+        if ( ( status = FudgePrefix_decodeFieldPrefix ( &prefix, writer->buffer [ mark.prefix ] ) ) != FUDGE_OK )
+            return status;
+        prefix.variablewidth = widthofwidth;
+        writer->buffer [ mark.prefix ] = FudgePrefix_encodeFieldPrefix ( prefix );
+    }
+
+    writepos = writer->buffer + mark.width;
+    FudgeCodec_encodeFieldLength ( width, &writepos );
+    return FUDGE_OK;
+}
+
+FudgeStatus FudgeWriter_addFieldIndicator ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_INDICATOR, name, ordinal ) ) != FUDGE_OK )
+        return status;
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+FudgeStatus FudgeWriter_addFieldInteger ( FudgeWriter writer,
+                                          const FudgeString name,
+                                          const fudge_i16 * ordinal,
+                                          fudge_type_id type,
+                                          const fudge_i64 value )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    if ( ( status = FudgeWriter_initField ( writer, &field, FudgeMsg_pickIntegerType ( type, value ), name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    switch ( field.type )
+    {
+        case FUDGE_TYPE_LONG:   field.data.i64 = value; break;
+        case FUDGE_TYPE_INT:    field.data.i32 = ( fudge_i32 ) value; break;
+        case FUDGE_TYPE_SHORT:  field.data.i16 = ( fudge_i16 ) value; break;
+        case FUDGE_TYPE_BYTE:   field.data.byte = ( fudge_byte ) value; break;
+        default:
+            return FUDGE_INTERNAL_PAYLOAD;
+    }
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+#define FUDGE_WRITEINTEGERFIELD_IMPL( typename, type, typeid )                                                                      \
+    FudgeStatus FudgeWriter_addField##typename ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, type value )    \
+    {                                                                                                                               \
+        return FudgeWriter_addFieldInteger ( writer, name, ordinal, typeid, ( fudge_i64 ) value );                                  \
+    }
+
+FUDGE_WRITEINTEGERFIELD_IMPL( I16,  fudge_i16,  FUDGE_TYPE_SHORT )
+FUDGE_WRITEINTEGERFIELD_IMPL( I32,  fudge_i32,  FUDGE_TYPE_INT )
+FUDGE_WRITEINTEGERFIELD_IMPL( I64,  fudge_i64,  FUDGE_TYPE_LONG )
+
+#define FUDGE_WRITEPRIMITIVEFIELD_IMPL( typename, type, typeid, bucket )                                                            \
+    FudgeStatus FudgeWriter_addField##typename ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, type value )    \
+    {                                                                                                                               \
+        FudgeStatus status;                                                                                                         \
+        FudgeField field;                                                                                                           \
+                                                                                                                                    \
+        if ( ( status = FudgeWriter_initField ( writer, &field, typeid, name, ordinal ) ) != FUDGE_OK )                             \
+            return status;                                                                                                          \
+        field.data . bucket = value;                                                                                                \
+        return FudgeWriter_writeField ( writer, &field );                                                                           \
+    }
+
+FUDGE_WRITEPRIMITIVEFIELD_IMPL( Byte, fudge_byte, FUDGE_TYPE_BYTE,    byte )
+FUDGE_WRITEPRIMITIVEFIELD_IMPL( Bool, fudge_bool, FUDGE_TYPE_BOOLEAN, boolean )
+FUDGE_WRITEPRIMITIVEFIELD_IMPL( F32,  fudge_f32,  FUDGE_TYPE_FLOAT,   f32 )
+FUDGE_WRITEPRIMITIVEFIELD_IMPL( F64,  fudge_f64,  FUDGE_TYPE_DOUBLE,  f64 )
+
+FudgeStatus FudgeWriter_addFieldOpaque ( FudgeWriter writer,
+                                         fudge_type_id type,
+                                         const FudgeString name,
+                                         const fudge_i16 * ordinal,
+                                         const fudge_byte * bytes,
+                                         fudge_i32 numbytes )
+{
+    FudgeStatus status;
+    FudgeField field;
+    const FudgeTypeDesc * typedesc = FudgeRegistry_getTypeDesc ( type );
+
+    if ( ! bytes && numbytes )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeWriter_initField ( writer, &field, type, name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    /* Only byte payloads can be written from a block of bytes, and these must
+       match the width of fixed width types */
+    if ( typedesc->payload != FUDGE_TYPE_PAYLOAD_BYTES )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+    if ( typedesc->fixedwidth >= 0 && typedesc->fixedwidth != numbytes )
+        return FUDGE_INVALID_TYPE_ACCESSOR;
+
+    field.data.bytes = numbytes ? bytes : 0;
+    field.numbytes = numbytes;
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+#define FUDGE_WRITEARRAYFIELD_IMPL( typename, type, typeid )                                                        \
+    FudgeStatus FudgeWriter_addField##typename##Array ( FudgeWriter writer,                                         \
+                                                        const FudgeString name,                                     \
+                                                        const fudge_i16 * ordinal,                                  \
+                                                        const type * elements,                                      \
+                                                        fudge_i32 numelements )                                     \
+    {                                                                                                               \
+        fudge_i32 maxelements = 0x7FFFFFFF / sizeof ( type );                                                       \
+        if ( numelements > maxelements )                                                                            \
+            return FUDGE_PAYLOAD_TOO_LONG;                                                                          \
+        return FudgeWriter_addFieldOpaque ( writer, typeid, name, ordinal,                                          \
+                                            ( const fudge_byte * ) elements, sizeof ( type ) * numelements );       \
+    }
+
+FUDGE_WRITEARRAYFIELD_IMPL( Byte, fudge_byte, FUDGE_TYPE_BYTE_ARRAY )
+FUDGE_WRITEARRAYFIELD_IMPL( I16,  fudge_i16,  FUDGE_TYPE_SHORT_ARRAY )
+FUDGE_WRITEARRAYFIELD_IMPL( I32,  fudge_i32,  FUDGE_TYPE_INT_ARRAY )
+FUDGE_WRITEARRAYFIELD_IMPL( I64,  fudge_i64,  FUDGE_TYPE_LONG_ARRAY )
+FUDGE_WRITEARRAYFIELD_IMPL( F32,  fudge_f32,  FUDGE_TYPE_FLOAT_ARRAY )
+FUDGE_WRITEARRAYFIELD_IMPL( F64,  fudge_f64,  FUDGE_TYPE_DOUBLE_ARRAY )
+
+FudgeStatus FudgeWriter_addFieldString ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeString string )
+{
+    FudgeStatus status;
+    FudgeField field;
+    size_t stringbytes;
+
+    if ( ! string )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_STRING, name, ordinal ) ) != FUDGE_OK )
+        return status;
+    if ( ( stringbytes = FudgeString_getSize ( string ) ) > 0x7FFFFFFF )
+        return FUDGE_PAYLOAD_TOO_LONG;
+
+    field.data.string = string;
+    field.numbytes = ( fudge_i32 ) stringbytes;
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+FudgeStatus FudgeWriter_addFieldMsg ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeMsg message )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    if ( ! message )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_FUDGE_MSG, name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    field.data.message = message;
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+FudgeStatus FudgeWriter_addFieldDate ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeDate * date )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    if ( ! date )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_DATE, name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    field.data.datetime.date = *date;
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+FudgeStatus FudgeWriter_addFieldTime ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeTime * time )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    if ( ! time )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_TIME, name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    field.data.datetime.time = *time;
+    return FudgeWriter_writeField ( writer, &field );
+}
+
+FudgeStatus FudgeWriter_addFieldDateTime ( FudgeWriter writer, const FudgeString name, const fudge_i16 * ordinal, const FudgeDateTime * datetime )
+{
+    FudgeStatus status;
+    FudgeField field;
+
+    if ( ! datetime )
+        return FUDGE_NULL_POINTER;
+    if ( ( status = FudgeWriter_initField ( writer, &field, FUDGE_TYPE_DATETIME, name, ordinal ) ) != FUDGE_OK )
+        return status;
+
+    field.data.datetime = *datetime;
+    return FudgeWriter_writeField ( writer, &field );
+}
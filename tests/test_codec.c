@@ -16,8 +16,11 @@
 #include "fudge/codec.h"
 #include "fudge/datetime.h"
 #include "fudge/envelope.h"
+#include "fudge/header.h"
+#include "fudge/layout.h"
 #include "fudge/string.h"
 #include "fudge/stringpool.h"
+#include "fudge/writer.h"
 #include "simpletest.h"
 #include "snprintf.h"
 
@@ -406,6 +409,43 @@ DEFINE_TEST( DecodeDeepTree )
     TEST_EQUALS_INT( FudgeString_release ( string ), FUDGE_OK );
 END_TEST
 
+DEFINE_TEST( DecodeInternedNames )
+    FudgeField first [ 32 ], second [ 32 ], field;
+    FudgeMsg messages [ 2 ];
+    FudgeString name;
+    fudge_i32 index, numfields;
+
+    /* Without interning, each message has its own names */
+    TEST_EQUALS_TRUE( ! FudgeCodec_getInternFieldNames ( ) );
+    messages [ 0 ] = loadFudgeMsg ( ALLNAMES_FILENAME );
+    messages [ 1 ] = loadFudgeMsg ( ALLNAMES_FILENAME );
+    TEST_EQUALS_INT( FudgeMsg_getFields ( first, 32, messages [ 0 ] ), 21 );
+    TEST_EQUALS_INT( FudgeMsg_getFields ( second, 32, messages [ 1 ] ), 21 );
+    TEST_EQUALS_TRUE( first [ 0 ].name != second [ 0 ].name );
+    TEST_EQUALS_INT( FudgeMsg_release ( messages [ 0 ] ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( messages [ 1 ] ), FUDGE_OK );
+
+    FudgeCodec_setInternFieldNames ( FUDGE_TRUE );
+    messages [ 0 ] = loadFudgeMsg ( ALLNAMES_FILENAME );
+    messages [ 1 ] = loadFudgeMsg ( ALLNAMES_FILENAME );
+    FudgeCodec_setInternFieldNames ( FUDGE_FALSE );
+
+    numfields = FudgeMsg_getFields ( first, 32, messages [ 0 ] );
+    TEST_EQUALS_INT( FudgeMsg_getFields ( second, 32, messages [ 1 ] ), numfields );
+    for ( index = 0; index < numfields; ++index )
+        TEST_EQUALS_TRUE( first [ index ].name == second [ index ].name );
+
+    /* Lookups with the interned name find the same field */
+    TEST_EQUALS_INT( FudgeString_internUTF8 ( &name, ( const fudge_byte * ) "Integer", 7 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_getFieldByName ( &field, messages [ 1 ], name ), FUDGE_OK );
+    TEST_EQUALS_TRUE( field.name == name );
+    TEST_EQUALS_INT( field.data.i32, 32767 + 5 );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_release ( messages [ 0 ] ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( messages [ 1 ] ), FUDGE_OK );
+END_TEST
+
 DEFINE_TEST( EncodeAllNames )
     fudge_byte empty [ 8192 ];
     fudge_byte * encoded, * reference;
@@ -852,6 +892,648 @@ DEFINE_TEST( EncodeDecodeCycle )
     free ( encoded );
 END_TEST
 
+DEFINE_TEST( EncodeVector )
+    fudge_byte blob [ 4096 ], small [ 16 ];
+    char chars [ 1024 ];
+    fudge_byte * encoded, * gathered;
+    fudge_i32 encodedsize, vectorsize, index;
+    FudgeIOVec * vectors;
+    size_t numvectors, vectorindex, gatheredsize;
+    FudgeMsgEnvelope envelope;
+    FudgeMsg message, submessage;
+    FudgeString name, text;
+    FudgeField field;
+
+    for ( index = 0; index < sizeof ( blob ); ++index )
+        blob [ index ] = ( fudge_byte ) index;
+    for ( index = 0; index < sizeof ( chars ); ++index )
+        chars [ index ] = 'a' + ( index % 26 );
+    memset ( small, 0x55, sizeof ( small ) );
+
+    /* Build a message with large and small payloads, one of them nested */
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "blob" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCII ( &text, chars, sizeof ( chars ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( message, name, 0, 1234567 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldOpaque ( message, FUDGE_TYPE_BYTE_ARRAY, name, 0, blob, sizeof ( blob ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldOpaque ( message, FUDGE_TYPE_BYTE_ARRAY_16, 0, 0, small, sizeof ( small ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( submessage, 0, 0, text ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( submessage, name, 0, 1.5 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, 0, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+
+    /* Reference encoding */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+
+    /* The large payloads should be referenced from the fields, not copied */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgVector ( envelope, 512, &vectors, &numvectors, &vectorsize ), FUDGE_OK );
+    TEST_EQUALS_INT( vectorsize, encodedsize );
+    TEST_EQUALS_INT( numvectors, 5 );
+    TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, message, 1 ), FUDGE_OK );
+    TEST_EQUALS_TRUE( vectors [ 1 ].iov_base == field.data.bytes );
+    TEST_EQUALS_INT( vectors [ 1 ].iov_len, sizeof ( blob ) );
+    TEST_EQUALS_TRUE( vectors [ 3 ].iov_base == FudgeString_getData ( text ) );
+    TEST_EQUALS_INT( vectors [ 3 ].iov_len, 1024 );
+
+    /* Gathered together the vectors should match the contiguous encoding */
+    gathered = ( fudge_byte * ) malloc ( vectorsize );
+    for ( vectorindex = 0, gatheredsize = 0; vectorindex < numvectors; ++vectorindex )
+    {
+        memcpy ( gathered + gatheredsize, vectors [ vectorindex ].iov_base, vectors [ vectorindex ].iov_len );
+        gatheredsize += vectors [ vectorindex ].iov_len;
+    }
+    TEST_EQUALS_MEMORY( gathered, gatheredsize, encoded, encodedsize );
+    free ( gathered );
+    FudgeCodec_freeVector ( vectors );
+
+    /* With a threshold above every payload everything goes in to one buffer */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgVector ( envelope, 1 << 30, &vectors, &numvectors, &vectorsize ), FUDGE_OK );
+    TEST_EQUALS_INT( numvectors, 1 );
+    TEST_EQUALS_MEMORY( vectors [ 0 ].iov_base, vectors [ 0 ].iov_len, encoded, encodedsize );
+    FudgeCodec_freeVector ( vectors );
+    FudgeCodec_freeVector ( 0 );
+
+    free ( encoded );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( text ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( EncodeWriter )
+    const fudge_byte * written;
+    fudge_byte * encoded, * reference;
+    fudge_i32 writtensize, encodedsize, referencesize, index;
+    fudge_i16 ordinal;
+    fudge_f64 doubles [ 100 ];
+    FudgeWriter writer;
+    FudgeMsgEnvelope envelope;
+    FudgeMsg message, submessage, innermessage;
+    FudgeString stringone, stringtwo, name;
+    FudgeStringPool stringpool;
+    FudgeStatus status;
+
+    TEST_EQUALS_INT( FudgeStringPool_create ( &stringpool ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &stringone, "fibble" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &stringtwo, "Blibble" ), FUDGE_OK );
+
+    /* Use a tiny initial buffer to force it to grow */
+    TEST_EQUALS_INT( FudgeWriter_create ( &writer, 1 ), FUDGE_OK );
+
+    /* Fields can only be added to a message in progress */
+    TEST_EQUALS_INT( FudgeWriter_addFieldI32 ( writer, 0, 0, 1 ), FUDGE_WRITER_NOT_IN_MSG );
+    TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_WRITER_NOT_IN_MSG );
+
+    /* Write the same message as the EncodeSubMsgs test */
+    TEST_EQUALS_INT( FudgeWriter_beginMsg ( writer, 0, 0, 0 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_beginSubMsg ( writer, FudgeStringPool_createStringFromASCIIZ ( stringpool, &status, "sub1" ), 0 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldString ( writer, FudgeStringPool_createStringFromASCIIZ ( stringpool, &status, "bibble" ), 0, stringone ), FUDGE_OK );
+    ordinal = 827;
+    TEST_EQUALS_INT( FudgeWriter_addFieldString ( writer, 0, &ordinal, stringtwo ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_beginSubMsg ( writer, FudgeStringPool_createStringFromASCIIZ ( stringpool, &status, "sub2" ), 0 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldI32 ( writer, FudgeStringPool_createStringFromASCIIZ ( stringpool, &status, "bibble9" ), 0, 9837438 ), FUDGE_OK );
+    ordinal = 828;
+    TEST_EQUALS_INT( FudgeWriter_addFieldF32 ( writer, 0, &ordinal, 82.77f ), FUDGE_OK );
+
+    /* Can't finish the message with a submessage open */
+    TEST_EQUALS_INT( FudgeWriter_endMsg ( writer, &written, &writtensize ), FUDGE_WRITER_UNBALANCED_SUBMSG );
+    TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_WRITER_UNBALANCED_SUBMSG );
+    TEST_EQUALS_INT( FudgeWriter_endMsg ( writer, &written, &writtensize ), FUDGE_OK );
+
+    loadFile ( &reference, &referencesize, SUBMSG_FILENAME );
+    TEST_EQUALS_MEMORY( written, writtensize, reference, referencesize );
+    free ( reference );
+
+    /* Reuse the writer for a message with nested submessages large enough to
+       need two and four byte widths, and check it against the codec */
+    for ( index = 0; index < 100; ++index )
+        doubles [ index ] = index * 1.5;
+    name = FudgeStringPool_createStringFromASCIIZ ( stringpool, &status, "doubles" );
+    ordinal = 1;
+
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &innermessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI64 ( message, name, 0, -5 ), FUDGE_OK );
+    for ( index = 0; index < 400; ++index )
+        TEST_EQUALS_INT( FudgeMsg_addFieldF64Array ( innermessage, name, &ordinal, doubles, 100 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( submessage, 0, &ordinal, innermessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldBool ( submessage, name, 0, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, &ordinal, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( message, 0, &ordinal, 70000 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 1, 2, 3, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeWriter_beginMsg ( writer, 1, 2, 3 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldI64 ( writer, name, 0, -5 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_beginSubMsg ( writer, name, &ordinal ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_beginSubMsg ( writer, 0, &ordinal ), FUDGE_OK );
+    for ( index = 0; index < 400; ++index )
+        TEST_EQUALS_INT( FudgeWriter_addFieldF64Array ( writer, name, &ordinal, doubles, 100 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldBool ( writer, name, 0, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldI32 ( writer, 0, &ordinal, 70000 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_endMsg ( writer, &written, &writtensize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( written, writtensize, encoded, encodedsize );
+
+    /* Existing messages can be written as fields too */
+    TEST_EQUALS_INT( FudgeWriter_beginMsg ( writer, 1, 2, 3 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldI64 ( writer, name, 0, -5 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldMsg ( writer, name, &ordinal, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_addFieldI32 ( writer, 0, &ordinal, 70000 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_endMsg ( writer, &written, &writtensize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( written, writtensize, encoded, encodedsize );
+
+    free ( encoded );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( innermessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_release ( writer ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( stringone ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( stringtwo ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeStringPool_release ( stringpool ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( EncodeCachedSubMsg )
+    fudge_byte * encoded, * reference;
+    fudge_i32 encodedsize, referencesize, vectorsize, index;
+    FudgeIOVec * vectors;
+    size_t numvectors;
+    FudgeMsgEnvelope envelope, referenceenvelope;
+    FudgeMsg message, referencemessage, staticdata, child, grandchild;
+    FudgeString name;
+
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "static" ), FUDGE_OK );
+
+    /* The same submessage content, with and without caching */
+    TEST_EQUALS_INT( FudgeMsg_create ( &staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &referencemessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_setEncodingCache ( staticdata, FUDGE_TRUE ), FUDGE_OK );
+    for ( index = 0; index < 64; ++index )
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( staticdata, name, 0, index * 1000 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( message, 0, 0, 2.5 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &referenceenvelope, 0, 0, 0, referencemessage ), FUDGE_OK );
+
+    /* First encode populates the cache, the second uses it */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    /* The vector encoder can reference the cached encoding directly */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgVector ( envelope, 16, &vectors, &numvectors, &vectorsize ), FUDGE_OK );
+    TEST_EQUALS_INT( numvectors, 3 );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( vectorsize, encodedsize );
+    TEST_EQUALS_MEMORY( vectors [ 1 ].iov_base, vectors [ 1 ].iov_len, encoded + vectors [ 0 ].iov_len, vectors [ 1 ].iov_len );
+    FudgeCodec_freeVector ( vectors );
+    free ( encoded );
+
+    /* Modifying the submessage must invalidate the cache: compare against an
+       uncached message built with the same fields */
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( staticdata, name, 0, 99 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_release ( staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &staticdata ), FUDGE_OK );
+    for ( index = 0; index < 64; ++index )
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( staticdata, name, 0, index * 1000 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( staticdata, name, 0, 99 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( referencemessage, name, 0, staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( referenceenvelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( referenceenvelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( referencemessage ), FUDGE_OK );
+
+    /* So must modifying a message further down the tree, beneath submessages
+       that have no cache of their own */
+    TEST_EQUALS_INT( FudgeMsg_create ( &staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_setEncodingCache ( staticdata, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( grandchild, name, 0, 1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( child, name, 0, grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( staticdata, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    free ( encoded );
+
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( grandchild, name, 0, 2 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_create ( &referencemessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( grandchild, name, 0, 1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( grandchild, name, 0, 2 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( child, name, 0, grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( referencemessage, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &referenceenvelope, 0, 0, 0, referencemessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( referenceenvelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    /* Once re-encoded, the cache is used again */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( referenceenvelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( referenceenvelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( referencemessage ), FUDGE_OK );
+
+    /* A submessage held by several cached messages (one of them twice)
+       passes a change to each; a holder that has been released is no
+       longer told */
+    TEST_EQUALS_INT( FudgeMsg_create ( &child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_setEncodingCache ( message, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_setEncodingCache ( staticdata, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( child, name, 0, 1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( grandchild, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( staticdata, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( staticdata, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( grandchild ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &referenceenvelope, 0, 0, 0, staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    free ( encoded );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( referenceenvelope, &encoded, &encodedsize ), FUDGE_OK );
+    free ( encoded );
+
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( child, name, 0, 2 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( child ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_create ( &child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &referencemessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( child, name, 0, 1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( child, name, 0, 2 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( referencemessage, name, 0, child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( child ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, referencemessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    /* The message held twice grows by twice as much */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( referenceenvelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_INT( encodedsize - 8, 2 * ( referencesize - 8 ) );
+    TEST_EQUALS_MEMORY( encoded + 8, referencesize - 8, reference + 8, referencesize - 8 );
+    free ( encoded );
+    free ( reference );
+
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( referenceenvelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( staticdata ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( referencemessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( EncodeLayout )
+    const fudge_byte * layoutbytes, * written;
+    fudge_byte * encoded, blob [ 300 ];
+    fudge_i32 layoutsize, writtensize, encodedsize, index;
+    fudge_i16 priceordinal = 1, blobordinal = 2;
+    char chars [ 300 ];
+    size_t slot;
+    fudge_type_id type;
+    FudgeLayoutField fields [ 6 ];
+    FudgeLayout layout, copy;
+    FudgeWriter writer;
+    FudgeMsgEnvelope envelope;
+    FudgeString name, symbol, shortsymbol, longsymbol;
+
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "symbol" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &shortsymbol, "ABC" ), FUDGE_OK );
+    for ( index = 0; index < 300; ++index )
+    {
+        chars [ index ] = 'a' + index % 26;
+        blob [ index ] = ( fudge_byte ) index;
+    }
+    TEST_EQUALS_INT( FudgeString_createFromASCII ( &longsymbol, chars, 300 ), FUDGE_OK );
+
+    /* An integer, a submessage holding a string and a long, followed by a
+       byte array and a double */
+    fields [ 0 ].type = FUDGE_TYPE_INT;          fields [ 0 ].name = 0;    fields [ 0 ].ordinal = &priceordinal; fields [ 0 ].depth = 0;
+    fields [ 1 ].type = FUDGE_TYPE_FUDGE_MSG;    fields [ 1 ].name = name; fields [ 1 ].ordinal = 0;             fields [ 1 ].depth = 0;
+    fields [ 2 ].type = FUDGE_TYPE_STRING;       fields [ 2 ].name = name; fields [ 2 ].ordinal = 0;             fields [ 2 ].depth = 1;
+    fields [ 3 ].type = FUDGE_TYPE_LONG;         fields [ 3 ].name = 0;    fields [ 3 ].ordinal = 0;             fields [ 3 ].depth = 1;
+    fields [ 4 ].type = FUDGE_TYPE_BYTE_ARRAY;   fields [ 4 ].name = 0;    fields [ 4 ].ordinal = &blobordinal;  fields [ 4 ].depth = 0;
+    fields [ 5 ].type = FUDGE_TYPE_DOUBLE;       fields [ 5 ].name = name; fields [ 5 ].ordinal = 0;             fields [ 5 ].depth = 0;
+
+    /* Depths can only increase after a submessage */
+    TEST_EQUALS_INT( FudgeLayout_createFromFields ( &layout, 0, 0, 0, fields + 2, 4 ), FUDGE_INVALID_INDEX );
+    TEST_EQUALS_INT( FudgeLayout_createFromFields ( &layout, 1, 2, 3, fields, 6 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_numSlots ( layout ), 5 );
+
+    TEST_EQUALS_INT( FudgeLayout_findSlotByOrdinal ( &slot, layout, 2 ), FUDGE_OK );
+    TEST_EQUALS_INT( slot, 3 );
+    TEST_EQUALS_INT( FudgeLayout_findSlotByOrdinal ( &slot, layout, 3 ), FUDGE_INVALID_ORDINAL );
+    TEST_EQUALS_INT( FudgeLayout_findSlotByName ( &slot, layout, name ), FUDGE_OK );
+    TEST_EQUALS_INT( slot, 1 );
+    TEST_EQUALS_INT( FudgeLayout_getSlotType ( &type, layout, 4 ), FUDGE_OK );
+    TEST_EQUALS_INT( type, FUDGE_TYPE_DOUBLE );
+    TEST_EQUALS_INT( FudgeLayout_getSlotType ( &type, layout, 5 ), FUDGE_INVALID_INDEX );
+
+    /* Type and range checks */
+    TEST_EQUALS_INT( FudgeLayout_setF64 ( layout, 0, 1.0 ), FUDGE_INVALID_TYPE_ACCESSOR );
+    TEST_EQUALS_INT( FudgeLayout_setI64 ( layout, 0, 0x100000000ll ), FUDGE_INVALID_TYPE_COERCION );
+    TEST_EQUALS_INT( FudgeLayout_setString ( layout, 3, shortsymbol ), FUDGE_INVALID_TYPE_ACCESSOR );
+    TEST_EQUALS_INT( FudgeLayout_setI32 ( layout, 5, 0 ), FUDGE_INVALID_INDEX );
+
+    TEST_EQUALS_INT( FudgeLayout_setI32 ( layout, 0, 123456 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_setI64 ( layout, 2, 5000000000000ll ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_setF64 ( layout, 4, 2.5 ), FUDGE_OK );
+
+    /* Store a series of variable width values that grow and shrink the
+       slots, the submessage and their widths; each time the layout must
+       match the output of the writer */
+    TEST_EQUALS_INT( FudgeWriter_create ( &writer, 0 ), FUDGE_OK );
+    for ( index = 0; index < 4; ++index )
+    {
+        symbol = index & 1 ? longsymbol : shortsymbol;
+        TEST_EQUALS_INT( FudgeLayout_setString ( layout, 1, symbol ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeLayout_setBytes ( layout, 3, blob, index * 100 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeLayout_getBytes ( layout, &layoutbytes, &layoutsize ), FUDGE_OK );
+
+        TEST_EQUALS_INT( FudgeWriter_beginMsg ( writer, 1, 2, 3 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_addFieldI32 ( writer, 0, &priceordinal, 123456 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_beginSubMsg ( writer, name, 0 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_addFieldString ( writer, name, 0, symbol ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_addFieldI64 ( writer, 0, 0, 5000000000000ll ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_endSubMsg ( writer ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_addFieldByteArray ( writer, 0, &blobordinal, blob, index * 100 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_addFieldF64 ( writer, name, 0, 2.5 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeWriter_endMsg ( writer, &written, &writtensize ), FUDGE_OK );
+        TEST_EQUALS_MEMORY( layoutbytes, layoutsize, written, writtensize );
+    }
+
+    /* A layout compiled from a prototype message starts with its encoding */
+    TEST_EQUALS_INT( FudgeCodec_decodeMsg ( &envelope, written, writtensize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_create ( &copy, envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_numSlots ( copy ), 5 );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_getBytes ( copy, &layoutbytes, &layoutsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( layoutbytes, layoutsize, encoded, encodedsize );
+    free ( encoded );
+
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_release ( copy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_release ( layout ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeWriter_release ( writer ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( longsymbol ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( shortsymbol ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( EncodeBatch )
+    static const char * filenames [ 4 ] = { ALLNAMES_FILENAME, FIXED_WIDTH_FILENAME, SUBMSG_FILENAME, DEEPER_FILENAME };
+    fudge_byte * batch, * encoded, * buffer;
+    fudge_i32 encodedsize, index;
+    size_t batchsize, offsets [ 4 ], bufferoffsets [ 4 ];
+    FudgeMsgEnvelope envelopes [ 4 ];
+
+    for ( index = 0; index < 4; ++index )
+    {
+        fudge_byte * bytes;
+        fudge_i32 numbytes;
+
+        loadFile ( &bytes, &numbytes, filenames [ index ] );
+        TEST_EQUALS_INT( FudgeCodec_decodeMsg ( envelopes + index, bytes, numbytes ), FUDGE_OK );
+        free ( bytes );
+    }
+
+    /* An empty batch has no bytes */
+    TEST_EQUALS_INT( FudgeCodec_encodeBatch ( envelopes, 0, &batch, &batchsize, 0 ), FUDGE_OK );
+    TEST_EQUALS_INT( batchsize, 0 );
+    TEST_EQUALS_TRUE( batch == 0 );
+
+    /* Each envelope in the batch must match its individual encoding */
+    TEST_EQUALS_INT( FudgeCodec_encodeBatch ( envelopes, 4, &batch, &batchsize, offsets ), FUDGE_OK );
+    TEST_EQUALS_INT( offsets [ 0 ], 0 );
+    for ( index = 0; index < 4; ++index )
+    {
+        size_t end = index < 3 ? offsets [ index + 1 ] : batchsize;
+
+        TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelopes [ index ], &encoded, &encodedsize ), FUDGE_OK );
+        TEST_EQUALS_MEMORY( batch + offsets [ index ], end - offsets [ index ], encoded, encodedsize );
+        free ( encoded );
+    }
+
+    /* Caller provided buffers must be large enough for the entire batch */
+    buffer = ( fudge_byte * ) malloc ( batchsize );
+    TEST_EQUALS_INT( FudgeCodec_encodeBatchToBuffer ( envelopes, 4, buffer, batchsize - 1, &batchsize, bufferoffsets ), FUDGE_OUT_OF_BYTES );
+    TEST_EQUALS_INT( FudgeCodec_encodeBatchToBuffer ( envelopes, 4, buffer, batchsize, &batchsize, bufferoffsets ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( buffer, batchsize, batch, batchsize );
+    TEST_EQUALS_MEMORY( bufferoffsets, sizeof ( bufferoffsets ), offsets, sizeof ( offsets ) );
+    free ( buffer );
+    free ( batch );
+
+    for ( index = 0; index < 4; ++index )
+        TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelopes [ index ] ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( EncodeParallel )
+    fudge_byte * encoded, * reference, blob [ 8192 ];
+    fudge_i32 encodedsize, referencesize, index, inner;
+    fudge_i16 ordinal;
+    FudgeMsgEnvelope envelope;
+    FudgeMsg message, submessage, shared, cached;
+    FudgeString name;
+
+    for ( index = 0; index < 8192; ++index )
+        blob [ index ] = ( fudge_byte ) ( index * 7 );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "blob" ), FUDGE_OK );
+
+    /* A few megabytes spread over submessages, including one that appears
+       several times in the tree and one with a cached encoding */
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &shared ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &cached ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_setEncodingCache ( cached, FUDGE_TRUE ), FUDGE_OK );
+    for ( index = 0; index < 16; ++index )
+    {
+        TEST_EQUALS_INT( FudgeMsg_addFieldByteArray ( shared, name, 0, blob, 4096 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldByteArray ( cached, 0, 0, blob + index, 8000 ), FUDGE_OK );
+    }
+
+    for ( index = 0; index < 8; ++index )
+    {
+        ordinal = ( fudge_i16 ) index;
+        TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+        for ( inner = 0; inner < 48; ++inner )
+        {
+            TEST_EQUALS_INT( FudgeMsg_addFieldByteArray ( submessage, name, &ordinal, blob + inner, 8192 - inner ), FUDGE_OK );
+            TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( submessage, 0, &ordinal, inner * 0.5 ), FUDGE_OK );
+        }
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( submessage, name, 0, shared ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, 0, &ordinal, submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, cached ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( message, name, &ordinal, index ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+    }
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 1, 2, 3, message ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgParallel ( envelope, 4, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+
+    /* A single thread is the same as the serial encoder */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgParallel ( envelope, 1, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+
+    /* Absurd thread counts are capped rather than overflowing */
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgParallel ( envelope, 0x40000000u, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsgParallel ( envelope, ( unsigned int ) -1, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( cached ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( shared ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( EncodeCompressed )
+    static const fudge_byte oversized [] = { 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x7f, 0xff, 0xff, 0xff };
+    fudge_byte * plain, * compressed, * reencoded, noise [ 4096 ];
+    const fudge_byte * layoutbytes;
+    fudge_i32 plainsize, compressedsize, reencodedsize, layoutsize, index;
+    FudgeLayout layout;
+    unsigned int seed = 1;
+    fudge_i16 ordinal;
+    FudgeMsgEnvelope envelope, decoded;
+    FudgeMsg message;
+    FudgeString name, value;
+
+    /* Repetitive names and values compress well */
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "repeated" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &value, "The same string value, time after time" ), FUDGE_OK );
+    for ( ordinal = 0; ordinal < 200; ++ordinal )
+    {
+        TEST_EQUALS_INT( FudgeMsg_addFieldString ( message, name, &ordinal, value ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( message, name, 0, ordinal ), FUDGE_OK );
+    }
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0x40, 3, 17, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+
+    /* Compression is off by default */
+    TEST_EQUALS_INT( FudgeCodec_getCompressionThreshold ( ), -1 );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &plain, &plainsize ), FUDGE_OK );
+    TEST_EQUALS_INT( plain [ 0 ] & FUDGE_DIRECTIVE_COMPRESSED, 0 );
+
+    /* Payloads below the threshold are left alone */
+    FudgeCodec_setCompressionThreshold ( plainsize );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &compressed, &compressedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( compressed, compressedsize, plain, plainsize );
+    free ( compressed );
+
+    FudgeCodec_setCompressionThreshold ( 1024 );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &compressed, &compressedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( compressed [ 0 ], ( fudge_byte ) ( 0x40 | FUDGE_DIRECTIVE_COMPRESSED ) );
+    TEST_EQUALS_INT( FudgeCodec_decodeI32 ( compressed + 4 ), compressedsize );
+    TEST_EQUALS_INT( FudgeCodec_decodeI32 ( compressed + 8 ), plainsize - 8 );
+    TEST_EQUALS_TRUE( compressedsize * 4 < plainsize );
+
+    /* Layouts map their slots on to the uncompressed form */
+    TEST_EQUALS_INT( FudgeLayout_create ( &layout, envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeLayout_getBytes ( layout, &layoutbytes, &layoutsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( layoutbytes, layoutsize, plain, plainsize );
+    TEST_EQUALS_INT( FudgeLayout_release ( layout ), FUDGE_OK );
+
+    /* Decoding is transparent and clears the directive */
+    TEST_EQUALS_INT( FudgeCodec_decodeMsg ( &decoded, compressed, compressedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_getDirectives ( decoded ), 0x40 );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_getSchemaVersion ( decoded ), 3 );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_getTaxonomy ( decoded ), 17 );
+    FudgeCodec_setCompressionThreshold ( -1 );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( decoded, &reencoded, &reencodedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( reencoded, reencodedsize, plain, plainsize );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( decoded ), FUDGE_OK );
+    free ( reencoded );
+
+    /* Corrupt payloads are rejected */
+    compressed [ 11 ] ^= 0x01;
+    TEST_EQUALS_INT( FudgeCodec_decodeMsg ( &decoded, compressed, compressedsize ), FUDGE_INVALID_COMPRESSED_PAYLOAD );
+    compressed [ 11 ] ^= 0x01;
+    reencoded = compressed + 4;
+    FudgeCodec_encodeI32 ( compressedsize - 1, &reencoded );
+    TEST_EQUALS_INT( FudgeCodec_decodeMsg ( &decoded, compressed, compressedsize - 1 ), FUDGE_INVALID_COMPRESSED_PAYLOAD );
+    free ( compressed );
+    free ( plain );
+
+    /* An uncompressed size the block could never produce is rejected before
+       anything is allocated for it */
+    TEST_EQUALS_INT( FudgeCodec_decodeMsg ( &decoded, oversized, sizeof ( oversized ) ), FUDGE_INVALID_COMPRESSED_PAYLOAD );
+
+    /* Messages that don't get smaller are sent uncompressed */
+    for ( index = 0; index < 4096; ++index )
+    {
+        seed = seed * 1103515245U + 12345U;
+        noise [ index ] = ( fudge_byte ) ( seed >> 16 );
+    }
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldByteArray ( message, 0, 0, noise, sizeof ( noise ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &plain, &plainsize ), FUDGE_OK );
+    FudgeCodec_setCompressionThreshold ( 0 );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &compressed, &compressedsize ), FUDGE_OK );
+    FudgeCodec_setCompressionThreshold ( -1 );
+    TEST_EQUALS_MEMORY( compressed, compressedsize, plain, plainsize );
+    free ( compressed );
+    free ( plain );
+
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( value ), FUDGE_OK );
+END_TEST
+
 DEFINE_TEST_SUITE( Codec )
     /* Interop decode test files */
     REGISTER_TEST( DecodeAllNames )
@@ -864,6 +1546,7 @@ DEFINE_TEST_SUITE( Codec )
 
     /* Other decode test files */
     REGISTER_TEST( DecodeDeepTree )
+    REGISTER_TEST( DecodeInternedNames )
 
     /* Interop encode tests */
     REGISTER_TEST( EncodeAllNames )
@@ -876,6 +1559,13 @@ DEFINE_TEST_SUITE( Codec )
 
     /* Other encode tests */
     REGISTER_TEST( EncodeDeepTree );
+    REGISTER_TEST( EncodeVector );
+    REGISTER_TEST( EncodeWriter );
+    REGISTER_TEST( EncodeCachedSubMsg );
+    REGISTER_TEST( EncodeLayout );
+    REGISTER_TEST( EncodeBatch );
+    REGISTER_TEST( EncodeParallel );
+    REGISTER_TEST( EncodeCompressed );
 
     /* Decode/Encode cycle */
     REGISTER_TEST( EncodeDecodeCycle );
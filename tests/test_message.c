@@ -13,12 +13,21 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "fudge/arena.h"
+#include "fudge/codec.h"
 #include "fudge/datetime.h"
+#include "fudge/delta.h"
+#include "fudge/envelope.h"
 #include "fudge/message.h"
 #include "fudge/string.h"
 #include "fudge/stringpool.h"
 #include "simpletest.h"
 
+#if defined(_MT) && defined(FUDGE_HAS_PTHREADS)
+#   define MESSAGE_TEST_THREADS 1
+#   include <pthread.h>
+#endif
+
 DEFINE_TEST( FieldFunctions )
     static const fudge_byte rawBytes [ 16 ] = { 0xff, 0xee, 0xdd, 0xcc, 0xbb, 0xaa, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 };
     static const fudge_i16 rawShorts [ 10 ] = { -32767, 32767, 0, 1, -1, 100, -100, 0, 16385 };
@@ -434,9 +443,489 @@ DEFINE_TEST( FieldCoercion )
     TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
 END_TEST
 
+DEFINE_TEST( DeltaPatches )
+    fudge_byte * encoded, * reference;
+    fudge_i32 encodedsize, referencesize;
+    fudge_i16 ordinals [ 3 ] = { 1, 5, 7 };
+    FudgeMsg baseline, target, patch, result, submessage, copy;
+    FudgeMsgEnvelope envelope;
+    FudgeString bid, ask, name, volume, symbol;
+    FudgeField field;
+
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &bid, "bid" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &ask, "ask" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "name" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &volume, "volume" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &symbol, "ABC" ), FUDGE_OK );
+
+    /* Two submessages with identical contents */
+    TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( submessage, name, 0, symbol ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &copy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( copy, name, 0, symbol ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_create ( &baseline ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( baseline, 0, ordinals, 100 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( baseline, bid, 0, 1.5 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( baseline, ask, 0, 1.6 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( baseline, name, ordinals + 2, symbol ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( baseline, 0, ordinals + 1, submessage ), FUDGE_OK );
+
+    /* Change the bid, remove the ask and add a volume */
+    TEST_EQUALS_INT( FudgeMsg_create ( &target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( target, 0, ordinals, 100 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( target, bid, 0, 1.55 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( target, name, ordinals + 2, symbol ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( target, 0, ordinals + 1, copy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI64 ( target, volume, 0, 1000000000000ll ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeDelta_create ( &patch, baseline, target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( patch ), 2 );
+    TEST_EQUALS_INT( FudgeMsg_getFieldByOrdinal ( &field, patch, FUDGEDELTA_SET_ORDINAL ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( field.data.message ), 2 );
+    TEST_EQUALS_INT( FudgeMsg_getFieldByOrdinal ( &field, patch, FUDGEDELTA_REMOVE_ORDINAL ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( field.data.message ), 1 );
+    TEST_EQUALS_INT( FudgeMsg_getFieldByOrdinal ( &field, patch, FUDGEDELTA_REPLACE_ORDINAL ), FUDGE_INVALID_ORDINAL );
+
+    /* The applied patch must encode identically to the target */
+    TEST_EQUALS_INT( FudgeDelta_apply ( &result, baseline, patch ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, result ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+    TEST_EQUALS_INT( FudgeMsg_release ( result ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( patch ), FUDGE_OK );
+
+    /* Identical messages produce an empty patch */
+    TEST_EQUALS_INT( FudgeDelta_create ( &patch, target, target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( patch ), 0 );
+    TEST_EQUALS_INT( FudgeMsg_release ( patch ), FUDGE_OK );
+
+    /* A target with a different field order (or without keys) can only be
+       sent in full */
+    TEST_EQUALS_INT( FudgeMsg_addFieldF64 ( target, ask, 0, 1.65 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( target, 0, ordinals, 101 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeDelta_create ( &patch, baseline, target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( patch ), 1 );
+    TEST_EQUALS_INT( FudgeMsg_getFieldByOrdinal ( &field, patch, FUDGEDELTA_REPLACE_ORDINAL ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeDelta_apply ( &result, baseline, patch ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, result ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    TEST_EQUALS_INT( FudgeMsg_release ( result ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( patch ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( target ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( baseline ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( copy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( symbol ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( volume ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( ask ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( bid ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( Arena )
+    static const fudge_byte rawBytes [ 5 ] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+    static const fudge_i32 rawInts [ 3 ] = { -1, 0, 2147483647 };
+
+    fudge_byte * encoded, * reencoded;
+    fudge_i32 encodedsize, reencodedsize;
+    fudge_i16 ordinal = 3;
+    size_t capacity;
+    int pass;
+    FudgeArena arena;
+    FudgeMsg message, submessage, external;
+    FudgeMsgEnvelope envelope;
+    FudgeString name, value, heapname;
+    FudgeField field;
+
+    TEST_EQUALS_INT( FudgeArena_create ( 0, 0 ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeArena_create ( &arena, 256 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeArena_getNumBytes ( arena ), 0 );
+
+    /* Objects outside the arena that are referenced from within it */
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &heapname, "heap" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &external ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( external, heapname, 0, 42 ), FUDGE_OK );
+
+    /* The arena's blocks are reused after each reset, so the second pass
+       must not need any more capacity than the first */
+    for ( pass = 0; pass < 2; ++pass )
+    {
+        TEST_EQUALS_INT( FudgeString_createFromASCIIZInArena ( &name, "name", arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeString_createFromUTF8InArena ( &value, ( const fudge_byte * ) "value", 5, arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeString_getSize ( value ), 5 );
+
+        TEST_EQUALS_INT( FudgeMsg_createInArena ( &message, arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_getArena ( message ) == arena, FUDGE_TRUE );
+        TEST_EQUALS_INT( FudgeMsg_createInArena ( &submessage, arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldString ( submessage, name, 0, value ), FUDGE_OK );
+
+        TEST_EQUALS_INT( FudgeMsg_addFieldI64 ( message, name, &ordinal, 1000000000000ll ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldString ( message, heapname, 0, value ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldOpaque ( message, FUDGE_TYPE_BYTE_ARRAY, name, 0, rawBytes, sizeof ( rawBytes ) ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32Array ( message, 0, &ordinal, rawInts, 3 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, 0, 0, external ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_numFields ( message ), 6 );
+
+        /* Arena objects ignore reference counting */
+        TEST_EQUALS_INT( FudgeMsg_retain ( message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+
+        TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, message, 2 ), FUDGE_OK );
+        TEST_EQUALS_MEMORY( field.data.bytes, field.numbytes, rawBytes, sizeof ( rawBytes ) );
+        TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, message, 3 ), FUDGE_OK );
+        TEST_EQUALS_MEMORY( field.data.bytes, field.numbytes, rawInts, sizeof ( rawInts ) );
+
+        /* An arena decode must produce a message that encodes identically */
+        TEST_EQUALS_INT( FudgeMsgEnvelope_createInArena ( &envelope, 0, 0, 0, message, arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+
+        TEST_EQUALS_INT( FudgeCodec_decodeMsgInArena ( &envelope, encoded, encodedsize, arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_getArena ( FudgeMsgEnvelope_getMessage ( envelope ) ) == arena, FUDGE_TRUE );
+        TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, FudgeMsgEnvelope_getMessage ( envelope ), 4 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_getArena ( field.data.message ) == arena, FUDGE_TRUE );
+        TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reencoded, &reencodedsize ), FUDGE_OK );
+        TEST_EQUALS_MEMORY( reencoded, reencodedsize, encoded, encodedsize );
+        free ( reencoded );
+        free ( encoded );
+
+        TEST_EQUALS_TRUE( FudgeArena_getNumBytes ( arena ) > 0 );
+        TEST_EQUALS_TRUE( FudgeArena_getCapacity ( arena ) >= FudgeArena_getNumBytes ( arena ) );
+        if ( pass )
+            TEST_EQUALS_INT( FudgeArena_getCapacity ( arena ), capacity );
+        capacity = FudgeArena_getCapacity ( arena );
+
+        /* Resetting releases the references held on the external objects */
+        TEST_EQUALS_INT( FudgeArena_reset ( arena ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeArena_getNumBytes ( arena ), 0 );
+        TEST_EQUALS_INT( FudgeArena_getCapacity ( arena ), capacity );
+    }
+
+    /* A NULL arena gives ordinary, reference counted objects */
+    TEST_EQUALS_INT( FudgeMsg_createInArena ( &message, 0 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_getArena ( message ) == 0, FUDGE_TRUE );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeArena_release ( arena ), FUDGE_OK );
+
+    /* Only the caller's references should remain */
+    TEST_EQUALS_INT( FudgeMsg_release ( external ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( heapname ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( Recycling )
+    FudgeMsg message, submessage, recycled;
+    FudgeMsgEnvelope envelope;
+    FudgeString name;
+    FudgeArena arena;
+    FudgeField field;
+    fudge_byte * encoded, * reference;
+    fudge_i32 encodedsize, referencesize;
+    int index;
+
+    TEST_EQUALS_INT( FudgeMsg_getRecycleLimit ( ), 0 );
+    TEST_EQUALS_INT( FudgeMsg_clear ( 0 ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "name" ), FUDGE_OK );
+
+    /* Clearing a message releases its fields, after which it can be
+       reused as if new */
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( submessage, name, 0, 1 ), FUDGE_OK );
+    for ( index = 0; index < 40; ++index )
+        TEST_EQUALS_INT( FudgeMsg_addFieldString ( message, name, 0, name ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    free ( encoded );
+
+    TEST_EQUALS_INT( FudgeMsg_clear ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( message ), 0 );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, 0, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+
+    /* The same message built from scratch must encode identically */
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, 0, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+    free ( reference );
+
+    /* Clearing an arena message releases its references to heap objects */
+    TEST_EQUALS_INT( FudgeArena_create ( &arena, 0 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_createInArena ( &recycled, arena ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( recycled, name, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_clear ( recycled ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( recycled ), 0 );
+    TEST_EQUALS_INT( FudgeArena_release ( arena ), FUDGE_OK );
+
+    /* Released messages are reused, emptied, by the next create */
+    FudgeMsg_setRecycleLimit ( 2 );
+    if ( FudgeMsg_getRecycleLimit ( ) == 2 )
+    {
+        TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_create ( &recycled ), FUDGE_OK );
+        TEST_EQUALS_TRUE( recycled == message );
+        TEST_EQUALS_INT( FudgeMsg_numFields ( recycled ), 0 );
+        TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, recycled, 0 ), FUDGE_INVALID_INDEX );
+
+        /* Releasing the parent recycles the submessage too, as it was the
+           last reference */
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( recycled, 0, 0, submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( recycled ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+        TEST_EQUALS_TRUE( message == recycled );
+        TEST_EQUALS_INT( FudgeMsg_numFields ( submessage ), 0 );
+        TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+
+        FudgeMsg_flushRecycled ( );
+        FudgeMsg_setRecycleLimit ( 0 );
+    }
+    else
+        TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+END_TEST
+
+#ifdef MESSAGE_TEST_THREADS
+typedef struct
+{
+    FudgeMsgEnvelope envelope;
+    fudge_byte * encoded;
+    fudge_i32 encodedsize;
+    FudgeStatus status;
+} FrozenEncode;
+
+void * testEncodeFrozen ( void * arg )
+{
+    FrozenEncode * encode = ( FrozenEncode * ) arg;
+    int index;
+
+    for ( index = 0; index < 256 && encode->status == FUDGE_OK; ++index )
+    {
+        free ( encode->encoded );
+        encode->status = FudgeCodec_encodeMsg ( encode->envelope, &encode->encoded, &encode->encodedsize );
+    }
+    return 0;
+}
+#endif /* ifdef MESSAGE_TEST_THREADS */
+
+DEFINE_TEST( Freeze )
+    FudgeMsg message, submessage, parent;
+    FudgeMsgEnvelope envelope;
+    FudgeString name;
+    fudge_byte * encoded, * reference;
+    fudge_i32 encodedsize, referencesize;
+    int index;
+
+    TEST_EQUALS_INT( FudgeMsg_freeze ( 0, FUDGE_FALSE ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_TRUE( ! FudgeMsg_isFrozen ( 0 ) );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "name" ), FUDGE_OK );
+
+    /* Build a message with a couple of levels of submessage and encode it
+       before freezing, for comparison */
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &parent ), FUDGE_OK );
+    for ( index = 0; index < 20; ++index )
+    {
+        TEST_EQUALS_INT( FudgeMsg_addFieldString ( submessage, name, 0, name ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( parent, 0, 0, index ), FUDGE_OK );
+    }
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( parent, name, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, parent ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, 0, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &reference, &referencesize ), FUDGE_OK );
+
+    /* Freezing covers the whole tree */
+    TEST_EQUALS_INT( FudgeMsg_freeze ( message, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_freeze ( message, FUDGE_TRUE ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeMsg_isFrozen ( message ) );
+    TEST_EQUALS_TRUE( FudgeMsg_isFrozen ( parent ) );
+    TEST_EQUALS_TRUE( FudgeMsg_isFrozen ( submessage ) );
+
+    /* Frozen messages can't be modified */
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( message, 0, 0, 1 ), FUDGE_MESSAGE_FROZEN );
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( submessage, name, 0, name ), FUDGE_MESSAGE_FROZEN );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32Array ( parent, 0, 0, &referencesize, 1 ), FUDGE_MESSAGE_FROZEN );
+    TEST_EQUALS_INT( FudgeMsg_clear ( parent ), FUDGE_MESSAGE_FROZEN );
+    TEST_EQUALS_INT( FudgeMsg_setEncodingCache ( message, FUDGE_FALSE ), FUDGE_MESSAGE_FROZEN );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( message ), 2 );
+    TEST_EQUALS_INT( FudgeMsg_numFields ( submessage ), 20 );
+
+    TEST_EQUALS_INT( FudgeMsg_release ( parent ), FUDGE_OK );
+
+    /* But can still be added to other messages */
+    TEST_EQUALS_INT( FudgeMsg_create ( &parent ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( parent, 0, 0, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( parent ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( encoded, encodedsize, reference, referencesize );
+    free ( encoded );
+
+#ifdef MESSAGE_TEST_THREADS
+    {
+        /* Several threads encoding the same frozen message at once must all
+           produce the same bytes */
+        pthread_t threads [ 4 ];
+        FrozenEncode encodes [ 4 ];
+
+        for ( index = 0; index < 4; ++index )
+        {
+            encodes [ index ].envelope = envelope;
+            encodes [ index ].encoded = 0;
+            encodes [ index ].status = FUDGE_OK;
+            TEST_EQUALS_INT( pthread_create ( threads + index, 0, testEncodeFrozen, encodes + index ), 0 );
+        }
+        for ( index = 0; index < 4; ++index )
+        {
+            TEST_EQUALS_INT( pthread_join ( threads [ index ], 0 ), 0 );
+            TEST_EQUALS_INT( encodes [ index ].status, FUDGE_OK );
+            TEST_EQUALS_MEMORY( encodes [ index ].encoded, encodes [ index ].encodedsize, reference, referencesize );
+            free ( encodes [ index ].encoded );
+        }
+    }
+#endif /* ifdef MESSAGE_TEST_THREADS */
+
+    /* A message frozen without an encoding cache still encodes the same */
+    TEST_EQUALS_INT( FudgeMsg_create ( &parent ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( parent, name, 0, 1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_freeze ( parent, FUDGE_FALSE ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( parent, name, 0, 2 ), FUDGE_MESSAGE_FROZEN );
+    TEST_EQUALS_INT( FudgeMsg_release ( parent ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+    free ( reference );
+END_TEST
+
+#ifdef MESSAGE_TEST_THREADS
+void * testRetireMessages ( void * arg )
+{
+    FudgeMsg * messages = ( FudgeMsg * ) arg;
+    int index;
+
+    /* Anything not handed to the reclaimer is destroyed as the thread
+       exits */
+    for ( index = 0; index < 200; ++index )
+        FudgeMsg_release ( messages [ index ] );
+    return 0;
+}
+#endif /* ifdef MESSAGE_TEST_THREADS */
+
+DEFINE_TEST( DeferredRelease )
+    FudgeMsg message, submessage, recycled;
+    FudgeString name;
+
+    TEST_EQUALS_TRUE( ! FudgeMsg_getDeferredRelease ( ) );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "name" ), FUDGE_OK );
+
+    FudgeMsg_setDeferredRelease ( FUDGE_TRUE );
+    FudgeMsg_setRecycleLimit ( 4 );
+    if ( FudgeMsg_getDeferredRelease ( ) && FudgeMsg_getRecycleLimit ( ) == 4 )
+    {
+        /* A retired message isn't destroyed, and so can't be recycled,
+           until the thread reclaims it */
+        TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( submessage, name, 0, 1 ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, 0, submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_create ( &recycled ), FUDGE_OK );
+        TEST_EQUALS_TRUE( recycled != message );
+        TEST_EQUALS_TRUE( recycled != submessage );
+        TEST_EQUALS_INT( FudgeMsg_release ( recycled ), FUDGE_OK );
+
+        /* Reclaiming destroys the retired messages and the submessage they
+           held, all of which are then recycled */
+        FudgeMsg_reclaimRetired ( );
+        TEST_EQUALS_INT( FudgeMsg_create ( &recycled ), FUDGE_OK );
+        TEST_EQUALS_TRUE( recycled == message );
+        TEST_EQUALS_INT( FudgeMsg_numFields ( recycled ), 0 );
+        TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+        TEST_EQUALS_TRUE( message == submessage );
+        TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_release ( recycled ), FUDGE_OK );
+        FudgeMsg_reclaimRetired ( );
+
+#ifdef MESSAGE_TEST_THREADS
+        {
+            /* Threads releasing shared messages hand them to the reclaimer
+               in batches */
+            pthread_t threads [ 2 ];
+            FudgeMsg messages [ 2 ][ 200 ];
+            int thread, index;
+
+            TEST_EQUALS_INT( FudgeMsg_startReclaimer ( ), FUDGE_OK );
+            TEST_EQUALS_INT( FudgeMsg_startReclaimer ( ), FUDGE_OK );
+            for ( thread = 0; thread < 2; ++thread )
+            {
+                for ( index = 0; index < 200; ++index )
+                {
+                    TEST_EQUALS_INT( FudgeMsg_create ( &messages [ thread ][ index ] ), FUDGE_OK );
+                    TEST_EQUALS_INT( FudgeMsg_addFieldString ( messages [ thread ][ index ], name, 0, name ), FUDGE_OK );
+                }
+                TEST_EQUALS_INT( pthread_create ( threads + thread, 0, testRetireMessages, messages [ thread ] ), 0 );
+            }
+            for ( thread = 0; thread < 2; ++thread )
+                TEST_EQUALS_INT( pthread_join ( threads [ thread ], 0 ), 0 );
+            TEST_EQUALS_INT( FudgeMsg_stopReclaimer ( ), FUDGE_OK );
+            TEST_EQUALS_INT( FudgeMsg_stopReclaimer ( ), FUDGE_OK );
+        }
+#else /* ifdef MESSAGE_TEST_THREADS */
+        TEST_EQUALS_INT( FudgeMsg_startReclaimer ( ), FUDGE_NOT_SUPPORTED );
+#endif /* ifdef MESSAGE_TEST_THREADS */
+    }
+
+    FudgeMsg_setDeferredRelease ( FUDGE_FALSE );
+    FudgeMsg_reclaimRetired ( );
+    FudgeMsg_flushRecycled ( );
+    FudgeMsg_setRecycleLimit ( 0 );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+END_TEST
+
 DEFINE_TEST_SUITE( Message )
     REGISTER_TEST( FieldFunctions )
     REGISTER_TEST( IntegerFieldDowncasting )
     REGISTER_TEST( FieldCoercion )
+    REGISTER_TEST( DeltaPatches )
+    REGISTER_TEST( Arena )
+    REGISTER_TEST( Recycling )
+    REGISTER_TEST( Freeze )
+    REGISTER_TEST( DeferredRelease )
 END_TEST_SUITE
 
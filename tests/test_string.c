@@ -16,6 +16,7 @@
 #include "fudge/string.h"
 #include "convertutf.h"
 #include "simpletest.h"
+#include "snprintf.h"
 
 /* Source strings - converted using iconv */
 static const fudge_byte StringTest_utf8Source []  = { 0xe2, 0x80, 0xbc, 0x20, 0xe2, 0x88, 0x9a, 0xe2,
@@ -43,6 +44,9 @@ static const fudge_byte StringTest_asciiConverted [] = { 0x3f, 0x20, 0x3f, 0x3f,
 
 DEFINE_TEST( Static )
     static FudgeStringStatic staticStr = { 0, StringTest_utf8Source, sizeof ( StringTest_utf8Source ) };
+    FUDGESTRING_STATIC( macroStr, "Field Name" );
+    FUDGESTRING_STATIC( emptyStr, "" );
+    FUDGESTRING_STATIC( invalidStr, "\xc3\x28" );
     FudgeString strFromUTF8;
     FudgeString strFromStatic1;
     FudgeString strFromStatic2;
@@ -55,12 +59,32 @@ DEFINE_TEST( Static )
     strFromStatic2 = FudgeString_fromStatic ( &staticStr );
     TEST_EQUALS_TRUE ( strFromStatic1 == strFromStatic2 );
 
-    /* Check it was constructed properly */
+    /* Check it was constructed properly, without copying the bytes */
     TEST_EQUALS_INT( FudgeString_compare ( strFromUTF8, strFromStatic1 ), 0 );
+    TEST_EQUALS_TRUE( FudgeString_getData ( strFromStatic1 ) == StringTest_utf8Source );
+    TEST_EQUALS_INT( FudgeString_getSize ( strFromStatic1 ), sizeof ( StringTest_utf8Source ) );
 
-    /* Tidy up. Note we don't release the static strings (unless we called retain) */
+    /* Static strings are immortal: releasing them has no effect */
+    TEST_EQUALS_INT( FudgeString_retain ( strFromStatic1 ), FUDGE_OK );
     TEST_EQUALS_INT( FudgeString_release ( strFromStatic1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( strFromStatic1 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( strFromStatic1 ), FUDGE_OK );
+    TEST_EQUALS_TRUE ( FudgeString_fromStatic ( &staticStr ) == strFromStatic1 );
+    TEST_EQUALS_INT( FudgeString_compare ( strFromUTF8, strFromStatic1 ), 0 );
     TEST_EQUALS_INT( FudgeString_release ( strFromUTF8 ), FUDGE_OK );
+
+    /* Strings declared with the macro */
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &strFromUTF8, "Field Name" ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeString_equals ( FudgeString_fromStatic ( &macroStr ), strFromUTF8 ) );
+    TEST_EQUALS_INT( FudgeString_getSize ( FudgeString_fromStatic ( &emptyStr ) ), 0 );
+    TEST_EQUALS_INT( FudgeString_compare ( FudgeString_fromStatic ( &emptyStr ), strFromStatic1 ), -1 );
+    TEST_EQUALS_INT( FudgeString_release ( strFromUTF8 ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeString_fromStatic ( 0 ) == 0 );
+
+    /* Invalid UTF8 is rejected, as by the copying constructors */
+    TEST_EQUALS_INT( FudgeString_createFromUTF8 ( &strFromUTF8, ( const fudge_byte * ) "\xc3\x28", 2 ), FUDGE_STRING_INVALID_UNICODE );
+    TEST_EQUALS_TRUE( FudgeString_fromStatic ( &invalidStr ) == 0 );
+    TEST_EQUALS_TRUE( FudgeString_fromStatic ( &invalidStr ) == 0 );
 END_TEST
 
 DEFINE_TEST( CreateFromASCII )
@@ -256,6 +280,170 @@ DEFINE_TEST( Comparison )
     FudgeString_release ( lowString );
 END_TEST
 
+DEFINE_TEST( Equality )
+    static const fudge_byte bomInMiddle [] = { 'a', 'b', 0xef, 0xbb, 0xbf, 'c' };
+    FudgeString utf8String, utf8Duplicate, utf16String, utf16Truncated, lowString, bomString, plainString;
+
+    TEST_EQUALS_INT( FudgeString_createFromUTF8 ( &utf8String, StringTest_utf8Source, sizeof ( StringTest_utf8Source ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromUTF8 ( &utf8Duplicate, StringTest_utf8Source, sizeof ( StringTest_utf8Source ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromUTF16 ( &utf16String, StringTest_utf16Source, sizeof ( StringTest_utf16Source ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromUTF16 ( &utf16Truncated, StringTest_utf16Source, sizeof ( StringTest_utf16Source ) - 2 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &lowString, "\b\n\t\t " ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromUTF8 ( &bomString, bomInMiddle, sizeof ( bomInMiddle ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &plainString, "abc" ), FUDGE_OK );
+
+    /* NULL strings */
+    TEST_EQUALS_TRUE( FudgeString_equals ( 0, 0 ) );
+    TEST_EQUALS_TRUE( ! FudgeString_equals ( utf8String, 0 ) );
+    TEST_EQUALS_TRUE( ! FudgeString_equals ( 0, utf8String ) );
+    TEST_EQUALS_INT( FudgeString_hash ( 0 ), 0 );
+
+    /* Equal strings have equal hashes, BOMs or not */
+    TEST_EQUALS_TRUE( FudgeString_equals ( utf8String, utf8String ) );
+    TEST_EQUALS_TRUE( FudgeString_equals ( utf8String, utf8Duplicate ) );
+    TEST_EQUALS_TRUE( FudgeString_hash ( utf8String ) == FudgeString_hash ( utf8Duplicate ) );
+    TEST_EQUALS_TRUE( FudgeString_equals ( utf16String, utf8String ) );
+    TEST_EQUALS_TRUE( FudgeString_hash ( utf16String ) == FudgeString_hash ( utf8String ) );
+    TEST_EQUALS_TRUE( FudgeString_equals ( bomString, plainString ) );
+    TEST_EQUALS_TRUE( FudgeString_equals ( plainString, bomString ) );
+    TEST_EQUALS_TRUE( FudgeString_hash ( bomString ) == FudgeString_hash ( plainString ) );
+    TEST_EQUALS_TRUE( FudgeString_hash ( utf8String ) != 0 );
+
+    /* Differing strings */
+    TEST_EQUALS_TRUE( ! FudgeString_equals ( lowString, utf8String ) );
+    TEST_EQUALS_TRUE( ! FudgeString_equals ( utf8String, utf16Truncated ) );
+    TEST_EQUALS_TRUE( ! FudgeString_equals ( utf16Truncated, utf16String ) );
+    TEST_EQUALS_TRUE( ! FudgeString_equals ( plainString, lowString ) );
+
+    FudgeString_release ( utf8String );
+    FudgeString_release ( utf8Duplicate );
+    FudgeString_release ( utf16String );
+    FudgeString_release ( utf16Truncated );
+    FudgeString_release ( lowString );
+    FudgeString_release ( bomString );
+    FudgeString_release ( plainString );
+END_TEST
+
+DEFINE_TEST( Intern )
+    FudgeString alpha, alphaCopy, beta, empty, interned [ 4 ], many [ 1000 ];
+    char buffer [ 16 ];
+    int index;
+
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &alpha, "alpha" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &alphaCopy, "alpha" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &beta, "beta" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCII ( &empty, 0, 0 ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeString_intern ( 0, alpha ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeString_intern ( interned, 0 ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeString_internUTF8 ( interned, 0, 1 ), FUDGE_NULL_POINTER );
+
+    /* Strings with the same contents share an instance, however they were
+       interned */
+    TEST_EQUALS_INT( FudgeString_intern ( interned, alpha ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_intern ( interned + 1, alphaCopy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_internUTF8 ( interned + 2, ( const fudge_byte * ) "alpha", 5 ), FUDGE_OK );
+    TEST_EQUALS_TRUE( interned [ 0 ] != alpha && interned [ 0 ] != alphaCopy );
+    TEST_EQUALS_TRUE( interned [ 0 ] == interned [ 1 ] );
+    TEST_EQUALS_TRUE( interned [ 0 ] == interned [ 2 ] );
+    TEST_EQUALS_INT( FudgeString_compare ( interned [ 0 ], alpha ), 0 );
+    TEST_EQUALS_INT( FudgeString_intern ( interned + 3, beta ), FUDGE_OK );
+    TEST_EQUALS_TRUE( interned [ 3 ] != interned [ 0 ] );
+    TEST_EQUALS_INT( FudgeString_compare ( interned [ 3 ], beta ), 0 );
+
+    /* Interned strings are immortal, so surplus releases are harmless */
+    for ( index = 0; index < 4; ++index )
+    {
+        TEST_EQUALS_INT( FudgeString_retain ( interned [ index ] ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeString_release ( interned [ index ] ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeString_release ( interned [ index ] ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeString_release ( interned [ index ] ), FUDGE_OK );
+    }
+    TEST_EQUALS_INT( FudgeString_intern ( interned + 1, alpha ), FUDGE_OK );
+    TEST_EQUALS_TRUE( interned [ 0 ] == interned [ 1 ] );
+    TEST_EQUALS_INT( FudgeString_getSize ( interned [ 1 ] ), 5 );
+
+    TEST_EQUALS_INT( FudgeString_intern ( interned, empty ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_internUTF8 ( interned + 1, 0, 0 ), FUDGE_OK );
+    TEST_EQUALS_TRUE( interned [ 0 ] == interned [ 1 ] );
+    TEST_EQUALS_INT( FudgeString_getSize ( interned [ 0 ] ), 0 );
+
+    /* Enough strings to share buckets */
+    for ( index = 0; index < 1000; ++index )
+    {
+        snprintf ( buffer, sizeof ( buffer ), "name%d", index );
+        TEST_EQUALS_INT( FudgeString_internUTF8 ( many + index, ( const fudge_byte * ) buffer, strlen ( buffer ) ), FUDGE_OK );
+    }
+    for ( index = 0; index < 1000; ++index )
+    {
+        snprintf ( buffer, sizeof ( buffer ), "name%d", index );
+        TEST_EQUALS_INT( FudgeString_internUTF8 ( interned, ( const fudge_byte * ) buffer, strlen ( buffer ) ), FUDGE_OK );
+        TEST_EQUALS_TRUE( interned [ 0 ] == many [ index ] );
+    }
+
+    TEST_EQUALS_INT( FudgeString_release ( alpha ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( alphaCopy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( beta ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( empty ), FUDGE_OK );
+END_TEST
+
+DEFINE_TEST( Transcoding )
+    static const UTF32 StringTest_codePoints [] = { 0x41, 0x7f, 0x80, 0x3b1, 0x7ff, 0x800, 0x20ac, 0xd7ff,
+                                                    0xe000, 0xfffd, 0x10000, 0x1f600, 0x10ffff };
+    UTF32 source [ 1024 ];
+    UTF8 expected [ 4096 ], * expectedEnd = expected;
+    UTF16 expected16 [ 2048 ], * expected16End = expected16;
+    const UTF32 * sourceStart = source;
+    const UTF8 * expectedStart = expected;
+    static const fudge_byte invalid [] = { 0x41, 0x42, 0xc3, 0x28, 0x43 };
+    fudge_byte * bytes, buffer [ 8 ];
+    size_t index, numbytes;
+    FudgeString string, copy;
+
+    /* Build a source with long runs of ASCII (to cover the block copies)
+       broken up by characters of every encoded width */
+    for ( index = 0; index < sizeof ( source ) / sizeof ( UTF32 ); ++index )
+        source [ index ] = ( index % 37 ) < 30 ? ( UTF32 ) ( 'a' + index % 26 )
+                                               : StringTest_codePoints [ index % 13 ];
+
+    /* The reference converters provide the expected results */
+    TEST_EQUALS_INT( ConvertUTF32toUTF8 ( &sourceStart, source + 1024, &expectedEnd, expected + sizeof ( expected ), strictConversion ), conversionOK );
+    TEST_EQUALS_INT( ConvertUTF8toUTF16 ( &expectedStart, expectedEnd, &expected16End, expected16 + 2048, strictConversion ), conversionOK );
+
+    /* UTF32 -> UTF8 -> UTF16 */
+    TEST_EQUALS_INT( FudgeString_createFromUTF32 ( &string, ( const fudge_byte * ) source, sizeof ( source ) ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( FudgeString_getData ( string ), FudgeString_getSize ( string ), expected, ( size_t ) ( expectedEnd - expected ) );
+    TEST_EQUALS_INT( FudgeString_convertToUTF16 ( &bytes, &numbytes, string ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( bytes, numbytes, expected16, ( size_t ) ( expected16End - expected16 ) * 2 );
+
+    /* UTF16 -> UTF8 -> UTF32 */
+    TEST_EQUALS_INT( FudgeString_createFromUTF16 ( &copy, bytes, numbytes ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeString_equals ( string, copy ) );
+    free ( bytes );
+    TEST_EQUALS_INT( FudgeString_convertToUTF32 ( &bytes, &numbytes, copy ), FUDGE_OK );
+    TEST_EQUALS_MEMORY( bytes, numbytes, source, sizeof ( source ) );
+    free ( bytes );
+    TEST_EQUALS_INT( FudgeString_release ( copy ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( string ), FUDGE_OK );
+
+    /* A character outside the BMP needs exactly two units of buffer */
+    TEST_EQUALS_INT( FudgeString_createFromUTF32 ( &string, ( const fudge_byte * ) ( StringTest_codePoints + 11 ), sizeof ( UTF32 ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_getSize ( string ), 4 );
+    TEST_EQUALS_INT( FudgeString_copyToUTF16 ( buffer, 3, string ), 0 );
+    TEST_EQUALS_INT( FudgeString_copyToUTF16 ( buffer, 4, string ), 4 );
+    TEST_EQUALS_INT( FudgeString_copyToUTF32 ( buffer, 4, string ), 4 );
+    TEST_EQUALS_MEMORY( buffer, 4, StringTest_codePoints + 11, 4 );
+    TEST_EQUALS_INT( FudgeString_release ( string ), FUDGE_OK );
+
+    /* Invalid sequences are still rejected */
+    TEST_EQUALS_INT( FudgeString_createFromUTF8 ( &string, invalid, sizeof ( invalid ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_convertToUTF16 ( &bytes, &numbytes, string ), FUDGE_STRING_INVALID_UNICODE );
+    TEST_EQUALS_INT( FudgeString_convertToUTF32 ( &bytes, &numbytes, string ), FUDGE_STRING_INVALID_UNICODE );
+    TEST_EQUALS_INT( FudgeString_release ( string ), FUDGE_OK );
+    source [ 0 ] = 0x110000;
+    TEST_EQUALS_INT( FudgeString_createFromUTF32 ( &string, ( const fudge_byte * ) source, sizeof ( source ) ), FUDGE_STRING_INVALID_UNICODE );
+END_TEST
+
 
 DEFINE_TEST_SUITE( String )
     REGISTER_TEST( Static )
@@ -263,5 +451,8 @@ DEFINE_TEST_SUITE( String )
     REGISTER_TEST( CreateFromUTF8 )
     REGISTER_TEST( CreateFromUTF16 )
     REGISTER_TEST( CreateFromUTF32 )
+    REGISTER_TEST( Transcoding )
     REGISTER_TEST( Comparison )
+    REGISTER_TEST( Equality )
+    REGISTER_TEST( Intern )
 END_TEST_SUITE
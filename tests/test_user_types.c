@@ -20,6 +20,11 @@
 #include "fudge/string.h"
 #include "fudge/stringpool.h"
 
+#if defined(_MT) && defined(FUDGE_HAS_PTHREADS)
+#   define USERTYPES_TEST_THREADS 1
+#   include <pthread.h>
+#endif
+
 /* Example user types */
 
 #define FUDGE_TYPE_EXAMPLEIP4   100
@@ -292,7 +297,73 @@ DEFINE_TEST( UserTypeHandling )
     TEST_EQUALS_INT( FudgeStringPool_release ( stringpool ), FUDGE_OK );
 END_TEST
 
+#ifdef USERTYPES_TEST_THREADS
+void * testRegisterRepeatedly ( void * arg )
+{
+    int index;
+    FudgeStatus status = FUDGE_OK;
+
+    for ( index = 0; index < 1000 && status == FUDGE_OK; ++index )
+        status = FudgeRegistry_registerType ( FUDGE_TYPE_EXAMPLETICK,
+                                              FUDGE_TYPE_PAYLOAD_BYTES,
+                                              FudgeCodec_decodeFieldExampleTick,
+                                              FudgeCodec_encodeFieldExampleTick,
+                                              FudgeType_coerceExampleTick );
+    *( ( FudgeStatus * ) arg ) = status;
+    return 0;
+}
+#endif /* ifdef USERTYPES_TEST_THREADS */
+
+DEFINE_TEST( ConcurrentRegistration )
+    FudgeMsg message;
+    FudgeMsgEnvelope envelope;
+    FudgeField field;
+    fudge_byte * encoded;
+    fudge_i32 encodedsize;
+    ExampleTickStruct tick;
+    int index;
+
+    ExampleTick_init ( &tick, "EUR=", 5, 1.2345, 1.2347, 1263138018u );
+    TEST_EQUALS_INT( FudgeRegistry_registerType ( FUDGE_TYPE_EXAMPLETICK,
+                                                  FUDGE_TYPE_PAYLOAD_BYTES,
+                                                  FudgeCodec_decodeFieldExampleTick,
+                                                  FudgeCodec_encodeFieldExampleTick,
+                                                  FudgeType_coerceExampleTick ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldExampleTick ( message, 0, &tick ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeCodec_encodeMsg ( envelope, &encoded, &encodedsize ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+
+#ifdef USERTYPES_TEST_THREADS
+    {
+        /* Decoding must carry on working while the type is re-registered */
+        pthread_t thread;
+        FudgeStatus status = FUDGE_INTERNAL_LIST_STATE;
+
+        TEST_EQUALS_INT( pthread_create ( &thread, 0, testRegisterRepeatedly, &status ), 0 );
+#endif /* ifdef USERTYPES_TEST_THREADS */
+        for ( index = 0; index < 1000; ++index )
+        {
+            TEST_EQUALS_INT( FudgeCodec_decodeMsg ( &envelope, encoded, encodedsize ), FUDGE_OK );
+            TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, FudgeMsgEnvelope_getMessage ( envelope ), 0 ), FUDGE_OK );
+            TEST_EQUALS_INT( field.type, FUDGE_TYPE_EXAMPLETICK );
+            TEST_EQUALS_MEMORY( field.data.bytes, field.numbytes, ( fudge_byte * ) &tick, sizeof ( ExampleTickStruct ) );
+            TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+        }
+#ifdef USERTYPES_TEST_THREADS
+        TEST_EQUALS_INT( pthread_join ( thread, 0 ), 0 );
+        TEST_EQUALS_INT( status, FUDGE_OK );
+    }
+#endif /* ifdef USERTYPES_TEST_THREADS */
+
+    free ( encoded );
+END_TEST
+
 DEFINE_TEST_SUITE( UserTypes )
     REGISTER_TEST( UserTypeHandling )
+    REGISTER_TEST( ConcurrentRegistration )
 END_TEST_SUITE
 
@@ -13,9 +13,20 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "fudge/envelope.h"
+#include "fudge/fudge.h"
+#include "fudge/message.h"
+#include "fudge/queue.h"
+#include "memory_internal.h"
 #include "fudge/stringpool.h"
 #include "reference.h"
 #include "simpletest.h"
+#include "snprintf.h"
+
+#if defined(_MT) && defined(FUDGE_HAS_PTHREADS)
+#   define UTILITIES_TEST_THREADS 1
+#   include <pthread.h>
+#endif
 
 #ifndef EXTERNAL_TESTS_ONLY
 DEFINE_TEST( ReferenceCount )
@@ -138,6 +149,518 @@ DEFINE_TEST( StringPool )
     TEST_EQUALS_INT( FudgeString_release ( string2 ), FUDGE_OK );
 END_TEST
 
+DEFINE_TEST( StringPoolCache )
+    static const fudge_byte accented [] = { 0xc3, 0xa9 };
+    FudgeStringPool pool;
+    FudgeStatus status;
+    FudgeString alpha, beta, gamma, many [ 1000 ];
+    char buffer [ 16 ];
+    int index;
+
+    TEST_EQUALS_INT( FudgeStringPool_create ( 0 ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeStringPool_create ( &pool ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( 0, &status, "alpha" ) == 0 );
+    TEST_EQUALS_INT( status, FUDGE_NULL_POINTER );
+
+    /* Repeated contents return the string already in the pool */
+    alpha = FudgeStringPool_createStringFromASCIIZ ( pool, &status, "alpha" );
+    TEST_EQUALS_INT( status, FUDGE_OK );
+    beta = FudgeStringPool_createStringFromASCII ( pool, &status, "beta", 4 );
+    TEST_EQUALS_INT( status, FUDGE_OK );
+    TEST_EQUALS_TRUE( alpha != beta );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( pool, &status, "alpha" ) == alpha );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromUTF8 ( pool, &status, ( const fudge_byte * ) "alpha", 5 ) == alpha );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCII ( pool, &status, "betamax", 4 ) == beta );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( pool, &status, "" ) == FudgeStringPool_createStringFromASCII ( pool, &status, 0, 0 ) );
+
+    /* Acquired strings are found as well */
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &gamma, "gamma" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeStringPool_acquire ( pool, gamma ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( pool, &status, "gamma" ) == gamma );
+    TEST_EQUALS_INT( FudgeString_createFromUTF8 ( &gamma, accented, sizeof ( accented ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeStringPool_acquire ( pool, gamma ), FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromUTF8 ( pool, &status, accented, sizeof ( accented ) ) == gamma );
+
+    /* ... but an ASCII lookup still rejects non-ASCII characters */
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCII ( pool, &status, ( const char * ) accented, sizeof ( accented ) ) == 0 );
+    TEST_EQUALS_INT( status, FUDGE_STRING_INVALID_ASCII );
+
+    /* Enough strings to fill several slabs and grow the index */
+    for ( index = 0; index < 1000; ++index )
+    {
+        snprintf ( buffer, sizeof ( buffer ), "name%d", index );
+        many [ index ] = FudgeStringPool_createStringFromASCIIZ ( pool, &status, buffer );
+        TEST_EQUALS_INT( status, FUDGE_OK );
+    }
+    for ( index = 0; index < 1000; ++index )
+    {
+        snprintf ( buffer, sizeof ( buffer ), "name%d", index );
+        TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( pool, &status, buffer ) == many [ index ] );
+        TEST_EQUALS_INT( FudgeString_compare ( many [ index ], FudgeStringPool_createStringFromUTF8 ( pool, &status, ( const fudge_byte * ) buffer, strlen ( buffer ) ) ), 0 );
+    }
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( pool, &status, "alpha" ) == alpha );
+
+    /* The pool can be reused once cleared */
+    TEST_EQUALS_INT( FudgeStringPool_clear ( pool ), FUDGE_OK );
+    alpha = FudgeStringPool_createStringFromASCIIZ ( pool, &status, "alpha" );
+    TEST_EQUALS_INT( status, FUDGE_OK );
+    TEST_EQUALS_TRUE( FudgeStringPool_createStringFromASCIIZ ( pool, &status, "alpha" ) == alpha );
+    TEST_EQUALS_INT( FudgeStringPool_release ( pool ), FUDGE_OK );
+END_TEST
+
+#ifdef UTILITIES_TEST_THREADS
+void * testSlabFreeBlocks ( void * blocks )
+{
+    int index;
+    for ( index = 0; index < 256; ++index )
+        FudgeMemory_slabManager ( )->deallocate ( ( ( void * * ) blocks ) [ index ] );
+    return 0;
+}
+#endif /* ifdef UTILITIES_TEST_THREADS */
+
+DEFINE_TEST( SlabManager )
+    FudgeMemoryManager * manager = FudgeMemory_slabManager ( );
+    static void * blocks [ 256 ], * reused [ 8192 ];
+    unsigned char * bytes;
+    size_t index, size, found;
+
+    /* Allocate blocks of every size class and some large blocks */
+    for ( index = 0; index < 256; ++index )
+    {
+        size = index * 3 + 1;
+        TEST_EQUALS_TRUE( ( blocks [ index ] = manager->allocate ( size ) ) != 0 );
+        TEST_EQUALS_INT( ( size_t ) blocks [ index ] % sizeof ( double ), 0 );
+        memset ( blocks [ index ], ( int ) index, size );
+    }
+    for ( index = 0; index < 256; ++index )
+    {
+        bytes = ( unsigned char * ) blocks [ index ];
+        TEST_EQUALS_INT( bytes [ 0 ], index );
+        TEST_EQUALS_INT( bytes [ index * 3 ], index );
+    }
+
+    /* Freed blocks are reused by the same thread */
+    manager->deallocate ( blocks [ 0 ] );
+    TEST_EQUALS_TRUE( manager->allocate ( 1 ) == blocks [ 0 ] );
+    for ( index = 0; index < 256; ++index )
+        manager->deallocate ( blocks [ index ] );
+    manager->deallocate ( 0 );
+
+    /* Reallocation keeps the contents when moving between size classes and
+       to and from the large allocations */
+    TEST_EQUALS_TRUE( ( bytes = ( unsigned char * ) manager->reallocate ( 0, 10 ) ) != 0 );
+    memcpy ( bytes, "0123456789", 10 );
+    TEST_EQUALS_TRUE( manager->reallocate ( bytes, 16 ) == bytes );
+    TEST_EQUALS_TRUE( ( bytes = ( unsigned char * ) manager->reallocate ( bytes, 100 ) ) != 0 );
+    TEST_EQUALS_MEMORY( bytes, 10, "0123456789", 10 );
+    TEST_EQUALS_TRUE( ( bytes = ( unsigned char * ) manager->reallocate ( bytes, 1000 ) ) != 0 );
+    TEST_EQUALS_MEMORY( bytes, 10, "0123456789", 10 );
+    TEST_EQUALS_TRUE( ( bytes = ( unsigned char * ) manager->reallocate ( bytes, 5000 ) ) != 0 );
+    TEST_EQUALS_MEMORY( bytes, 10, "0123456789", 10 );
+    TEST_EQUALS_TRUE( ( bytes = ( unsigned char * ) manager->reallocate ( bytes, 20 ) ) != 0 );
+    TEST_EQUALS_MEMORY( bytes, 10, "0123456789", 10 );
+    manager->deallocate ( bytes );
+
+#ifdef UTILITIES_TEST_THREADS
+    {
+        /* Blocks freed by another thread go back to this thread's cache, and
+           are reused before any more memory is taken from the system */
+        pthread_t thread;
+
+        for ( index = 0; index < 256; ++index )
+            TEST_EQUALS_TRUE( ( blocks [ index ] = manager->allocate ( 40 ) ) != 0 );
+        TEST_EQUALS_INT( pthread_create ( &thread, 0, testSlabFreeBlocks, blocks ), 0 );
+        TEST_EQUALS_INT( pthread_join ( thread, 0 ), 0 );
+
+        /* The cache may hold other free blocks of the same size; these
+           come first */
+        for ( size = 0, found = 0; size < 8192 && found < 256; ++size )
+        {
+            TEST_EQUALS_TRUE( ( reused [ size ] = manager->allocate ( 40 ) ) != 0 );
+            for ( index = 0; index < 256; ++index )
+                if ( reused [ size ] == blocks [ index ] )
+                    ++found;
+        }
+        TEST_EQUALS_INT( found, 256 );
+        for ( index = 0; index < size; ++index )
+            manager->deallocate ( reused [ index ] );
+    }
+#else /* ifdef UTILITIES_TEST_THREADS */
+    ( void ) reused;
+    ( void ) found;
+#endif /* ifdef UTILITIES_TEST_THREADS */
+END_TEST
+
+DEFINE_TEST( ExtendedManager )
+    FudgeMemoryManagerEx other = { 0, FudgeMemory_legacyAllocate, FudgeMemory_legacyReallocate, FudgeMemory_legacyDeallocate };
+    size_t alignment, index;
+    unsigned char * block;
+
+    /* The manager can't be changed once the library has been initialised */
+    TEST_EQUALS_INT( Fudge_initEx ( FudgeMemory_defaultManager ( ) ), FUDGE_OK );
+    other.context = FudgeMemory_defaultManager ( );
+    TEST_EQUALS_INT( Fudge_initManagerEx ( &other ), FUDGE_CHANGED_MEMORY_MANAGER );
+    TEST_EQUALS_INT( Fudge_initManagerEx ( 0 ), FUDGE_NULL_POINTER );
+
+    /* The legacy adapter provides alignments greater than malloc's */
+    for ( alignment = 1; alignment <= 4096; alignment *= 2 )
+    {
+        TEST_EQUALS_TRUE( ( block = FudgeMemory_legacyAllocate ( other.context, 100, alignment ) ) != 0 );
+        TEST_EQUALS_INT( ( size_t ) block % alignment, 0 );
+        for ( index = 0; index < 100; ++index )
+            block [ index ] = ( unsigned char ) index;
+
+        TEST_EQUALS_TRUE( ( block = FudgeMemory_legacyReallocate ( other.context, block, 100, 1000, alignment ) ) != 0 );
+        TEST_EQUALS_INT( ( size_t ) block % alignment, 0 );
+        for ( index = 0; index < 100; ++index )
+            TEST_EQUALS_INT( block [ index ], index );
+        block [ 999 ] = 0xff;
+
+        TEST_EQUALS_TRUE( ( block = FudgeMemory_legacyReallocate ( other.context, block, 1000, 10, alignment ) ) != 0 );
+        TEST_EQUALS_INT( ( size_t ) block % alignment, 0 );
+        TEST_EQUALS_INT( block [ 9 ], 9 );
+        FudgeMemory_legacyDeallocate ( other.context, block, 10, alignment );
+    }
+
+    /* Reallocating NULL is an allocation, freeing NULL does nothing */
+    TEST_EQUALS_TRUE( ( block = FudgeMemory_legacyReallocate ( other.context, 0, 0, 64, 256 ) ) != 0 );
+    TEST_EQUALS_INT( ( size_t ) block % 256, 0 );
+    FudgeMemory_legacyDeallocate ( other.context, block, 64, 256 );
+    FudgeMemory_legacyDeallocate ( other.context, 0, 0, 256 );
+
+    /* Sized frees are passed through from the public interface */
+    TEST_EQUALS_TRUE( ( block = FudgeMemory_malloc ( 32 ) ) != 0 );
+    FudgeMemory_freeSized ( block, 32 );
+END_TEST
+
+DEFINE_TEST( MemoryStats )
+    static const fudge_byte rawBytes [ 100 ] = { 0 };
+
+    FudgeMemoryStats before, during, after;
+    FudgeMemoryCounters * counters;
+    FudgeMsg message;
+    FudgeMsgEnvelope envelope;
+    FudgeString string;
+    int index, category;
+
+    TEST_EQUALS_INT( Fudge_getMemoryStats ( 0 ), FUDGE_NULL_POINTER );
+
+    Fudge_setMemoryStatsEnabled ( FUDGE_TRUE );
+    if ( ! Fudge_getMemoryStatsEnabled ( ) )
+        return 0;   /* Not supported on this platform */
+
+    TEST_EQUALS_INT( Fudge_getMemoryStats ( &before ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &string, "field" ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    for ( index = 0; index < 20; ++index )
+        TEST_EQUALS_INT( FudgeMsg_addFieldOpaque ( message, FUDGE_TYPE_BYTE_ARRAY, string, 0, rawBytes, sizeof ( rawBytes ) ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_create ( &envelope, 0, 0, 0, message ), FUDGE_OK );
+
+    /* Every category is in use */
+    TEST_EQUALS_INT( Fudge_getMemoryStats ( &during ), FUDGE_OK );
+    for ( category = 0; category < FUDGE_MEMORY_NUM_CATEGORIES; ++category )
+    {
+        counters = &( during.categories [ category ] );
+        TEST_EQUALS_TRUE( counters->currentbytes > before.categories [ category ].currentbytes );
+        TEST_EQUALS_TRUE( counters->allocations > before.categories [ category ].allocations );
+        TEST_EQUALS_TRUE( counters->peakbytes >= counters->currentbytes );
+    }
+    TEST_EQUALS_INT( during.categories [ FUDGE_MEMORY_BYTES ].currentbytes - before.categories [ FUDGE_MEMORY_BYTES ].currentbytes, 20 * sizeof ( rawBytes ) );
+    TEST_EQUALS_INT( during.categories [ FUDGE_MEMORY_MESSAGES ].allocations - before.categories [ FUDGE_MEMORY_MESSAGES ].allocations, 1 );
+    TEST_EQUALS_INT( during.categories [ FUDGE_MEMORY_ENVELOPES ].allocations - before.categories [ FUDGE_MEMORY_ENVELOPES ].allocations, 1 );
+    TEST_EQUALS_INT( during.categories [ FUDGE_MEMORY_STRINGS ].allocations - before.categories [ FUDGE_MEMORY_STRINGS ].allocations, 1 );
+
+    /* Releasing everything returns the current counts to where they were,
+       but leaves the peaks */
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( envelope ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( string ), FUDGE_OK );
+
+    TEST_EQUALS_INT( Fudge_getMemoryStats ( &after ), FUDGE_OK );
+    for ( category = 0; category < FUDGE_MEMORY_NUM_CATEGORIES; ++category )
+    {
+        counters = &( after.categories [ category ] );
+        TEST_EQUALS_INT( counters->currentbytes, before.categories [ category ].currentbytes );
+        TEST_EQUALS_INT( counters->frees - before.categories [ category ].frees,
+                         counters->allocations - before.categories [ category ].allocations );
+        TEST_EQUALS_TRUE( counters->peakbytes >= during.categories [ category ].currentbytes );
+    }
+
+    Fudge_setMemoryStatsEnabled ( FUDGE_FALSE );
+END_TEST
+
+#ifdef UTILITIES_TEST_THREADS
+void * testConfinedRetainRelease ( void * message )
+{
+    int index;
+    FudgeField field;
+    for ( index = 0; index < 4096; ++index )
+    {
+        FudgeMsg_retain ( ( FudgeMsg ) message );
+        if ( FudgeMsg_getFieldByOrdinal ( &field, ( FudgeMsg ) message, 1 ) == FUDGE_OK )
+        {
+            FudgeMsg_retain ( field.data.message );
+            FudgeMsg_release ( field.data.message );
+        }
+        if ( FudgeMsg_getFieldByOrdinal ( &field, ( FudgeMsg ) message, 3 ) == FUDGE_OK )
+        {
+            FudgeString_retain ( field.data.string );
+            FudgeString_release ( field.data.string );
+        }
+        FudgeMsg_release ( ( FudgeMsg ) message );
+    }
+    return 0;
+}
+#endif /* ifdef UTILITIES_TEST_THREADS */
+
+DEFINE_TEST( ThreadConfinement )
+    FudgeMsg message, submessage;
+    FudgeString name, value;
+    fudge_i16 ordinal;
+
+    TEST_EQUALS_TRUE( ! Fudge_getThreadConfinement ( ) );
+    Fudge_setThreadConfinement ( FUDGE_TRUE );
+    TEST_EQUALS_TRUE( Fudge_getThreadConfinement ( ) );
+
+#ifndef EXTERNAL_TESTS_ONLY
+    {
+        FudgeRefCount refcount;
+
+        /* Confined counts work as normal within their thread */
+        TEST_EQUALS_INT( FudgeRefCount_create ( &refcount ), FUDGE_OK );
+#ifdef _MT
+        TEST_EQUALS_TRUE( ! FudgeRefCount_isShared ( refcount ) );
+#endif /* ifdef _MT */
+        FudgeRefCount_increment ( refcount );
+        TEST_EQUALS_INT( FudgeRefCount_count ( refcount ), 2 );
+        FudgeRefCount_share ( refcount );
+        TEST_EQUALS_TRUE( FudgeRefCount_isShared ( refcount ) );
+        TEST_EQUALS_INT( FudgeRefCount_decrementAndReturn ( refcount ), 1 );
+        TEST_EQUALS_INT( FudgeRefCount_destroy ( refcount ), FUDGE_OK );
+    }
+#endif /* ifndef EXTERNAL_TESTS_ONLY */
+
+    /* Build a message with a named submessage, then share it */
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_create ( &submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &name, "submessage" ), FUDGE_OK );
+    ordinal = 1;
+    TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( submessage, 0, 0, 1234 ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_addFieldMsg ( message, name, &ordinal, submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( submessage ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( name ), FUDGE_OK );
+
+    TEST_EQUALS_INT( FudgeMsg_share ( 0 ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeMsg_share ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_share ( message ), FUDGE_OK );
+
+    /* Fields added after sharing are shared as they're added */
+    TEST_EQUALS_INT( FudgeString_createFromASCIIZ ( &value, "value" ), FUDGE_OK );
+    ordinal = 3;
+    TEST_EQUALS_INT( FudgeMsg_addFieldString ( message, 0, &ordinal, value ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeString_release ( value ), FUDGE_OK );
+
+#ifdef UTILITIES_TEST_THREADS
+    {
+        pthread_t threads [ 4 ];
+        int index;
+
+        for ( index = 0; index < 4; ++index )
+            TEST_EQUALS_INT( pthread_create ( threads + index, 0, testConfinedRetainRelease, message ), 0 );
+        testConfinedRetainRelease ( message );
+        for ( index = 0; index < 4; ++index )
+            TEST_EQUALS_INT( pthread_join ( threads [ index ], 0 ), 0 );
+    }
+#endif /* ifdef UTILITIES_TEST_THREADS */
+
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    Fudge_setThreadConfinement ( FUDGE_FALSE );
+END_TEST
+
+#ifdef UTILITIES_TEST_THREADS
+#define QUEUE_TEST_ITEMS 20000
+
+/* Producers push messages holding the numbers 1 to QUEUE_TEST_ITEMS, in
+   batches of up to 16 */
+void * testQueueProducer ( void * queue )
+{
+    FudgeMsg messages [ 16 ];
+    size_t num, pushed, offset;
+    fudge_i32 next = 1;
+
+    while ( next <= QUEUE_TEST_ITEMS )
+    {
+        for ( num = 0; num < 16 && next <= QUEUE_TEST_ITEMS; ++num, ++next )
+        {
+            FudgeMsg_create ( messages + num );
+            FudgeMsg_addFieldI32 ( messages [ num ], 0, 0, next );
+        }
+        for ( offset = 0; offset < num; offset += pushed )
+            FudgeQueue_pushMsgs ( ( FudgeQueue ) queue, messages + offset, num - offset, &pushed );
+    }
+    return 0;
+}
+
+typedef struct
+{
+    FudgeQueue queue;
+    size_t count;
+    fudge_i64 total;
+    fudge_bool ordered;
+} QueueConsumer;
+
+void * testQueueConsumer ( void * arg )
+{
+    QueueConsumer * consumer = ( QueueConsumer * ) arg;
+    FudgeMsg messages [ 16 ];
+    FudgeField field;
+    size_t index, popped;
+    fudge_i32 value, previous = 0;
+
+    while ( consumer->count < QUEUE_TEST_ITEMS )
+    {
+        /* Each consumer takes exactly QUEUE_TEST_ITEMS messages */
+        FudgeQueue_popMsgs ( consumer->queue, messages,
+                             QUEUE_TEST_ITEMS - consumer->count < 16 ? QUEUE_TEST_ITEMS - consumer->count : 16, &popped );
+        for ( index = 0; index < popped; ++index )
+        {
+            FudgeMsg_getFieldAtIndex ( &field, messages [ index ], 0 );
+            FudgeMsg_getFieldAsI32 ( &field, &value );
+            if ( value <= previous )
+                consumer->ordered = FUDGE_FALSE;
+            previous = value;
+            consumer->total += value;
+            FudgeMsg_release ( messages [ index ] );
+        }
+        consumer->count += popped;
+    }
+    return 0;
+}
+#endif /* ifdef UTILITIES_TEST_THREADS */
+
+DEFINE_TEST( Queue )
+    FudgeQueue queue;
+    FudgeMsg message;
+    FudgeMsgEnvelope envelopes [ 10 ], popped [ 4 ];
+    size_t index, count;
+
+    TEST_EQUALS_INT( FudgeQueue_create ( 0, FUDGE_QUEUE_ENVELOPES, 4, FUDGE_QUEUE_MPMC ), FUDGE_NULL_POINTER );
+    if ( FudgeQueue_create ( &queue, FUDGE_QUEUE_ENVELOPES, 5, FUDGE_QUEUE_MPMC ) == FUDGE_NOT_SUPPORTED )
+        return 0;   /* Not supported on this platform */
+    TEST_EQUALS_INT( FudgeQueue_getCapacity ( queue ), 8 );
+    TEST_EQUALS_INT( FudgeQueue_getSize ( queue ), 0 );
+
+    /* Capacities whose cells can't be addressed are refused up front */
+    TEST_EQUALS_INT( FudgeQueue_create ( &queue, FUDGE_QUEUE_ENVELOPES, ( size_t ) -1 / 4, FUDGE_QUEUE_MPMC ), FUDGE_OUT_OF_MEMORY );
+    TEST_EQUALS_INT( FudgeQueue_create ( &queue, FUDGE_QUEUE_ENVELOPES, ( size_t ) -1, FUDGE_QUEUE_MPMC ), FUDGE_OUT_OF_MEMORY );
+
+    /* Empty queues and the wrong type of object */
+    TEST_EQUALS_INT( FudgeQueue_popEnvelope ( queue, popped ), FUDGE_QUEUE_EMPTY );
+    TEST_EQUALS_INT( FudgeQueue_pushEnvelope ( queue, 0 ), FUDGE_NULL_POINTER );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeQueue_pushMsg ( queue, message ), FUDGE_QUEUE_INVALID_CONTENTS );
+
+    /* A batch push moves as many envelopes as will fit, in order */
+    for ( index = 0; index < 10; ++index )
+        TEST_EQUALS_INT( FudgeMsgEnvelope_create ( envelopes + index, 0, 0, ( fudge_i16 ) index, message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeQueue_pushEnvelopes ( queue, envelopes, 10, &count ), FUDGE_OK );
+    TEST_EQUALS_INT( count, 8 );
+    TEST_EQUALS_INT( FudgeQueue_getSize ( queue ), 8 );
+    TEST_EQUALS_INT( FudgeQueue_pushEnvelope ( queue, envelopes [ 8 ] ), FUDGE_QUEUE_FULL );
+    TEST_EQUALS_INT( FudgeQueue_pushEnvelopes ( queue, envelopes + 8, 2, &count ), FUDGE_QUEUE_FULL );
+    TEST_EQUALS_INT( count, 0 );
+
+    /* Popping hands over the queue's reference */
+    TEST_EQUALS_INT( FudgeQueue_popEnvelopes ( queue, popped, 3, &count ), FUDGE_OK );
+    TEST_EQUALS_INT( count, 3 );
+    for ( index = 0; index < 3; ++index )
+    {
+        TEST_EQUALS_TRUE( popped [ index ] == envelopes [ index ] );
+        TEST_EQUALS_INT( FudgeMsgEnvelope_release ( popped [ index ] ), FUDGE_OK );
+    }
+    TEST_EQUALS_INT( FudgeQueue_pushEnvelopes ( queue, envelopes + 8, 2, &count ), FUDGE_OK );
+    TEST_EQUALS_INT( count, 2 );
+    TEST_EQUALS_INT( FudgeQueue_popEnvelope ( queue, popped ), FUDGE_OK );
+    TEST_EQUALS_TRUE( popped [ 0 ] == envelopes [ 3 ] );
+    TEST_EQUALS_INT( FudgeMsgEnvelope_release ( popped [ 0 ] ), FUDGE_OK );
+
+    /* The remaining envelopes are released with the queue */
+    TEST_EQUALS_INT( FudgeQueue_getSize ( queue ), 6 );
+    TEST_EQUALS_INT( FudgeQueue_release ( queue ), FUDGE_OK );
+
+    /* The same again for an SPSC queue, wrapping around the end */
+    TEST_EQUALS_INT( FudgeQueue_create ( &queue, FUDGE_QUEUE_MESSAGES, 4, FUDGE_QUEUE_SPSC ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeQueue_getCapacity ( queue ), 4 );
+    TEST_EQUALS_INT( FudgeQueue_popMsg ( queue, &message ), FUDGE_QUEUE_EMPTY );
+    for ( index = 0; index < 10; ++index )
+    {
+        TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeMsg_addFieldI32 ( message, 0, 0, ( fudge_i32 ) index ), FUDGE_OK );
+        TEST_EQUALS_INT( FudgeQueue_pushMsg ( queue, message ), FUDGE_OK );
+        if ( index % 2 )
+        {
+            FudgeField field;
+            fudge_i32 value;
+            TEST_EQUALS_INT( FudgeQueue_popMsg ( queue, &message ), FUDGE_OK );
+            TEST_EQUALS_INT( FudgeMsg_getFieldAtIndex ( &field, message, 0 ), FUDGE_OK );
+            TEST_EQUALS_INT( FudgeMsg_getFieldAsI32 ( &field, &value ), FUDGE_OK );
+            TEST_EQUALS_INT( value, ( fudge_i32 ) index / 2 );
+            TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+        }
+        if ( FudgeQueue_getSize ( queue ) == 4 )
+            break;
+    }
+    TEST_EQUALS_INT( index, 6 );
+    TEST_EQUALS_INT( FudgeMsg_create ( &message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeQueue_pushMsg ( queue, message ), FUDGE_QUEUE_FULL );
+    TEST_EQUALS_INT( FudgeMsg_release ( message ), FUDGE_OK );
+    TEST_EQUALS_INT( FudgeQueue_release ( queue ), FUDGE_OK );
+
+#ifdef UTILITIES_TEST_THREADS
+    {
+        /* Messages created by confined producers can be released by the
+           consumers, as pushing shares them */
+        const FudgeQueueMode modes [ 2 ] = { FUDGE_QUEUE_SPSC, FUDGE_QUEUE_MPMC };
+        pthread_t producers [ 2 ], consumers [ 2 ];
+        QueueConsumer state [ 2 ];
+        size_t mode, numthreads;
+
+        Fudge_setThreadConfinement ( FUDGE_TRUE );
+        for ( mode = 0; mode < 2; ++mode )
+        {
+            numthreads = modes [ mode ] == FUDGE_QUEUE_SPSC ? 1 : 2;
+            TEST_EQUALS_INT( FudgeQueue_create ( &queue, FUDGE_QUEUE_MESSAGES, 64, modes [ mode ] ), FUDGE_OK );
+            for ( index = 0; index < numthreads; ++index )
+            {
+                state [ index ].queue = queue;
+                state [ index ].count = 0;
+                state [ index ].total = 0;
+                state [ index ].ordered = FUDGE_TRUE;
+                TEST_EQUALS_INT( pthread_create ( producers + index, 0, testQueueProducer, queue ), 0 );
+                TEST_EQUALS_INT( pthread_create ( consumers + index, 0, testQueueConsumer, state + index ), 0 );
+            }
+            for ( index = 0; index < numthreads; ++index )
+            {
+                TEST_EQUALS_INT( pthread_join ( producers [ index ], 0 ), 0 );
+                TEST_EQUALS_INT( pthread_join ( consumers [ index ], 0 ), 0 );
+            }
+
+            /* Every message arrives exactly once, and in order from a
+               single producer */
+            TEST_EQUALS_INT( FudgeQueue_getSize ( queue ), 0 );
+            TEST_EQUALS_TRUE( state [ 0 ].total + ( numthreads == 2 ? state [ 1 ].total : 0 ) ==
+                              ( fudge_i64 ) numthreads * QUEUE_TEST_ITEMS * ( QUEUE_TEST_ITEMS + 1 ) / 2 );
+            if ( numthreads == 1 )
+                TEST_EQUALS_TRUE( state [ 0 ].ordered );
+            TEST_EQUALS_INT( FudgeQueue_release ( queue ), FUDGE_OK );
+        }
+        Fudge_setThreadConfinement ( FUDGE_FALSE );
+    }
+#endif /* ifdef UTILITIES_TEST_THREADS */
+END_TEST
+
 void testFloatConversion ( float input );
 void testDoubleConversion ( double input );
 void testI64Conversion ( int64_t input );
@@ -168,6 +691,12 @@ DEFINE_TEST_SUITE( Utilities )
     REGISTER_TEST( ReferenceCount )
 #endif /* ifndef EXTERNAL_TESTS_ONLY */
     REGISTER_TEST( StringPool )
+    REGISTER_TEST( StringPoolCache )
+    REGISTER_TEST( SlabManager )
+    REGISTER_TEST( ExtendedManager )
+    REGISTER_TEST( MemoryStats )
+    REGISTER_TEST( ThreadConfinement )
+    REGISTER_TEST( Queue )
     REGISTER_TEST( EndianConversion )
 END_TEST_SUITE
 